@@ -20,6 +20,17 @@ set(FLOW_ALLOC_TIMEOUT 20000 CACHE STRING
 # OAP (Ouroboros Authentication Protocol)
 set(OAP_REPLAY_TIMER 20 CACHE STRING
   "OAP replay protection window (s)")
+set(OAP_CRT_CACHE 256 CACHE STRING
+  "Verified peer certificates remembered by the IRMd, 0: disable")
+set(OAP_KEY_POOL 8 CACHE STRING
+  "Ephemeral key pairs kept ready per key exchange algorithm, 0: disable")
+set(OAP_TICKET_LIFETIME 3600 CACHE STRING
+  "Time between full key exchanges with a peer when resuming (s), 0: disable")
+set(OAP_TICKETS 1024 CACHE STRING
+  "Maximum number of OAP session resumption tickets kept by the IRMd")
+if(OAP_TICKETS LESS 1)
+  message(FATAL_ERROR "OAP_TICKETS must be at least 1")
+endif()
 set(DEBUG_PROTO_OAP FALSE CACHE BOOL
   "Add Flow allocation protocol message output to IRMd debug logging")
 
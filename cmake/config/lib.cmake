@@ -20,6 +20,15 @@ else()
     "Clock to use for condition variable timing")
 endif()
 
+# Activity timestamps only need tick resolution, RTT samples use the above
+if(PTHREAD_COND_CLOCK STREQUAL "CLOCK_MONOTONIC")
+  set(COARSE_CLOCK "CLOCK_MONOTONIC_COARSE" CACHE INTERNAL
+    "Coarse clock for per-packet activity timestamps")
+else()
+  set(COARSE_CLOCK "${PTHREAD_COND_CLOCK}" CACHE INTERNAL
+    "Coarse clock for per-packet activity timestamps")
+endif()
+
 # Timeouts
 set(SOCKET_TIMEOUT 500 CACHE STRING
   "Default timeout for responses from IPCPs (ms)")
@@ -38,7 +47,7 @@ set(DELTA_T_RTX 120 CACHE STRING
 
 # FRCT configuration
 set(FRCT_REORDER_QUEUE_SIZE 256 CACHE STRING
-  "Size of the reordering queue, must be a power of 2")
+  "Initial size of the reordering queue, must be a power of 2")
 set(FRCT_START_WINDOW 64 CACHE STRING
   "Start window, must be a power of 2")
 set(FRCT_LINUX_RTT_ESTIMATOR TRUE CACHE BOOL
@@ -51,12 +60,49 @@ set(FRCT_RTO_MIN 250 CACHE STRING
   "Minimum Retransmission Timeout (RTO) for FRCT (us)")
 set(FRCT_TICK_TIME 5000 CACHE STRING
   "Tick time for FRCT activity (retransmission, acknowledgments) (us)")
+set(FRCT_FRAGMENT_SIZE 1400 CACHE STRING
+  "Maximum payload of an FRCT fragment, writes above the layer MTU are fragmented (B)")
+set(FRCT_MAX_FRAGMENTS 64 CACHE STRING
+  "Maximum number of fragments in a datagram without retransmission, at most the reorder queue size")
+set(FRCT_REASSEMBLY_TIMEOUT 1000 CACHE STRING
+  "Time to wait for missing fragments on flows without retransmission (ms)")
+set(FRCT_MAX_REORDER_QUEUE_SIZE 16384 CACHE STRING
+  "Size the reordering queue can grow to, must be a power of 2")
+if(FRCT_MAX_REORDER_QUEUE_SIZE LESS FRCT_REORDER_QUEUE_SIZE)
+  message(FATAL_ERROR "FRCT_MAX_REORDER_QUEUE_SIZE must not be below the initial size")
+endif()
+if(FRCT_MAX_FRAGMENTS GREATER FRCT_REORDER_QUEUE_SIZE)
+  message(FATAL_ERROR "FRCT_MAX_FRAGMENTS must not exceed the reorder queue")
+endif()
+set(FRCT_CONGESTION_CONTROL "reno" CACHE STRING
+  "Congestion control for reliable FRCT flows (none, reno)")
+set_property(CACHE FRCT_CONGESTION_CONTROL PROPERTY STRINGS none reno)
+if(FRCT_CONGESTION_CONTROL STREQUAL "none")
+  set(FRCT_CC FRCTCCNONE)
+elseif(FRCT_CONGESTION_CONTROL STREQUAL "reno")
+  set(FRCT_CC FRCTCCRENO)
+else()
+  message(FATAL_ERROR "Unknown FRCT congestion control: ${FRCT_CONGESTION_CONTROL}")
+endif()
+set(FRCT_ACK_EVERY 2 CACHE STRING
+  "Packets the FRCT receiver takes in before it ACKs without waiting for the timer")
+if(FRCT_ACK_EVERY LESS 1)
+  message(FATAL_ERROR "FRCT_ACK_EVERY must be at least 1")
+endif()
+set(FRCT_FEC_BLOCK 0 CACHE STRING
+  "FEC block for FRCT flows without retransmission, power of 2 up to 64, 0: off")
+set(FRCT_FEC_TIMEOUT 20 CACHE STRING
+  "Time the FRCT receiver holds packets behind a loss for FEC recovery (ms)")
+set(FRCT_PACING TRUE CACHE BOOL
+  "Pace FRCT transmissions over the RTT or the flow bandwidth")
+set(FRCT_PACING_QUANTUM 1000 CACHE STRING
+  "Burst the FRCT pacer lets through back-to-back (us)")
 
 # Retransmission (RXM) configuration
 set(RXM_BUFFER_ON_HEAP FALSE CACHE BOOL
   "Store packets for retransmission on the heap instead of in packet buffer")
 set(RXM_BLOCKING TRUE CACHE BOOL
-  "Use blocking writes for retransmission")
+  "Block on the pool (one timer slot at most) and the tx rbuff for retransmission")
 set(RXM_MIN_RESOLUTION 20 CACHE STRING
   "Minimum retransmission delay (ns), as a power to 2")
 set(RXM_WHEEL_MULTIPLIER 4 CACHE STRING
@@ -81,6 +127,13 @@ set(TPM_DEBUG_ABORT_TIMEOUT 0 CACHE STRING
 # Encryption
 set(KEY_ROTATION_BIT 20 CACHE STRING
   "Bit position in packet counter that triggers key rotation (default 20 = every 2^20 packets)")
+set(PROC_CRYPT_WORKERS 0 CACHE STRING
+  "Threads per process that encrypt outgoing packets, 0: encrypt in the writer")
+if(PROC_CRYPT_WORKERS GREATER 255)
+  message(FATAL_ERROR "PROC_CRYPT_WORKERS must not exceed 255")
+endif()
+set(PROC_CRYPT_QUEUE 64 CACHE STRING
+  "Packets per flow waiting for or in encryption by the workers")
 
 # Flow statistics (requires FUSE)
 if(HAVE_FUSE)
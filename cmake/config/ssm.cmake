@@ -32,6 +32,17 @@ set(SSM_FLOW_SET_PREFIX "/${SHM_PREFIX}.set." CACHE INTERNAL
 set(SSM_POOL_SHARDS 4 CACHE STRING
     "Number of allocator shards per size class")
 
+# Per-QoS cube reservations, percentage of the blocks in each size class
+# that lower-priority cubes may not allocate (voice > video > best effort)
+set(SSM_POOL_RSV_VOICE 5 CACHE STRING
+    "Percentage of each size class reserved for the voice QoS cube")
+set(SSM_POOL_RSV_VIDEO 5 CACHE STRING
+    "Percentage of each size class reserved for the video QoS cube")
+math(EXPR SSM_POOL_RSV_TOTAL "${SSM_POOL_RSV_VOICE} + ${SSM_POOL_RSV_VIDEO}")
+if(SSM_POOL_RSV_TOTAL GREATER 100)
+  message(FATAL_ERROR "SSM pool reservations exceed 100 percent")
+endif()
+
 # Global Shared Packet Pool (GSPP) - for privileged processes
 # Shared by all processes in 'ouroboros' group (~60 MB total)
 set(SSM_GSPP_256_BLOCKS 1024 CACHE STRING
@@ -117,6 +128,8 @@ message(STATUS "  Size classes: "
     "256B, 512B, 1KiB, 2KiB, 4KiB, 16KiB, 64KiB, 256KiB, 1MiB")
 message(STATUS "  Max allocation: 1 MB")
 message(STATUS "  Shards per class: ${SSM_POOL_SHARDS}")
+message(STATUS "  Reserved per class: voice ${SSM_POOL_RSV_VOICE}%, "
+    "video ${SSM_POOL_RSV_VIDEO}%")
 message(STATUS "  GSPP (privileged): ${SSM_GSPP_SIZE_DISPLAY} "
     "(${SSM_GSPP_TOTAL_SIZE} bytes)")
 message(STATUS "    Blocks: ${SSM_GSPP_256_BLOCKS}, ${SSM_GSPP_512_BLOCKS}, "
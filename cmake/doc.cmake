@@ -6,6 +6,7 @@ set(MAN_NAMES
   flow_accept.3
   flow_alloc.3
   flow_dealloc.3
+  flow_dealloc_async.3
   flow_read.3
   flow_write.3
   fccntl.3
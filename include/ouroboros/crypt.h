@@ -27,6 +27,7 @@
 #include <ouroboros/utils.h>
 
 #include <assert.h>
+#include <time.h>
 
 #define IVSZ             16
 #define SYMMKEYSZ        32
@@ -101,10 +102,21 @@
 #define IS_KEX_CIPHER_SET(cfg) ((cfg)->c.nid != NID_undef)
 
 
+#define CRYPT_DIR_CLI         0     /* Nonce space of the initiator  */
+#define CRYPT_DIR_SRV         1     /* Nonce space of the acceptor   */
+
 struct crypt_sk {
         int       nid;
         uint8_t * key;
         uint8_t   rot_bit; /* Rotation bit to control epoch */
+        uint8_t   dir;     /* Both ends share the key       */
+        uint8_t   lanes;   /* Threads that encrypt at once  */
+};
+
+struct crypt_stat {
+        uint8_t   epoch;   /* Current key epoch, mod 256    */
+        size_t    n_auth;  /* Failed authentication         */
+        size_t    n_epoch; /* No key for the epoch          */
 };
 
 struct sec_config {
@@ -213,6 +225,11 @@ int                auth_add_crt_to_store(struct auth_ctx * ctx,
 int                auth_verify_crt(struct auth_ctx * ctx,
                                    void *            crt);
 
+/* As auth_verify_crt, expiry is the earliest end in the chain used */
+int                auth_verify_crt_chain(struct auth_ctx * ctx,
+                                         void *            crt,
+                                         time_t *          expiry);
+
 int                auth_sign(void *     pkp,
                              int        md_nid,
                              buffer_t   msg,
@@ -294,18 +311,46 @@ ssize_t            md_digest(int        md_nid,
 
 ssize_t            md_len(int md_nid);
 
+ssize_t            md_hmac(int       md_nid,
+                           buffer_t  key,
+                           buffer_t  in,
+                           uint8_t * out);
+
+/* HKDF, fills key.len bytes of key.data */
+int                md_hkdf(int          md_nid,
+                           buffer_t     secret,
+                           buffer_t     salt,
+                           const char * info,
+                           buffer_t     key);
+
+/* In place on IV | data | tag, the caller reserves IV and tag space. */
 int                crypt_encrypt(struct crypt_ctx * ctx,
-                                 buffer_t           in,
-                                 buffer_t *         out);
+                                 buffer_t           buf);
 
 int                crypt_decrypt(struct crypt_ctx * ctx,
-                                 buffer_t           in,
-                                 buffer_t *         out);
+                                 buffer_t           buf);
+
+/* As crypt_encrypt, each lane can be used by one thread at a time. */
+int                crypt_encrypt_lane(struct crypt_ctx * ctx,
+                                      buffer_t           buf,
+                                      size_t             lane);
+
+/* Returns the number of buffers done, the length of a failed one is 0. */
+size_t             crypt_encrypt_batch(struct crypt_ctx * ctx,
+                                       buffer_t *         bufs,
+                                       size_t             n);
+
+size_t             crypt_decrypt_batch(struct crypt_ctx * ctx,
+                                       buffer_t *         bufs,
+                                       size_t             n);
 
 int                crypt_get_ivsz(struct crypt_ctx * ctx);
 
 int                crypt_get_tagsz(struct crypt_ctx * ctx);
 
+int                crypt_get_stat(struct crypt_ctx *  ctx,
+                                  struct crypt_stat * st);
+
 int                crypt_load_crt_file(const char * path,
                                        void **      crt);
 
@@ -320,6 +365,9 @@ int                crypt_get_pubkey_crt(void *  crt,
 
 void               crypt_free_crt(void * crt);
 
+/* Shares crt, each holder calls crypt_free_crt */
+int                crypt_ref_crt(void * crt);
+
 int                crypt_load_privkey_file(const char * path,
                                            void **      key);
 
@@ -346,6 +394,9 @@ int                crypt_cmp_key(const void * key1,
 
 void               crypt_free_key(void * key);
 
+/* Shares key, each holder calls crypt_free_key */
+int                crypt_ref_key(void * key);
+
 int                crypt_crt_str(const void * crt,
                                  char *       buf);
 
@@ -358,6 +409,10 @@ int                crypt_check_crt_name(void *       crt,
 int                crypt_get_crt_name(void * crt,
                                      char * name);
 
+/* End of the validity period */
+int                crypt_get_crt_expiry(void *   crt,
+                                       time_t * expiry);
+
 /* Secure memory allocation for sensitive data (keys, secrets) */
 int                crypt_secure_malloc_init(size_t max);
 
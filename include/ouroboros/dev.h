@@ -46,6 +46,9 @@ int     flow_join(const char *            bc,
 
 int     flow_dealloc(int fd);
 
+/* Returns at once, lingering and IRMd updates run in the background. */
+int     flow_dealloc_async(int fd);
+
 ssize_t flow_write(int          fd,
                    const void * buf,
                    size_t       count);
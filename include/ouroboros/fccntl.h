@@ -25,6 +25,7 @@
 
 #include <ouroboros/cdefs.h>
 
+#include <stdint.h>
 #include <sys/time.h>
 
 /* Flow flags, same values as fcntl.h */
@@ -49,6 +50,12 @@
 #define FRCTFRTX      00000001 /* Reliable flow          */
 #define FRCTFRESCNTL  00000002 /* Feedback from receiver */
 #define FRCTFLINGER   00000004 /* Send unsent data       */
+#define FRCTFSACK     00000010 /* Selective ACKs         */
+#define FRCTFPACE     00000020 /* Pace transmissions     */
+
+/* FRCT congestion control */
+#define FRCTCCNONE    0        /* No congestion window   */
+#define FRCTCCRENO    1        /* Loss-based (Reno)      */
 
 /* Flow operations */
 #define FLOWSRCVTIMEO 00000001 /* Set read timeout       */
@@ -60,10 +67,49 @@
 #define FLOWGFLAGS    00000007 /* Get flags for flow     */
 #define FLOWGRXQLEN   00000010 /* Get queue length on rx */
 #define FLOWGTXQLEN   00000011 /* Get queue length on tx */
+#define FLOWGCRYPT    00000012 /* Get encryption stats   */
 
 /* FRCT operations */
 #define FRCTSFLAGS    00001000 /* Set flags for FRCT     */
 #define FRCTGFLAGS    00002000 /* Get flags for FRCT     */
+#define FRCTSCC       00003000 /* Set congestion control */
+#define FRCTGCC       00004000 /* Get congestion control */
+#define FRCTSFEC      00005000 /* Set FEC block size     */
+#define FRCTGFEC      00006000 /* Get FEC block size     */
+#define FRCTGSTAT     00007000 /* Get FRCT statistics    */
+
+/* Encryption statistics */
+struct flow_crypt_stat {
+        uint64_t epoch;     /* Key epoch, mod 256      */
+        uint64_t n_auth;    /* Failed authentication   */
+        uint64_t n_epoch;   /* No key for the epoch    */
+};
+
+/* FRCT statistics, times in ns */
+struct frct_stat {
+        uint64_t srtt;      /* Smoothed rtt            */
+        uint64_t mdev;      /* RTT deviation           */
+        uint64_t rto;       /* Retransmission timeout  */
+        uint64_t cwnd;      /* Congestion window, pkts */
+        uint64_t rq_size;   /* Reorder queue size      */
+        uint32_t snd_lwe;   /* Sender left edge        */
+        uint32_t snd_rwe;   /* Sender right edge       */
+        uint32_t snd_seqno; /* Next seqno to send      */
+        uint32_t rcv_lwe;   /* Receiver left edge      */
+        uint32_t rcv_rwe;   /* Receiver right edge     */
+        uint32_t rcv_ackno; /* Last ACK sent           */
+        uint64_t n_rtx;     /* Retransmissions         */
+        uint64_t n_prb;     /* RTT probes              */
+        uint64_t n_rtt;     /* RTT estimates           */
+        uint64_t n_dup;     /* Duplicates received     */
+        uint64_t n_dak;     /* Delayed ACKs received   */
+        uint64_t n_rdv;     /* Rendez-vous sent        */
+        uint64_t n_out;     /* Packets out of window   */
+        uint64_t n_rqo;     /* Packets out of rqueue   */
+        uint64_t n_sak;     /* Rxm skipped, SACK'd     */
+        uint64_t n_pce;     /* Writer held by pacer    */
+        uint64_t n_fec;     /* Recovered by FEC        */
+};
 
 __BEGIN_DECLS
 
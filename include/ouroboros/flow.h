@@ -49,6 +49,7 @@ struct flow_info {
         uid_t           uid;   /* 0 = privileged (GSPP), > 0 = PUP uid */
 
         time_t          mpl;
+        size_t          mtu;   /* 0 = not bounded by the layer */
 
         struct qos_spec qs;
 
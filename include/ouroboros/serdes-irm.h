@@ -64,6 +64,11 @@ int flow_dealloc__irm_req_ser(buffer_t *               buf,
                               const struct flow_info * flow,
                               const struct timespec *  timeo);
 
+int flow_dealloc_batch__irm_req_ser(buffer_t *               buf,
+                                    const struct flow_info * flows,
+                                    size_t                   n,
+                                    const struct timespec *  timeo);
+
 int ipcp_flow_dealloc__irm_req_ser(buffer_t *               buf,
                                    const struct flow_info * info);
 
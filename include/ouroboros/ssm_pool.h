@@ -23,6 +23,7 @@
 #ifndef OUROBOROS_LIB_SSM_POOL_H
 #define OUROBOROS_LIB_SSM_POOL_H
 
+#include <ouroboros/qoscube.h>
 #include <ouroboros/ssm_pk_buff.h>
 #include <ouroboros/time.h>
 
@@ -32,6 +33,14 @@
 
 struct ssm_pool;
 
+struct ssm_pool_stats {
+        size_t size;                   /* block size in bytes         */
+        size_t blocks;                 /* blocks in this size class   */
+        size_t free;                   /* blocks currently available  */
+        size_t reserved[QOS_CUBE_MAX]; /* blocks reserved per cube    */
+        size_t denied[QOS_CUBE_MAX];   /* allocations refused per cube */
+};
+
 /* Pool API: uid = 0 for GSPP (privileged), uid > 0 for PUP (per-user) */
 struct ssm_pool *    ssm_pool_create(uid_t uid,
                                      gid_t gid);
@@ -46,14 +55,22 @@ int                  ssm_pool_mlock(struct ssm_pool * pool);
 
 void                 ssm_pool_gspp_purge(void);
 
-/* Alloc count bytes, returns block index, a ptr and pk_buff.  */
+/* IPCP-internal allocations carry all cubes, never restricted. */
+#define SSM_QC_IPCP QOS_CUBE_MAX
+
+/*
+ * Alloc count bytes, returns block index, a ptr and pk_buff.
+ * A cube may not take blocks reserved for higher-priority cubes.
+ */
 ssize_t              ssm_pool_alloc(struct ssm_pool *    pool,
                                    size_t                count,
+                                   qoscube_t             qc,
                                    uint8_t **            ptr,
                                    struct ssm_pk_buff ** spb);
 
 ssize_t              ssm_pool_alloc_b(struct ssm_pool *        pool,
                                       size_t                  count,
+                                      qoscube_t               qc,
                                       uint8_t **              ptr,
                                       struct ssm_pk_buff **   spb,
                                       const struct timespec * abstime);
@@ -68,6 +85,11 @@ struct ssm_pk_buff * ssm_pool_get(struct ssm_pool * pool,
 int                  ssm_pool_remove(struct ssm_pool * pool,
                                      size_t            idx);
 
+/* Stats for the n-th configured size class, -ENOENT past the last. */
+int                  ssm_pool_stats(struct ssm_pool *       pool,
+                                    size_t                  n,
+                                    struct ssm_pool_stats * stats);
+
 void                 ssm_pool_reclaim_orphans(struct ssm_pool * pool,
                                               pid_t             pid);
 
@@ -121,5 +121,23 @@ static __attribute__((unused)) const char * server_crt_ec = \
 "gRo=\n"
 "-----END CERTIFICATE-----\n";
 
+/* Unrelated root other.unittest.o7s, expires before the chain above */
+static __attribute__((unused)) const char * other_ca_crt_ec = \
+"-----BEGIN CERTIFICATE-----\n"
+"MIICPzCCAeWgAwIBAgIUNlJUwS1QLctq3bWhvxlkRswsvmowCgYIKoZIzj0EAwIw\n"
+"bTELMAkGA1UEBhMCQkUxDDAKBgNVBAgMA09WTDEOMAwGA1UEBwwFR2hlbnQxDDAK\n"
+"BgNVBAoMA283czEVMBMGA1UECwwMdW5pdHRlc3QubzdzMRswGQYDVQQDDBJvdGhl\n"
+"ci51bml0dGVzdC5vN3MwHhcNMjYxMDE4MTk0NDQ2WhcNMzAxMDE3MTk0NDQ2WjBt\n"
+"MQswCQYDVQQGEwJCRTEMMAoGA1UECAwDT1ZMMQ4wDAYDVQQHDAVHaGVudDEMMAoG\n"
+"A1UECgwDbzdzMRUwEwYDVQQLDAx1bml0dGVzdC5vN3MxGzAZBgNVBAMMEm90aGVy\n"
+"LnVuaXR0ZXN0Lm83czBZMBMGByqGSM49AgEGCCqGSM49AwEHA0IABBR+HUQeo4zY\n"
+"ZAySkByArtZTbiNwEv5hFFmSPOCzQOhsqqqNQQ1VmiEQbRh3jGkjYixjkgbYJqOm\n"
+"XsPKAMpr1DyjYzBhMB0GA1UdDgQWBBTZDfr8FyS2z7M3NaKk/fKY3xAoQjAfBgNV\n"
+"HSMEGDAWgBTZDfr8FyS2z7M3NaKk/fKY3xAoQjAPBgNVHRMBAf8EBTADAQH/MA4G\n"
+"A1UdDwEB/wQEAwIBBjAKBggqhkjOPQQDAgNIADBFAiAvzyOWIYveZMSlPNof7lUv\n"
+"QJAm1OQ22wLgPfdbdSsGgQIhAI/WiBZTYiP3gIu2RnnOKjbE7aKrfMgksVI4Ddsd\n"
+"lpWk\n"
+"-----END CERTIFICATE-----\n";
+
 #endif /* TEST_CERTS_H */
 
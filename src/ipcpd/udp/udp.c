@@ -285,7 +285,8 @@ static int udp_ipcp_port_req(struct __SOCKADDR * c_saddr,
 {
         int fd;
 
-        fd = ipcp_wait_flow_req_arr(dst, qs, IPCP_UDP_MPL, data);
+        fd = ipcp_wait_flow_req_arr(dst, qs, IPCP_UDP_MPL,
+                                    IPCP_UDP_MAX_PACKET_SIZE, data);
         if (fd < 0) {
                 log_err("Could not get new flow from IRMd.");
                 return -1;
@@ -332,7 +333,8 @@ static int udp_ipcp_port_alloc_reply(const struct __SOCKADDR * saddr,
 
         pthread_rwlock_unlock(&udp_data.flows_lock);
 
-        if (ipcp_flow_alloc_reply(s_eid, response, mpl, data) < 0) {
+        if (ipcp_flow_alloc_reply(s_eid, response, mpl,
+                                  IPCP_UDP_MAX_PACKET_SIZE, data) < 0) {
                 log_err("Failed to reply to flow allocation.");
                 return -1;
         }
@@ -1209,6 +1209,7 @@ static int flow_alloc_direct(const char *       dst,
 
         acc.n_1_pid = flow->n_pid;
         acc.mpl     = DIRECT_MPL;
+        acc.mtu     = 0; /* no lower layer */
         acc.qs      = flow->qs;
         acc.state   = FLOW_ALLOCATED;
 
@@ -1244,6 +1245,7 @@ static int flow_alloc_direct(const char *       dst,
         flow->id      = acc.id;
         flow->n_1_pid = acc.n_pid;
         flow->mpl     = DIRECT_MPL;
+        flow->mtu     = 0;
         flow->state   = FLOW_ALLOCATED;
 
         log_info("Flow %d allocated (direct) for %d to %s.",
@@ -1407,6 +1409,23 @@ static int flow_dealloc(struct flow_info * flow,
         return 0;
 }
 
+static int flow_dealloc_batch(flow_info_msg_t ** flows,
+                              size_t             n,
+                              struct timespec *  ts)
+{
+        struct flow_info flow;
+        size_t           i;
+        int              ret = 0;
+
+        for (i = 0; i < n; ++i) {
+                flow = flow_info_msg_to_s(flows[i]);
+                if (flow_dealloc(&flow, ts) < 0)
+                        ret = -EIPCP;
+        }
+
+        return ret;
+}
+
 static int flow_dealloc_resp(struct flow_info * flow)
 {
         reg_dealloc_flow_resp(flow);
@@ -1659,8 +1678,12 @@ static irm_msg_t * do_command_msg(irm_msg_t * msg,
                         ret_msg->flow_info = flow_info_s_to_msg(&flow);
                 break;
         case IRM_MSG_CODE__IRM_FLOW_DEALLOC:
-                flow = flow_info_msg_to_s(msg->flow_info);
                 ts = timespec_msg_to_s(msg->timeo);
+                if (msg->n_flows > 0) {
+                        res = flow_dealloc_batch(msg->flows, msg->n_flows, &ts);
+                        break;
+                }
+                flow = flow_info_msg_to_s(msg->flow_info);
                 res = flow_dealloc(&flow, &ts);
                 break;
         case IRM_MSG_CODE__IPCP_FLOW_DEALLOC:
@@ -2077,6 +2100,21 @@ static int irm_init(void)
                 goto fail_oap;
         }
 
+        if (oap_io_init() < 0) {
+                log_err("Failed to initialize OAP credential cache.");
+                goto fail_oap_io;
+        }
+
+        if (oap_pool_init() < 0) {
+                log_err("Failed to initialize OAP key pool.");
+                goto fail_oap_pool;
+        }
+
+        if (oap_ticket_init(OAP_TICKET_LIFETIME) < 0) {
+                log_err("Failed to initialize OAP tickets.");
+                goto fail_oap_ticket;
+        }
+
         if (irm_load_store(OUROBOROS_CA_CRT_DIR) < 0) {
                 log_err("Failed to load CA certificates.");
                 goto fail_load_store;
@@ -2123,6 +2161,12 @@ static int irm_init(void)
  #endif
 #endif
  fail_load_store:
+        oap_ticket_fini();
+ fail_oap_ticket:
+        oap_pool_fini();
+ fail_oap_pool:
+        oap_io_fini();
+ fail_oap_io:
         oap_auth_fini();
  fail_oap:
         tpm_destroy(irmd.tpm);
@@ -2156,6 +2200,12 @@ static void irm_fini(void)
         if (irmd_get_state() != IRMD_INIT)
                 log_warn("Unsafe destroy.");
 
+        oap_ticket_fini();
+
+        oap_pool_fini();
+
+        oap_io_fini();
+
         oap_auth_fini();
 
         tpm_destroy(irmd.tpm);
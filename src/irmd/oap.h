@@ -35,6 +35,21 @@ void oap_auth_fini(void);
 
 int  oap_auth_add_ca_crt(void * crt);
 
+/* OAP credential cache (in oap/io.c) */
+int  oap_io_init(void);
+
+void oap_io_fini(void);
+
+/* OAP ephemeral key pool (in oap/pool.c) */
+int  oap_pool_init(void);
+
+void oap_pool_fini(void);
+
+/* OAP session resumption tickets (in oap/ticket.c), lifetime in s */
+int  oap_ticket_init(uint32_t lifetime);
+
+void oap_ticket_fini(void);
+
 /*
 * Prepare OAP request header for server, returns context
 * Passes client data for srv, returns srv data for client
@@ -33,6 +33,7 @@
 #include <ouroboros/list.h>
 #include <ouroboros/logs.h>
 #include <ouroboros/pthread.h>
+#include <ouroboros/random.h>
 #include <ouroboros/time.h>
 
 #include "config.h"
@@ -50,14 +51,42 @@ struct oap_replay_entry {
         uint8_t          id[OAP_ID_SIZE];
 };
 
+/* Peer crt that passed chain verification */
+struct oap_crt_entry {
+        struct list_head next;
+        uint8_t          fp[OAP_CRT_FP_SIZE];
+        time_t           expiry;
+};
+
 static struct {
         struct auth_ctx * ca_ctx;
         struct {
                 struct list_head list;
                 pthread_mutex_t  mtx;
         } replay;
+        struct {
+                struct list_head list;      /* Most recent first */
+                size_t           len;
+                uint64_t         gen;       /* CA store changes  */
+                size_t           hits;
+                size_t           verifs;    /* Chain verifications */
+                pthread_mutex_t  mtx;
+        } crt;
 } oap_auth;
 
+#ifdef OAP_TEST_MODE
+static time_t crt_skew; /* Moves the cache clock in the tests */
+#endif
+
+static time_t crt_now(void)
+{
+#ifdef OAP_TEST_MODE
+        return time(NULL) + crt_skew;
+#else
+        return time(NULL);
+#endif
+}
+
 int oap_auth_init(void)
 {
         oap_auth.ca_ctx = auth_create_ctx();
@@ -73,19 +102,53 @@ int oap_auth_init(void)
                 goto fail_mtx;
         }
 
+        list_head_init(&oap_auth.crt.list);
+
+        oap_auth.crt.len    = 0;
+        oap_auth.crt.gen    = 0;
+        oap_auth.crt.hits   = 0;
+        oap_auth.crt.verifs = 0;
+
+        if (pthread_mutex_init(&oap_auth.crt.mtx, NULL)) {
+                log_err("Failed to init OAP crt cache mutex.");
+                goto fail_crt_mtx;
+        }
+
         return 0;
 
+ fail_crt_mtx:
+        pthread_mutex_destroy(&oap_auth.replay.mtx);
  fail_mtx:
         auth_destroy_ctx(oap_auth.ca_ctx);
  fail_ctx:
         return -1;
 }
 
+static void crt_cache_flush(void)
+{
+        struct list_head * p;
+        struct list_head * h;
+
+        list_for_each_safe(p, h, &oap_auth.crt.list) {
+                struct oap_crt_entry * e;
+                e = list_entry(p, struct oap_crt_entry, next);
+                list_del(&e->next);
+                free(e);
+        }
+
+        oap_auth.crt.len = 0;
+}
+
 void oap_auth_fini(void)
 {
         struct list_head * p;
         struct list_head * h;
 
+        pthread_mutex_lock(&oap_auth.crt.mtx);
+        crt_cache_flush();
+        pthread_mutex_unlock(&oap_auth.crt.mtx);
+        pthread_mutex_destroy(&oap_auth.crt.mtx);
+
         pthread_mutex_lock(&oap_auth.replay.mtx);
 
         list_for_each_safe(p, h, &oap_auth.replay.list) {
@@ -103,9 +166,139 @@ void oap_auth_fini(void)
 
 int oap_auth_add_ca_crt(void * crt)
 {
-        return auth_add_crt_to_store(oap_auth.ca_ctx, crt);
+        int ret;
+
+        pthread_mutex_lock(&oap_auth.crt.mtx);
+
+        ret = auth_add_crt_to_store(oap_auth.ca_ctx, crt);
+
+        /* Verifications against the old store no longer count */
+        ++oap_auth.crt.gen;
+        crt_cache_flush();
+
+        pthread_mutex_unlock(&oap_auth.crt.mtx);
+
+        return ret;
 }
 
+static bool crt_cache_hit(const uint8_t * fp)
+{
+        struct list_head * p;
+        struct list_head * h;
+        time_t             now;
+
+        now = crt_now();
+
+        pthread_mutex_lock(&oap_auth.crt.mtx);
+
+        list_for_each_safe(p, h, &oap_auth.crt.list) {
+                struct oap_crt_entry * e;
+                e = list_entry(p, struct oap_crt_entry, next);
+                if (e->expiry <= now) {
+                        list_del(&e->next);
+                        --oap_auth.crt.len;
+                        free(e);
+                        continue;
+                }
+
+                if (memcmp(e->fp, fp, OAP_CRT_FP_SIZE) == 0) {
+                        list_move(&e->next, &oap_auth.crt.list);
+                        ++oap_auth.crt.hits;
+                        pthread_mutex_unlock(&oap_auth.crt.mtx);
+                        return true;
+                }
+        }
+
+        pthread_mutex_unlock(&oap_auth.crt.mtx);
+
+        return false;
+}
+
+/* Valid until the first crt in the verified chain expires */
+static void crt_cache_add(const uint8_t * fp,
+                          time_t          expiry,
+                          uint64_t        gen)
+{
+        struct oap_crt_entry * e;
+        struct list_head *     p;
+
+        if (OAP_CRT_CACHE == 0 || expiry <= crt_now())
+                return;
+
+        e = malloc(sizeof(*e));
+        if (e == NULL)
+                return;
+
+        memcpy(e->fp, fp, OAP_CRT_FP_SIZE);
+
+        pthread_mutex_lock(&oap_auth.crt.mtx);
+
+        if (gen != oap_auth.crt.gen) { /* CA store changed meanwhile */
+                pthread_mutex_unlock(&oap_auth.crt.mtx);
+                free(e);
+                return;
+        }
+
+        e->expiry = expiry;
+
+        list_for_each(p, &oap_auth.crt.list) { /* Concurrent miss */
+                struct oap_crt_entry * o;
+                o = list_entry(p, struct oap_crt_entry, next);
+                if (memcmp(o->fp, fp, OAP_CRT_FP_SIZE) == 0) {
+                        o->expiry = expiry;
+                        list_move(&o->next, &oap_auth.crt.list);
+                        pthread_mutex_unlock(&oap_auth.crt.mtx);
+                        free(e);
+                        return;
+                }
+        }
+
+        if (oap_auth.crt.len >= OAP_CRT_CACHE) { /* Drop least recent */
+                struct oap_crt_entry * l;
+                l = list_last_entry(&oap_auth.crt.list,
+                                    struct oap_crt_entry, next);
+                list_del(&l->next);
+                --oap_auth.crt.len;
+                free(l);
+        }
+
+        list_add(&e->next, &oap_auth.crt.list);
+        ++oap_auth.crt.len;
+
+        pthread_mutex_unlock(&oap_auth.crt.mtx);
+}
+
+#ifdef OAP_TEST_MODE
+void oap_auth_crt_stats(size_t * len,
+                        size_t * hits,
+                        size_t * verifs)
+{
+        pthread_mutex_lock(&oap_auth.crt.mtx);
+
+        *len    = oap_auth.crt.len;
+        *hits   = oap_auth.crt.hits;
+        *verifs = oap_auth.crt.verifs;
+
+        pthread_mutex_unlock(&oap_auth.crt.mtx);
+}
+
+void oap_auth_crt_skew(time_t skew)
+{
+        crt_skew = skew;
+}
+
+void oap_auth_crt_add(const uint8_t * fp)
+{
+        uint64_t gen;
+
+        pthread_mutex_lock(&oap_auth.crt.mtx);
+        gen = oap_auth.crt.gen;
+        pthread_mutex_unlock(&oap_auth.crt.mtx);
+
+        crt_cache_add(fp, crt_now() + 3600, gen);
+}
+#endif /* OAP_TEST_MODE */
+
 #define TIMESYNC_SLACK 100 /* ms */
 #define ID_IS_EQUAL(id1, id2) (memcmp(id1, id2, OAP_ID_SIZE) == 0)
 int oap_check_hdr(const struct oap_hdr * hdr)
@@ -186,6 +379,10 @@ int oap_auth_peer(char *                 name,
         void *     pk;
         buffer_t   sign; /* Signed region */
         uint8_t *  id = peer_hdr->id.data;
+        uint8_t    fp[MAX_HASH_SIZE];
+        bool       known;
+        uint64_t   gen;
+        time_t     expiry;
 
         assert(name != NULL);
         assert(local_hdr != NULL);
@@ -216,12 +413,27 @@ int oap_auth_peer(char *                 name,
 
         log_dbg_id(id, "Got public key from crt.");
 
-        if (auth_verify_crt(oap_auth.ca_ctx, crt) < 0) {
-                log_err_id(id, "Failed to verify peer with CA store.");
-                goto fail_crt;
-        }
+        /* Chain verified before, the signature is checked regardless */
+        known = md_digest(OAP_CRT_FP_NID, peer_hdr->crt, fp) ==
+                OAP_CRT_FP_SIZE;
+        if (known && crt_cache_hit(fp)) {
+                log_dbg_id(id, "Peer crt verified before.");
+        } else {
+                pthread_mutex_lock(&oap_auth.crt.mtx);
+                gen = oap_auth.crt.gen;
+                ++oap_auth.crt.verifs;
+                pthread_mutex_unlock(&oap_auth.crt.mtx);
+
+                if (auth_verify_crt_chain(oap_auth.ca_ctx, crt, &expiry) < 0) {
+                        log_err_id(id, "Failed to verify peer with CA store.");
+                        goto fail_crt;
+                }
 
-        log_dbg_id(id, "Successfully verified peer crt.");
+                log_dbg_id(id, "Successfully verified peer crt.");
+
+                if (known)
+                        crt_cache_add(fp, expiry, gen);
+        }
 
         sign = peer_hdr->hdr;
         sign.len -= peer_hdr->sig.len;
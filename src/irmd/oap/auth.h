@@ -25,6 +25,11 @@
 
 #include "hdr.h"
 
+#include <time.h>
+
+#define OAP_CRT_FP_NID  NID_sha256
+#define OAP_CRT_FP_SIZE 32
+
 int  oap_check_hdr(const struct oap_hdr * hdr);
 
 /* name is updated with the peer's certificate name if available */
@@ -32,4 +37,15 @@ int  oap_auth_peer(char *                 name,
                    const struct oap_hdr * local_hdr,
                    const struct oap_hdr * peer_hdr);
 
+/* Crt cache test hooks, only built with OAP_TEST_MODE */
+void oap_auth_crt_stats(size_t * len,
+                        size_t * hits,
+                        size_t * verifs);
+
+/* Offset in seconds for the cache clock */
+void oap_auth_crt_skew(time_t skew);
+
+/* Caches a fingerprint for an hour */
+void oap_auth_crt_add(const uint8_t * fp);
+
 #endif /* OUROBOROS_IRMD_OAP_AUTH_H */
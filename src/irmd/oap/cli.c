@@ -38,6 +38,8 @@
 #include "auth.h"
 #include "hdr.h"
 #include "io.h"
+#include "pool.h"
+#include "ticket.h"
 #include "../oap.h"
 
 #include <assert.h>
@@ -58,6 +60,8 @@ struct oap_cli_ctx {
         struct oap_hdr    local_hdr;
         void *            pkp;     /* Ephemeral keypair    */
         uint8_t *         key;     /* For client-encap KEM */
+        struct oap_tkt    tkt;     /* Offered for resumption */
+        bool              resume;
 };
 
 #define OAP_CLI_CTX_INIT(s) \
@@ -112,16 +116,10 @@ int load_server_kem_pk(const char *        name,
         snprintf(path, sizeof(path),
                  OUROBOROS_CLI_CRT_DIR "/%s/kex.srv.pub.%s", name, ext);
 
-        if (IS_HYBRID_KEM(cfg->x.str)) {
-                if (crypt_load_pubkey_raw_file(path, pk) < 0) {
-                        log_err("Failed to load %s pubkey from %s.", ext, path);
-                        return -1;
-                }
-        } else {
-                if (crypt_load_pubkey_file_to_der(path, pk) < 0) {
-                        log_err("Failed to load %s pubkey from %s.", ext, path);
-                        return -1;
-                }
+        if (io_load_pk(path, IS_HYBRID_KEM(cfg->x.str) ? IO_PK_RAW : IO_PK,
+                       pk) < 0) {
+                log_err("Failed to load %s pubkey from %s.", ext, path);
+                return -1;
         }
 
         log_dbg("Loaded %s pubkey from %s (%zu bytes).", ext, path, pk->len);
@@ -139,7 +137,7 @@ static int do_client_kex_prepare_dhe(struct oap_cli_ctx * s)
         ssize_t             len;
 
         /* Generate ephemeral keypair, send PK */
-        len = kex_pkp_create(kcfg, &s->pkp, kex->data);
+        len = pool_pkp_take(kcfg, &s->pkp, kex->data);
         if (len < 0) {
                 log_err_id(id, "Failed to generate DHE keypair.");
                 return -ECRYPT;
@@ -204,7 +202,7 @@ static int do_client_kex_prepare_kem_decap(struct oap_cli_ctx * s)
         ssize_t             len;
 
         /* Server encaps: generate keypair, send PK */
-        len = kex_pkp_create(kcfg, &s->pkp, kex->data);
+        len = pool_pkp_take(kcfg, &s->pkp, kex->data);
         if (len < 0) {
                 log_err_id(id, "Failed to generate KEM keypair.");
                 return -ECRYPT;
@@ -242,6 +240,7 @@ int oap_cli_prepare(void **                  ctx,
         struct oap_cli_ctx * s;
         void *               pkp = NULL;
         void *               crt = NULL;
+        buffer_t             psk = BUF_INIT;
         ssize_t              ret;
 
         assert(ctx != NULL);
@@ -290,8 +289,18 @@ int oap_cli_prepare(void **                  ctx,
                 goto fail_kex;
         }
 
+        /* The full key exchange stays in as fallback */
+        if (IS_KEX_ALGO_SET(&s->kcfg) &&
+            tkt_take_cli(info->name, &s->kcfg, &s->tkt) == 0) {
+                s->resume = true;
+                s->local_hdr.tkt.data = s->tkt.id;
+                s->local_hdr.tkt.len  = OAP_TKT_ID_SIZE;
+                psk.data = s->tkt.psk;
+                psk.len  = SYMMKEYSZ;
+        }
+
         if (oap_hdr_encode(&s->local_hdr, pkp, crt, &s->kcfg,
-                           (buffer_t) BUF_INIT, NID_undef)) {
+                           (buffer_t) BUF_INIT, NID_undef, psk)) {
                 log_err_id(s->id.data, "Failed to create OAP request header.");
                 goto fail_hdr;
         }
@@ -350,6 +359,8 @@ void oap_ctx_free(void * ctx)
         if (s->key != NULL)
                 crypt_secure_free(s->key, SYMMKEYSZ);
 
+        tkt_clear(&s->tkt);
+
         memset(s, 0, sizeof(*s));
         free(s);
 }
@@ -488,6 +499,28 @@ static int do_client_kex_complete(struct oap_cli_ctx *   s,
         return do_client_kex_complete_dhe(s, peer_hdr, sk);
 }
 
+static int do_client_resume(struct oap_cli_ctx *   s,
+                            const struct oap_hdr * peer_hdr)
+{
+        uint8_t * id = s->id.data;
+        buffer_t  signed_hdr;
+
+        if (!s->resume) {
+                log_err_id(id, "Resumed response without a ticket.");
+                return -EAUTH;
+        }
+
+        signed_hdr.data = peer_hdr->hdr.data;
+        signed_hdr.len  = peer_hdr->hdr.len - peer_hdr->sig.len;
+
+        if (tkt_check_mac(&s->tkt, signed_hdr, peer_hdr->sig.data) < 0) {
+                log_err_id(id, "Failed to verify resumed response.");
+                return -EAUTH;
+        }
+
+        return 0;
+}
+
 int oap_cli_complete(void *                   ctx,
                      const struct name_info * info,
                      buffer_t                 rsp_buf,
@@ -528,8 +561,11 @@ int oap_cli_complete(void *                   ctx,
                 goto fail_oap;
         }
 
-        /* Authenticate server */
-        if (oap_auth_peer(peer, &s->local_hdr, &peer_hdr) < 0) {
+        /* Authenticate server, by its ticket when resumed */
+        if (peer_hdr.kex_flags.psk) {
+                if (do_client_resume(s, &peer_hdr) < 0)
+                        goto fail_oap;
+        } else if (oap_auth_peer(peer, &s->local_hdr, &peer_hdr) < 0) {
                 log_err_id(id, "Failed to authenticate server.");
                 goto fail_oap;
         }
@@ -553,7 +589,14 @@ int oap_cli_complete(void *                   ctx,
         }
 
         /* Complete key exchange */
-        if (do_client_kex_complete(s, &peer_hdr, sk) < 0) {
+        if (peer_hdr.kex_flags.psk) {
+                if (tkt_session_key(&s->tkt, s->id, sk) < 0) {
+                        log_err_id(id, "Failed to derive resumed key.");
+                        goto fail_oap;
+                }
+                log_info_id(id, "Resumed session with %s.",
+                            crypt_nid_to_str(sk->nid));
+        } else if (do_client_kex_complete(s, &peer_hdr, sk) < 0) {
                 log_err_id(id, "Failed to complete key exchange.");
                 goto fail_oap;
         }
@@ -564,6 +607,13 @@ int oap_cli_complete(void *                   ctx,
                 goto fail_oap;
         }
 
+        /* A resumed session keeps the lifetime of the full exchange */
+        if (peer_hdr.kex_flags.psk)
+                tkt_issue(false, info->name, sk, s->tkt.kdf, s->id,
+                          s->tkt.expiry);
+        else
+                tkt_issue(false, info->name, sk, peer_hdr.kdf_nid, s->id, 0);
+
         log_info_id(id, "OAP completed for %s.", info->name);
 
         oap_ctx_free(s);
@@ -54,6 +54,7 @@ int oap_hdr_decode(struct oap_hdr * oap_hdr,
         uint16_t     ciph_nid;
         size_t       crt_len;
         size_t       data_len;
+        size_t       tkt_len;
         size_t       hash_len;
         size_t       sig_len;
 
@@ -109,6 +110,7 @@ int oap_hdr_decode(struct oap_hdr * oap_hdr,
         oap_hdr->kex.len = (size_t) (kex_len & OAP_KEX_LEN_MASK);
         oap_hdr->kex_flags.fmt  = (kex_len & OAP_KEX_FMT_BIT) ? 1 : 0;
         oap_hdr->kex_flags.role = (kex_len & OAP_KEX_ROLE_BIT) ? 1 : 0;
+        oap_hdr->kex_flags.psk  = (kex_len & OAP_KEX_PSK_BIT) ? 1 : 0;
         offset += sizeof(uint16_t);
 
         /* data_len */
@@ -119,18 +121,27 @@ int oap_hdr_decode(struct oap_hdr * oap_hdr,
         hash_len = (req_md_nid != NID_undef) ?
                    (size_t) md_len(req_md_nid) : 0;
 
+        /* Request with resumption ticket */
+        tkt_len = (hash_len == 0 && oap_hdr->kex_flags.psk) ?
+                  OAP_TKT_SIZE : 0;
+
         /* Validate total length */
         if (hdr.len < (size_t) offset + crt_len + oap_hdr->kex.len +
-                      data_len + hash_len)
+                      data_len + tkt_len + hash_len)
                 goto fail_decode;
 
         /* Derive sig_len from remaining bytes */
         sig_len = hdr.len - offset - crt_len - oap_hdr->kex.len -
-                  data_len - hash_len;
-
-        /* Unsigned packets must not have trailing bytes */
-        if (crt_len == 0 && sig_len != 0)
+                  data_len - tkt_len - hash_len;
+
+        /* Resumed responses carry an HMAC and no certificate */
+        if (hash_len != 0 && oap_hdr->kex_flags.psk) {
+                if (crt_len != 0 || sig_len != OAP_TKT_MAC_SIZE)
+                        goto fail_decode;
+        } else if (crt_len == 0 && sig_len != 0) {
+                /* Unsigned packets must not have trailing bytes */
                 goto fail_decode;
+        }
 
         /* Parse variable fields */
         oap_hdr->crt.data = hdr.data + offset;
@@ -144,6 +155,10 @@ int oap_hdr_decode(struct oap_hdr * oap_hdr,
         oap_hdr->data.len = data_len;
         offset += data_len;
 
+        oap_hdr->tkt.data = hdr.data + offset;
+        oap_hdr->tkt.len = tkt_len;
+        offset += tkt_len;
+
         oap_hdr->req_hash.data = hdr.data + offset;
         oap_hdr->req_hash.len = hash_len;
         offset += hash_len;
@@ -212,7 +227,8 @@ int oap_hdr_encode(struct oap_hdr *    hdr,
                    void *              crt,
                    struct sec_config * kcfg,
                    buffer_t            req_hash,
-                   int                 req_md_nid)
+                   int                 req_md_nid,
+                   buffer_t            psk)
 {
         struct timespec now;
         uint64_t        stamp;
@@ -220,16 +236,23 @@ int oap_hdr_encode(struct oap_hdr *    hdr,
         buffer_t        der = BUF_INIT;
         buffer_t        sig = BUF_INIT;
         buffer_t        sign;
+        uint8_t         hash[MAX_HASH_SIZE];
         uint16_t        len;
         uint16_t        ciph_nid;
         uint16_t        kdf_nid;
         uint16_t        md_nid;
         uint16_t        kex_len;
+        size_t          tkt_len;
         off_t           offset;
 
         assert(hdr != NULL);
         assert(hdr->id.data != NULL && hdr->id.len == OAP_ID_SIZE);
         assert(kcfg != NULL);
+        assert(psk.len == 0 || pkp == NULL || req_md_nid == NID_undef);
+
+        /* A longer key share would run into the flag bits */
+        if (hdr->kex.len > OAP_KEX_LEN_MASK)
+                return -EINVAL;
 
         clock_gettime(CLOCK_REALTIME, &now);
         stamp = hton64(TS_TO_UINT64(now));
@@ -249,11 +272,15 @@ int oap_hdr_encode(struct oap_hdr *    hdr,
                 if (kcfg->x.mode == KEM_MODE_CLIENT_ENCAP)
                         kex_len |= OAP_KEX_ROLE_BIT;
         }
+        if (psk.len > 0)
+                kex_len |= OAP_KEX_PSK_BIT;
         kex_len = hton16(kex_len);
 
+        tkt_len = (psk.len > 0 && req_md_nid == NID_undef) ? OAP_TKT_SIZE : 0;
+
         /* Fixed header (36 bytes) + variable fields + req_hash (if auth) */
         out.len = OAP_HDR_MIN_SIZE + der.len + hdr->kex.len + hdr->data.len +
-                  req_hash.len;
+                  tkt_len + req_hash.len;
 
         out.data = malloc(out.len);
         if (out.data == NULL)
@@ -313,6 +340,18 @@ int oap_hdr_encode(struct oap_hdr *    hdr,
                 memcpy(out.data + offset, hdr->data.data, hdr->data.len);
         offset += hdr->data.len;
 
+        /* ticket id and binder (request with psk) */
+        if (tkt_len != 0) {
+                memcpy(out.data + offset, hdr->tkt.data, OAP_TKT_ID_SIZE);
+                offset += OAP_TKT_ID_SIZE;
+                sign.data = out.data;
+                sign.len  = (size_t) offset;
+                if (md_hmac(OAP_TKT_MAC_NID, psk, sign, hash) < 0)
+                        goto fail_sig;
+                memcpy(out.data + offset, hash, OAP_TKT_MAC_SIZE);
+                offset += OAP_TKT_MAC_SIZE;
+        }
+
         /* req_hash (variable, only for authenticated responses) */
         if (req_hash.len != 0)
                 memcpy(out.data + offset, req_hash.data, req_hash.len);
@@ -327,6 +366,17 @@ int oap_hdr_encode(struct oap_hdr *    hdr,
         if (pkp != NULL && auth_sign(pkp, kcfg->d.nid, sign, &sig) < 0)
                 goto fail_sig;
 
+        /* Resumed response, authenticated by the ticket secret */
+        if (psk.len > 0 && tkt_len == 0) {
+                if (md_hmac(OAP_TKT_MAC_NID, psk, sign, hash) < 0)
+                        goto fail_sig;
+                sig.data = malloc(OAP_TKT_MAC_SIZE);
+                if (sig.data == NULL)
+                        goto fail_sig;
+                memcpy(sig.data, hash, OAP_TKT_MAC_SIZE);
+                sig.len = OAP_TKT_MAC_SIZE;
+        }
+
         hdr->hdr = out;
 
         /* Append signature */
@@ -34,7 +34,13 @@
 
 #define OAP_KEX_FMT_BIT  0x8000 /* bit 15: 0=X.509 DER, 1=Raw               */
 #define OAP_KEX_ROLE_BIT 0x4000 /* bit 14: 0=Server encaps, 1=Client encaps */
-#define OAP_KEX_LEN_MASK 0x3FFF /* bits 0-13: Length (0-16383 bytes)        */
+#define OAP_KEX_PSK_BIT  0x2000 /* bit 13: 1=Resumption ticket              */
+#define OAP_KEX_LEN_MASK 0x1FFF /* bits 0-12: Length (0-8191 bytes)         */
+
+#define OAP_TKT_ID_SIZE  (16)
+#define OAP_TKT_MAC_NID  NID_sha256
+#define OAP_TKT_MAC_SIZE (32)   /* HMAC-SHA-256 */
+#define OAP_TKT_SIZE     (OAP_TKT_ID_SIZE + OAP_TKT_MAC_SIZE)
 
 #define OAP_KEX_ROLE(hdr) (hdr->kex_flags.role)
 #define OAP_KEX_FMT(hdr) (hdr->kex_flags.fmt)
@@ -62,7 +68,7 @@
  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+    |
  * |         md_nid (16 bits)      |        crt_len (16 bits)      |    |
  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+    |
- * |F|R|      kex_len (14 bits)    |        data_len (16 bits)     |    | Signed
+ * |F|R|P|    kex_len (13 bits)    |        data_len (16 bits)     |    | Signed
  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+    | Region
  * |                                                               |    |
  * +                  certificate (variable)                       +    |
@@ -83,6 +89,11 @@
  * |                                                               |    |
  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+    |
  * |                                                               |    |
+ * +            ticket (48 bytes, request with P set only)         +    |
+ * |      ticket id (128 bits) | HMAC-SHA-256 binder (256 bits)    |    |
+ * |                                                               |    |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+    |
+ * |                                                               |    |
  * +                  req_hash (variable, response only)           +    |
  * |                      H(request) using req md_nid / sha384     |    |
  * |                                                               |    |
@@ -100,9 +111,20 @@
  *   F (bit 15): Format - 0 = X.509 DER, 1 = Raw/Hybrid
  *   R (bit 14): Role   - 0 = Server encaps, 1 = Client encaps
  *               (R is ignored for non-KEM algorithms)
- *   Bits 0-13:  Length (0-16383 bytes)
+ *   P (bit 13): Resumption - request: a ticket follows the data,
+ *               response: the ticket was accepted, the signature is
+ *               an HMAC-SHA-256 keyed with the ticket secret
+ *   Bits 0-12:  Length (0-8191 bytes)
  *
- * Request:  sig_len = total - 36 - crt_len - kex_len - data_len
+ * Before P, the length took bits 0-13 (0-16383 bytes). Longer key
+ * shares are refused on encode, they would set P on the wire.
+ *
+ * The binder is an HMAC-SHA-256 over the header up to the binder,
+ * keyed with the ticket secret. A request with a ticket still carries
+ * a full key exchange, the server falls back to it when the ticket is
+ * unknown or expired.
+ *
+ * Request:  sig_len = total - 36 - crt_len - kex_len - data_len - tkt_len
  * Response: sig_len = total - 36 - crt_len - kex_len - data_len - hash_len
  *           where hash_len = md_len(req_md_nid / sha384)
  */
@@ -117,13 +139,15 @@ struct oap_hdr {
         uint16_t     kdf_nid;
         uint16_t     md_nid;
         struct {
-                bool fmt;   /* Format */
-                bool role;  /* Role   */
+                bool fmt;   /* Format     */
+                bool role;  /* Role       */
+                bool psk;   /* Resumption */
         } kex_flags;
         buffer_t     id;
         buffer_t     crt;
         buffer_t     kex;
         buffer_t     data;
+        buffer_t     tkt;      /* Ticket id | binder - request only */
         buffer_t     req_hash; /* H(request) - response only */
         buffer_t     sig;
         buffer_t     hdr;
@@ -138,12 +162,17 @@ void oap_hdr_init(struct oap_hdr * hdr,
 
 void oap_hdr_fini(struct oap_hdr * oap_hdr);
 
+/*
+ * With a psk, a request adds the ticket id in tkt.data and its binder,
+ * a response is authenticated with an HMAC instead of a signature.
+ */
 int  oap_hdr_encode(struct oap_hdr *    hdr,
                     void *              pkp,
                     void *              crt,
                     struct sec_config * kcfg,
                     buffer_t            req_hash,
-                    int                 req_md_nid);
+                    int                 req_md_nid,
+                    buffer_t            psk);
 
 int  oap_hdr_decode(struct oap_hdr * hdr,
                     buffer_t         buf,
@@ -30,16 +30,260 @@
 
 #include <ouroboros/crypt.h>
 #include <ouroboros/errno.h>
+#include <ouroboros/list.h>
 #include <ouroboros/logs.h>
+#include <ouroboros/pthread.h>
 
 #include "config.h"
 
 #include "io.h"
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
+/*
+ * Parsed credentials, reloaded when the file changes
+ */
+
+struct io_entry {
+        struct list_head next;
+        char *           path;
+        enum io_type     type;
+        dev_t            dev;
+        ino_t            ino;
+        off_t            size;
+        struct timespec  mtim;
+        void *           obj;  /* Certificate or key */
+        buffer_t         pk;   /* Public key bytes   */
+};
+
+static struct {
+        struct list_head list;
+        pthread_mutex_t  mtx;
+} io_cache;
+
+int oap_io_init(void)
+{
+        list_head_init(&io_cache.list);
+
+        if (pthread_mutex_init(&io_cache.mtx, NULL)) {
+                log_err("Failed to init OAP credential cache mutex.");
+                return -1;
+        }
+
+        return 0;
+}
+
+static void io_entry_destroy(struct io_entry * e)
+{
+        if (e->type == IO_CRT)
+                crypt_free_crt(e->obj);
+        else
+                crypt_free_key(e->obj);
+
+        freebuf(e->pk);
+        free(e->path);
+        free(e);
+}
+
+void oap_io_fini(void)
+{
+        struct list_head * p;
+        struct list_head * h;
+
+        pthread_mutex_lock(&io_cache.mtx);
+
+        list_for_each_safe(p, h, &io_cache.list) {
+                struct io_entry * e;
+                e = list_entry(p, struct io_entry, next);
+                list_del(&e->next);
+                io_entry_destroy(e);
+        }
+
+        pthread_mutex_unlock(&io_cache.mtx);
+        pthread_mutex_destroy(&io_cache.mtx);
+}
+
+static int io_parse(struct io_entry * e)
+{
+        switch (e->type) {
+        case IO_CRT:
+                return crypt_load_crt_file(e->path, &e->obj);
+        case IO_KEY:
+                return crypt_load_privkey_file(e->path, &e->obj);
+        case IO_KEY_RAW:
+                return crypt_load_privkey_raw_file(e->path, &e->obj);
+        case IO_PK:
+                return crypt_load_pubkey_file_to_der(e->path, &e->pk);
+        case IO_PK_RAW:
+                return crypt_load_pubkey_raw_file(e->path, &e->pk);
+        default:
+                return -EINVAL;
+        }
+}
+
+static struct io_entry * io_entry_create(const char *        path,
+                                         enum io_type        type,
+                                         const struct stat * st)
+{
+        struct io_entry * e;
+
+        e = malloc(sizeof(*e));
+        if (e == NULL)
+                goto fail_malloc;
+
+        memset(e, 0, sizeof(*e));
+
+        e->path = strdup(path);
+        if (e->path == NULL)
+                goto fail_path;
+
+        e->type = type;
+        e->dev  = st->st_dev;
+        e->ino  = st->st_ino;
+        e->size = st->st_size;
+        e->mtim = st->st_mtim;
+
+        if (io_parse(e) < 0)
+                goto fail_parse;
+
+        return e;
+
+ fail_parse:
+        free(e->path);
+ fail_path:
+        free(e);
+ fail_malloc:
+        return NULL;
+}
+
+static bool io_entry_is_current(const struct io_entry * e,
+                                const struct stat *     st)
+{
+        return e->dev == st->st_dev && e->ino == st->st_ino
+                && e->size == st->st_size
+                && e->mtim.tv_sec == st->st_mtim.tv_sec
+                && e->mtim.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static struct io_entry * io_cache_get(const char * path,
+                                      enum io_type type)
+{
+        struct list_head * p;
+
+        list_for_each(p, &io_cache.list) {
+                struct io_entry * e;
+                e = list_entry(p, struct io_entry, next);
+                if (e->type == type && strcmp(e->path, path) == 0)
+                        return e;
+        }
+
+        return NULL;
+}
+
+/* Hands the caller its own reference or copy */
+static int io_entry_share(const struct io_entry * e,
+                          void **                 obj,
+                          buffer_t *              pk)
+{
+        switch (e->type) {
+        case IO_CRT:
+                if (crypt_ref_crt(e->obj) < 0)
+                        return -ECRYPT;
+                *obj = e->obj;
+                return 0;
+        case IO_KEY:
+        case IO_KEY_RAW:
+                if (crypt_ref_key(e->obj) < 0)
+                        return -ECRYPT;
+                *obj = e->obj;
+                return 0;
+        default:
+                pk->data = malloc(e->pk.len);
+                if (pk->data == NULL)
+                        return -ENOMEM;
+                memcpy(pk->data, e->pk.data, e->pk.len);
+                pk->len = e->pk.len;
+                return 0;
+        }
+}
+
+static int io_load(const char * path,
+                   enum io_type type,
+                   void **      obj,
+                   buffer_t *   pk)
+{
+        struct stat       st;
+        struct io_entry * e;
+        struct io_entry * old;
+        int               ret;
+
+        if (stat(path, &st) < 0)
+                return -ENOENT;
+
+        pthread_mutex_lock(&io_cache.mtx);
+
+        e = io_cache_get(path, type);
+        if (e != NULL && io_entry_is_current(e, &st)) {
+                ret = io_entry_share(e, obj, pk);
+                pthread_mutex_unlock(&io_cache.mtx);
+                return ret;
+        }
+
+        pthread_mutex_unlock(&io_cache.mtx);
+
+        /* Parse without the lock, the last one to finish is kept */
+        e = io_entry_create(path, type, &st);
+        if (e == NULL)
+                return -ECRYPT;
+
+        pthread_mutex_lock(&io_cache.mtx);
+
+        ret = io_entry_share(e, obj, pk);
+
+        old = io_cache_get(path, type);
+        if (old != NULL) {
+                list_del(&old->next);
+                io_entry_destroy(old);
+        }
+
+        list_add(&e->next, &io_cache.list);
+
+        pthread_mutex_unlock(&io_cache.mtx);
+
+        log_dbg("Cached %s.", path);
+
+        return ret;
+}
+
+int io_load_obj(const char * path,
+                enum io_type type,
+                void **      obj)
+{
+        assert(path != NULL);
+        assert(obj != NULL);
+        assert(type == IO_CRT || type == IO_KEY || type == IO_KEY_RAW);
+
+        *obj = NULL;
+
+        return io_load(path, type, obj, NULL);
+}
+
+int io_load_pk(const char * path,
+               enum io_type type,
+               buffer_t *   pk)
+{
+        assert(path != NULL);
+        assert(pk != NULL);
+        assert(type == IO_PK || type == IO_PK_RAW);
+
+        clrbuf(*pk);
+
+        return io_load(path, type, NULL, pk);
+}
+
 /*
  * Shared credential and configuration loading helpers
  */
@@ -75,12 +319,12 @@ int load_credentials(const char *                  name,
                 return 0;
         }
 
-        if (crypt_load_crt_file(paths->crt, crt) < 0) {
+        if (io_load_obj(paths->crt, IO_CRT, crt) < 0) {
                 log_err("Failed to load %s for %s.", paths->crt, name);
                 goto fail_crt;
         }
 
-        if (crypt_load_privkey_file(paths->key, pkp) < 0) {
+        if (io_load_obj(paths->key, IO_KEY, pkp) < 0) {
                 log_err("Failed to load %s for %s.", paths->key, name);
                 goto fail_key;
         }
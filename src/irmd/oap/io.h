@@ -26,6 +26,24 @@
 #include <ouroboros/crypt.h>
 #include <ouroboros/name.h>
 
+enum io_type {
+        IO_CRT = 0,  /* Certificate, PEM         */
+        IO_KEY,      /* Private key (pair), PEM  */
+        IO_KEY_RAW,  /* Private key (pair), raw  */
+        IO_PK,       /* Public key, PEM to DER   */
+        IO_PK_RAW    /* Public key, raw          */
+};
+
+/* Parsed once per file version, free with crypt_free_crt/key */
+int  io_load_obj(const char * path,
+                 enum io_type type,
+                 void **      obj);
+
+/* A copy of the cached public key, free with freebuf */
+int  io_load_pk(const char * path,
+                enum io_type type,
+                buffer_t *   pk);
+
 #ifndef OAP_TEST_MODE
 int  load_credentials(const char *                  name,
                       const struct name_sec_paths * paths,
@@ -0,0 +1,289 @@
+/*
+ * Ouroboros - Copyright (C) 2016 - 2026
+ *
+ * OAP - Pool of pre-generated ephemeral key pairs
+ *
+ *    Dimitri Staessens <dimitri@ouroboros.rocks>
+ *    Sander Vrijders   <sander@ouroboros.rocks>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., http://www.fsf.org/about/contact/.
+ */
+
+#if defined(__linux__) || defined(__CYGWIN__)
+ #define _DEFAULT_SOURCE
+#else
+ #define _POSIX_C_SOURCE 200809L
+#endif
+
+#define OUROBOROS_PREFIX "irmd/oap"
+
+#include <ouroboros/crypt.h>
+#include <ouroboros/errno.h>
+#include <ouroboros/list.h>
+#include <ouroboros/logs.h>
+#include <ouroboros/pthread.h>
+
+#include "config.h"
+
+#include "pool.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct pool_pkp {
+        void *    pkp;
+        uint8_t * pk;
+        size_t    len;
+};
+
+/* Key pairs for one KEX algorithm, a stack of n */
+struct pool_slot {
+        struct list_head  next;
+        struct sec_config cfg;
+        struct pool_pkp * pkps;
+        size_t            n;
+        bool              failed;
+};
+
+static struct {
+        struct list_head slots;
+        size_t           max;   /* Key pairs per algorithm */
+        bool             stop;
+        pthread_mutex_t  mtx;
+        pthread_cond_t   cond;
+        pthread_t        refill;
+} oap_pool;
+
+static void pool_pkp_destroy(struct pool_pkp * p)
+{
+        kex_pkp_destroy(p->pkp);
+        free(p->pk);
+}
+
+static struct pool_slot * pool_slot_create(int nid)
+{
+        struct pool_slot * s;
+
+        s = malloc(sizeof(*s));
+        if (s == NULL)
+                goto fail_malloc;
+
+        memset(s, 0, sizeof(*s));
+
+        s->pkps = malloc(oap_pool.max * sizeof(*s->pkps));
+        if (s->pkps == NULL)
+                goto fail_pkps;
+
+        SET_KEX_ALGO_NID(&s->cfg, nid);
+
+        list_add_tail(&s->next, &oap_pool.slots);
+
+        return s;
+
+ fail_pkps:
+        free(s);
+ fail_malloc:
+        return NULL;
+}
+
+static void pool_slot_destroy(struct pool_slot * s)
+{
+        while (s->n > 0)
+                pool_pkp_destroy(&s->pkps[--s->n]);
+
+        free(s->pkps);
+        free(s);
+}
+
+static struct pool_slot * pool_slot_get(int nid)
+{
+        struct list_head * p;
+
+        list_for_each(p, &oap_pool.slots) {
+                struct pool_slot * s;
+                s = list_entry(p, struct pool_slot, next);
+                if (s->cfg.x.nid == nid)
+                        return s;
+        }
+
+        return NULL;
+}
+
+static struct pool_slot * pool_slot_low(void)
+{
+        struct list_head * p;
+
+        list_for_each(p, &oap_pool.slots) {
+                struct pool_slot * s;
+                s = list_entry(p, struct pool_slot, next);
+                if (!s->failed && s->n < oap_pool.max)
+                        return s;
+        }
+
+        return NULL;
+}
+
+static void * pool_refill(void * o)
+{
+        struct pool_slot * s;
+        struct sec_config  cfg;
+        struct pool_pkp    p;
+        uint8_t            buf[MSGBUFSZ];
+        int                len;
+
+        (void) o;
+
+        pthread_mutex_lock(&oap_pool.mtx);
+
+        while (!oap_pool.stop) {
+                s = pool_slot_low();
+                if (s == NULL) {
+                        pthread_cond_wait(&oap_pool.cond, &oap_pool.mtx);
+                        continue;
+                }
+
+                cfg = s->cfg;
+
+                pthread_mutex_unlock(&oap_pool.mtx);
+
+                p.pkp = NULL;
+                p.pk  = NULL;
+
+                len = kex_pkp_create(&cfg, &p.pkp, buf);
+                if (len >= 0) {
+                        p.len = (size_t) len;
+                        p.pk  = malloc(p.len);
+                        if (p.pk != NULL)
+                                memcpy(p.pk, buf, p.len);
+                }
+
+                pthread_mutex_lock(&oap_pool.mtx);
+
+                if (len < 0 || p.pk == NULL) {
+                        log_warn("Failed to pre-generate %s keys.",
+                                 cfg.x.str);
+                        kex_pkp_destroy(p.pkp);
+                        s->failed = true;
+                        continue;
+                }
+
+                if (s->n < oap_pool.max)
+                        s->pkps[s->n++] = p;
+                else
+                        pool_pkp_destroy(&p);
+        }
+
+        pthread_mutex_unlock(&oap_pool.mtx);
+
+        return (void *) 0;
+}
+
+int oap_pool_init(void)
+{
+        list_head_init(&oap_pool.slots);
+
+        oap_pool.max  = OAP_KEY_POOL;
+        oap_pool.stop = false;
+
+        if (pthread_mutex_init(&oap_pool.mtx, NULL)) {
+                log_err("Failed to init key pool mutex.");
+                goto fail_mtx;
+        }
+
+        if (pthread_cond_init(&oap_pool.cond, NULL)) {
+                log_err("Failed to init key pool cond.");
+                goto fail_cond;
+        }
+
+        if (oap_pool.max > 0 &&
+            pthread_create(&oap_pool.refill, NULL, pool_refill, NULL)) {
+                log_err("Failed to start key pool thread.");
+                goto fail_thr;
+        }
+
+        return 0;
+
+ fail_thr:
+        pthread_cond_destroy(&oap_pool.cond);
+ fail_cond:
+        pthread_mutex_destroy(&oap_pool.mtx);
+ fail_mtx:
+        return -1;
+}
+
+void oap_pool_fini(void)
+{
+        struct list_head * p;
+        struct list_head * h;
+
+        if (oap_pool.max > 0) {
+                pthread_mutex_lock(&oap_pool.mtx);
+                oap_pool.stop = true;
+                pthread_cond_signal(&oap_pool.cond);
+                pthread_mutex_unlock(&oap_pool.mtx);
+
+                pthread_join(oap_pool.refill, NULL);
+        }
+
+        list_for_each_safe(p, h, &oap_pool.slots) {
+                struct pool_slot * s;
+                s = list_entry(p, struct pool_slot, next);
+                list_del(&s->next);
+                pool_slot_destroy(s);
+        }
+
+        pthread_cond_destroy(&oap_pool.cond);
+        pthread_mutex_destroy(&oap_pool.mtx);
+}
+
+int pool_pkp_take(struct sec_config * cfg,
+                  void **             pkp,
+                  uint8_t *           pk)
+{
+        struct pool_slot * s;
+        struct pool_pkp    p;
+
+        assert(cfg != NULL);
+        assert(pkp != NULL);
+        assert(pk != NULL);
+
+        if (oap_pool.max == 0 || kex_validate_nid(cfg->x.nid) < 0)
+                return kex_pkp_create(cfg, pkp, pk);
+
+        pthread_mutex_lock(&oap_pool.mtx);
+
+        s = pool_slot_get(cfg->x.nid);
+        if (s == NULL)
+                s = pool_slot_create(cfg->x.nid);
+
+        pthread_cond_signal(&oap_pool.cond);
+
+        if (s == NULL || s->n == 0) {
+                pthread_mutex_unlock(&oap_pool.mtx);
+                return kex_pkp_create(cfg, pkp, pk);
+        }
+
+        p = s->pkps[--s->n];
+
+        pthread_mutex_unlock(&oap_pool.mtx);
+
+        memcpy(pk, p.pk, p.len);
+        free(p.pk);
+
+        *pkp = p.pkp;
+
+        return (int) p.len;
+}
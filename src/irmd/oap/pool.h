@@ -0,0 +1,33 @@
+/*
+ * Ouroboros - Copyright (C) 2016 - 2026
+ *
+ * OAP - Pool of pre-generated ephemeral key pairs
+ *
+ *    Dimitri Staessens <dimitri@ouroboros.rocks>
+ *    Sander Vrijders   <sander@ouroboros.rocks>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., http://www.fsf.org/about/contact/.
+ */
+
+#ifndef OUROBOROS_IRMD_OAP_POOL_H
+#define OUROBOROS_IRMD_OAP_POOL_H
+
+#include <ouroboros/crypt.h>
+
+/* As kex_pkp_create, a pooled key pair is handed out only once */
+int  pool_pkp_take(struct sec_config * cfg,
+                   void **             pkp,
+                   uint8_t *           pk);
+
+#endif /* OUROBOROS_IRMD_OAP_POOL_H */
@@ -37,6 +37,8 @@
 #include "auth.h"
 #include "hdr.h"
 #include "io.h"
+#include "pool.h"
+#include "ticket.h"
 #include "oap.h"
 
 #include <assert.h>
@@ -91,18 +93,9 @@ int load_server_kem_keypair(const char * name,
         snprintf(path, sizeof(path),
                  OUROBOROS_SRV_CRT_DIR "/%s/kex.key.%s", name, ext);
 
-        if (raw_fmt) {
-                if (crypt_load_privkey_raw_file(path, pkp) < 0) {
-                        log_err("Failed to load %s keypair from %s.",
-                                ext, path);
-                        return -ECRYPT;
-                }
-        } else {
-                if (crypt_load_privkey_file(path, pkp) < 0) {
-                        log_err("Failed to load %s keypair from %s.",
-                                ext, path);
-                        return -ECRYPT;
-                }
+        if (io_load_obj(path, raw_fmt ? IO_KEY_RAW : IO_KEY, pkp) < 0) {
+                log_err("Failed to load %s keypair from %s.", ext, path);
+                return -ECRYPT;
         }
 
         log_dbg("Loaded server KEM keypair from %s.", path);
@@ -303,7 +296,7 @@ static int do_server_kex_dhe(const struct oap_hdr * peer_hdr,
         int       ret;
         uint8_t * id = peer_hdr->id.data;
 
-        key_len = kex_pkp_create(kcfg, &epkp, kex->data);
+        key_len = pool_pkp_take(kcfg, &epkp, kex->data);
         if (key_len < 0) {
                 log_err_id(id, "Failed to generate key pair.");
                 return -ECRYPT;
@@ -375,6 +368,40 @@ int do_server_kex(const struct name_info * info,
                 return do_server_kex_dhe(peer_hdr, kcfg, kex, sk);
 }
 
+static int do_server_resume(const struct name_info * info,
+                            const struct oap_hdr *   peer_hdr,
+                            struct sec_config *      kcfg,
+                            struct oap_tkt *         tkt)
+{
+        uint8_t * id = peer_hdr->id.data;
+        buffer_t  bound;
+        int       ret;
+
+        /* The binder covers the header up to itself */
+        bound.data = peer_hdr->hdr.data;
+        bound.len  = (size_t) (peer_hdr->tkt.data - peer_hdr->hdr.data)
+                + OAP_TKT_ID_SIZE;
+
+        ret = tkt_take_srv(info->name, peer_hdr->tkt.data, bound,
+                           peer_hdr->tkt.data + OAP_TKT_ID_SIZE, kcfg, tkt);
+        if (ret == -EAUTH) {
+                log_warn_id(id, "Bad ticket binder, full key exchange.");
+                return ret;
+        }
+
+        if (ret < 0) {
+                log_dbg_id(id, "Ticket not accepted, full key exchange.");
+                return ret;
+        }
+
+        SET_KEX_CIPHER_NID(kcfg, tkt->nid);
+        SET_KEX_KDF_NID(kcfg, tkt->kdf);
+
+        log_info_id(id, "Resumed session with %s.", kcfg->c.str);
+
+        return 0;
+}
+
 int oap_srv_process(const struct name_info * info,
                     buffer_t                 req_buf,
                     buffer_t *               rsp_buf,
@@ -384,6 +411,8 @@ int oap_srv_process(const struct name_info * info,
         struct oap_hdr        peer_hdr;
         struct oap_hdr        local_hdr;
         struct sec_config     kcfg;
+        struct oap_tkt        tkt;
+        buffer_t              psk = BUF_INIT;
         uint8_t               kex_buf[MSGBUFSZ];
         uint8_t               hash_buf[MAX_HASH_SIZE];
         buffer_t              req_hash = BUF_INIT;
@@ -393,6 +422,7 @@ int oap_srv_process(const struct name_info * info,
         void *                pkp = NULL;
         void *                crt = NULL;
         int                   req_md_nid;
+        int                   ret;
 
         assert(info != NULL);
         assert(rsp_buf != NULL);
@@ -434,13 +464,22 @@ int oap_srv_process(const struct name_info * info,
 
         oap_hdr_init(&local_hdr, peer_hdr.id, kex_buf, *data, NID_undef);
 
-        if (oap_auth_peer(cli_name, &local_hdr, &peer_hdr) < 0) {
+        /* A valid ticket replaces authentication and key exchange */
+        if (peer_hdr.kex_flags.psk &&
+            do_server_resume(info, &peer_hdr, &kcfg, &tkt) == 0) {
+                psk.data = tkt.psk;
+                psk.len  = SYMMKEYSZ;
+                if (tkt_session_key(&tkt, peer_hdr.id, sk) < 0) {
+                        log_err_id(id, "Failed to derive resumed key.");
+                        goto fail_kex;
+                }
+        } else if (oap_auth_peer(cli_name, &local_hdr, &peer_hdr) < 0) {
                 log_err_id(id, "Failed to authenticate client.");
                 goto fail_auth;
-        }
-
-        if (do_server_kex(info, &peer_hdr, &kcfg, &local_hdr.kex, sk) < 0)
+        } else if (do_server_kex(info, &peer_hdr, &kcfg, &local_hdr.kex,
+                                 sk) < 0) {
                 goto fail_kex;
+        }
 
         sk->nid = kcfg.c.nid;
 
@@ -460,8 +499,13 @@ int oap_srv_process(const struct name_info * info,
         req_hash.data = hash_buf;
         req_hash.len = (size_t) hash_ret;
 
-        if (oap_hdr_encode(&local_hdr, pkp, crt, &kcfg,
-                           req_hash, req_md_nid) < 0) {
+        if (psk.len > 0)
+                ret = oap_hdr_encode(&local_hdr, NULL, NULL, &kcfg,
+                                     req_hash, req_md_nid, psk);
+        else
+                ret = oap_hdr_encode(&local_hdr, pkp, crt, &kcfg,
+                                     req_hash, req_md_nid, psk);
+        if (ret < 0) {
                 log_err_id(id, "Failed to create OAP response header.");
                 goto fail_auth;
         }
@@ -476,8 +520,15 @@ int oap_srv_process(const struct name_info * info,
         /* Transfer ownership of response buffer */
         *rsp_buf = local_hdr.hdr;
 
+        /* A resumed session keeps the lifetime of the full exchange */
+        tkt_issue(true, info->name, sk, kcfg.k.nid, peer_hdr.id,
+                  psk.len > 0 ? tkt.expiry : 0);
+
         log_info_id(id, "OAP request processed for %s.", info->name);
 
+        if (psk.len > 0)
+                tkt_clear(&tkt);
+
         crypt_free_crt(crt);
         crypt_free_key(pkp);
 
@@ -486,12 +537,16 @@ int oap_srv_process(const struct name_info * info,
  fail_data:
         oap_hdr_fini(&local_hdr);
  fail_auth:
+        if (psk.len > 0)
+                tkt_clear(&tkt);
         crypt_free_crt(crt);
         crypt_free_key(pkp);
  fail_cred:
         return -EAUTH;
 
  fail_kex:
+        if (psk.len > 0)
+                tkt_clear(&tkt);
         crypt_free_crt(crt);
         crypt_free_key(pkp);
         return -ECRYPT;
@@ -20,6 +20,7 @@
  * Foundation, Inc., http://www.fsf.org/about/contact/.
  */
 
+#include "config.h"
 #include "common.h"
 
 #include <ouroboros/crypt.h>
@@ -111,6 +112,16 @@ int oap_test_setup(struct oap_test_ctx * ctx,
                 goto fail_init;
         }
 
+        if (oap_pool_init() < 0) {
+                printf("Failed to init OAP key pool.\n");
+                goto fail_pool;
+        }
+
+        if (oap_ticket_init(OAP_TICKET_LIFETIME) < 0) {
+                printf("Failed to init OAP tickets.\n");
+                goto fail_ticket;
+        }
+
         if (crypt_load_crt_str(root_ca_str, &ctx->root_ca) < 0) {
                 printf("Failed to load root CA cert.\n");
                 goto fail_root_ca;
@@ -138,6 +149,10 @@ int oap_test_setup(struct oap_test_ctx * ctx,
  fail_im_ca:
         crypt_free_crt(ctx->root_ca);
  fail_root_ca:
+        oap_ticket_fini();
+ fail_ticket:
+        oap_pool_fini();
+ fail_pool:
         oap_auth_fini();
  fail_init:
         memset(ctx, 0, sizeof(*ctx));
@@ -163,6 +178,8 @@ void oap_test_teardown(struct oap_test_ctx * ctx)
         crypt_free_crt(ctx->im_ca);
         crypt_free_crt(ctx->root_ca);
 
+        oap_ticket_fini();
+        oap_pool_fini();
         oap_auth_fini();
         memset(ctx, 0, sizeof(*ctx));
 }
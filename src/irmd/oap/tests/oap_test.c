@@ -41,9 +41,14 @@
 #include <test/certs/ecdsa.h>
 
 #include "oap.h"
+#include "oap/auth.h"
+#include "oap/hdr.h"
+#include "oap/io.h"
+#include "oap/pool.h"
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 #ifdef HAVE_OPENSSL
@@ -53,6 +58,9 @@
 #define AUTH    true
 #define NO_AUTH false
 
+#define IO_LOADS 1000 /* Credential loads in the rate test */
+#define POOL_PKPS (3 * OAP_KEY_POOL + 1)
+
 extern const uint16_t kex_supported_nids[];
 extern const uint16_t md_supported_nids[];
 
@@ -132,6 +140,307 @@ static int test_oap_auth_init_fini(void)
         return TEST_RC_FAIL;
 }
 
+static int write_tmp(char *       path,
+                     const char * str)
+{
+        FILE * fp;
+        int    fd;
+
+        if (path[0] == '\0') {
+                strcpy(path, "/tmp/oap_test_XXXXXX");
+                fd = mkstemp(path);
+                if (fd < 0)
+                        return -1;
+                close(fd);
+        }
+
+        fp = fopen(path, "w");
+        if (fp == NULL)
+                return -1;
+
+        fputs(str, fp);
+
+        return fclose(fp) == 0 ? 0 : -1;
+}
+
+static int test_oap_io_cache(void)
+{
+        char   crt_path[32] = "";
+        char   key_path[32] = "";
+        void * crt1 = NULL;
+        void * crt2 = NULL;
+        void * crt3 = NULL;
+        void * key1 = NULL;
+        void * key2 = NULL;
+
+        TEST_START();
+
+        if (oap_io_init() < 0) {
+                printf("Failed to init credential cache.\n");
+                goto fail_init;
+        }
+
+        if (write_tmp(crt_path, signed_server_crt_ec) < 0 ||
+            write_tmp(key_path, server_pkp_ec) < 0) {
+                printf("Failed to write credential files.\n");
+                goto fail;
+        }
+
+        if (io_load_obj(crt_path, IO_CRT, &crt1) < 0 ||
+            io_load_obj(crt_path, IO_CRT, &crt2) < 0) {
+                printf("Failed to load crt.\n");
+                goto fail;
+        }
+
+        if (crt1 != crt2) {
+                printf("Unchanged crt was parsed again.\n");
+                goto fail;
+        }
+
+        if (io_load_obj(key_path, IO_KEY, &key1) < 0 ||
+            io_load_obj(key_path, IO_KEY, &key2) < 0) {
+                printf("Failed to load key.\n");
+                goto fail;
+        }
+
+        if (key1 != key2) {
+                printf("Unchanged key was parsed again.\n");
+                goto fail;
+        }
+
+        if (write_tmp(crt_path, root_ca_crt_ec) < 0) {
+                printf("Failed to replace crt file.\n");
+                goto fail;
+        }
+
+        if (io_load_obj(crt_path, IO_CRT, &crt3) < 0) {
+                printf("Failed to load replaced crt.\n");
+                goto fail;
+        }
+
+        if (crt3 == crt1) {
+                printf("Replaced crt not reloaded.\n");
+                goto fail;
+        }
+
+        unlink(crt_path);
+        crypt_free_crt(crt3);
+        crt3 = NULL;
+
+        if (io_load_obj(crt_path, IO_CRT, &crt3) == 0) {
+                printf("Loaded crt from a removed file.\n");
+                goto fail;
+        }
+
+        unlink(key_path);
+
+        crypt_free_key(key2);
+        crypt_free_key(key1);
+        crypt_free_crt(crt2);
+        crypt_free_crt(crt1);
+
+        oap_io_fini();
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail:
+        crypt_free_crt(crt3);
+        crypt_free_key(key2);
+        crypt_free_key(key1);
+        crypt_free_crt(crt2);
+        crypt_free_crt(crt1);
+        unlink(key_path);
+        unlink(crt_path);
+        oap_io_fini();
+ fail_init:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+static int load_creds(const char * crt_path,
+                      const char * key_path,
+                      bool         cached)
+{
+        void * crt;
+        void * key;
+        int    ret;
+
+        if (cached)
+                ret = io_load_obj(crt_path, IO_CRT, &crt);
+        else
+                ret = crypt_load_crt_file(crt_path, &crt);
+        if (ret < 0)
+                return -1;
+
+        if (cached)
+                ret = io_load_obj(key_path, IO_KEY, &key);
+        else
+                ret = crypt_load_privkey_file(key_path, &key);
+
+        crypt_free_crt(crt);
+
+        if (ret < 0)
+                return -1;
+
+        crypt_free_key(key);
+
+        return 0;
+}
+
+static int test_oap_io_cache_rate(void)
+{
+        char            crt_path[32] = "";
+        char            key_path[32] = "";
+        struct timespec t0;
+        struct timespec t1;
+        struct timespec t2;
+        size_t          i;
+        size_t          parsed;
+        size_t          cached;
+
+        TEST_START();
+
+        if (oap_io_init() < 0) {
+                printf("Failed to init credential cache.\n");
+                goto fail_init;
+        }
+
+        if (write_tmp(crt_path, signed_server_crt_ec) < 0 ||
+            write_tmp(key_path, server_pkp_ec) < 0) {
+                printf("Failed to write credential files.\n");
+                goto fail;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
+        for (i = 0; i < IO_LOADS; ++i)
+                if (load_creds(crt_path, key_path, false) < 0)
+                        goto fail_load;
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        for (i = 0; i < IO_LOADS; ++i)
+                if (load_creds(crt_path, key_path, true) < 0)
+                        goto fail_load;
+
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+
+        parsed = (size_t) ts_diff_us(&t1, &t0) + 1;
+        cached = (size_t) ts_diff_us(&t2, &t1) + 1;
+
+        printf("Credential loads/s: %zu parsed, %zu cached.\n",
+               (size_t) (IO_LOADS * MILLION / parsed),
+               (size_t) (IO_LOADS * MILLION / cached));
+
+        if (cached >= parsed) {
+                printf("Cached loads not faster than parsing.\n");
+                goto fail;
+        }
+
+        unlink(key_path);
+        unlink(crt_path);
+
+        oap_io_fini();
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_load:
+        printf("Failed to load credentials.\n");
+ fail:
+        unlink(key_path);
+        unlink(crt_path);
+        oap_io_fini();
+ fail_init:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+static int test_oap_key_pool(void)
+{
+        struct timespec   wait = TIMESPEC_INIT_MS(100);
+        struct sec_config cfg;
+        void *            pkp[POOL_PKPS];
+        uint8_t           pk[POOL_PKPS][MSGBUFSZ];
+        size_t            len[POOL_PKPS];
+        uint8_t           s1[SYMMKEYSZ];
+        uint8_t           s2[SYMMKEYSZ];
+        buffer_t          buf;
+        size_t            n;
+        size_t            i;
+        size_t            j;
+        int               ret;
+
+        TEST_START();
+
+        memset(&cfg, 0, sizeof(cfg));
+        SET_KEX_ALGO_NID(&cfg, NID_X25519);
+        SET_KEX_KDF_NID(&cfg, NID_sha256);
+
+        if (oap_pool_init() < 0) {
+                printf("Failed to init key pool.\n");
+                goto fail_init;
+        }
+
+        for (n = 0; n < POOL_PKPS; ++n) {
+                pkp[n] = NULL;
+                ret = pool_pkp_take(&cfg, &pkp[n], pk[n]);
+                if (ret <= 0) {
+                        printf("Failed to take key pair %zu.\n", n);
+                        goto fail;
+                }
+                len[n] = (size_t) ret;
+                if (n % (OAP_KEY_POOL + 1) == 0)
+                        nanosleep(&wait, NULL); /* Let the pool refill */
+        }
+
+        for (i = 0; i < n; ++i) {
+                for (j = i + 1; j < n; ++j) {
+                        if (len[i] == len[j] &&
+                            memcmp(pk[i], pk[j], len[i]) == 0) {
+                                printf("Key pairs %zu and %zu equal.\n",
+                                       i, j);
+                                goto fail;
+                        }
+                }
+        }
+
+        /* Each private key matches the public key handed out with it */
+        for (i = 0; i + 1 < n; ++i) {
+                buf.data = pk[i + 1];
+                buf.len  = len[i + 1];
+                if (kex_dhe_derive(&cfg, pkp[i], buf, s1) < 0)
+                        goto fail_derive;
+                buf.data = pk[i];
+                buf.len  = len[i];
+                if (kex_dhe_derive(&cfg, pkp[i + 1], buf, s2) < 0)
+                        goto fail_derive;
+                if (memcmp(s1, s2, SYMMKEYSZ) != 0) {
+                        printf("Key pair %zu does not match its pk.\n", i);
+                        goto fail;
+                }
+        }
+
+        while (n > 0)
+                kex_pkp_destroy(pkp[--n]);
+
+        oap_pool_fini();
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_derive:
+        printf("Failed to derive secret.\n");
+ fail:
+        while (n > 0)
+                kex_pkp_destroy(pkp[--n]);
+        oap_pool_fini();
+ fail_init:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
 static int test_oap_roundtrip(int kex)
 {
         struct oap_test_ctx ctx;
@@ -366,6 +675,49 @@ static int test_oap_inflated_length_field(void)
 }
 
 /* Attacker claims cert is smaller - causes misparse of subsequent fields */
+static int test_oap_kex_len_overflow(void)
+{
+        struct oap_hdr    hdr;
+        struct sec_config kcfg;
+        uint8_t           id[OAP_ID_SIZE];
+        uint8_t *         kex;
+        buffer_t          idb = { OAP_ID_SIZE, id };
+
+        TEST_START();
+
+        kex = calloc(1, OAP_KEX_LEN_MASK + 1);
+        if (kex == NULL) {
+                printf("Failed to allocate key share.\n");
+                goto fail;
+        }
+
+        memset(id, 0, sizeof(id));
+        memset(&kcfg, 0, sizeof(kcfg));
+
+        oap_hdr_init(&hdr, idb, kex, (buffer_t) BUF_INIT, NID_undef);
+
+        /* One byte more would set the resumption bit */
+        hdr.kex.len = OAP_KEX_LEN_MASK + 1;
+
+        if (oap_hdr_encode(&hdr, NULL, NULL, &kcfg, (buffer_t) BUF_INIT,
+                           NID_undef, (buffer_t) BUF_INIT) != -EINVAL) {
+                printf("Encoded a key share of %zu bytes.\n", hdr.kex.len);
+                oap_hdr_fini(&hdr);
+                goto fail_kex;
+        }
+
+        free(kex);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+
+ fail_kex:
+        free(kex);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
 static int test_oap_deflated_length_field(void)
 {
         struct oap_test_ctx ctx;
@@ -1114,43 +1466,656 @@ static int test_oap_server_name_mismatch(void)
         return TEST_RC_FAIL;
 }
 
-int oap_test(int    argc,
-             char **argv)
+/* Runs a handshake on ctx, dropping the buffers of the previous one */
+static int handshake(struct oap_test_ctx * ctx,
+                     bool *                resumed)
 {
-        int ret = 0;
+        uint16_t kex_len;
 
-        (void) argc;
-        (void) argv;
+        freebuf(ctx->req_hdr);
+        freebuf(ctx->resp_hdr);
+        freebuf(ctx->data);
 
-        ret |= test_oap_auth_init_fini();
+        if (oap_cli_prepare_ctx(ctx) < 0) {
+                printf("Client prepare failed.\n");
+                return -1;
+        }
 
-#ifdef HAVE_OPENSSL
-        ret |= test_oap_roundtrip_auth_only();
-        ret |= test_oap_roundtrip_kex_only();
-        ret |= test_oap_piggyback_data();
+        if (oap_srv_process_ctx(ctx) < 0) {
+                printf("Server process failed.\n");
+                return -1;
+        }
 
-        ret |= test_oap_roundtrip_all();
-        ret |= test_oap_roundtrip_md_all();
+        if (oap_cli_complete_ctx(ctx) < 0) {
+                printf("Client complete failed.\n");
+                return -1;
+        }
 
-        ret |= test_oap_corrupted_request();
-        ret |= test_oap_corrupted_response();
-        ret |= test_oap_truncated_request();
-        ret |= test_oap_inflated_length_field();
-        ret |= test_oap_deflated_length_field();
-        ret |= test_oap_nid_without_kex();
-        ret |= test_oap_unsupported_nid();
+        if (memcmp(ctx->cli.key, ctx->srv.key, SYMMKEYSZ) != 0) {
+                printf("Client and server keys do not match.\n");
+                return -1;
+        }
 
-        ret |= test_oap_cipher_mismatch();
-        ret |= test_oap_srv_enc_cli_none();
-        ret |= test_oap_cli_enc_srv_none();
-        ret |= test_oap_cli_rejects_downgrade();
-        ret |= test_oap_srv_rejects_weak_kex();
+        memcpy(&kex_len, ctx->resp_hdr.data + OAP_KEX_LEN_OFFSET,
+               sizeof(kex_len));
+        *resumed = (ntoh16(kex_len) & OAP_KEX_PSK_BIT) != 0;
 
-        ret |= test_oap_outdated_packet();
-        ret |= test_oap_future_packet();
-        ret |= test_oap_replay_packet();
-        ret |= test_oap_server_name_mismatch();
+        return 0;
+}
+
+static int test_oap_resume(void)
+{
+        struct oap_test_ctx ctx;
+        uint8_t             key[SYMMKEYSZ];
+        bool                resumed;
+        int                 i;
+
+        test_default_cfg();
+
+        TEST_START();
+
+        if (oap_test_setup(&ctx, root_ca_crt_ec, im_ca_crt_ec) < 0)
+                goto fail;
+
+        if (handshake(&ctx, &resumed) < 0)
+                goto fail_cleanup;
+
+        if (resumed) {
+                printf("First handshake resumed.\n");
+                goto fail_cleanup;
+        }
+
+        /* Each resumption hands out the ticket for the next one */
+        for (i = 0; i < 3; ++i) {
+                memcpy(key, ctx.cli.key, SYMMKEYSZ);
+
+                if (handshake(&ctx, &resumed) < 0)
+                        goto fail_cleanup;
+
+                if (!resumed) {
+                        printf("Handshake %d not resumed.\n", i + 2);
+                        goto fail_cleanup;
+                }
+
+                if (ctx.cli.nid == NID_undef || ctx.srv.nid != ctx.cli.nid) {
+                        printf("Cipher not set in resumed flow.\n");
+                        goto fail_cleanup;
+                }
+
+                if (memcmp(key, ctx.cli.key, SYMMKEYSZ) == 0) {
+                        printf("Resumed flow reuses the session key.\n");
+                        goto fail_cleanup;
+                }
+        }
+
+        oap_test_teardown(&ctx);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+
+ fail_cleanup:
+        oap_test_teardown(&ctx);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+static int test_oap_resume_expired(void)
+{
+        struct oap_test_ctx ctx;
+        struct timespec     wait = TIMESPEC_INIT_MS(1100);
+        bool                resumed;
+
+        test_default_cfg();
+
+        TEST_START();
+
+        if (oap_test_setup(&ctx, root_ca_crt_ec, im_ca_crt_ec) < 0)
+                goto fail;
+
+        oap_ticket_fini();
+
+        if (oap_ticket_init(1) < 0) {
+                printf("Failed to init tickets.\n");
+                goto fail_init;
+        }
+
+        if (handshake(&ctx, &resumed) < 0)
+                goto fail_cleanup;
+
+        nanosleep(&wait, NULL);
+
+        if (handshake(&ctx, &resumed) < 0)
+                goto fail_cleanup;
+
+        if (resumed) {
+                printf("Resumed with an expired ticket.\n");
+                goto fail_cleanup;
+        }
+
+        oap_test_teardown(&ctx);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+
+ fail_init:
+        oap_ticket_init(OAP_TICKET_LIFETIME);
+ fail_cleanup:
+        oap_test_teardown(&ctx);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+static int test_oap_resume_unknown_ticket(void)
+{
+        struct oap_test_ctx ctx;
+        bool                resumed;
+
+        test_default_cfg();
+
+        TEST_START();
+
+        if (oap_test_setup(&ctx, root_ca_crt_ec, im_ca_crt_ec) < 0)
+                goto fail;
+
+        if (handshake(&ctx, &resumed) < 0)
+                goto fail_cleanup;
+
+        /* The server does not honour a ticket issued for another name */
+        strcpy(ctx.srv.info.name, "other.server.name");
+
+        if (handshake(&ctx, &resumed) < 0)
+                goto fail_cleanup;
+
+        if (resumed) {
+                printf("Resumed with a ticket for another name.\n");
+                goto fail_cleanup;
+        }
+
+        oap_test_teardown(&ctx);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+
+ fail_cleanup:
+        oap_test_teardown(&ctx);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+/* A request with a forged binder leaves the ticket to its holder */
+static int test_oap_resume_bad_binder(void)
+{
+        struct oap_test_ctx ctx;
+        buffer_t            good;
+        buffer_t            forged;
+        uint16_t            kex_len;
+        bool                resumed;
+
+        test_default_cfg();
+
+        TEST_START();
+
+        if (oap_test_setup(&ctx, root_ca_crt_ec, im_ca_crt_ec) < 0)
+                goto fail;
+
+        if (handshake(&ctx, &resumed) < 0)
+                goto fail_cleanup;
+
+        freebuf(ctx.req_hdr);
+        freebuf(ctx.resp_hdr);
+        freebuf(ctx.data);
+
+        if (oap_cli_prepare_ctx(&ctx) < 0) {
+                printf("Client prepare failed.\n");
+                goto fail_cleanup;
+        }
+
+        good = ctx.req_hdr;
+
+        forged.len  = good.len;
+        forged.data = malloc(good.len);
+        if (forged.data == NULL) {
+                printf("Failed to copy request.\n");
+                goto fail_cleanup;
+        }
+
+        /* The id is under the binder */
+        memcpy(forged.data, good.data, good.len);
+        forged.data[0] ^= 0x01;
+
+        ctx.req_hdr = forged;
+
+        oap_srv_process_ctx(&ctx);
+
+        ctx.req_hdr = good;
+
+        freebuf(forged);
+        freebuf(ctx.resp_hdr);
+        freebuf(ctx.data);
+
+        if (oap_srv_process_ctx(&ctx) < 0) {
+                printf("Server process failed.\n");
+                goto fail_cleanup;
+        }
+
+        memcpy(&kex_len, ctx.resp_hdr.data + OAP_KEX_LEN_OFFSET,
+               sizeof(kex_len));
+        if (!(ntoh16(kex_len) & OAP_KEX_PSK_BIT)) {
+                printf("Forged binder used up the ticket.\n");
+                goto fail_cleanup;
+        }
+
+        if (oap_cli_complete_ctx(&ctx) < 0) {
+                printf("Client complete failed.\n");
+                goto fail_cleanup;
+        }
+
+        if (memcmp(ctx.cli.key, ctx.srv.key, SYMMKEYSZ) != 0) {
+                printf("Client and server keys do not match.\n");
+                goto fail_cleanup;
+        }
+
+        oap_test_teardown(&ctx);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+
+ fail_cleanup:
+        oap_test_teardown(&ctx);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+/* Both sides authenticate with the same crt, without resumption. */
+static int crt_cache_setup(struct oap_test_ctx * ctx)
+{
+        bool resumed;
+
+        test_default_cfg();
+        test_cfg.cli.auth = AUTH;
+
+        if (oap_test_setup(ctx, root_ca_crt_ec, im_ca_crt_ec) < 0)
+                goto fail;
+
+        /* Full authentication on every handshake */
+        oap_ticket_fini();
+
+        if (oap_ticket_init(0) < 0) {
+                printf("Failed to init tickets.\n");
+                oap_ticket_init(OAP_TICKET_LIFETIME);
+                goto fail_cleanup;
+        }
+
+        /* The server verifies the crt, the client finds it cached */
+        if (handshake(ctx, &resumed) < 0)
+                goto fail_cleanup;
+
+        return 0;
+
+ fail_cleanup:
+        oap_test_teardown(ctx);
+ fail:
+        return -1;
+}
+
+static int crt_cache_fill(size_t n)
+{
+        uint8_t fp[OAP_CRT_FP_SIZE];
+
+        while (n-- > 0) {
+                if (random_buffer(fp, sizeof(fp)) < 0)
+                        return -1;
+                oap_auth_crt_add(fp);
+        }
+
+        return 0;
+}
+
+static int test_oap_crt_cache(void)
+{
+        struct oap_test_ctx ctx;
+        bool                resumed;
+        size_t              len;
+        size_t              hits;
+        size_t              verifs;
+        size_t              n;
+        int                 i;
+
+        TEST_START();
+
+        if (crt_cache_setup(&ctx) < 0)
+                goto fail;
+
+        oap_auth_crt_stats(&len, &hits, &verifs);
+        if (len != 1 || hits != 1 || verifs != 1) {
+                printf("Cache %zu, %zu hits, %zu verified.\n",
+                       len, hits, verifs);
+                goto fail_cleanup;
+        }
+
+        for (i = 0; i < 3; ++i) {
+                if (handshake(&ctx, &resumed) < 0)
+                        goto fail_cleanup;
+        }
+
+        n = hits;
+
+        oap_auth_crt_stats(&len, &hits, &verifs);
+        if (verifs != 1 || hits != n + 6) {
+                printf("Repeat handshakes verified %zu chains, %zu hits.\n",
+                       verifs - 1, hits - n);
+                goto fail_cleanup;
+        }
+
+        freebuf(ctx.req_hdr);
+        freebuf(ctx.resp_hdr);
+        freebuf(ctx.data);
+
+        if (oap_cli_prepare_ctx(&ctx) < 0) {
+                printf("Client prepare failed.\n");
+                goto fail_cleanup;
+        }
+
+        if (oap_srv_process_ctx(&ctx) < 0) {
+                printf("Server process failed.\n");
+                goto fail_cleanup;
+        }
+
+        /* A known crt does not exempt the signature */
+        ctx.resp_hdr.data[ctx.resp_hdr.len - 1] ^= 0xFF;
+
+        if (oap_cli_complete_ctx(&ctx) == 0) {
+                printf("Client accepted a bad signature.\n");
+                goto fail_cleanup;
+        }
+
+        oap_test_teardown(&ctx);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+
+ fail_cleanup:
+        oap_test_teardown(&ctx);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+static int test_oap_crt_cache_flush(void)
+{
+        struct oap_test_ctx ctx;
+        bool                resumed;
+        void *              ca;
+        size_t              len;
+        size_t              hits;
+        size_t              verifs;
+
+        TEST_START();
+
+        if (crypt_load_crt_str(other_ca_crt_ec, &ca) < 0) {
+                printf("Failed to load CA crt.\n");
+                goto fail;
+        }
+
+        if (crt_cache_setup(&ctx) < 0)
+                goto fail_ca;
+
+        if (oap_auth_add_ca_crt(ca) < 0) {
+                printf("Failed to add CA crt.\n");
+                goto fail_cleanup;
+        }
+
+        oap_auth_crt_stats(&len, &hits, &verifs);
+        if (len != 0) {
+                printf("%zu crts cached after a CA change.\n", len);
+                goto fail_cleanup;
+        }
+
+        if (handshake(&ctx, &resumed) < 0)
+                goto fail_cleanup;
+
+        oap_auth_crt_stats(&len, &hits, &verifs);
+        if (len != 1 || verifs != 2) {
+                printf("Cache %zu, %zu verified.\n", len, verifs);
+                goto fail_cleanup;
+        }
+
+        oap_test_teardown(&ctx);
+        crypt_free_crt(ca);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+
+ fail_cleanup:
+        oap_test_teardown(&ctx);
+ fail_ca:
+        crypt_free_crt(ca);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+#define CRT_CENTURY ((time_t) 100 * 365 * 24 * 3600)
+
+static int test_oap_crt_cache_expiry(void)
+{
+        struct oap_test_ctx ctx;
+        bool                resumed;
+        size_t              len;
+        size_t              hits;
+        size_t              verifs;
+
+        TEST_START();
+
+        if (crt_cache_setup(&ctx) < 0)
+                goto fail;
+
+        /* An hour on, the test chain is still valid */
+        oap_auth_crt_skew(3600);
+
+        if (handshake(&ctx, &resumed) < 0)
+                goto fail_cleanup;
+
+        oap_auth_crt_stats(&len, &hits, &verifs);
+        if (len != 1 || verifs != 1) {
+                printf("Cache %zu, %zu verified.\n", len, verifs);
+                goto fail_cleanup;
+        }
+
+        /* Past the chain expiry, verified on both sides, not cached */
+        oap_auth_crt_skew(CRT_CENTURY);
+
+        if (handshake(&ctx, &resumed) < 0)
+                goto fail_cleanup;
+
+        oap_auth_crt_stats(&len, &hits, &verifs);
+        if (len != 0 || verifs != 3) {
+                printf("Expired: cache %zu, %zu verified.\n", len, verifs);
+                goto fail_cleanup;
+        }
+
+        oap_auth_crt_skew(0);
+        oap_test_teardown(&ctx);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+
+ fail_cleanup:
+        oap_auth_crt_skew(0);
+        oap_test_teardown(&ctx);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+static int test_oap_crt_cache_lru(void)
+{
+        struct oap_test_ctx ctx;
+        bool                resumed;
+        size_t              len;
+        size_t              hits;
+        size_t              verifs;
+
+        TEST_START();
+
+        if (crt_cache_setup(&ctx) < 0)
+                goto fail;
+
+        if (crt_cache_fill(OAP_CRT_CACHE) < 0) {
+                printf("Failed to fill the cache.\n");
+                goto fail_cleanup;
+        }
+
+        /* The peer crt was least recent, it made room */
+        oap_auth_crt_stats(&len, &hits, &verifs);
+        if (len != OAP_CRT_CACHE) {
+                printf("Cache %zu, bound %d.\n", len, OAP_CRT_CACHE);
+                goto fail_cleanup;
+        }
+
+        if (handshake(&ctx, &resumed) < 0)
+                goto fail_cleanup;
+
+        oap_auth_crt_stats(&len, &hits, &verifs);
+        if (len != OAP_CRT_CACHE || verifs != 2) {
+                printf("Evicted: cache %zu, %zu verified.\n", len, verifs);
+                goto fail_cleanup;
+        }
+
+        /* In use, it stays while the least recent make room */
+        if (crt_cache_fill(OAP_CRT_CACHE - 1) < 0) {
+                printf("Failed to fill the cache.\n");
+                goto fail_cleanup;
+        }
+
+        if (handshake(&ctx, &resumed) < 0)
+                goto fail_cleanup;
+
+        oap_auth_crt_stats(&len, &hits, &verifs);
+        if (len != OAP_CRT_CACHE || verifs != 2) {
+                printf("Recent: cache %zu, %zu verified.\n", len, verifs);
+                goto fail_cleanup;
+        }
+
+        oap_test_teardown(&ctx);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+
+ fail_cleanup:
+        oap_test_teardown(&ctx);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+/* Two misses on the same crt race to add it. */
+static int test_oap_crt_cache_dup(void)
+{
+        struct oap_test_ctx ctx;
+        uint8_t             fp[OAP_CRT_FP_SIZE];
+        size_t              len;
+        size_t              hits;
+        size_t              verifs;
+
+        TEST_START();
+
+        if (crt_cache_setup(&ctx) < 0)
+                goto fail;
+
+        if (random_buffer(fp, sizeof(fp)) < 0) {
+                printf("Failed to generate fingerprint.\n");
+                goto fail_cleanup;
+        }
+
+        oap_auth_crt_add(fp);
+        oap_auth_crt_add(fp);
+
+        oap_auth_crt_stats(&len, &hits, &verifs);
+        if (len != 2) {
+                printf("Cache %zu after adding one crt twice.\n", len);
+                goto fail_cleanup;
+        }
+
+        oap_test_teardown(&ctx);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+
+ fail_cleanup:
+        oap_test_teardown(&ctx);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+int oap_test(int    argc,
+             char **argv)
+{
+        int ret = 0;
+
+        (void) argc;
+        (void) argv;
+
+        ret |= test_oap_auth_init_fini();
+
+#ifdef HAVE_OPENSSL
+        ret |= test_oap_io_cache();
+        ret |= test_oap_io_cache_rate();
+        ret |= test_oap_key_pool();
+
+        ret |= test_oap_roundtrip_auth_only();
+        ret |= test_oap_roundtrip_kex_only();
+        ret |= test_oap_piggyback_data();
+
+        ret |= test_oap_roundtrip_all();
+        ret |= test_oap_roundtrip_md_all();
+
+        ret |= test_oap_corrupted_request();
+        ret |= test_oap_corrupted_response();
+        ret |= test_oap_truncated_request();
+        ret |= test_oap_inflated_length_field();
+        ret |= test_oap_deflated_length_field();
+        ret |= test_oap_kex_len_overflow();
+        ret |= test_oap_nid_without_kex();
+        ret |= test_oap_unsupported_nid();
+
+        ret |= test_oap_cipher_mismatch();
+        ret |= test_oap_srv_enc_cli_none();
+        ret |= test_oap_cli_enc_srv_none();
+        ret |= test_oap_cli_rejects_downgrade();
+        ret |= test_oap_srv_rejects_weak_kex();
+
+        ret |= test_oap_outdated_packet();
+        ret |= test_oap_future_packet();
+        ret |= test_oap_replay_packet();
+        ret |= test_oap_server_name_mismatch();
+#if OAP_CRT_CACHE > 0
+        ret |= test_oap_crt_cache();
+        ret |= test_oap_crt_cache_flush();
+        ret |= test_oap_crt_cache_expiry();
+        ret |= test_oap_crt_cache_lru();
+        ret |= test_oap_crt_cache_dup();
+#else
+        (void) test_oap_crt_cache;
+        (void) test_oap_crt_cache_flush;
+        (void) test_oap_crt_cache_expiry;
+        (void) test_oap_crt_cache_lru;
+        (void) test_oap_crt_cache_dup;
+#endif
+
+        ret |= test_oap_resume();
+        ret |= test_oap_resume_expired();
+        ret |= test_oap_resume_unknown_ticket();
+        ret |= test_oap_resume_bad_binder();
 #else
+        (void) test_oap_io_cache;
+        (void) test_oap_io_cache_rate;
+        (void) test_oap_key_pool;
         (void) test_oap_roundtrip_auth_only;
         (void) test_oap_roundtrip_kex_only;
         (void) test_oap_piggyback_data;
@@ -1163,6 +2128,7 @@ int oap_test(int    argc,
         (void) test_oap_truncated_request;
         (void) test_oap_inflated_length_field;
         (void) test_oap_deflated_length_field;
+        (void) test_oap_kex_len_overflow;
         (void) test_oap_nid_without_kex;
         (void) test_oap_unsupported_nid;
         (void) test_oap_cipher_mismatch;
@@ -1174,6 +2140,15 @@ int oap_test(int    argc,
         (void) test_oap_future_packet;
         (void) test_oap_replay_packet;
         (void) test_oap_server_name_mismatch;
+        (void) test_oap_crt_cache;
+        (void) test_oap_crt_cache_flush;
+        (void) test_oap_crt_cache_expiry;
+        (void) test_oap_crt_cache_lru;
+        (void) test_oap_crt_cache_dup;
+        (void) test_oap_resume;
+        (void) test_oap_resume_expired;
+        (void) test_oap_resume_unknown_ticket;
+        (void) test_oap_resume_bad_binder;
 
         ret = TEST_RC_SKIP;
 #endif
@@ -0,0 +1,349 @@
+/*
+ * Ouroboros - Copyright (C) 2016 - 2026
+ *
+ * OAP - Session resumption tickets
+ *
+ *    Dimitri Staessens <dimitri@ouroboros.rocks>
+ *    Sander Vrijders   <sander@ouroboros.rocks>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., http://www.fsf.org/about/contact/.
+ */
+
+#if defined(__linux__) || defined(__CYGWIN__)
+ #define _DEFAULT_SOURCE
+#else
+ #define _POSIX_C_SOURCE 200809L
+#endif
+
+#define OUROBOROS_PREFIX "irmd/oap"
+
+#include <ouroboros/crypt.h>
+#include <ouroboros/errno.h>
+#include <ouroboros/list.h>
+#include <ouroboros/logs.h>
+#include <ouroboros/pthread.h>
+#include <ouroboros/time.h>
+
+#include "config.h"
+
+#include "ticket.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TKT_INFO_ID  "o7s-oap-ticket"
+#define TKT_INFO_PSK "o7s-oap-resume"
+#define TKT_INFO_KEY "o7s-oap-psk"
+
+struct tkt_entry {
+        struct list_head next;
+        bool             srv;
+        struct oap_tkt   tkt;
+};
+
+static struct {
+        struct list_head list;
+        size_t           len;
+        uint64_t         lifetime; /* ns, 0: no resumption */
+        pthread_mutex_t  mtx;
+} oap_tkt;
+
+int oap_ticket_init(uint32_t lifetime)
+{
+        list_head_init(&oap_tkt.list);
+
+        oap_tkt.len      = 0;
+        oap_tkt.lifetime = (uint64_t) lifetime * BILLION;
+
+        if (pthread_mutex_init(&oap_tkt.mtx, NULL)) {
+                log_err("Failed to init OAP ticket mutex.");
+                return -1;
+        }
+
+        return 0;
+}
+
+static void tkt_entry_destroy(struct tkt_entry * e)
+{
+        list_del(&e->next);
+        --oap_tkt.len;
+        tkt_clear(&e->tkt);
+        free(e);
+}
+
+void oap_ticket_fini(void)
+{
+        struct list_head * p;
+        struct list_head * h;
+
+        pthread_mutex_lock(&oap_tkt.mtx);
+
+        list_for_each_safe(p, h, &oap_tkt.list)
+                tkt_entry_destroy(list_entry(p, struct tkt_entry, next));
+
+        pthread_mutex_unlock(&oap_tkt.mtx);
+        pthread_mutex_destroy(&oap_tkt.mtx);
+}
+
+static uint64_t tkt_now(void)
+{
+        struct timespec now;
+
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        return TS_TO_UINT64(now);
+}
+
+void tkt_clear(struct oap_tkt * tkt)
+{
+        crypt_secure_clear(tkt, sizeof(*tkt));
+}
+
+void tkt_issue(bool                    srv,
+               const char *            name,
+               const struct crypt_sk * sk,
+               int                     kdf,
+               buffer_t                id,
+               uint64_t                expiry)
+{
+        struct tkt_entry * e;
+        buffer_t           secret;
+        buffer_t           out;
+        uint64_t           now;
+
+        assert(name != NULL && strlen(name) <= NAME_SIZE);
+        assert(sk != NULL);
+
+        if (oap_tkt.lifetime == 0 || sk->nid == NID_undef)
+                return;
+
+        now = tkt_now();
+        if (expiry == 0)
+                expiry = now + oap_tkt.lifetime;
+
+        if (expiry <= now)
+                return;
+
+        e = malloc(sizeof(*e));
+        if (e == NULL)
+                goto fail_malloc;
+
+        memset(e, 0, sizeof(*e));
+
+        secret.data = sk->key;
+        secret.len  = SYMMKEYSZ;
+
+        out.data = e->tkt.id;
+        out.len  = OAP_TKT_ID_SIZE;
+        if (md_hkdf(kdf, secret, id, TKT_INFO_ID, out) < 0)
+                goto fail_derive;
+
+        out.data = e->tkt.psk;
+        out.len  = SYMMKEYSZ;
+        if (md_hkdf(kdf, secret, id, TKT_INFO_PSK, out) < 0)
+                goto fail_derive;
+
+        strcpy(e->tkt.name, name);
+        e->tkt.nid    = sk->nid;
+        e->tkt.kdf    = kdf;
+        e->tkt.expiry = expiry;
+        e->srv        = srv;
+
+        pthread_mutex_lock(&oap_tkt.mtx);
+
+        if (oap_tkt.len >= OAP_TICKETS) /* Drop the oldest */
+                tkt_entry_destroy(list_first_entry(&oap_tkt.list,
+                                                   struct tkt_entry, next));
+
+        list_add_tail(&e->next, &oap_tkt.list);
+        ++oap_tkt.len;
+
+        pthread_mutex_unlock(&oap_tkt.mtx);
+
+        return;
+
+ fail_derive:
+        tkt_clear(&e->tkt);
+        free(e);
+ fail_malloc:
+        log_warn("Failed to issue resumption ticket for %s.", name);
+}
+
+/* Not weaker than what is configured now */
+static bool tkt_is_acceptable(const struct oap_tkt *    tkt,
+                              const struct sec_config * kcfg)
+{
+        if (!IS_KEX_ALGO_SET(kcfg))
+                return false;
+
+        if (crypt_cipher_rank(tkt->nid) < crypt_cipher_rank(kcfg->c.nid))
+                return false;
+
+        return crypt_kdf_rank(tkt->kdf) >= crypt_kdf_rank(kcfg->k.nid);
+}
+
+/* By id on the server, by server name on the client */
+static struct tkt_entry * tkt_get(bool            srv,
+                                  const char *    name,
+                                  const uint8_t * id)
+{
+        struct list_head * p;
+        struct list_head * h;
+        uint64_t           now;
+
+        now = tkt_now();
+
+        list_for_each_safe(p, h, &oap_tkt.list) {
+                struct tkt_entry * e;
+                e = list_entry(p, struct tkt_entry, next);
+                if (e->tkt.expiry <= now) {
+                        tkt_entry_destroy(e);
+                        continue;
+                }
+
+                if (e->srv != srv)
+                        continue;
+
+                if (id != NULL) {
+                        if (memcmp(e->tkt.id, id, OAP_TKT_ID_SIZE) == 0)
+                                return e;
+                } else if (strcmp(e->tkt.name, name) == 0) {
+                        return e;
+                }
+        }
+
+        return NULL;
+}
+
+int tkt_take_cli(const char *              name,
+                 const struct sec_config * kcfg,
+                 struct oap_tkt *          tkt)
+{
+        struct tkt_entry * e;
+
+        assert(name != NULL);
+        assert(kcfg != NULL);
+        assert(tkt != NULL);
+
+        if (oap_tkt.lifetime == 0)
+                return -ENOENT;
+
+        pthread_mutex_lock(&oap_tkt.mtx);
+
+        e = tkt_get(false, name, NULL);
+        if (e == NULL) {
+                pthread_mutex_unlock(&oap_tkt.mtx);
+                return -ENOENT;
+        }
+
+        *tkt = e->tkt;
+        tkt_entry_destroy(e);
+
+        pthread_mutex_unlock(&oap_tkt.mtx);
+
+        if (!tkt_is_acceptable(tkt, kcfg)) {
+                tkt_clear(tkt);
+                return -EPERM;
+        }
+
+        return 0;
+}
+
+int tkt_check_mac(const struct oap_tkt * tkt,
+                  buffer_t               in,
+                  const uint8_t *        mac)
+{
+        uint8_t  buf[MAX_HASH_SIZE];
+        buffer_t key;
+        uint8_t  diff = 0;
+        size_t   i;
+
+        key.data = (uint8_t *) tkt->psk;
+        key.len  = SYMMKEYSZ;
+
+        if (md_hmac(OAP_TKT_MAC_NID, key, in, buf) != OAP_TKT_MAC_SIZE)
+                return -ECRYPT;
+
+        for (i = 0; i < OAP_TKT_MAC_SIZE; ++i)
+                diff |= buf[i] ^ mac[i];
+
+        return diff == 0 ? 0 : -EAUTH;
+}
+
+int tkt_take_srv(const char *              name,
+                 const uint8_t *           id,
+                 buffer_t                  in,
+                 const uint8_t *           mac,
+                 const struct sec_config * kcfg,
+                 struct oap_tkt *          tkt)
+{
+        struct tkt_entry * e;
+
+        assert(name != NULL);
+        assert(id != NULL);
+        assert(mac != NULL);
+        assert(kcfg != NULL);
+        assert(tkt != NULL);
+
+        if (oap_tkt.lifetime == 0)
+                return -ENOENT;
+
+        pthread_mutex_lock(&oap_tkt.mtx);
+
+        e = tkt_get(true, name, id);
+        if (e == NULL) {
+                pthread_mutex_unlock(&oap_tkt.mtx);
+                return -ENOENT;
+        }
+
+        /* Anyone can replay the id, only the holder can bind it */
+        if (tkt_check_mac(&e->tkt, in, mac) < 0) {
+                pthread_mutex_unlock(&oap_tkt.mtx);
+                return -EAUTH;
+        }
+
+        *tkt = e->tkt;
+        tkt_entry_destroy(e);
+
+        pthread_mutex_unlock(&oap_tkt.mtx);
+
+        if (strcmp(tkt->name, name) != 0 || !tkt_is_acceptable(tkt, kcfg)) {
+                tkt_clear(tkt);
+                return -EPERM;
+        }
+
+        return 0;
+}
+
+int tkt_session_key(const struct oap_tkt * tkt,
+                    buffer_t               id,
+                    struct crypt_sk *      sk)
+{
+        buffer_t secret;
+        buffer_t key;
+
+        secret.data = (uint8_t *) tkt->psk;
+        secret.len  = SYMMKEYSZ;
+
+        key.data = sk->key;
+        key.len  = SYMMKEYSZ;
+
+        if (md_hkdf(tkt->kdf, secret, id, TKT_INFO_KEY, key) < 0)
+                return -ECRYPT;
+
+        sk->nid = tkt->nid;
+
+        return 0;
+}
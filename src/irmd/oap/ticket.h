@@ -0,0 +1,74 @@
+/*
+ * Ouroboros - Copyright (C) 2016 - 2026
+ *
+ * OAP - Session resumption tickets
+ *
+ *    Dimitri Staessens <dimitri@ouroboros.rocks>
+ *    Sander Vrijders   <sander@ouroboros.rocks>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., http://www.fsf.org/about/contact/.
+ */
+
+#ifndef OUROBOROS_IRMD_OAP_TICKET_H
+#define OUROBOROS_IRMD_OAP_TICKET_H
+
+#include <ouroboros/crypt.h>
+#include <ouroboros/name.h>
+
+#include "hdr.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct oap_tkt {
+        uint8_t  id[OAP_TKT_ID_SIZE];
+        uint8_t  psk[SYMMKEYSZ];
+        char     name[NAME_SIZE + 1]; /* Server name         */
+        int      nid;                 /* Cipher              */
+        int      kdf;                 /* KDF                 */
+        uint64_t expiry;              /* Full KEX + lifetime */
+};
+
+/* Derives a ticket from a session key, expiry 0 starts a new lifetime */
+void tkt_issue(bool                    srv,
+               const char *            name,
+               const struct crypt_sk * sk,
+               int                     kdf,
+               buffer_t                id,
+               uint64_t                expiry);
+
+/* Single use, the ticket is removed from the store */
+int  tkt_take_cli(const char *              name,
+                  const struct sec_config * kcfg,
+                  struct oap_tkt *          tkt);
+
+/* Only a good binder over in takes the ticket, a bad one leaves it */
+int  tkt_take_srv(const char *              name,
+                  const uint8_t *           id,
+                  buffer_t                  in,
+                  const uint8_t *           mac,
+                  const struct sec_config * kcfg,
+                  struct oap_tkt *          tkt);
+
+int  tkt_check_mac(const struct oap_tkt * tkt,
+                   buffer_t               in,
+                   const uint8_t *        mac);
+
+int  tkt_session_key(const struct oap_tkt * tkt,
+                     buffer_t               id,
+                     struct crypt_sk *      sk);
+
+void tkt_clear(struct oap_tkt * tkt);
+
+#endif /* OUROBOROS_IRMD_OAP_TICKET_H */
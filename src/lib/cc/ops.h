@@ -0,0 +1,47 @@
+/*
+ * Ouroboros - Copyright (C) 2016 - 2026
+ *
+ * FRCT congestion control policy ops
+ *
+ *    Dimitri Staessens <dimitri@ouroboros.rocks>
+ *    Sander Vrijders   <sander@ouroboros.rocks>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., http://www.fsf.org/about/contact/.
+ */
+
+#ifndef OUROBOROS_LIB_CC_OPS_H
+#define OUROBOROS_LIB_CC_OPS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct cc_ops {
+        void * (* ctx_create)(void);
+
+        void   (* ctx_destroy)(void * ctx);
+
+        /* Packets allowed in flight. */
+        size_t (* wnd)(void * ctx);
+
+        /* n new packets were acknowledged. */
+        void   (* ack)(void * ctx,
+                       size_t n);
+
+        /* Loss with flight packets outstanding, rto if the timer fired. */
+        void   (* loss)(void * ctx,
+                        size_t flight,
+                        bool   rto);
+};
+
+#endif /* OUROBOROS_LIB_CC_OPS_H */
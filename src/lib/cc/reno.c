@@ -0,0 +1,111 @@
+/*
+ * Ouroboros - Copyright (C) 2016 - 2026
+ *
+ * Loss-based (Reno) congestion control
+ *
+ *    Dimitri Staessens <dimitri@ouroboros.rocks>
+ *    Sander Vrijders   <sander@ouroboros.rocks>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., http://www.fsf.org/about/contact/.
+ */
+
+#include "reno.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RENO_IW       10        /* Initial window (pkts), RFC 6928 */
+#define RENO_MIN_SST  2         /* Minimum slow start threshold    */
+#define RENO_MAX_WND  (1 << 20) /* Keeps the window from wrapping  */
+
+struct reno_ctx {
+        size_t cwnd;     /* Congestion window (pkts)      */
+        size_t ssthresh; /* Slow start threshold (pkts)   */
+        size_t acked;    /* ACK'd in congestion avoidance */
+};
+
+struct cc_ops reno_cc_ops = {
+        .ctx_create  = reno_ctx_create,
+        .ctx_destroy = reno_ctx_destroy,
+        .wnd         = reno_wnd,
+        .ack         = reno_ack,
+        .loss        = reno_loss
+};
+
+void * reno_ctx_create(void)
+{
+        struct reno_ctx * ctx;
+
+        ctx = malloc(sizeof(*ctx));
+        if (ctx == NULL)
+                return NULL;
+
+        memset(ctx, 0, sizeof(*ctx));
+
+        ctx->cwnd     = RENO_IW;
+        ctx->ssthresh = RENO_MAX_WND;
+
+        return (void *) ctx;
+}
+
+void reno_ctx_destroy(void * ctx)
+{
+        free(ctx);
+}
+
+size_t reno_wnd(void * _ctx)
+{
+        struct reno_ctx * ctx = _ctx;
+
+        return ctx->cwnd;
+}
+
+void reno_ack(void * _ctx,
+              size_t n)
+{
+        struct reno_ctx * ctx = _ctx;
+
+        if (ctx->cwnd < ctx->ssthresh) { /* Slow start */
+                ctx->cwnd += n;
+                if (ctx->cwnd <= ctx->ssthresh)
+                        return;
+                n = ctx->cwnd - ctx->ssthresh;
+                ctx->cwnd = ctx->ssthresh;
+        }
+
+        /* Additive increase, one packet per window. */
+        ctx->acked += n;
+        while (ctx->acked >= ctx->cwnd) {
+                ctx->acked -= ctx->cwnd;
+                ctx->cwnd++;
+        }
+
+        if (ctx->cwnd > RENO_MAX_WND)
+                ctx->cwnd = RENO_MAX_WND;
+}
+
+void reno_loss(void * _ctx,
+               size_t flight,
+               bool   rto)
+{
+        struct reno_ctx * ctx = _ctx;
+
+        /* Multiplicative decrease, restart from 1 after a timeout. */
+        ctx->ssthresh = flight >> 1;
+        if (ctx->ssthresh < RENO_MIN_SST)
+                ctx->ssthresh = RENO_MIN_SST;
+
+        ctx->cwnd  = rto ? 1 : ctx->ssthresh;
+        ctx->acked = 0;
+}
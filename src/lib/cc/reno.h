@@ -0,0 +1,43 @@
+/*
+ * Ouroboros - Copyright (C) 2016 - 2026
+ *
+ * Loss-based (Reno) congestion control
+ *
+ *    Dimitri Staessens <dimitri@ouroboros.rocks>
+ *    Sander Vrijders   <sander@ouroboros.rocks>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., http://www.fsf.org/about/contact/.
+ */
+
+#ifndef OUROBOROS_LIB_CC_RENO_H
+#define OUROBOROS_LIB_CC_RENO_H
+
+#include "ops.h"
+
+void * reno_ctx_create(void);
+
+void   reno_ctx_destroy(void * ctx);
+
+size_t reno_wnd(void * ctx);
+
+void   reno_ack(void * ctx,
+                size_t n);
+
+void   reno_loss(void * ctx,
+                 size_t flight,
+                 bool   rto);
+
+extern struct cc_ops reno_cc_ops;
+
+#endif /* OUROBOROS_LIB_CC_RENO_H */
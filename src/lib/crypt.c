@@ -595,41 +595,91 @@ int crypt_kex_rank(int nid)
 /* Hash length now returned by md_digest() */
 
 int crypt_encrypt(struct crypt_ctx * ctx,
-                  buffer_t           in,
-                  buffer_t *         out)
+                  buffer_t           buf)
 {
         assert(ctx != NULL);
         assert(ctx->ctx != NULL);
 
 #ifdef HAVE_OPENSSL
-        return openssl_encrypt(ctx->ctx, in, out);
+        return openssl_encrypt(ctx->ctx, buf);
 #else
         (void) ctx;
-        (void) in;
-        (void) out;
+        (void) buf;
 
         return -ECRYPT;
 #endif
 }
 
 int crypt_decrypt(struct crypt_ctx * ctx,
-                  buffer_t           in,
-                  buffer_t *         out)
+                  buffer_t           buf)
 {
         assert(ctx != NULL);
         assert(ctx->ctx != NULL);
 
 #ifdef HAVE_OPENSSL
-        return openssl_decrypt(ctx->ctx, in, out);
+        return openssl_decrypt(ctx->ctx, buf);
 #else
         (void) ctx;
-        (void) in;
-        (void) out;
+        (void) buf;
 
         return -ECRYPT;
 #endif
 }
 
+int crypt_encrypt_lane(struct crypt_ctx * ctx,
+                       buffer_t           buf,
+                       size_t             lane)
+{
+        assert(ctx != NULL);
+        assert(ctx->ctx != NULL);
+
+#ifdef HAVE_OPENSSL
+        return openssl_encrypt_lane(ctx->ctx, buf, lane);
+#else
+        (void) ctx;
+        (void) buf;
+        (void) lane;
+
+        return -ECRYPT;
+#endif
+}
+
+size_t crypt_encrypt_batch(struct crypt_ctx * ctx,
+                           buffer_t *         bufs,
+                           size_t             n)
+{
+        assert(ctx != NULL);
+        assert(ctx->ctx != NULL);
+
+#ifdef HAVE_OPENSSL
+        return openssl_encrypt_batch(ctx->ctx, bufs, n);
+#else
+        (void) ctx;
+        (void) bufs;
+        (void) n;
+
+        return 0;
+#endif
+}
+
+size_t crypt_decrypt_batch(struct crypt_ctx * ctx,
+                           buffer_t *         bufs,
+                           size_t             n)
+{
+        assert(ctx != NULL);
+        assert(ctx->ctx != NULL);
+
+#ifdef HAVE_OPENSSL
+        return openssl_decrypt_batch(ctx->ctx, bufs, n);
+#else
+        (void) ctx;
+        (void) bufs;
+        (void) n;
+
+        return 0;
+#endif
+}
+
 struct crypt_ctx * crypt_create_ctx(struct crypt_sk * sk)
 {
         struct crypt_ctx * crypt;
@@ -699,6 +749,22 @@ int crypt_get_tagsz(struct crypt_ctx * ctx)
 #endif
 }
 
+int crypt_get_stat(struct crypt_ctx *  ctx,
+                   struct crypt_stat * st)
+{
+        if (ctx == NULL || st == NULL)
+                return -EINVAL;
+
+#ifdef HAVE_OPENSSL
+        assert(ctx->ctx != NULL);
+        openssl_crypt_get_stat(ctx->ctx, st);
+        return 0;
+#else
+        assert(ctx->ctx == NULL);
+        return -ENOTSUP;
+#endif
+}
+
 int crypt_load_privkey_file(const char * path,
                             void **      key)
 {
@@ -825,6 +891,18 @@ void crypt_free_key(void * key)
 #endif
 }
 
+int crypt_ref_key(void * key)
+{
+        if (key == NULL)
+                return 0;
+
+#ifdef HAVE_OPENSSL
+        return openssl_ref_key((EVP_PKEY *) key);
+#else
+        return 0;
+#endif
+}
+
 int crypt_load_crt_file(const char * path,
                         void **      crt)
 {
@@ -898,6 +976,17 @@ void crypt_free_crt(void * crt)
 #endif
 }
 
+int crypt_ref_crt(void * crt)
+{
+        if (crt == NULL)
+                return 0;
+#ifdef HAVE_OPENSSL
+        return openssl_ref_crt(crt);
+#else
+        return 0;
+#endif
+}
+
 int crypt_crt_str(const void * crt,
                   char *       buf)
 {
@@ -954,6 +1043,21 @@ int crypt_get_crt_name(void * crt,
 #endif
 }
 
+int crypt_get_crt_expiry(void *   crt,
+                         time_t * expiry)
+{
+        assert(expiry != NULL);
+
+#ifdef HAVE_OPENSSL
+        return openssl_get_crt_expiry(crt, expiry);
+#else
+        (void) crt;
+        (void) expiry;
+
+        return -1;
+#endif
+}
+
 struct auth_ctx * auth_create_ctx(void)
 {
         struct auth_ctx * ctx;
@@ -1007,11 +1111,29 @@ int auth_verify_crt(struct auth_ctx * ctx,
                     void *            crt)
 {
 #ifdef HAVE_OPENSSL
-        return openssl_verify_crt(ctx->store, crt);
+        return openssl_verify_crt(ctx->store, crt, NULL);
+#else
+        (void) ctx;
+        (void) crt;
+
+        return 0;
+#endif
+}
+
+int auth_verify_crt_chain(struct auth_ctx * ctx,
+                          void *            crt,
+                          time_t *          expiry)
+{
+        assert(expiry != NULL);
+
+#ifdef HAVE_OPENSSL
+        return openssl_verify_crt(ctx->store, crt, expiry);
 #else
         (void) ctx;
         (void) crt;
 
+        *expiry = 0;
+
         return 0;
 #endif
 }
@@ -1077,6 +1199,42 @@ ssize_t md_len(int md_nid)
 #endif
 }
 
+ssize_t md_hmac(int       md_nid,
+                buffer_t  key,
+                buffer_t  in,
+                uint8_t * out)
+{
+#ifdef HAVE_OPENSSL
+        return openssl_md_hmac(md_nid, key, in, out);
+#else
+        (void) md_nid;
+        (void) key;
+        (void) in;
+        (void) out;
+
+        return -1;
+#endif
+}
+
+int md_hkdf(int          md_nid,
+            buffer_t     secret,
+            buffer_t     salt,
+            const char * info,
+            buffer_t     key)
+{
+#ifdef HAVE_OPENSSL
+        return openssl_md_hkdf(md_nid, secret, salt, info, key);
+#else
+        (void) md_nid;
+        (void) secret;
+        (void) salt;
+        (void) info;
+        (void) key;
+
+        return -1;
+#endif
+}
+
 int crypt_secure_malloc_init(size_t max)
 {
 #ifdef HAVE_OPENSSL
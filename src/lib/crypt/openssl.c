@@ -30,7 +30,6 @@
 #include <ouroboros/errno.h>
 #include <ouroboros/crypt.h>
 #include <ouroboros/hash.h>
-#include <ouroboros/random.h>
 #include <ouroboros/utils.h>
 
 #include <openssl/evp.h>
@@ -45,6 +44,7 @@
 #include <openssl/x509_vfy.h>
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 
 #define IS_EC_GROUP(str) (strcmp(str, "EC") == 0)
@@ -55,24 +55,59 @@
 #define HKDF_INFO_ROTATION "o7s-key-rotation"
 #define HKDF_SALT_LEN      32 /* SHA-256 output size */
 
+/* Nonce: flags | key epoch | salt | packet counter | 0. */
+#define IV_SALT_LEN        4
+#define IV_CNTR_LEN        8
+#define IV_PHASE_BIT       0x80 /* Low bit of the epoch */
+#define IV_DIR_BIT         0x40
+#define IV_EPOCH           1    /* Byte with the epoch  */
+
+struct crypt_lane {
+        EVP_CIPHER_CTX * evp;
+        uint64_t         gen;  /* key generation, 0: unkeyed */
+};
+
 struct ossl_crypt_ctx {
-        EVP_CIPHER_CTX *   evp_ctx;
-        const EVP_CIPHER * cipher;
-        int                ivsz;
-        int                tagsz;
+        const EVP_CIPHER *  cipher;
+        int                 ivsz;
+        int                 tagsz;
+
+        pthread_mutex_t     mtx;   /* all but the lanes  */
+
+        struct crypt_lane * lanes; /* seal outside a lock */
+        size_t              n_lanes;
+
+        struct {
+                EVP_CIPHER_CTX * enc; /* keyed with cur */
+                EVP_CIPHER_CTX * cur; /* decrypt, cur   */
+                EVP_CIPHER_CTX * prv; /* decrypt, prv   */
+                EVP_CIPHER_CTX * nxt; /* decrypt, nxt   */
+        } evp; /* only the IV changes per packet */
+
+        struct {
+                uint8_t  salt[IV_SALT_LEN];
+                uint64_t cntr;  /* packets encrypted    */
+        } iv;
 
         struct {
                 uint8_t * cur; /* current key */
                 uint8_t * prv; /* rotated key */
+                uint8_t * nxt; /* candidate   */
         } keys;
 
         struct {
-                uint32_t cntr;  /* counter              */
-                uint32_t mask;  /* phase mask           */
+                uint32_t mask;  /* packets per epoch    */
                 uint32_t age;   /* counter within epoch */
-                uint8_t  phase; /* current key phase    */
+                uint8_t  epoch; /* rotations, mod 256   */
+                uint64_t gen;   /* rotations + 1        */
+                uint64_t nxt;   /* gen of the candidate */
                 uint8_t  salt[HKDF_SALT_LEN];
         } rot; /* rotation logic */
+
+        struct {
+                size_t   n_auth;  /* failed authentication */
+                size_t   n_epoch; /* no key for the epoch  */
+        } stat;
 };
 
 struct kdf_info {
@@ -84,16 +119,12 @@ struct kdf_info {
 };
 
 /* Key rotation macros */
-#define HAS_PHASE_BIT_TOGGLED(ctx) \
-        (((ctx)->rot.cntr & (ctx)->rot.mask) != \
-         (((ctx)->rot.cntr - 1) & (ctx)->rot.mask))
+#define IS_EPOCH_DONE(ctx) \
+        ((ctx)->rot.age >= (ctx)->rot.mask)
 
 #define HAS_GRACE_EXPIRED(ctx) \
         ((ctx)->rot.age >= ((ctx)->rot.mask >> 1))
 
-#define ROTATION_TOO_RECENT(ctx) \
-        ((ctx)->rot.age < ((ctx)->rot.mask - ((ctx)->rot.mask >> 2)))
-
 /* Convert hash NID to OpenSSL digest name string for HKDF */
 static const char * hash_nid_to_digest_name(int nid)
 {
@@ -259,62 +290,83 @@ static int derive_key_hkdf(struct kdf_info * ki)
 }
 
 /* Key rotation helper functions implementation */
-static int should_rotate_key_rx(struct ossl_crypt_ctx * ctx,
-                                uint8_t                 rx_phase)
-{
-        assert(ctx != NULL);
-
-        /* Phase must have changed */
-        if (rx_phase == ctx->rot.phase)
-                return 0;
-
-        if (ROTATION_TOO_RECENT(ctx))
-                return 0;
-
-        return 1;
-}
-
-static int rotate_key(struct ossl_crypt_ctx * ctx)
+static int derive_next_key(struct ossl_crypt_ctx * ctx)
 {
         struct kdf_info ki;
-        uint8_t *       tmp;
 
         assert(ctx != NULL);
 
-        /* Swap keys - move current to prev */
-        tmp = ctx->keys.prv;
-        ctx->keys.prv = ctx->keys.cur;
+        /* Once per epoch, whatever the peer sends. */
+        if (ctx->rot.nxt == ctx->rot.gen)
+                return 0;
 
-        if (tmp != NULL) {
-                /* Reuse old prev_key memory for new key */
-                ctx->keys.cur = tmp;
-        } else {
-                /* First rotation - allocate new memory */
-                ctx->keys.cur = OPENSSL_secure_malloc(SYMMKEYSZ);
-                if (ctx->keys.cur == NULL)
+        if (ctx->keys.nxt == NULL) {
+                ctx->keys.nxt = OPENSSL_secure_malloc(SYMMKEYSZ);
+                if (ctx->keys.nxt == NULL)
                         return -ECRYPT;
         }
 
-        /* Derive new key from previous key using HKDF */
-        ki.secret.data = ctx->keys.prv;
+        /* Derive new key from current key using HKDF */
+        ki.secret.data = ctx->keys.cur;
         ki.secret.len  = SYMMKEYSZ;
         ki.nid         = NID_sha256;
         ki.salt.data   = ctx->rot.salt;
         ki.salt.len    = HKDF_SALT_LEN;
         ki.info.data   = (uint8_t *) HKDF_INFO_ROTATION;
         ki.info.len    = strlen(HKDF_INFO_ROTATION);
-        ki.key.data    = ctx->keys.cur;
+        ki.key.data    = ctx->keys.nxt;
         ki.key.len     = SYMMKEYSZ;
 
         if (derive_key_hkdf(&ki) != 0)
                 return -ECRYPT;
 
-        ctx->rot.age   = 0;
-        ctx->rot.phase = !ctx->rot.phase;
+        if (EVP_DecryptInit_ex(ctx->evp.nxt, NULL, NULL, ctx->keys.nxt,
+                               NULL) != 1)
+                return -ECRYPT;
+
+        ctx->rot.nxt = ctx->rot.gen;
+
+        return 0;
+}
+
+/* Next becomes current, current becomes previous. */
+static int commit_next_key(struct ossl_crypt_ctx * ctx)
+{
+        uint8_t *        tmp;
+        EVP_CIPHER_CTX * tmp_evp;
+
+        assert(ctx != NULL);
+        assert(ctx->keys.nxt != NULL);
+
+        tmp           = ctx->keys.prv;
+        ctx->keys.prv = ctx->keys.cur;
+        ctx->keys.cur = ctx->keys.nxt;
+        ctx->keys.nxt = tmp;
+
+        tmp_evp      = ctx->evp.prv;
+        ctx->evp.prv = ctx->evp.cur;
+        ctx->evp.cur = ctx->evp.nxt;
+        ctx->evp.nxt = tmp_evp;
+
+        ctx->rot.age = 0;
+        ctx->rot.epoch++;
+        ctx->rot.gen++;
+
+        if (EVP_EncryptInit_ex(ctx->evp.enc, NULL, NULL, ctx->keys.cur,
+                               NULL) != 1)
+                return -ECRYPT;
 
         return 0;
 }
 
+static int rotate_key(struct ossl_crypt_ctx * ctx)
+{
+        if (derive_next_key(ctx) != 0)
+                return -ECRYPT;
+
+        return commit_next_key(ctx);
+}
+
 static void cleanup_old_key(struct ossl_crypt_ctx * ctx)
 {
         assert(ctx != NULL);
@@ -330,45 +382,46 @@ static void cleanup_old_key(struct ossl_crypt_ctx * ctx)
 }
 
 static int try_decrypt(struct ossl_crypt_ctx * ctx,
-                       uint8_t *               key,
+                       EVP_CIPHER_CTX *        evp,
                        uint8_t *               iv,
-                       uint8_t *               input,
-                       int                     in_sz,
-                       uint8_t *               out,
-                       int *                   out_sz)
+                       uint8_t *               data,
+                       int                     len)
 {
         uint8_t * tag;
         int       tmp_sz;
         int       ret;
 
-        tag = input + in_sz;
+        tag = data + len;
 
-        EVP_CIPHER_CTX_reset(ctx->evp_ctx);
-
-        ret = EVP_DecryptInit_ex(ctx->evp_ctx, ctx->cipher, NULL, key, iv);
+        ret = EVP_DecryptInit_ex(evp, NULL, NULL, NULL, iv);
         if (ret != 1)
                 return -1;
 
         if (ctx->tagsz > 0) {
-                ret = EVP_CIPHER_CTX_ctrl(ctx->evp_ctx, EVP_CTRL_AEAD_SET_TAG,
+                ret = EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_AEAD_SET_TAG,
                                           ctx->tagsz, tag);
                 if (ret != 1)
                         return -1;
         }
 
-        ret = EVP_DecryptUpdate(ctx->evp_ctx, out, &tmp_sz, input, in_sz);
+        ret = EVP_DecryptUpdate(evp, data, &tmp_sz, data, len);
         if (ret != 1)
                 return -1;
 
-        *out_sz = tmp_sz;
+        assert(tmp_sz == len);
 
-        ret = EVP_DecryptFinal_ex(ctx->evp_ctx, out + tmp_sz, &tmp_sz);
+        ret = EVP_DecryptFinal_ex(evp, data + tmp_sz, &tmp_sz);
         if (ret != 1)
-                return -1;
+                goto fail_final;
 
-        *out_sz += tmp_sz;
+        assert(tmp_sz == 0);
 
         return 0;
+ fail_final:
+        /* The keystream is an XOR, run it again to restore the input. */
+        if (EVP_DecryptInit_ex(evp, NULL, NULL, NULL, iv) == 1)
+                EVP_DecryptUpdate(evp, data, &tmp_sz, data, len);
+        return -1;
 }
 
 /*
@@ -948,145 +1001,300 @@ int openssl_dhe_derive(EVP_PKEY * pkp,
         return -ECRYPT;
 }
 
-int openssl_encrypt(struct ossl_crypt_ctx * ctx,
-                    buffer_t                in,
-                    buffer_t *              out)
-{
-        uint8_t *  ptr;
-        uint8_t *  iv;
-        int        in_sz;
-        int        out_sz;
-        int        tmp_sz;
-        int        ret;
-
-        assert(ctx != NULL);
+static void build_iv(struct ossl_crypt_ctx * ctx,
+                     uint8_t *               iv)
+{
+        uint64_t cntr;
+        int      i;
 
-        in_sz = (int) in.len;
+        assert(ctx->ivsz >= IV_SALT_LEN + IV_CNTR_LEN);
 
-        out->data = malloc(in.len + EVP_MAX_BLOCK_LENGTH + \
-                           ctx->ivsz + ctx->tagsz);
-        if (out->data == NULL)
-                goto fail_malloc;
+        memcpy(iv, ctx->iv.salt, IV_SALT_LEN);
 
-        iv  = out->data;
-        ptr = out->data + ctx->ivsz;
+        /* The receiver picks the key from the epoch. */
+        iv[IV_EPOCH] = ctx->rot.epoch;
+        if (ctx->rot.epoch & 1)
+                iv[0] |= IV_PHASE_BIT;
 
-        if (random_buffer(iv, ctx->ivsz) < 0)
-                goto fail_encrypt;
+        cntr = ctx->iv.cntr;
+        for (i = IV_SALT_LEN + IV_CNTR_LEN - 1; i >= IV_SALT_LEN; --i) {
+                iv[i] = (uint8_t) cntr;
+                cntr >>= 8;
+        }
 
-        /* Set IV bit 7 to current key phase (KEY_ROTATION_BIT of counter) */
-        if (ctx->rot.cntr & ctx->rot.mask)
-                iv[0] |= 0x80;
-        else
-                iv[0] &= 0x7F;
+        /* CTR mode counts blocks in the remaining bytes. */
+        memset(iv + IV_SALT_LEN + IV_CNTR_LEN, 0,
+               ctx->ivsz - IV_SALT_LEN - IV_CNTR_LEN);
+}
 
-        EVP_CIPHER_CTX_reset(ctx->evp_ctx);
+static int seal(struct ossl_crypt_ctx * ctx,
+                EVP_CIPHER_CTX *        evp,
+                uint8_t *               iv,
+                uint8_t *               data,
+                int                     len)
+{
+        int out_sz;
+        int tmp_sz;
+        int ret;
 
-        ret = EVP_EncryptInit_ex(ctx->evp_ctx, ctx->cipher, NULL,
-                                 ctx->keys.cur, iv);
+        ret = EVP_EncryptInit_ex(evp, NULL, NULL, NULL, iv);
         if (ret != 1)
-                goto fail_encrypt;
+                return -1;
 
-        ret = EVP_EncryptUpdate(ctx->evp_ctx, ptr, &tmp_sz, in.data, in_sz);
+        ret = EVP_EncryptUpdate(evp, data, &tmp_sz, data, len);
         if (ret != 1)
-                goto fail_encrypt;
+                return -1;
 
         out_sz = tmp_sz;
-        ret =  EVP_EncryptFinal_ex(ctx->evp_ctx, ptr + tmp_sz, &tmp_sz);
+        ret = EVP_EncryptFinal_ex(evp, data + tmp_sz, &tmp_sz);
         if (ret != 1)
-                goto fail_encrypt;
+                return -1;
 
         out_sz += tmp_sz;
 
+        /* Stream and AEAD modes only, the tag space must stay free. */
+        assert(out_sz == len);
+
         /* For AEAD ciphers, get and append the authentication tag */
         if (ctx->tagsz > 0) {
-                ret = EVP_CIPHER_CTX_ctrl(ctx->evp_ctx, EVP_CTRL_AEAD_GET_TAG,
-                                          ctx->tagsz, ptr + out_sz);
+                ret = EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_AEAD_GET_TAG,
+                                          ctx->tagsz, data + out_sz);
                 if (ret != 1)
-                        goto fail_encrypt;
-                out_sz += ctx->tagsz;
+                        return -1;
         }
 
-        assert(out_sz >= in_sz);
-
-        out->len = (size_t) out_sz + ctx->ivsz;
+        return 0;
+}
 
-        /* Increment packet counter and check for key rotation */
-        ctx->rot.cntr++;
+/* Needs the lock, the packet was sealed with the current key. */
+static int advance_iv(struct ossl_crypt_ctx * ctx)
+{
+        ctx->iv.cntr++;
         ctx->rot.age++;
 
-        if (HAS_PHASE_BIT_TOGGLED(ctx)) {
-                if (rotate_key(ctx) != 0)
-                        goto fail_encrypt;
-        }
-
-        cleanup_old_key(ctx);
+        if (IS_EPOCH_DONE(ctx) && rotate_key(ctx) != 0)
+                return -1;
 
         return 0;
- fail_encrypt:
-        free(out->data);
- fail_malloc:
-        clrbuf(*out);
-        return -ECRYPT;
 }
 
-int openssl_decrypt(struct ossl_crypt_ctx * ctx,
-                    buffer_t                in,
-                    buffer_t *              out)
+/* Needs the lock. */
+static int encrypt_pkt(struct ossl_crypt_ctx * ctx,
+                       buffer_t                buf)
 {
         uint8_t * iv;
-        uint8_t * input;
-        uint8_t   rx_phase;
-        int       out_sz;
-        int       in_sz;
+        int       len;
 
         assert(ctx != NULL);
 
-        in_sz = (int) in.len - ctx->ivsz;
-        if (in_sz < ctx->tagsz)
+        if (buf.len < (size_t) (ctx->ivsz + ctx->tagsz))
                 return -ECRYPT;
 
-        in_sz -= ctx->tagsz;
+        len = (int) buf.len - ctx->ivsz - ctx->tagsz;
+        iv  = buf.data;
 
-        out->data = malloc(in_sz + EVP_MAX_BLOCK_LENGTH);
-        if (out->data == NULL)
-                goto fail_malloc;
+        build_iv(ctx, iv);
+
+        if (seal(ctx, ctx->evp.enc, iv, iv + ctx->ivsz, len) != 0)
+                return -ECRYPT;
+
+        if (advance_iv(ctx) != 0)
+                return -ECRYPT;
+
+        return 0;
+}
+
+/* Needs the lock. */
+static int decrypt_pkt(struct ossl_crypt_ctx * ctx,
+                       buffer_t                buf)
+{
+        EVP_CIPHER_CTX * evp;
+        uint8_t *        iv;
+        uint8_t *        data;
+        uint8_t          rx_epoch;
+        bool             next;
+        int              len;
+
+        assert(ctx != NULL);
+
+        if (buf.len < (size_t) (ctx->ivsz + ctx->tagsz))
+                return -ECRYPT;
 
-        iv    = in.data;
-        input = in.data + ctx->ivsz;
+        len = (int) buf.len - ctx->ivsz - ctx->tagsz;
 
-        /* Extract phase from IV bit 7 and check for key rotation */
-        rx_phase = (iv[0] & 0x80) ? 1 : 0;
+        iv   = buf.data;
+        data = buf.data + ctx->ivsz;
 
-        if (should_rotate_key_rx(ctx, rx_phase)) {
-                if (rotate_key(ctx) != 0)
-                        goto fail_decrypt;
+        rx_epoch = iv[IV_EPOCH];
+        next     = false;
+
+        /* One key per epoch, a single authentication attempt. */
+        if (rx_epoch == ctx->rot.epoch) {
+                evp = ctx->evp.cur;
+        } else if (rx_epoch == (uint8_t) (ctx->rot.epoch - 1) &&
+                   ctx->keys.prv != NULL) {
+                evp = ctx->evp.prv;
+        } else if (rx_epoch == (uint8_t) (ctx->rot.epoch + 1)) {
+                /* At any age, packets lost in this epoch don't count. */
+                if (derive_next_key(ctx) != 0)
+                        return -ECRYPT;
+                evp  = ctx->evp.nxt;
+                next = true;
+        } else {
+                __atomic_fetch_add(&ctx->stat.n_epoch, 1, __ATOMIC_RELAXED);
+                return -ECRYPT;
         }
 
-        ctx->rot.cntr++;
+        if (try_decrypt(ctx, evp, iv, data, len) != 0) {
+                __atomic_fetch_add(&ctx->stat.n_auth, 1, __ATOMIC_RELAXED);
+                return -ECRYPT;
+        }
+
+        /* Only an authenticated packet moves the epoch. */
+        if (next && commit_next_key(ctx) != 0)
+                return -ECRYPT;
+
         ctx->rot.age++;
 
-        if (try_decrypt(ctx, ctx->keys.cur, iv, input, in_sz, out->data,
-                        &out_sz) != 0) {
-                if (ctx->keys.prv == NULL)
-                        goto fail_decrypt;
-                if (try_decrypt(ctx, ctx->keys.prv, iv, input, in_sz,
-                                out->data, &out_sz) != 0)
-                        goto fail_decrypt;
+        return 0;
+}
+
+int openssl_encrypt(struct ossl_crypt_ctx * ctx,
+                    buffer_t                buf)
+{
+        int ret;
+
+        assert(ctx != NULL);
+
+        pthread_mutex_lock(&ctx->mtx);
+
+        ret = encrypt_pkt(ctx, buf);
+
+        cleanup_old_key(ctx);
+
+        pthread_mutex_unlock(&ctx->mtx);
+
+        return ret;
+}
+
+int openssl_decrypt(struct ossl_crypt_ctx * ctx,
+                    buffer_t                buf)
+{
+        int ret;
+
+        assert(ctx != NULL);
+
+        pthread_mutex_lock(&ctx->mtx);
+
+        ret = decrypt_pkt(ctx, buf);
+
+        cleanup_old_key(ctx);
+
+        pthread_mutex_unlock(&ctx->mtx);
+
+        return ret;
+}
+
+/* The nonce is taken under the lock, the cipher runs outside it. */
+int openssl_encrypt_lane(struct ossl_crypt_ctx * ctx,
+                         buffer_t                buf,
+                         size_t                  lane)
+{
+        struct crypt_lane * l;
+        uint8_t *           iv;
+        int                 len;
+
+        assert(ctx != NULL);
+        assert(lane < ctx->n_lanes);
+
+        if (buf.len < (size_t) (ctx->ivsz + ctx->tagsz))
+                return -ECRYPT;
+
+        len = (int) buf.len - ctx->ivsz - ctx->tagsz;
+        iv  = buf.data;
+        l   = &ctx->lanes[lane];
+
+        pthread_mutex_lock(&ctx->mtx);
+
+        if (l->gen != ctx->rot.gen) {
+                if (EVP_EncryptInit_ex(l->evp, ctx->cipher, NULL,
+                                       ctx->keys.cur, NULL) != 1)
+                        goto fail_lock;
+                l->gen = ctx->rot.gen;
         }
 
-        assert(out_sz <= in_sz);
+        build_iv(ctx, iv);
 
-        out->len = (size_t) out_sz;
+        if (advance_iv(ctx) != 0)
+                goto fail_lock;
+
+        cleanup_old_key(ctx);
+
+        pthread_mutex_unlock(&ctx->mtx);
+
+        if (seal(ctx, l->evp, iv, iv + ctx->ivsz, len) != 0)
+                return -ECRYPT;
 
         return 0;
- fail_decrypt:
-        free(out->data);
- fail_malloc:
-        clrbuf(*out);
+ fail_lock:
+        pthread_mutex_unlock(&ctx->mtx);
         return -ECRYPT;
 }
 
+size_t openssl_encrypt_batch(struct ossl_crypt_ctx * ctx,
+                             buffer_t *              bufs,
+                             size_t                  n)
+{
+        size_t i;
+        size_t cnt = 0;
+
+        assert(ctx != NULL);
+        assert(bufs != NULL || n == 0);
+
+        pthread_mutex_lock(&ctx->mtx);
+
+        for (i = 0; i < n; ++i) {
+                if (encrypt_pkt(ctx, bufs[i]) < 0) {
+                        bufs[i].len = 0;
+                        continue;
+                }
+                ++cnt;
+        }
+
+        cleanup_old_key(ctx);
+
+        pthread_mutex_unlock(&ctx->mtx);
+
+        return cnt;
+}
+
+size_t openssl_decrypt_batch(struct ossl_crypt_ctx * ctx,
+                             buffer_t *              bufs,
+                             size_t                  n)
+{
+        size_t i;
+        size_t cnt = 0;
+
+        assert(ctx != NULL);
+        assert(bufs != NULL || n == 0);
+
+        pthread_mutex_lock(&ctx->mtx);
+
+        for (i = 0; i < n; ++i) {
+                if (decrypt_pkt(ctx, bufs[i]) < 0) {
+                        bufs[i].len = 0;
+                        continue;
+                }
+                ++cnt;
+        }
+
+        cleanup_old_key(ctx);
+
+        pthread_mutex_unlock(&ctx->mtx);
+
+        return cnt;
+}
+
 struct ossl_crypt_ctx * openssl_crypt_create_ctx(struct crypt_sk * sk)
 {
         struct ossl_crypt_ctx * ctx;
@@ -1108,6 +1316,7 @@ struct ossl_crypt_ctx * openssl_crypt_create_ctx(struct crypt_sk * sk)
         memcpy(ctx->keys.cur, sk->key, SYMMKEYSZ);
 
         ctx->keys.prv = NULL;
+        ctx->keys.nxt = NULL;
 
         /* Derive rotation salt from initial shared secret */
         if (EVP_Digest(sk->key, SYMMKEYSZ, ctx->rot.salt, NULL,
@@ -1119,22 +1328,90 @@ struct ossl_crypt_ctx * openssl_crypt_create_ctx(struct crypt_sk * sk)
                 goto fail_cipher;
 
         ctx->ivsz = EVP_CIPHER_iv_length(ctx->cipher);
+        if (ctx->ivsz < IV_SALT_LEN + IV_CNTR_LEN)
+                goto fail_cipher;
 
         /* Set tag size for AEAD ciphers (GCM, CCM, OCB, ChaCha20-Poly1305) */
         if (EVP_CIPHER_flags(ctx->cipher) & EVP_CIPH_FLAG_AEAD_CIPHER)
                 ctx->tagsz = 16;  /* Standard AEAD tag length (128 bits) */
 
-        ctx->rot.cntr  = 0;
         ctx->rot.mask  = (1U << sk->rot_bit);
         ctx->rot.age   = 0;
-        ctx->rot.phase = 0;
+        ctx->rot.epoch = 0;
+        ctx->rot.gen   = 1;
+        ctx->rot.nxt   = 0;
+
+        /* Separate nonce spaces, both ends encrypt with the same key. */
+        memcpy(ctx->iv.salt, ctx->rot.salt, IV_SALT_LEN);
+        ctx->iv.salt[0] &= ~(IV_PHASE_BIT | IV_DIR_BIT);
+        if (sk->dir == CRYPT_DIR_SRV)
+                ctx->iv.salt[0] |= IV_DIR_BIT;
+
+        ctx->iv.cntr = 0;
 
-        ctx->evp_ctx = EVP_CIPHER_CTX_new();
-        if (ctx->evp_ctx == NULL)
+        ctx->evp.enc = EVP_CIPHER_CTX_new();
+        if (ctx->evp.enc == NULL)
                 goto fail_cipher;
 
+        ctx->evp.cur = EVP_CIPHER_CTX_new();
+        if (ctx->evp.cur == NULL)
+                goto fail_evp_cur;
+
+        ctx->evp.prv = EVP_CIPHER_CTX_new();
+        if (ctx->evp.prv == NULL)
+                goto fail_evp_prv;
+
+        ctx->evp.nxt = EVP_CIPHER_CTX_new();
+        if (ctx->evp.nxt == NULL)
+                goto fail_evp_nxt;
+
+        if (EVP_EncryptInit_ex(ctx->evp.enc, ctx->cipher, NULL,
+                               ctx->keys.cur, NULL) != 1)
+                goto fail_init;
+
+        if (EVP_DecryptInit_ex(ctx->evp.cur, ctx->cipher, NULL,
+                               ctx->keys.cur, NULL) != 1)
+                goto fail_init;
+
+        /* Keyed on rotation. */
+        if (EVP_DecryptInit_ex(ctx->evp.prv, ctx->cipher, NULL,
+                               NULL, NULL) != 1)
+                goto fail_init;
+
+        if (EVP_DecryptInit_ex(ctx->evp.nxt, ctx->cipher, NULL,
+                               NULL, NULL) != 1)
+                goto fail_init;
+
+        if (sk->lanes > 0) {
+                ctx->lanes = calloc(sk->lanes, sizeof(*ctx->lanes));
+                if (ctx->lanes == NULL)
+                        goto fail_init;
+        }
+
+        /* Keyed on first use. */
+        for (ctx->n_lanes = 0; ctx->n_lanes < sk->lanes; ++ctx->n_lanes) {
+                ctx->lanes[ctx->n_lanes].evp = EVP_CIPHER_CTX_new();
+                if (ctx->lanes[ctx->n_lanes].evp == NULL)
+                        goto fail_lanes;
+        }
+
+        if (pthread_mutex_init(&ctx->mtx, NULL))
+                goto fail_lanes;
+
         return ctx;
 
+ fail_lanes:
+        while (ctx->n_lanes-- > 0)
+                EVP_CIPHER_CTX_free(ctx->lanes[ctx->n_lanes].evp);
+        free(ctx->lanes);
+ fail_init:
+        EVP_CIPHER_CTX_free(ctx->evp.nxt);
+ fail_evp_nxt:
+        EVP_CIPHER_CTX_free(ctx->evp.prv);
+ fail_evp_prv:
+        EVP_CIPHER_CTX_free(ctx->evp.cur);
+ fail_evp_cur:
+        EVP_CIPHER_CTX_free(ctx->evp.enc);
  fail_cipher:
         OPENSSL_secure_clear_free(ctx->keys.cur, SYMMKEYSZ);
  fail_key:
@@ -1154,7 +1431,20 @@ void openssl_crypt_destroy_ctx(struct ossl_crypt_ctx * ctx)
         if (ctx->keys.prv != NULL)
                 OPENSSL_secure_clear_free(ctx->keys.prv, SYMMKEYSZ);
 
-        EVP_CIPHER_CTX_free(ctx->evp_ctx);
+        if (ctx->keys.nxt != NULL)
+                OPENSSL_secure_clear_free(ctx->keys.nxt, SYMMKEYSZ);
+
+        while (ctx->n_lanes-- > 0)
+                EVP_CIPHER_CTX_free(ctx->lanes[ctx->n_lanes].evp);
+        free(ctx->lanes);
+
+        EVP_CIPHER_CTX_free(ctx->evp.nxt);
+        EVP_CIPHER_CTX_free(ctx->evp.prv);
+        EVP_CIPHER_CTX_free(ctx->evp.cur);
+        EVP_CIPHER_CTX_free(ctx->evp.enc);
+
+        pthread_mutex_destroy(&ctx->mtx);
+
         free(ctx);
 }
 
@@ -1172,6 +1462,20 @@ int openssl_crypt_get_tagsz(struct ossl_crypt_ctx * ctx)
         return ctx->tagsz;
 }
 
+void openssl_crypt_get_stat(struct ossl_crypt_ctx * ctx,
+                            struct crypt_stat *     st)
+{
+        assert(ctx != NULL);
+        assert(st != NULL);
+
+        pthread_mutex_lock(&ctx->mtx);
+        st->epoch   = ctx->rot.epoch;
+        pthread_mutex_unlock(&ctx->mtx);
+
+        st->n_auth  = __atomic_load_n(&ctx->stat.n_auth, __ATOMIC_RELAXED);
+        st->n_epoch = __atomic_load_n(&ctx->stat.n_epoch, __ATOMIC_RELAXED);
+}
+
 /* AUTHENTICATION */
 
 int openssl_load_crt_file(const char * path,
@@ -1278,6 +1582,11 @@ void openssl_free_crt(void * crt)
         X509_free((X509 *) crt);
 }
 
+int openssl_ref_crt(void * crt)
+{
+        return X509_up_ref((X509 *) crt) == 1 ? 0 : -ECRYPT;
+}
+
 int openssl_load_privkey_file(const char * path,
                               void **      key)
 {
@@ -1559,6 +1868,11 @@ void openssl_free_key(EVP_PKEY * key)
         EVP_PKEY_free(key);
 }
 
+int openssl_ref_key(EVP_PKEY * key)
+{
+        return EVP_PKEY_up_ref(key) == 1 ? 0 : -ECRYPT;
+}
+
 int openssl_check_crt_name(void *       crt,
                            const char * name)
 {
@@ -1623,6 +1937,26 @@ int openssl_get_crt_name(void * crt,
         return -1;
 }
 
+int openssl_get_crt_expiry(void *   crt,
+                           time_t * expiry)
+{
+        const ASN1_TIME * end;
+        int               days;
+        int               secs;
+
+        end = X509_get0_notAfter((X509 *) crt);
+        if (end == NULL)
+                return -1;
+
+        /* Relative to now, avoids converting the ASN.1 time */
+        if (ASN1_TIME_diff(&days, &secs, NULL, end) != 1)
+                return -1;
+
+        *expiry = time(NULL) + (time_t) days * 86400 + secs;
+
+        return 0;
+}
+
 int openssl_crt_str(const void * crt,
                     char *       str)
 {
@@ -1697,8 +2031,31 @@ int openssl_auth_add_crt_to_store(void * store,
         return ret == 1 ? 0 : -1;
 }
 
-int openssl_verify_crt(void * store,
-                       void * crt)
+/* Earliest end of validity over the chain that was verified */
+static int chain_expiry(X509_STORE_CTX * ctx,
+                        time_t *         expiry)
+{
+        STACK_OF(X509) * chain;
+        time_t           end;
+        int              i;
+
+        chain = X509_STORE_CTX_get0_chain(ctx);
+        if (chain == NULL || sk_X509_num(chain) == 0)
+                return -1;
+
+        for (i = 0; i < sk_X509_num(chain); ++i) {
+                if (openssl_get_crt_expiry(sk_X509_value(chain, i), &end))
+                        return -1;
+                if (i == 0 || end < *expiry)
+                        *expiry = end;
+        }
+
+        return 0;
+}
+
+int openssl_verify_crt(void *   store,
+                       void *   crt,
+                       time_t * expiry)
 {
         X509_STORE_CTX * ctx;
         X509_STORE *     _store;
@@ -1720,6 +2077,9 @@ int openssl_verify_crt(void * store,
         if (ret != 1)
                 goto fail_ca;
 
+        if (expiry != NULL && chain_expiry(ctx, expiry) < 0)
+                goto fail_ca;
+
         X509_STORE_CTX_free(ctx);
 
         return 0;
@@ -1852,6 +2212,44 @@ ssize_t openssl_md_len(int nid)
         return (ssize_t) EVP_MD_get_size(md);
 }
 
+ssize_t openssl_md_hmac(int       nid,
+                        buffer_t  key,
+                        buffer_t  in,
+                        uint8_t * out)
+{
+        size_t len;
+
+        assert(key.data != NULL);
+        assert(out != NULL);
+
+        if (EVP_Q_mac(NULL, "HMAC", NULL, hash_nid_to_digest_name(nid),
+                      NULL, key.data, key.len, in.data, in.len,
+                      out, EVP_MAX_MD_SIZE, &len) == NULL)
+                return -ECRYPT;
+
+        return (ssize_t) len;
+}
+
+int openssl_md_hkdf(int          nid,
+                    buffer_t     secret,
+                    buffer_t     salt,
+                    const char * info,
+                    buffer_t     key)
+{
+        struct kdf_info ki;
+
+        assert(info != NULL);
+
+        ki.secret    = secret;
+        ki.nid       = nid;
+        ki.salt      = salt;
+        ki.info.data = (uint8_t *) info;
+        ki.info.len  = strlen(info);
+        ki.key       = key;
+
+        return derive_key_hkdf(&ki);
+}
+
 int openssl_secure_malloc_init(size_t max,
                                size_t guard)
 {
@@ -62,12 +62,22 @@ int     openssl_get_algo_from_pk_raw(buffer_t pk,
                                      char *   algo);
 
 int     openssl_encrypt(struct ossl_crypt_ctx * ctx,
-                        buffer_t                in,
-                        buffer_t *              out);
+                        buffer_t                buf);
 
 int     openssl_decrypt(struct ossl_crypt_ctx * ctx,
-                        buffer_t                in,
-                        buffer_t *              out);
+                        buffer_t                buf);
+
+int     openssl_encrypt_lane(struct ossl_crypt_ctx * ctx,
+                             buffer_t                buf,
+                             size_t                  lane);
+
+size_t  openssl_encrypt_batch(struct ossl_crypt_ctx * ctx,
+                              buffer_t *              bufs,
+                              size_t                  n);
+
+size_t  openssl_decrypt_batch(struct ossl_crypt_ctx * ctx,
+                              buffer_t *              bufs,
+                              size_t                  n);
 
 struct ossl_crypt_ctx * openssl_crypt_create_ctx(struct crypt_sk * sk);
 
@@ -77,6 +87,9 @@ int                     openssl_crypt_get_ivsz(struct ossl_crypt_ctx * ctx);
 
 int                     openssl_crypt_get_tagsz(struct ossl_crypt_ctx * ctx);
 
+void                    openssl_crypt_get_stat(struct ossl_crypt_ctx * ctx,
+                                               struct crypt_stat *     st);
+
 /* AUTHENTICATION */
 
 int     openssl_load_crt_file(const char * path,
@@ -93,6 +106,8 @@ int     openssl_get_pubkey_crt(void *  crt,
 
 void    openssl_free_crt(void * crt);
 
+int     openssl_ref_crt(void * crt);
+
 int     openssl_load_privkey_file(const char * path,
                                   void **      key);
 
@@ -117,12 +132,17 @@ int     openssl_cmp_key(const EVP_PKEY * key1,
 
 void    openssl_free_key(EVP_PKEY * key);
 
+int     openssl_ref_key(EVP_PKEY * key);
+
 int     openssl_check_crt_name(void *       crt,
                                const char * name);
 
 int     openssl_get_crt_name(void * crt,
                              char * name);
 
+int     openssl_get_crt_expiry(void *   crt,
+                               time_t * expiry);
+
 int     openssl_crt_str(const void * crt,
                         char *       str);
 
@@ -136,8 +156,9 @@ void    openssl_auth_destroy_store(void * store);
 int     openssl_auth_add_crt_to_store(void * store,
                                       void * crt);
 
-int     openssl_verify_crt(void * store,
-                           void * crt);
+int     openssl_verify_crt(void *   store,
+                           void *   crt,
+                           time_t * expiry);
 
 int     openssl_sign(EVP_PKEY * pkp,
                      int        md_nid,
@@ -155,6 +176,17 @@ ssize_t openssl_md_digest(int        md_nid,
 
 ssize_t openssl_md_len(int md_nid);
 
+ssize_t openssl_md_hmac(int       md_nid,
+                        buffer_t  key,
+                        buffer_t  in,
+                        uint8_t * out);
+
+int     openssl_md_hkdf(int          md_nid,
+                        buffer_t     secret,
+                        buffer_t     salt,
+                        const char * info,
+                        buffer_t     key);
+
 /* Secure memory allocation */
 int     openssl_secure_malloc_init(size_t max,
                                    size_t guard);
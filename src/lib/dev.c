@@ -59,6 +59,7 @@
 #include <gcrypt.h>
 #endif
 #include <assert.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -70,6 +71,10 @@
 #define CLOCK_REALTIME_COARSE CLOCK_REALTIME
 #endif
 
+#ifndef CLOCK_MONOTONIC_COARSE
+#define CLOCK_MONOTONIC_COARSE CLOCK_MONOTONIC
+#endif
+
 /* Partial read information. */
 #define NO_PART   -1
 #define DONE_PART -2
@@ -78,6 +83,17 @@
 #define SECMEMSZ  16384
 #define MSGBUFSZ  2048
 
+/* Flows per IRMd message when deallocating in the background. */
+#define DEALLOC_BATCH 64
+
+/* A packet and the FEC repair it completes are encrypted together. */
+#define SPB_BATCH     2
+
+/* Flow tables grow per chunk, memory follows the flows in use. */
+#define FLOW_CHUNK    256
+#define FD_CHUNKS     ((PROG_MAX_FLOWS + FLOW_CHUNK - 1) / FLOW_CHUNK)
+#define ID_CHUNKS     ((SYS_MAX_FLOWS + FLOW_CHUNK - 1) / FLOW_CHUNK)
+
 /* map flow_ids to flow descriptors; track state of the flow */
 struct fmap {
         int             fd;
@@ -90,8 +106,10 @@ struct fmap {
 
 struct flow {
         struct list_head      next;
+        int                   fd;
 
         struct flow_info      info;
+        qoscube_t             qc;
 
         struct ssm_rbuff *    rx_rb;
         struct ssm_rbuff *    tx_rb;
@@ -99,10 +117,13 @@ struct flow {
 
         uint16_t              oflags;
         ssize_t               part_idx;
+        bool                  dealloc; /* handed to the rx thread */
 
         struct crypt_ctx *    crypt;
         int                   headsz;  /* IV */
         int                   tailsz;  /* Tag + CRC */
+        struct flow_txq *     txq;     /* crypto workers */
+        size_t                frag;    /* 0 = no fragmentation */
 
         struct timespec       snd_act;
         struct timespec       rcv_act;
@@ -115,6 +136,25 @@ struct flow {
         struct frcti *        frcti;
 };
 
+/* Packets on their way through the crypto workers. */
+struct crypt_job {
+        struct list_head next;
+        struct flow *    flow;
+        ssize_t          idx[SPB_BATCH]; /* -1 once sent */
+        size_t           n;
+        bool             done;
+};
+
+/* Encrypted out of order, sent in the order they were written. */
+struct flow_txq {
+        struct crypt_job jobs[CRYPT_QUEUE];
+        size_t           head; /* next to send */
+        size_t           tail; /* next free    */
+        bool             busy; /* being sent   */
+        pthread_mutex_t  mtx;
+        pthread_cond_t   cond;
+};
+
 struct flow_set {
         size_t           idx;
         pthread_rwlock_t lock;
@@ -133,9 +173,10 @@ struct {
         struct bmp *          fds;
         struct bmp *          fqueues;
 
-        struct flow *         flows;
-        struct fmap *         id_to_fd;
+        struct flow *         flows[FD_CHUNKS];
+        struct fmap *         id_to_fd[ID_CHUNKS];
         struct list_head      flow_list;
+        struct list_head      dealloc_list;
 
         pthread_mutex_t       mtx;
         pthread_cond_t        cond;
@@ -145,9 +186,126 @@ struct {
         size_t                n_frcti;
         fset_t *              frct_set;
 
+        struct {
+                pthread_t *      tids;
+                size_t           n_tids;
+                size_t           n_flows;
+                struct list_head jobs;
+                pthread_mutex_t  mtx;
+                pthread_cond_t   cond;
+        } cw; /* crypto workers */
+
         pthread_rwlock_t      lock;
 } proc;
 
+/* Chunks are only freed at exit, lookups need not hold the lock. */
+static struct flow * flow_get(int fd)
+{
+        struct flow * chunk;
+
+        if (fd < 0 || fd >= PROG_MAX_FLOWS)
+                return NULL;
+
+        chunk = __atomic_load_n(&proc.flows[fd / FLOW_CHUNK], __ATOMIC_ACQUIRE);
+        if (chunk == NULL)
+                return NULL;
+
+        return chunk + fd % FLOW_CHUNK;
+}
+
+static struct fmap * fmap_get(int flow_id)
+{
+        struct fmap * chunk;
+
+        if (flow_id < 0 || flow_id >= SYS_MAX_FLOWS)
+                return NULL;
+
+        chunk = __atomic_load_n(&proc.id_to_fd[flow_id / FLOW_CHUNK],
+                                __ATOMIC_ACQUIRE);
+        if (chunk == NULL)
+                return NULL;
+
+        return chunk + flow_id % FLOW_CHUNK;
+}
+
+static int flow_id_to_fd(int flow_id)
+{
+        struct fmap * p;
+
+        p = fmap_get(flow_id);
+
+        return p == NULL ? -1 : p->fd;
+}
+
+static void flow_clear(struct flow * flow)
+{
+        memset(flow, 0, sizeof(*flow));
+
+        flow->info.id = -1;
+}
+
+/* Called under the proc lock. */
+static int flow_grow(int fd)
+{
+        struct flow * chunk;
+        size_t        i;
+
+        assert(fd >= 0 && fd < PROG_MAX_FLOWS);
+
+        if (proc.flows[fd / FLOW_CHUNK] != NULL)
+                return 0;
+
+        chunk = malloc(sizeof(*chunk) * FLOW_CHUNK);
+        if (chunk == NULL)
+                return -ENOMEM;
+
+        for (i = 0; i < FLOW_CHUNK; ++i)
+                flow_clear(&chunk[i]);
+
+        __atomic_store_n(&proc.flows[fd / FLOW_CHUNK], chunk,
+                         __ATOMIC_RELEASE);
+
+        return 0;
+}
+
+/* Called under the proc lock. */
+static int fmap_grow(int flow_id)
+{
+        struct fmap * chunk;
+        size_t        i;
+
+        if (flow_id < 0 || flow_id >= SYS_MAX_FLOWS)
+                return -EINVAL;
+
+        if (proc.id_to_fd[flow_id / FLOW_CHUNK] != NULL)
+                return 0;
+
+        chunk = malloc(sizeof(*chunk) * FLOW_CHUNK);
+        if (chunk == NULL)
+                return -ENOMEM;
+
+        for (i = 0; i < FLOW_CHUNK; ++i) {
+                chunk[i].fd    = -1;
+                chunk[i].state = FLOW_INIT;
+        }
+
+        __atomic_store_n(&proc.id_to_fd[flow_id / FLOW_CHUNK], chunk,
+                         __ATOMIC_RELEASE);
+
+        return 0;
+}
+
+static void flow_tables_free(void)
+{
+        size_t i;
+
+        for (i = 0; i < FD_CHUNKS; ++i)
+                free(proc.flows[i]);
+
+        for (i = 0; i < ID_CHUNKS; ++i)
+                free(proc.id_to_fd[i]);
+}
+
 static void flow_destroy(struct fmap * p)
 {
         pthread_mutex_lock(&proc.mtx);
@@ -196,7 +354,16 @@ static enum flow_state flow_wait_assign(int flow_id)
         enum flow_state state;
         struct fmap *   p;
 
-        p = &proc.id_to_fd[flow_id];
+        pthread_rwlock_wrlock(&proc.lock);
+
+        if (fmap_grow(flow_id) < 0) {
+                pthread_rwlock_unlock(&proc.lock);
+                return FLOW_NULL;
+        }
+
+        pthread_rwlock_unlock(&proc.lock);
+
+        p = fmap_get(flow_id);
 
         pthread_mutex_lock(&proc.mtx);
 
@@ -255,81 +422,488 @@ static void proc_exit(void)
         send_recv_msg(&msg);
 }
 
-static int spb_encrypt(struct flow *        flow,
-                       struct ssm_pk_buff * spb)
+/* Each packet on its own, a failed one is released and set to NULL. */
+static int spb_encrypt_batch(struct flow *         flow,
+                             struct ssm_pk_buff ** spb,
+                             size_t                n)
 {
-        buffer_t  in;
-        buffer_t  out;
-        uint8_t * head;
-        uint8_t * tail;
+        buffer_t bufs[SPB_BATCH];
+        size_t   at[SPB_BATCH];
+        size_t   i;
+        size_t   m = 0;
+        int      ret = 0;
+
+        assert(n <= SPB_BATCH);
 
         if (flow->crypt == NULL)
                 return 0; /* No encryption */
 
-        in.data = ssm_pk_buff_head(spb);
-        in.len  = ssm_pk_buff_len(spb);
+        for (i = 0; i < n; ++i) {
+                if (ssm_pk_buff_head_alloc(spb[i], flow->headsz) == NULL) {
+                        spb[i] = NULL;
+                        ret    = -ECRYPT;
+                        continue;
+                }
 
-        if (crypt_encrypt(flow->crypt, in, &out) < 0)
-                goto fail_encrypt;
+                if (ssm_pk_buff_tail_alloc(spb[i], flow->tailsz) == NULL) {
+                        ssm_pk_buff_head_release(spb[i], flow->headsz);
+                        spb[i] = NULL;
+                        ret    = -ECRYPT;
+                        continue;
+                }
 
-        head = ssm_pk_buff_head_alloc(spb, flow->headsz);
-        if (head == NULL)
-                goto fail_alloc;
+                bufs[m].data = ssm_pk_buff_head(spb[i]);
+                bufs[m].len  = ssm_pk_buff_len(spb[i]);
+                at[m++]      = i;
+        }
 
-        tail = ssm_pk_buff_tail_alloc(spb, flow->tailsz);
-        if (tail == NULL)
+        if (crypt_encrypt_batch(flow->crypt, bufs, m) == m)
+                return ret;
+
+        for (i = 0; i < m; ++i) {
+                if (bufs[i].len > 0)
+                        continue;
+                ssm_pk_buff_tail_release(spb[at[i]], flow->tailsz);
+                ssm_pk_buff_head_release(spb[at[i]], flow->headsz);
+                spb[at[i]] = NULL;
+        }
+
+        return -ECRYPT;
+}
+
+static int spb_encrypt(struct flow *        flow,
+                       struct ssm_pk_buff * spb)
+{
+        return spb_encrypt_batch(flow, &spb, 1);
+}
+
+static int spb_encrypt_lane(struct flow *        flow,
+                            struct ssm_pk_buff * spb,
+                            size_t               lane)
+{
+        buffer_t buf;
+
+        if (ssm_pk_buff_head_alloc(spb, flow->headsz) == NULL)
                 goto fail_alloc;
 
-        memcpy(head, out.data, out.len);
+        if (ssm_pk_buff_tail_alloc(spb, flow->tailsz) == NULL)
+                goto fail_tail;
 
-        freebuf(out);
+        buf.data = ssm_pk_buff_head(spb);
+        buf.len  = ssm_pk_buff_len(spb);
+
+        if (crypt_encrypt_lane(flow->crypt, buf, lane) < 0)
+                goto fail_encrypt;
 
         return 0;
- fail_alloc:
-        freebuf(out);
  fail_encrypt:
+        ssm_pk_buff_tail_release(spb, flow->tailsz);
+ fail_tail:
+        ssm_pk_buff_head_release(spb, flow->headsz);
+ fail_alloc:
         return -ECRYPT;
 }
 
 static int spb_decrypt(struct flow *        flow,
                        struct ssm_pk_buff * spb)
 {
-        buffer_t  in;
-        buffer_t  out;
-        uint8_t * head;
+        buffer_t buf;
 
         if (flow->crypt == NULL)
                 return 0; /* No decryption */
 
-        in.data = ssm_pk_buff_head(spb);
-        in.len  = ssm_pk_buff_len(spb);
-
-        if (crypt_decrypt(flow->crypt, in, &out) < 0)
-                return -ENOMEM;
+        buf.data = ssm_pk_buff_head(spb);
+        buf.len  = ssm_pk_buff_len(spb);
 
+        if (crypt_decrypt(flow->crypt, buf) < 0)
+                return -ECRYPT;
 
-        head = ssm_pk_buff_head_release(spb, flow->headsz) + flow->headsz;
+        ssm_pk_buff_head_release(spb, flow->headsz);
         ssm_pk_buff_tail_release(spb, flow->tailsz);
 
-        memcpy(head, out.data, out.len);
+        return 0;
+}
+
+static int add_crc(struct ssm_pk_buff * spb);
+
+static struct flow_txq * flow_txq_create(void)
+{
+        struct flow_txq *  q;
+        pthread_condattr_t cattr;
+
+        q = malloc(sizeof(*q));
+        if (q == NULL)
+                goto fail_malloc;
+
+        q->head = 0;
+        q->tail = 0;
+        q->busy = false;
+
+        if (pthread_mutex_init(&q->mtx, NULL))
+                goto fail_mtx;
+
+        if (pthread_condattr_init(&cattr))
+                goto fail_cattr;
+#ifndef __APPLE__
+        pthread_condattr_setclock(&cattr, PTHREAD_COND_CLOCK);
+#endif
+        if (pthread_cond_init(&q->cond, &cattr))
+                goto fail_cond;
+
+        pthread_condattr_destroy(&cattr);
+
+        return q;
+
+ fail_cond:
+        pthread_condattr_destroy(&cattr);
+ fail_cattr:
+        pthread_mutex_destroy(&q->mtx);
+ fail_mtx:
+        free(q);
+ fail_malloc:
+        return NULL;
+}
+
+static void flow_txq_destroy(struct flow_txq * q)
+{
+        pthread_cond_destroy(&q->cond);
+        pthread_mutex_destroy(&q->mtx);
+        free(q);
+}
+
+/* Keeps the packet if the rbuff is full, the writer or a tick retries. */
+static int crypt_job_send(struct crypt_job * job,
+                          bool               block,
+                          struct timespec *  abstime)
+{
+        struct flow * flow = job->flow;
+        size_t        i;
+        int           ret;
+
+        for (i = 0; i < job->n; ++i) {
+                if (job->idx[i] < 0)
+                        continue;
+
+                if (!block)
+                        ret = ssm_rbuff_write(flow->tx_rb, job->idx[i]);
+                else
+                        ret = ssm_rbuff_write_b(flow->tx_rb, job->idx[i],
+                                                abstime);
+
+                if (ret == -EAGAIN || ret == -ETIMEDOUT)
+                        return ret;
+
+                if (ret < 0)
+                        ssm_pool_remove(proc.pool, job->idx[i]);
+                else
+                        ssm_flow_set_notify(flow->set, flow->info.id,
+                                            FLOW_PKT);
+
+                job->idx[i] = -1;
+        }
+
+        return 0;
+}
+
+static void __cleanup_txq_idle(void * o)
+{
+        struct flow_txq * q = (struct flow_txq *) o;
+
+        pthread_mutex_lock(&q->mtx);
+
+        q->busy = false;
+        pthread_cond_broadcast(&q->cond);
+}
+
+/* Needs the txq lock, sends the jobs that are done in write order. */
+static int flow_txq_flush(struct flow *     flow,
+                          bool              block,
+                          struct timespec * abstime)
+{
+        struct flow_txq *  q   = flow->txq;
+        struct crypt_job * j;
+        int                ret = 0;
+
+        if (q->busy)
+                return 0;
+
+        q->busy = true;
+
+        while (q->head != q->tail) {
+                j = &q->jobs[q->head % CRYPT_QUEUE];
+                if (!j->done)
+                        break;
+
+                pthread_mutex_unlock(&q->mtx);
+
+                pthread_cleanup_push(__cleanup_txq_idle, q);
+
+                ret = crypt_job_send(j, block, abstime);
+
+                pthread_cleanup_pop(false);
+
+                pthread_mutex_lock(&q->mtx);
+
+                if (ret < 0)
+                        break;
+
+                ++q->head;
+        }
+
+        q->busy = false;
+        pthread_cond_broadcast(&q->cond);
+
+        return ret;
+}
+
+static bool flow_txq_done(struct flow_txq * q)
+{
+        size_t i;
+
+        for (i = q->head; i != q->tail; ++i)
+                if (!q->jobs[i % CRYPT_QUEUE].done)
+                        return false;
+
+        return true;
+}
+
+static bool flow_txq_empty(struct flow_txq * q)
+{
+        bool empty;
+
+        pthread_mutex_lock(&q->mtx);
+
+        empty = q->head == q->tail;
+
+        pthread_mutex_unlock(&q->mtx);
+
+        return empty;
+}
+
+/* Retries what a full rbuff held back, without blocking. */
+static void flow_txq_kick(struct flow * flow)
+{
+        pthread_mutex_lock(&flow->txq->mtx);
+
+        flow_txq_flush(flow, false, NULL);
+
+        pthread_mutex_unlock(&flow->txq->mtx);
+}
+
+/* Waits for the workers, sends what fits and drops the rest. */
+static void flow_txq_drain(struct flow * flow)
+{
+        struct flow_txq *  q = flow->txq;
+        struct crypt_job * j;
+        size_t             i;
+
+        pthread_mutex_lock(&q->mtx);
+
+        while (q->busy || !flow_txq_done(q))
+                pthread_cond_wait(&q->cond, &q->mtx);
+
+        flow_txq_flush(flow, false, NULL);
+
+        for (; q->head != q->tail; ++q->head) {
+                j = &q->jobs[q->head % CRYPT_QUEUE];
+                for (i = 0; i < j->n; ++i)
+                        if (j->idx[i] >= 0)
+                                ssm_pool_remove(proc.pool, j->idx[i]);
+        }
+
+        pthread_mutex_unlock(&q->mtx);
+}
+
+/* A full queue pushes the writer onto the rbuff, as inline sends do. */
+static int flow_txq_submit(struct flow *         flow,
+                           struct ssm_pk_buff ** spb,
+                           size_t                n,
+                           bool                  block,
+                           struct timespec *     abstime)
+{
+        struct flow_txq *  q   = flow->txq;
+        struct crypt_job * job = NULL;
+        size_t             i;
+        int                ret = 0;
+
+        pthread_mutex_lock(&q->mtx);
+
+        pthread_cleanup_push(__cleanup_mutex_unlock, &q->mtx);
+
+        while (q->tail - q->head == CRYPT_QUEUE) {
+                if (!q->busy && q->jobs[q->head % CRYPT_QUEUE].done) {
+                        ret = flow_txq_flush(flow, block, abstime);
+                        if (ret < 0)
+                                break;
+                        continue;
+                }
+                if (!block) {
+                        ret = -EAGAIN;
+                        break;
+                }
+                if (abstime != NULL) {
+                        ret = -pthread_cond_timedwait(&q->cond, &q->mtx,
+                                                      abstime);
+                        if (ret == -ETIMEDOUT)
+                                break;
+                } else {
+                        pthread_cond_wait(&q->cond, &q->mtx);
+                }
+        }
+
+        if (q->tail - q->head < CRYPT_QUEUE) {
+                job = &q->jobs[q->tail++ % CRYPT_QUEUE];
+                job->flow = flow;
+                job->n    = n;
+                job->done = false;
+                for (i = 0; i < n; ++i)
+                        job->idx[i] = ssm_pk_buff_get_idx(spb[i]);
+        }
+
+        pthread_cleanup_pop(true);
+
+        if (job == NULL)
+                return ret;
+
+        pthread_mutex_lock(&proc.cw.mtx);
+
+        list_add_tail(&job->next, &proc.cw.jobs);
+        pthread_cond_signal(&proc.cw.cond);
 
-        freebuf(out);
+        pthread_mutex_unlock(&proc.cw.mtx);
 
         return 0;
 }
 
+/* Workers never block on the rbuff, a full one stalls the queue. */
+static void crypt_job_done(struct crypt_job * job)
+{
+        struct flow_txq * q = job->flow->txq;
+
+        pthread_mutex_lock(&q->mtx);
+
+        job->done = true;
+
+        flow_txq_flush(job->flow, false, NULL);
+
+        pthread_cond_broadcast(&q->cond);
+
+        pthread_mutex_unlock(&q->mtx);
+}
+
+static void crypt_job_run(struct crypt_job * job,
+                          size_t             lane)
+{
+        struct flow *        flow = job->flow;
+        struct ssm_pk_buff * spb;
+        size_t               i;
+
+        for (i = 0; i < job->n; ++i) {
+                spb = ssm_pool_get(proc.pool, job->idx[i]);
+                if (spb_encrypt_lane(flow, spb, lane) == 0 &&
+                    (flow->info.qs.ber != 0 || add_crc(spb) == 0))
+                        continue;
+
+                ssm_pool_remove(proc.pool, job->idx[i]);
+                job->idx[i] = -1;
+        }
+
+        crypt_job_done(job);
+}
+
+static void * crypt_worker(void * o)
+{
+        size_t             lane = (size_t) (uintptr_t) o;
+        struct crypt_job * job;
+
+        while (true) {
+                pthread_mutex_lock(&proc.cw.mtx);
+
+                pthread_cleanup_push(__cleanup_mutex_unlock, &proc.cw.mtx);
+
+                while (list_is_empty(&proc.cw.jobs))
+                        pthread_cond_wait(&proc.cw.cond, &proc.cw.mtx);
+
+                job = list_first_entry(&proc.cw.jobs, struct crypt_job, next);
+                list_del(&job->next);
+
+                pthread_cleanup_pop(true);
+
+                crypt_job_run(job, lane);
+        }
+
+        return (void *) 0;
+}
+
+/* Called under the proc lock, with no jobs queued. */
+static int crypt_workers_start(void)
+{
+        size_t i;
+
+        proc.cw.n_tids = CRYPT_WORKERS;
+
+        proc.cw.tids = malloc(proc.cw.n_tids * sizeof(*proc.cw.tids));
+        if (proc.cw.tids == NULL)
+                goto fail_tids;
+
+        if (pthread_mutex_init(&proc.cw.mtx, NULL))
+                goto fail_mtx;
+
+        if (pthread_cond_init(&proc.cw.cond, NULL))
+                goto fail_cond;
+
+        list_head_init(&proc.cw.jobs);
+
+        for (i = 0; i < proc.cw.n_tids; ++i) {
+                if (pthread_create(&proc.cw.tids[i], NULL, crypt_worker,
+                                   (void *) (uintptr_t) i))
+                        goto fail_thr;
+        }
+
+        return 0;
+
+ fail_thr:
+        while (i-- > 0) {
+                pthread_cancel(proc.cw.tids[i]);
+                pthread_join(proc.cw.tids[i], NULL);
+        }
+        pthread_cond_destroy(&proc.cw.cond);
+ fail_cond:
+        pthread_mutex_destroy(&proc.cw.mtx);
+ fail_mtx:
+        free(proc.cw.tids);
+ fail_tids:
+        return -ENOMEM;
+}
+
+/* Called under the proc lock, all flows drained. */
+static void crypt_workers_stop(void)
+{
+        size_t i;
+
+        assert(list_is_empty(&proc.cw.jobs));
+
+        for (i = 0; i < proc.cw.n_tids; ++i) {
+                pthread_cancel(proc.cw.tids[i]);
+                pthread_join(proc.cw.tids[i], NULL);
+        }
+
+        pthread_cond_destroy(&proc.cw.cond);
+        pthread_mutex_destroy(&proc.cw.mtx);
+
+        free(proc.cw.tids);
+}
+
 #include "frct.c"
 
 void * flow_tx(void * o)
 {
-        struct timespec tic = TIMESPEC_INIT_NS(TICTIME);
-
         (void) o;
 
         while (true) {
                 timerwheel_move();
 
-                nanosleep(&tic, NULL);
+                timerwheel_wait();
         }
 
         return (void *) 0;
@@ -342,7 +916,7 @@ static void flow_send_keepalive(struct flow * flow,
         ssize_t              idx;
         uint8_t *            ptr;
 
-        idx = ssm_pool_alloc(proc.pool, 0, &ptr, &spb);
+        idx = ssm_pool_alloc(proc.pool, 0, flow->qc, &ptr, &spb);
         if (idx < 0)
                 return;
 
@@ -378,7 +952,7 @@ static void _flow_keepalive(struct flow * flow)
         if (timeo == 0 || acl & (ACL_FLOWPEER | ACL_FLOWDOWN))
                 return;
 
-        clock_gettime(PTHREAD_COND_CLOCK, &now);
+        clock_gettime(COARSE_CLOCK, &now);
 
         if (ts_diff_ns(&now, &r_act) > (int64_t) timeo * MILLION) {
                 ssm_rbuff_set_acl(flow->rx_rb, ACL_FLOWPEER);
@@ -408,6 +982,171 @@ static void handle_keepalives(void)
                 _flow_keepalive(flow);
         }
 
+        /* Lingering flows stay alive until they are torn down. */
+        list_for_each_safe(p, h, &proc.dealloc_list) {
+                struct flow * flow;
+                flow = list_entry(p, struct flow, next);
+                _flow_keepalive(flow);
+        }
+
+        pthread_rwlock_unlock(&proc.lock);
+}
+
+/* Sends what a full rbuff held back in the crypto queues. */
+static void handle_txqs(void)
+{
+        struct list_head * p;
+        struct flow *      flow;
+
+        pthread_rwlock_rdlock(&proc.lock);
+
+        list_for_each(p, &proc.flow_list) {
+                flow = list_entry(p, struct flow, next);
+                if (flow->txq != NULL)
+                        flow_txq_kick(flow);
+        }
+
+        list_for_each(p, &proc.dealloc_list) {
+                flow = list_entry(p, struct flow, next);
+                if (flow->txq != NULL)
+                        flow_txq_kick(flow);
+        }
+
+        pthread_rwlock_unlock(&proc.lock);
+}
+
+static ssize_t flow_rx_spb(struct flow *         flow,
+                           struct ssm_pk_buff ** spb,
+                           bool                  block,
+                           struct timespec *     abstime);
+
+static void flow_fini(int fd);
+
+/* Returns true while a deallocated flow has to linger. */
+static bool flow_linger(struct flow * flow,
+                        time_t *      timeo)
+{
+        struct frcti *       frcti = flow->frcti;
+        struct ssm_pk_buff * spb;
+        ssize_t              idx;
+        size_t               n;
+
+        /* A reader still in flow_read owns the rbuff, wait for it. */
+        if (frcti != NULL && pthread_mutex_trylock(&frcti->rcv_mtx))
+                return true;
+
+        n = ssm_rbuff_queued(flow->rx_rb);
+        while (n-- > 0) {
+                idx = flow_rx_spb(flow, &spb, false, NULL);
+                if (idx < 0)
+                        continue;
+
+                if (frcti == NULL) {
+                        ipcp_spb_release(spb);
+                        continue;
+                }
+
+                pthread_rwlock_rdlock(&proc.lock);
+
+                __frcti_rcv(frcti, spb);
+
+                pthread_rwlock_unlock(&proc.lock);
+        }
+
+        /* Nobody will read what was delivered. */
+        while (frcti != NULL && (idx = __frcti_queued_pdu(frcti)) >= 0)
+                ssm_pool_remove(proc.pool, idx);
+
+        if (frcti != NULL)
+                pthread_mutex_unlock(&frcti->rcv_mtx);
+
+        pthread_rwlock_rdlock(&proc.lock);
+
+        *timeo = frcti_dealloc(flow->frcti);
+
+        pthread_rwlock_unlock(&proc.lock);
+
+        /* Down, or the keepalives gave up on the peer. */
+        if (ssm_rbuff_get_acl(flow->rx_rb) & (ACL_FLOWDOWN | ACL_FLOWPEER)) {
+                *timeo = *timeo < 0 ? -*timeo : *timeo;
+                return false;
+        }
+
+        if (flow->txq != NULL && !flow_txq_empty(flow->txq))
+                return true;
+
+        return *timeo < 0 || ssm_rbuff_queued(flow->tx_rb) > 0;
+}
+
+static void flow_dealloc_batch(int *                   fds,
+                               size_t                  n,
+                               const struct timespec * timeo)
+{
+        struct flow_info info[DEALLOC_BATCH];
+        uint8_t          buf[SOCK_BUF_SIZE];
+        buffer_t         msg = {SOCK_BUF_SIZE, buf};
+        size_t           i;
+
+        memset(info, 0, sizeof(info));
+
+        for (i = 0; i < n; ++i) {
+                info[i].id    = flow_get(fds[i])->info.id;
+                info[i].n_pid = getpid();
+        }
+
+        /* IRMd cleans up on exit if this fails, release locally. */
+        if (flow_dealloc_batch__irm_req_ser(&msg, info, n, timeo) == 0
+            && send_recv_msg(&msg) == 0)
+                irm__irm_result_des(&msg);
+
+        for (i = 0; i < n; ++i)
+                flow_fini(fds[i]);
+}
+
+static void handle_deallocs(void)
+{
+        struct list_head   pending;
+        struct list_head * p;
+        struct list_head * h;
+        struct timespec    timeo = TIMESPEC_INIT_S(0);
+        int                fds[DEALLOC_BATCH];
+        size_t             n = 0;
+
+        list_head_init(&pending);
+
+        pthread_rwlock_wrlock(&proc.lock);
+
+        list_for_each_safe(p, h, &proc.dealloc_list)
+                list_move(p, &pending);
+
+        pthread_rwlock_unlock(&proc.lock);
+
+        /* Only this thread touches the pending flows. */
+        list_for_each_safe(p, h, &pending) {
+                struct flow * flow;
+                time_t        t;
+
+                flow = list_entry(p, struct flow, next);
+                if (flow_linger(flow, &t))
+                        continue;
+
+                timeo.tv_sec = MAX(timeo.tv_sec, t);
+                fds[n++] = flow->fd;
+                if (n == DEALLOC_BATCH) {
+                        flow_dealloc_batch(fds, n, &timeo);
+                        timeo.tv_sec = 0;
+                        n = 0;
+                }
+        }
+
+        if (n > 0)
+                flow_dealloc_batch(fds, n, &timeo);
+
+        pthread_rwlock_wrlock(&proc.lock);
+
+        list_for_each_safe(p, h, &pending)
+                list_move(p, &proc.dealloc_list);
+
         pthread_rwlock_unlock(&proc.lock);
 }
 
@@ -430,13 +1169,19 @@ void * flow_rx(void * o)
 
         /* fevent will filter all FRCT packets for us */
         while ((ret = fevent(proc.frct_set, fq, &tic)) != 0) {
-                if (ret == -ETIMEDOUT) {
+                if (ret != -ETIMEDOUT) {
+                        while (fqueue_next(fq) >= 0)
+                                ; /* no need to act */
+                } else {
                         handle_keepalives();
-                        continue;
                 }
 
-                while (fqueue_next(fq) >= 0)
-                        ; /* no need to act */
+                if (CRYPT_WORKERS > 0)
+                        handle_txqs();
+
+                /* Unlocked peek, a miss is caught on the next pass. */
+                if (!list_is_empty(&proc.dealloc_list))
+                        handle_deallocs();
         }
 
         pthread_cleanup_pop(true);
@@ -444,56 +1189,60 @@ void * flow_rx(void * o)
         return (void *) 0;
 }
 
-static void flow_clear(int fd)
+static void __flow_fini(int fd)
 {
-        memset(&proc.flows[fd], 0, sizeof(proc.flows[fd]));
+        struct flow * flow;
 
-        proc.flows[fd].info.id  = -1;
-}
+        flow = flow_get(fd);
 
-static void __flow_fini(int fd)
-{
-        assert(fd >= 0 && fd < SYS_MAX_FLOWS);
+        assert(flow != NULL);
 
-        if (proc.flows[fd].frcti != NULL) {
+        if (flow->txq != NULL) {
+                flow_txq_drain(flow);
+                flow_txq_destroy(flow->txq);
+                if (--proc.cw.n_flows == 0)
+                        crypt_workers_stop();
+        }
+
+        if (flow->frcti != NULL) {
                 proc.n_frcti--;
                 if (proc.n_frcti == 0) {
                         pthread_cancel(proc.tx);
                         pthread_join(proc.tx, NULL);
                 }
 
-                ssm_flow_set_del(proc.fqset, 0, proc.flows[fd].info.id);
+                ssm_flow_set_del(proc.fqset, 0, flow->info.id);
 
-                frcti_destroy(proc.flows[fd].frcti);
+                frcti_destroy(flow->frcti);
         }
 
-        if (proc.flows[fd].info.id != -1) {
-                flow_destroy(&proc.id_to_fd[proc.flows[fd].info.id]);
+        if (flow->info.id != -1) {
+                flow_destroy(fmap_get(flow->info.id));
                 bmp_release(proc.fds, fd);
         }
 
-        if (proc.flows[fd].rx_rb != NULL) {
-                ssm_rbuff_set_acl(proc.flows[fd].rx_rb, ACL_FLOWDOWN);
-                ssm_rbuff_close(proc.flows[fd].rx_rb);
+        if (flow->rx_rb != NULL) {
+                ssm_rbuff_set_acl(flow->rx_rb, ACL_FLOWDOWN);
+                ssm_rbuff_close(flow->rx_rb);
         }
 
-        if (proc.flows[fd].tx_rb != NULL) {
-                ssm_rbuff_set_acl(proc.flows[fd].tx_rb, ACL_FLOWDOWN);
-                ssm_rbuff_close(proc.flows[fd].tx_rb);
+        if (flow->tx_rb != NULL) {
+                ssm_rbuff_set_acl(flow->tx_rb, ACL_FLOWDOWN);
+                ssm_rbuff_close(flow->tx_rb);
         }
 
-        if (proc.flows[fd].set != NULL) {
-                ssm_flow_set_notify(proc.flows[fd].set,
-                                    proc.flows[fd].info.id,
+        if (flow->set != NULL) {
+                ssm_flow_set_notify(flow->set,
+                                    flow->info.id,
                                     FLOW_DEALLOC);
-                ssm_flow_set_close(proc.flows[fd].set);
+                ssm_flow_set_close(flow->set);
         }
 
-        crypt_destroy_ctx(proc.flows[fd].crypt);
+        crypt_destroy_ctx(flow->crypt);
 
-        list_del(&proc.flows[fd].next);
+        list_del(&flow->next);
 
-        flow_clear(fd);
+        flow_clear(flow);
 }
 
 static void flow_fini(int fd)
@@ -505,6 +1254,19 @@ static void flow_fini(int fd)
         pthread_rwlock_unlock(&proc.lock);
 }
 
+/* Largest fragment that fits the layer with all our headers. */
+static size_t flow_frag_size(const struct flow * flow)
+{
+        size_t hdr;
+
+        hdr = FRCT_PCILEN + flow->headsz + flow->tailsz + CRCLEN;
+
+        if (flow->info.mtu <= hdr) /* No MTU, or too small for FRCT */
+                return 0;
+
+        return MIN(flow->info.mtu - hdr, (size_t) FRAG_SIZE);
+}
+
 #define IS_ENCRYPTED(crypt) ((crypt)->nid != NID_undef)
 #define IS_ORDERED(flow) (flow.qs.in_order != 0)
 static int flow_init(struct flow_info * info,
@@ -515,7 +1277,7 @@ static int flow_init(struct flow_info * info,
         int             fd;
         int             err = -ENOMEM;
 
-        clock_gettime(PTHREAD_COND_CLOCK, &now);
+        clock_gettime(COARSE_CLOCK, &now);
 
         pthread_rwlock_wrlock(&proc.lock);
 
@@ -525,9 +1287,14 @@ static int flow_init(struct flow_info * info,
                 goto fail_fds;
         }
 
-        flow = &proc.flows[fd];
+        if (flow_grow(fd) < 0 || fmap_grow(info->id) < 0)
+                goto fail_grow;
 
+        flow = flow_get(fd);
+
+        flow->fd   = fd;
         flow->info = *info;
+        flow->qc   = qos_spec_to_cube(info->qs);
 
         flow->rx_rb = ssm_rbuff_open(info->n_pid, info->id);
         if (flow->rx_rb == NULL)
@@ -548,10 +1315,12 @@ static int flow_init(struct flow_info * info,
         flow->crypt    = NULL;
         flow->headsz   = 0;
         flow->tailsz   = 0;
+        flow->txq      = NULL;
 
         if (IS_ENCRYPTED(sk)) {
                 /* Set to lower value in tests, should we make configurable? */
                 sk->rot_bit = KEY_ROTATION_BIT;
+                sk->lanes   = CRYPT_WORKERS;
                 flow->crypt = crypt_create_ctx(sk);
                 if (flow->crypt == NULL)
                         goto fail_crypt;
@@ -559,6 +1328,17 @@ static int flow_init(struct flow_info * info,
                 flow->tailsz = crypt_get_tagsz(flow->crypt);
         }
 
+        flow->frag = flow_frag_size(flow);
+
+        if (flow->crypt != NULL && CRYPT_WORKERS > 0) {
+                flow->txq = flow_txq_create();
+                if (flow->txq == NULL)
+                        goto fail_txq;
+                if (proc.cw.n_flows == 0 && crypt_workers_start() < 0)
+                        goto fail_workers;
+                ++proc.cw.n_flows;
+        }
+
         assert(flow->frcti == NULL);
 
         if (IS_ORDERED(flow->info)) {
@@ -577,33 +1357,144 @@ static int flow_init(struct flow_info * info,
 
         list_add_tail(&flow->next, &proc.flow_list);
 
-        proc.id_to_fd[info->id].fd = fd;
+        fmap_get(info->id)->fd = fd;
+
+        flow_set_state(fmap_get(info->id), FLOW_ALLOCATED);
+
+        pthread_rwlock_unlock(&proc.lock);
+
+        return fd;
+
+ fail_tx_thread:
+        ssm_flow_set_del(proc.fqset, 0, info->id);
+ fail_flow_set_add:
+        frcti_destroy(flow->frcti);
+ fail_frcti:
+        if (flow->txq != NULL && --proc.cw.n_flows == 0)
+                crypt_workers_stop();
+ fail_workers:
+        if (flow->txq != NULL)
+                flow_txq_destroy(flow->txq);
+ fail_txq:
+        crypt_destroy_ctx(flow->crypt);
+ fail_crypt:
+        ssm_flow_set_close(flow->set);
+ fail_set:
+        ssm_rbuff_close(flow->tx_rb);
+ fail_tx_rb:
+        ssm_rbuff_close(flow->rx_rb);
+ fail_rx_rb:
+        flow_clear(flow);
+ fail_grow:
+        bmp_release(proc.fds, fd);
+ fail_fds:
+        pthread_rwlock_unlock(&proc.lock);
+        return err;
+}
+
+#ifdef PROC_FLOW_STATS
+#define POOL_RIB_STRLEN 512 /* 8 lines of 54 characters */
+
+static int pool_rib_fmt(const char * path,
+                        char *       buf)
+{
+        struct ssm_pool_stats st;
+        char *                entry;
+        size_t                size;
+        size_t                n = 0;
+
+        entry = strstr(path, RIB_SEPARATOR);
+        if (entry == NULL)
+                return -ENOENT;
+
+        size = (size_t) atol(entry + 1);
+
+        do {
+                if (ssm_pool_stats(proc.pool, n++, &st) < 0)
+                        return -ENOENT;
+        } while (st.size != size);
+
+        return sprintf(buf,
+                       "Block size (bytes):              %20zu\n"
+                       "Total blocks:                    %20zu\n"
+                       "Free blocks:                     %20zu\n"
+                       "Reserved for video:              %20zu\n"
+                       "Reserved for voice:              %20zu\n"
+                       "Denied best effort allocations:  %20zu\n"
+                       "Denied video allocations:        %20zu\n"
+                       "Denied voice allocations:        %20zu\n",
+                       st.size,
+                       st.blocks,
+                       st.free,
+                       st.reserved[QOS_CUBE_VIDEO],
+                       st.reserved[QOS_CUBE_VOICE],
+                       st.denied[QOS_CUBE_BE],
+                       st.denied[QOS_CUBE_VIDEO],
+                       st.denied[QOS_CUBE_VOICE]);
+}
+
+static int pool_rib_read(const char * path,
+                         char *       buf,
+                         size_t       len)
+{
+        (void) len;
+
+        return pool_rib_fmt(path, buf);
+}
+
+static int pool_rib_readdir(char *** buf)
+{
+        struct ssm_pool_stats st;
+        char                  str[21];
+        int                   n = 0;
+        int                   i;
+
+        while (ssm_pool_stats(proc.pool, n, &st) == 0)
+                ++n;
+
+        *buf = malloc(sizeof(**buf) * n);
+        if (*buf == NULL)
+                goto fail_malloc;
+
+        for (i = 0; i < n; ++i) {
+                ssm_pool_stats(proc.pool, i, &st);
+                sprintf(str, "%zu", st.size);
+                (*buf)[i] = strdup(str);
+                if ((*buf)[i] == NULL)
+                        goto fail_strdup;
+        }
+
+        return n;
+
+ fail_strdup:
+        while (i-- > 0)
+                free((*buf)[i]);
+        free(*buf);
+ fail_malloc:
+        return -ENOMEM;
+}
 
-        flow_set_state(&proc.id_to_fd[info->id], FLOW_ALLOCATED);
+static int pool_rib_getattr(const char *      path,
+                            struct rib_attr * attr)
+{
+        char buf[POOL_RIB_STRLEN];
+        int  n;
 
-        pthread_rwlock_unlock(&proc.lock);
+        n = pool_rib_fmt(path, buf);
 
-        return fd;
+        attr->size  = n < 0 ? 0 : n;
+        attr->mtime = 0;
 
- fail_tx_thread:
-        ssm_flow_set_del(proc.fqset, 0, info->id);
- fail_flow_set_add:
-        frcti_destroy(flow->frcti);
- fail_frcti:
-        crypt_destroy_ctx(flow->crypt);
- fail_crypt:
-        ssm_flow_set_close(flow->set);
- fail_set:
-        ssm_rbuff_close(flow->tx_rb);
- fail_tx_rb:
-        ssm_rbuff_close(flow->rx_rb);
- fail_rx_rb:
-        bmp_release(proc.fds, fd);
- fail_fds:
-        pthread_rwlock_unlock(&proc.lock);
-        return err;
+        return 0;
 }
 
+static struct rib_ops pool_r_ops = {
+        .read    = pool_rib_read,
+        .readdir = pool_rib_readdir,
+        .getattr = pool_rib_getattr
+};
+#endif /* PROC_FLOW_STATS */
+
 static bool check_python(char * str)
 {
         if (!strcmp(path_strip(str), "python") ||
@@ -620,7 +1511,6 @@ static void init(int     argc,
 {
         struct proc_info info;
         char * prog = argv[0];
-        int    i;
 #ifdef PROC_FLOW_STATS
         char   procstr[32];
 #endif
@@ -677,24 +1567,6 @@ static void init(int     argc,
                 goto fail_rdrb;
         }
 
-        proc.flows = malloc(sizeof(*proc.flows) * PROG_MAX_FLOWS);
-        if (proc.flows == NULL) {
-                fprintf(stderr, "FATAL: Could not malloc flows.\n");
-                goto fail_flows;
-        }
-
-        for (i = 0; i < PROG_MAX_FLOWS; ++i)
-                flow_clear(i);
-
-        proc.id_to_fd = malloc(sizeof(*proc.id_to_fd) * SYS_MAX_FLOWS);
-        if (proc.id_to_fd == NULL) {
-                fprintf(stderr, "FATAL: Could not malloc id_to_fd.\n");
-                goto fail_id_to_fd;
-        }
-
-        for (i = 0; i < SYS_MAX_FLOWS; ++i)
-                proc.id_to_fd[i].state = FLOW_INIT;
-
         if (pthread_mutex_init(&proc.mtx, NULL)) {
                 fprintf(stderr, "FATAL: Could not init mutex.\n");
                 goto fail_mtx;
@@ -739,19 +1611,25 @@ static void init(int     argc,
                         fprintf(stderr, "FATAL: Could not initialize RIB.\n");
                         goto fail_rib_init;
                 }
+                if (rib_reg("pool", &pool_r_ops) < 0) {
+                        fprintf(stderr, "FATAL: Could not register pool.\n");
+                        goto fail_rib_reg;
+                }
         }
 #endif
+        list_head_init(&proc.flow_list);
+        list_head_init(&proc.dealloc_list);
+
         if (pthread_create(&proc.rx, NULL, flow_rx, NULL) < 0) {
                 fprintf(stderr, "FATAL: Could not start monitor thread.\n");
                 goto fail_monitor;
         }
 
-        list_head_init(&proc.flow_list);
-
         return;
 
  fail_monitor:
 #if defined PROC_FLOW_STATS
+ fail_rib_reg:
         rib_fini();
  fail_rib_init:
 #endif
@@ -767,10 +1645,6 @@ static void init(int     argc,
  fail_cond:
         pthread_mutex_destroy(&proc.mtx);
  fail_mtx:
-        free(proc.id_to_fd);
- fail_id_to_fd:
-        free(proc.flows);
- fail_flows:
         ssm_pool_close(proc.pool);
  fail_rdrb:
         bmp_destroy(proc.fqueues);
@@ -784,7 +1658,8 @@ static void init(int     argc,
 
 static void fini(void)
 {
-        int  i;
+        struct list_head * p;
+        struct list_head * h;
 
         if (proc.fds == NULL)
                 return;
@@ -794,15 +1669,16 @@ static void fini(void)
 
         pthread_rwlock_wrlock(&proc.lock);
 
-        for (i = 0; i < PROG_MAX_FLOWS; ++i) {
-                struct flow * flow = &proc.flows[i];
-                if (flow->info.id != -1) {
-                        ssize_t idx;
-                        ssm_rbuff_set_acl(flow->rx_rb, ACL_FLOWDOWN);
-                        while ((idx = ssm_rbuff_read(flow->rx_rb)) >= 0)
-                                ssm_pool_remove(proc.pool, idx);
-                        __flow_fini(i);
-                }
+        list_for_each_safe(p, h, &proc.dealloc_list)
+                list_move(p, &proc.flow_list);
+
+        list_for_each_safe(p, h, &proc.flow_list) {
+                struct flow * flow = list_entry(p, struct flow, next);
+                ssize_t       idx;
+                ssm_rbuff_set_acl(flow->rx_rb, ACL_FLOWDOWN);
+                while ((idx = ssm_rbuff_read(flow->rx_rb)) >= 0)
+                        ssm_pool_remove(proc.pool, idx);
+                __flow_fini(flow->fd);
         }
 
         pthread_cond_destroy(&proc.cond);
@@ -821,8 +1697,7 @@ static void fini(void)
 
         pthread_rwlock_destroy(&proc.lock);
 
-        free(proc.flows);
-        free(proc.id_to_fd);
+        flow_tables_free();
 
         ssm_pool_close(proc.pool);
 
@@ -873,6 +1748,7 @@ int flow_accept(qosspec_t *             qs,
                 return err;
 
         crypt.key = key;
+        crypt.dir = CRYPT_DIR_SRV;
 
         err = flow__irm_result_des(&msg, &flow, &crypt);
         if (err < 0)
@@ -920,6 +1796,7 @@ int flow_alloc(const char *            dst,
         }
 
         crypt.key = key;
+        crypt.dir = CRYPT_DIR_CLI;
 
         err = flow__irm_result_des(&msg, &flow, &crypt);
         if (err < 0)
@@ -959,6 +1836,7 @@ int flow_join(const char *            dst,
                 return err;
 
         crypt.key = key;
+        crypt.dir = CRYPT_DIR_CLI;
 
         err = flow__irm_result_des(&msg, &flow, &crypt);
         if (err < 0)
@@ -988,11 +1866,13 @@ int flow_dealloc(int fd)
 
         memset(&info, 0, sizeof(flow));
 
-        flow = &proc.flows[fd];
+        flow = flow_get(fd);
+        if (flow == NULL)
+                return -ENOTALLOC;
 
         pthread_rwlock_rdlock(&proc.lock);
 
-        if (flow->info.id < 0) {
+        if (flow->info.id < 0 || flow->dealloc) {
                 pthread_rwlock_unlock(&proc.lock);
                 return -ENOTALLOC;
         }
@@ -1047,6 +1927,33 @@ int flow_dealloc(int fd)
         return err;
 }
 
+int flow_dealloc_async(int fd)
+{
+        struct flow * flow;
+
+        if (fd < 0 || fd >= PROG_MAX_FLOWS)
+                return -EINVAL;
+
+        flow = flow_get(fd);
+        if (flow == NULL)
+                return -ENOTALLOC;
+
+        pthread_rwlock_wrlock(&proc.lock);
+
+        if (flow->info.id < 0 || flow->dealloc) {
+                pthread_rwlock_unlock(&proc.lock);
+                return -ENOTALLOC;
+        }
+
+        flow->dealloc = true;
+
+        list_move(&flow->next, &proc.dealloc_list);
+
+        pthread_rwlock_unlock(&proc.lock);
+
+        return 0;
+}
+
 int ipcp_flow_dealloc(int fd)
 {
         struct flow_info info;
@@ -1058,7 +1965,9 @@ int ipcp_flow_dealloc(int fd)
         if (fd < 0 || fd >= SYS_MAX_FLOWS )
                 return -EINVAL;
 
-        flow = &proc.flows[fd];
+        flow = flow_get(fd);
+        if (flow == NULL)
+                return -ENOTALLOC;
 
         memset(&info, 0, sizeof(flow));
 
@@ -1092,27 +2001,35 @@ int fccntl(int fd,
            int cmd,
            ...)
 {
-        uint32_t *        fflags;
-        uint16_t *        cflags;
-        uint16_t          csflags;
-        va_list           l;
-        struct timespec * timeo;
-        qosspec_t *       qs;
-        uint32_t          rx_acl;
-        uint32_t          tx_acl;
-        size_t *          qlen;
-        struct flow *     flow;
+        uint32_t *               fflags;
+        uint16_t *               cflags;
+        uint16_t                 csflags;
+        va_list                  l;
+        struct timespec *        timeo;
+        qosspec_t *              qs;
+        uint32_t                 rx_acl;
+        uint32_t                 tx_acl;
+        size_t *                 qlen;
+        int *                    cc;
+        int *                    fec;
+        struct frct_stat *       st;
+        struct flow_crypt_stat * cs;
+        struct crypt_stat        cst;
+        int                      ret;
+        struct flow *            flow;
 
         if (fd < 0 || fd >= SYS_MAX_FLOWS)
                 return -EBADF;
 
-        flow = &proc.flows[fd];
+        flow = flow_get(fd);
+        if (flow == NULL)
+                return -ENOTALLOC;
 
         va_start(l, cmd);
 
         pthread_rwlock_wrlock(&proc.lock);
 
-        if (flow->info.id < 0) {
+        if (flow->info.id < 0 || flow->dealloc) {
                 pthread_rwlock_unlock(&proc.lock);
                 va_end(l);
                 return -ENOTALLOC;
@@ -1167,6 +2084,17 @@ int fccntl(int fd,
                 qlen  = va_arg(l, size_t *);
                 *qlen = ssm_rbuff_queued(flow->tx_rb);
                 break;
+        case FLOWGCRYPT:
+                cs = va_arg(l, struct flow_crypt_stat *);
+                if (cs == NULL)
+                        goto einval;
+                if (flow->crypt == NULL)
+                        goto eperm;
+                crypt_get_stat(flow->crypt, &cst);
+                cs->epoch   = cst.epoch;
+                cs->n_auth  = cst.n_auth;
+                cs->n_epoch = cst.n_epoch;
+                break;
         case FLOWSFLAGS:
                 flow->oflags = va_arg(l, uint32_t);
                 rx_acl = ssm_rbuff_get_acl(flow->rx_rb);
@@ -1218,6 +2146,50 @@ int fccntl(int fd,
                         goto eperm;
                 *cflags = frcti_getflags(flow->frcti);
                 break;
+        case FRCTSCC:
+                if (flow->frcti == NULL)
+                        goto eperm;
+                ret = frcti_setcc(flow->frcti, va_arg(l, int));
+                if (ret < 0) {
+                        pthread_rwlock_unlock(&proc.lock);
+                        va_end(l);
+                        return ret;
+                }
+                break;
+        case FRCTGCC:
+                cc = va_arg(l, int *);
+                if (cc == NULL)
+                        goto einval;
+                if (flow->frcti == NULL)
+                        goto eperm;
+                *cc = frcti_getcc(flow->frcti);
+                break;
+        case FRCTSFEC:
+                if (flow->frcti == NULL)
+                        goto eperm;
+                ret = frcti_setfec(flow->frcti, va_arg(l, int));
+                if (ret < 0) {
+                        pthread_rwlock_unlock(&proc.lock);
+                        va_end(l);
+                        return ret;
+                }
+                break;
+        case FRCTGFEC:
+                fec = va_arg(l, int *);
+                if (fec == NULL)
+                        goto einval;
+                if (flow->frcti == NULL)
+                        goto eperm;
+                *fec = frcti_getfec(flow->frcti);
+                break;
+        case FRCTGSTAT:
+                st = va_arg(l, struct frct_stat *);
+                if (st == NULL)
+                        goto einval;
+                if (flow->frcti == NULL)
+                        goto eperm;
+                frcti_getstat(flow->frcti, st);
+                break;
         default:
                 pthread_rwlock_unlock(&proc.lock);
                 va_end(l);
@@ -1267,16 +2239,32 @@ static int add_crc(struct ssm_pk_buff * spb)
         return 0;
 }
 
+/* The FEC repair goes out behind the packet that completed its block. */
+static void flow_tx_fec(struct flow * flow,
+                        ssize_t       idx)
+{
+        if (ssm_rbuff_write(flow->tx_rb, idx) < 0) {
+                ssm_pool_remove(proc.pool, idx);
+                return;
+        }
+
+        ssm_flow_set_notify(flow->set, flow->info.id, FLOW_PKT);
+}
+
 static int flow_tx_spb(struct flow *        flow,
                        struct ssm_pk_buff * spb,
+                       uint8_t              fgm,
                        bool                 block,
                        struct timespec *    abstime)
 {
-        struct timespec now;
-        ssize_t         idx;
-        int             ret;
+        struct timespec      now;
+        struct ssm_pk_buff * tx[SPB_BATCH];
+        size_t               n = 1;
+        ssize_t              idx;
+        ssize_t              fec = -1;
+        int                  ret;
 
-        clock_gettime(PTHREAD_COND_CLOCK, &now);
+        clock_gettime(COARSE_CLOCK, &now);
 
         pthread_rwlock_wrlock(&proc.lock);
 
@@ -1289,14 +2277,33 @@ static int flow_tx_spb(struct flow *        flow,
         pthread_rwlock_rdlock(&proc.lock);
 
         if (ssm_pk_buff_len(spb) > 0) {
-                if (frcti_snd(flow->frcti, spb) < 0)
+                if (frcti_snd(flow->frcti, spb, fgm) < 0)
                         goto enomem;
 
-                if (spb_encrypt(flow, spb) < 0)
-                        goto enomem;
+                tx[0] = spb;
 
-                if (flow->info.qs.ber == 0 && add_crc(spb) != 0)
-                        goto enomem;
+                fec = frcti_fec_pop(flow->frcti);
+                if (fec >= 0)
+                        tx[n++] = ssm_pool_get(proc.pool, fec);
+
+                if (flow->txq != NULL)
+                        goto offload;
+
+                if (spb_encrypt_batch(flow, tx, n) < 0) {
+                        if (tx[0] == NULL)
+                                goto enomem;
+                        ssm_pool_remove(proc.pool, fec);
+                        fec = -1;
+                }
+
+                if (flow->info.qs.ber == 0) {
+                        if (add_crc(spb) != 0)
+                                goto enomem;
+                        if (fec >= 0 && add_crc(tx[1]) != 0) {
+                                ssm_pool_remove(proc.pool, fec);
+                                fec = -1;
+                        }
+                }
         }
 
         pthread_cleanup_push(__cleanup_rwlock_unlock, &proc.lock);
@@ -1311,42 +2318,135 @@ static int flow_tx_spb(struct flow *        flow,
         else
                 ssm_flow_set_notify(flow->set, flow->info.id, FLOW_PKT);
 
+        if (fec >= 0)
+                flow_tx_fec(flow, fec);
+
+        pthread_cleanup_pop(true);
+
+        return 0;
+
+offload:
+        pthread_cleanup_push(__cleanup_rwlock_unlock, &proc.lock);
+
+        ret = flow_txq_submit(flow, tx, n, block, abstime);
+
         pthread_cleanup_pop(true);
 
+        if (ret < 0) { /* As a full rbuff, drop. */
+                if (fec >= 0)
+                        ssm_pool_remove(proc.pool, fec);
+                ssm_pool_remove(proc.pool, idx);
+        }
+
         return 0;
 
 enomem:
         pthread_rwlock_unlock(&proc.lock);
+        if (fec >= 0)
+                ssm_pool_remove(proc.pool, fec);
         ssm_pool_remove(proc.pool, idx);
         return -ENOMEM;
 }
 
-ssize_t flow_write(int          fd,
-                   const void * buf,
-                   size_t       count)
+static ssize_t flow_write_pkt(struct flow *     flow,
+                              const void *      buf,
+                              size_t            count,
+                              uint8_t           fgm,
+                              int               flags,
+                              struct timespec * abstime)
 {
-        struct flow *        flow;
         ssize_t              idx;
         int                  ret;
-        int                  flags;
-        struct timespec      abs;
-        struct timespec *    abstime = NULL;
         struct ssm_pk_buff * spb;
         uint8_t *            ptr;
 
+        if (flags & FLOWFWNOBLOCK) {
+                if (!frcti_is_window_open(flow->frcti))
+                        return -EAGAIN;
+                idx = ssm_pool_alloc(proc.pool, count, flow->qc,
+                                     &ptr, &spb);
+        } else {
+                ret = frcti_window_wait(flow->frcti, abstime);
+                if (ret < 0)
+                        return ret;
+                idx = ssm_pool_alloc_b(proc.pool, count, flow->qc,
+                                       &ptr, &spb, abstime);
+        }
+
+        if (idx < 0)
+                return idx;
+
+        if (count > 0)
+                memcpy(ptr, buf, count);
+
+        ret = flow_tx_spb(flow, spb, fgm, !(flags & FLOWFWNOBLOCK), abstime);
+
+        return ret < 0 ? (ssize_t) ret : (ssize_t) count;
+}
+
+/*
+ * Once the first fragment is out, the others block. The receiver
+ * grows its rq to take a datagram on a reliable flow.
+ */
+static ssize_t flow_write_frags(struct flow *     flow,
+                                const uint8_t *   buf,
+                                size_t            count,
+                                int               flags,
+                                struct timespec * abstime)
+{
+        size_t  done;
+        size_t  len;
+        size_t  max;
+        uint8_t fgm;
+        ssize_t ret;
+
+        max = flow->frcti->snd_cr.cflags & FRCTFRTX ? RQ_MAX : FRAG_MAX;
+        if (count > flow->frag * max)
+                return -EMSGSIZE;
+
+        for (done = 0; done < count; done += len) {
+                len = MIN(count - done, flow->frag);
+
+                fgm = done == 0 ? FRCT_FFGM : 0;
+                if (done + len < count)
+                        fgm |= FRCT_MFGM;
+
+                ret = flow_write_pkt(flow, buf + done, len, fgm, flags,
+                                     abstime);
+                if (ret < 0)
+                        return ret;
+
+                flags &= ~FLOWFWNOBLOCK;
+        }
+
+        return count;
+}
+
+ssize_t flow_write(int          fd,
+                   const void * buf,
+                   size_t       count)
+{
+        struct flow *     flow;
+        ssize_t           ret;
+        int               flags;
+        struct timespec   abs;
+        struct timespec * abstime = NULL;
+
         if (buf == NULL && count != 0)
                 return -EINVAL;
 
         if (fd < 0 || fd >= PROG_MAX_FLOWS)
                 return -EBADF;
 
-        flow = &proc.flows[fd];
+        flow = flow_get(fd);
+        if (flow == NULL)
+                return -ENOTALLOC;
 
         clock_gettime(PTHREAD_COND_CLOCK, &abs);
 
         pthread_rwlock_wrlock(&proc.lock);
 
-        if (flow->info.id < 0) {
+        if (flow->info.id < 0 || flow->dealloc) {
                 pthread_rwlock_unlock(&proc.lock);
                 return -ENOTALLOC;
         }
@@ -1363,26 +2463,22 @@ ssize_t flow_write(int          fd,
         if ((flags & FLOWFACCMODE) == FLOWFRDONLY)
                 return -EPERM;
 
-        if (flags & FLOWFWNOBLOCK) {
-                if (!frcti_is_window_open(flow->frcti))
-                        return -EAGAIN;
-                idx = ssm_pool_alloc(proc.pool, count, &ptr, &spb);
-        } else {
-                ret = frcti_window_wait(flow->frcti, abstime);
-                if (ret < 0)
-                        return ret;
-                idx = ssm_pool_alloc_b(proc.pool, count, &ptr, &spb, abstime);
-        }
+        if (flow->frcti == NULL)
+                return flow_write_pkt(flow, buf, count, 0, flags, abstime);
 
-        if (idx < 0)
-                return idx;
+        /* Other writers can't interleave with the fragments. */
+        pthread_mutex_lock(&flow->frcti->snd_mtx);
 
-        if (count > 0)
-                memcpy(ptr, buf, count);
+        pthread_cleanup_push(__cleanup_mutex_unlock, &flow->frcti->snd_mtx);
+
+        if (flow->frag > 0 && count > flow->frag)
+                ret = flow_write_frags(flow, buf, count, flags, abstime);
+        else
+                ret = flow_write_pkt(flow, buf, count, 0, flags, abstime);
 
-        ret = flow_tx_spb(flow, spb, !(flags & FLOWFWNOBLOCK), abstime);
+        pthread_cleanup_pop(true);
 
-        return ret < 0 ? (ssize_t) ret : (ssize_t) count;
+        return ret;
 }
 
 static bool invalid_pkt(struct flow *        flow,
@@ -1413,7 +2509,7 @@ static ssize_t flow_rx_spb(struct flow *         flow,
         if (idx < 0)
                 return idx;
 
-        clock_gettime(PTHREAD_COND_CLOCK, &now);
+        clock_gettime(COARSE_CLOCK, &now);
 
         pthread_rwlock_wrlock(&proc.lock);
 
@@ -1431,6 +2527,40 @@ static ssize_t flow_rx_spb(struct flow *         flow,
         return idx;
 }
 
+/* Reads until FRCT has the next PDU, or one packet on a raw flow. */
+static ssize_t flow_rx_pdu(struct flow *     flow,
+                           bool              block,
+                           struct timespec * abstime)
+{
+        struct ssm_pk_buff * spb;
+        ssize_t              idx = -1;
+
+        pthread_rwlock_rdlock(&proc.lock);
+
+        while ((idx = frcti_queued_pdu(flow->frcti)) < 0) {
+                pthread_rwlock_unlock(&proc.lock);
+
+                idx = flow_rx_spb(flow, &spb, block, abstime);
+                if (idx < 0) {
+                        if (block && idx != -EAGAIN)
+                                return idx;
+                        if (!block)
+                                return idx;
+
+                        pthread_rwlock_rdlock(&proc.lock);
+                        continue;
+                }
+
+                pthread_rwlock_rdlock(&proc.lock);
+
+                frcti_rcv(flow->frcti, spb);
+        }
+
+        pthread_rwlock_unlock(&proc.lock);
+
+        return idx;
+}
+
 ssize_t flow_read(int    fd,
                   void * buf,
                   size_t count)
@@ -1443,19 +2573,22 @@ ssize_t flow_read(int    fd,
         struct timespec      now;
         struct timespec *    abstime = NULL;
         struct flow *        flow;
+        struct frcti *       frcti;
         bool                 block;
         bool                 partrd;
 
         if (fd < 0 || fd >= PROG_MAX_FLOWS)
                 return -EBADF;
 
-        flow = &proc.flows[fd];
+        flow = flow_get(fd);
+        if (flow == NULL)
+                return -ENOTALLOC;
 
         clock_gettime(PTHREAD_COND_CLOCK, &now);
 
         pthread_rwlock_rdlock(&proc.lock);
 
-        if (flow->info.id < 0) {
+        if (flow->info.id < 0 || flow->dealloc) {
                 pthread_rwlock_unlock(&proc.lock);
                 return -ENOTALLOC;
         }
@@ -1474,31 +2607,25 @@ ssize_t flow_read(int    fd,
                 abstime = &abs;
         }
 
-        idx = flow->part_idx;
-        if (idx < 0) {
-                while ((idx = frcti_queued_pdu(flow->frcti)) < 0) {
-                        pthread_rwlock_unlock(&proc.lock);
-
-                        idx = flow_rx_spb(flow, &spb, block, abstime);
-                        if (idx < 0) {
-                                if (block && idx != -EAGAIN)
-                                        return idx;
-                                if (!block)
-                                        return idx;
+        idx   = flow->part_idx;
+        frcti = flow->frcti;
 
-                                pthread_rwlock_rdlock(&proc.lock);
-                                continue;
-                        }
-
-                        pthread_rwlock_rdlock(&proc.lock);
+        pthread_rwlock_unlock(&proc.lock);
 
-                        frcti_rcv(flow->frcti, spb);
-                }
+        if (idx < 0 && frcti != NULL) {
+                /* The rx thread leaves the rbuff to us while we wait. */
+                pthread_mutex_lock(&frcti->rcv_mtx);
+                pthread_cleanup_push(__cleanup_mutex_unlock, &frcti->rcv_mtx);
+                idx = flow_rx_pdu(flow, block, abstime);
+                pthread_cleanup_pop(true);
+        } else if (idx < 0) {
+                idx = flow_rx_pdu(flow, block, abstime);
         }
 
-        spb = ssm_pool_get(proc.pool, idx);
+        if (idx < 0)
+                return idx;
 
-        pthread_rwlock_unlock(&proc.lock);
+        spb = ssm_pool_get(proc.pool, idx);
 
         packet = ssm_pk_buff_head(spb);
 
@@ -1617,7 +2744,9 @@ int fset_add(struct flow_set * set,
         if (set == NULL || fd < 0 || fd >= SYS_MAX_FLOWS)
                 return -EINVAL;
 
-        flow = &proc.flows[fd];
+        flow = flow_get(fd);
+        if (flow == NULL)
+                return -EINVAL;
 
         pthread_rwlock_rdlock(&proc.lock);
 
@@ -1626,6 +2755,11 @@ int fset_add(struct flow_set * set,
                 goto fail;
         }
 
+        if (flow->dealloc) {
+                ret = -ENOTALLOC;
+                goto fail;
+        }
+
         if (flow->frcti != NULL)
                 ssm_flow_set_del(proc.fqset, 0, flow->info.id);
 
@@ -1653,7 +2787,9 @@ void fset_del(struct flow_set * set,
         if (set == NULL || fd < 0 || fd >= SYS_MAX_FLOWS)
                 return;
 
-        flow = &proc.flows[fd];
+        flow = flow_get(fd);
+        if (flow == NULL)
+                return;
 
         pthread_rwlock_rdlock(&proc.lock);
 
@@ -1661,7 +2797,7 @@ void fset_del(struct flow_set * set,
                 ssm_flow_set_del(proc.fqset, set->idx, flow->info.id);
 
         if (flow->frcti != NULL)
-                ssm_flow_set_add(proc.fqset, 0, proc.flows[fd].info.id);
+                ssm_flow_set_add(proc.fqset, 0, flow->info.id);
 
         pthread_rwlock_unlock(&proc.lock);
 }
@@ -1675,11 +2811,13 @@ bool fset_has(const struct flow_set * set,
         if (set == NULL || fd < 0 || fd >= SYS_MAX_FLOWS)
                 return false;
 
-        flow = &proc.flows[fd];
+        flow = flow_get(fd);
+        if (flow == NULL)
+                return false;
 
         pthread_rwlock_rdlock(&proc.lock);
 
-        if (flow->info.id < 0) {
+        if (flow->info.id < 0 || flow->dealloc) {
                 pthread_rwlock_unlock(&proc.lock);
                 return false;
         }
@@ -1705,14 +2843,14 @@ static int fqueue_filter(struct fqueue * fq)
 
                 pthread_rwlock_rdlock(&proc.lock);
 
-                fd = proc.id_to_fd[fq->fqueue[fq->next].flow_id].fd;
+                fd = flow_id_to_fd(fq->fqueue[fq->next].flow_id);
                 if (fd < 0) {
                         ++fq->next;
                         pthread_rwlock_unlock(&proc.lock);
                         continue;
                 }
 
-                frcti = proc.flows[fd].frcti;
+                frcti = flow_get(fd)->frcti;
                 if (frcti == NULL) {
                         pthread_rwlock_unlock(&proc.lock);
                         return 1;
@@ -1725,9 +2863,18 @@ static int fqueue_filter(struct fqueue * fq)
 
                 pthread_rwlock_unlock(&proc.lock);
 
-                idx = flow_rx_spb(&proc.flows[fd], &spb, false, NULL);
-                if (idx < 0)
-                        return 0;
+                /* A blocked reader handles its own packets. */
+                if (pthread_mutex_trylock(&frcti->rcv_mtx)) {
+                        ++fq->next;
+                        continue;
+                }
+
+                idx = flow_rx_spb(flow_get(fd), &spb, false, NULL);
+                if (idx < 0) { /* A reader beat us to it. */
+                        pthread_mutex_unlock(&frcti->rcv_mtx);
+                        ++fq->next;
+                        continue;
+                }
 
                 pthread_rwlock_rdlock(&proc.lock);
 
@@ -1735,6 +2882,8 @@ static int fqueue_filter(struct fqueue * fq)
 
                 __frcti_rcv(frcti, spb);
 
+                pthread_mutex_unlock(&frcti->rcv_mtx);
+
                 if (__frcti_pdu_ready(frcti) >= 0) {
                         pthread_rwlock_unlock(&proc.lock);
                         return 1;
@@ -1766,7 +2915,7 @@ int fqueue_next(struct fqueue * fq)
 
         e = fq->fqueue + fq->next;
 
-        fd = proc.id_to_fd[e->flow_id].fd;
+        fd = flow_id_to_fd(e->flow_id);
 
         ++fq->next;
 
@@ -1857,7 +3006,7 @@ int np1_flow_dealloc(int    flow_id,
 
         pthread_rwlock_rdlock(&proc.lock);
 
-        fd = proc.id_to_fd[flow_id].fd;
+        fd = flow_id_to_fd(flow_id);
 
         pthread_rwlock_unlock(&proc.lock);
 
@@ -1874,7 +3023,7 @@ int np1_flow_resp(int flow_id,
 
         pthread_rwlock_rdlock(&proc.lock);
 
-        fd = proc.id_to_fd[flow_id].fd;
+        fd = flow_id_to_fd(flow_id);
 
         pthread_rwlock_unlock(&proc.lock);
 
@@ -1900,6 +3049,7 @@ int ipcp_create_r(const struct ipcp_info * info)
 int ipcp_flow_req_arr(const buffer_t * dst,
                       qosspec_t        qs,
                       time_t           mpl,
+                      size_t           mtu,
                       const buffer_t * data)
 {
         struct flow_info flow;
@@ -1916,6 +3066,7 @@ int ipcp_flow_req_arr(const buffer_t * dst,
         flow.n_1_pid = getpid();
         flow.qs      = qs;
         flow.mpl     = mpl;
+        flow.mtu     = mtu;
 
         if (ipcp_flow_req_arr__irm_req_ser(&msg, dst, &flow, data) < 0)
                 return -ENOMEM;
@@ -1925,6 +3076,7 @@ int ipcp_flow_req_arr(const buffer_t * dst,
                 return err;
 
         crypt.key = key;
+        crypt.dir = CRYPT_DIR_SRV;
 
         err = flow__irm_result_des(&msg, &flow, &crypt);
         if (err < 0)
@@ -1936,6 +3088,7 @@ int ipcp_flow_req_arr(const buffer_t * dst,
         flow.n_1_pid = flow.n_pid;
         flow.n_pid   = getpid();
         flow.mpl     = 0;
+        flow.mtu     = 0;
         flow.qs      = qos_np1;
 
         crypt.nid = NID_undef;
@@ -1946,6 +3099,7 @@ int ipcp_flow_req_arr(const buffer_t * dst,
 int ipcp_flow_alloc_reply(int              fd,
                           int              response,
                           time_t           mpl,
+                          size_t           mtu,
                           const buffer_t * data)
 {
         struct flow_info flow;
@@ -1957,11 +3111,12 @@ int ipcp_flow_alloc_reply(int              fd,
 
         pthread_rwlock_rdlock(&proc.lock);
 
-        flow.id = proc.flows[fd].info.id;
+        flow.id = flow_get(fd)->info.id;
 
         pthread_rwlock_unlock(&proc.lock);
 
         flow.mpl         = mpl;
+        flow.mtu         = mtu;
 
         if (ipcp_flow_alloc_reply__irm_msg_ser(&msg, &flow, response, data) < 0)
                 return -ENOMEM;
@@ -1982,7 +3137,7 @@ int ipcp_flow_read(int                   fd,
         assert(fd >= 0 && fd < SYS_MAX_FLOWS);
         assert(spb);
 
-        flow = &proc.flows[fd];
+        flow = flow_get(fd);
 
         pthread_rwlock_rdlock(&proc.lock);
 
@@ -2014,11 +3169,13 @@ int ipcp_flow_write(int                  fd,
         assert(fd >= 0 && fd < SYS_MAX_FLOWS);
         assert(spb);
 
-        flow = &proc.flows[fd];
+        flow = flow_get(fd);
+        if (flow == NULL)
+                return -ENOTALLOC;
 
         pthread_rwlock_wrlock(&proc.lock);
 
-        if (flow->info.id < 0) {
+        if (flow->info.id < 0 || flow->dealloc) {
                 pthread_rwlock_unlock(&proc.lock);
                 return -ENOTALLOC;
         }
@@ -2030,7 +3187,7 @@ int ipcp_flow_write(int                  fd,
 
         pthread_rwlock_unlock(&proc.lock);
 
-        ret = flow_tx_spb(flow, spb, true, NULL);
+        ret = flow_tx_spb(flow, spb, 0, true, NULL);
 
         return ret;
 }
@@ -2038,6 +3195,7 @@ int ipcp_flow_write(int                  fd,
 static int pool_copy_spb(struct ssm_pool *     src_pool,
                          ssize_t               src_idx,
                          struct ssm_pool *     dst_pool,
+                         qoscube_t             qc,
                          struct ssm_pk_buff ** dst_spb)
 {
         struct ssm_pk_buff * src;
@@ -2047,7 +3205,7 @@ static int pool_copy_spb(struct ssm_pool *     src_pool,
         src = ssm_pool_get(src_pool, src_idx);
         len = ssm_pk_buff_len(src);
 
-        if (ssm_pool_alloc(dst_pool, len, &ptr, dst_spb) < 0) {
+        if (ssm_pool_alloc(dst_pool, len, qc, &ptr, dst_spb) < 0) {
                 ssm_pool_remove(src_pool, src_idx);
                 return -ENOMEM;
         }
@@ -2068,7 +3226,7 @@ int np1_flow_read(int                   fd,
         assert(fd >= 0 && fd < SYS_MAX_FLOWS);
         assert(spb);
 
-        flow = &proc.flows[fd];
+        flow = flow_get(fd);
 
         assert(flow->info.id >= 0);
 
@@ -2086,7 +3244,7 @@ int np1_flow_read(int                   fd,
                 *spb = ssm_pool_get(proc.pool, idx);
         } else {
                 /* Cross-pool copy: PUP -> GSPP */
-                if (pool_copy_spb(pool, idx, proc.pool, spb) < 0)
+                if (pool_copy_spb(pool, idx, proc.pool, flow->qc, spb) < 0)
                         return -ENOMEM;
         }
 
@@ -2105,11 +3263,13 @@ int np1_flow_write(int                  fd,
         assert(fd >= 0 && fd < SYS_MAX_FLOWS);
         assert(spb);
 
-        flow = &proc.flows[fd];
+        flow = flow_get(fd);
+        if (flow == NULL)
+                return -ENOTALLOC;
 
         pthread_rwlock_rdlock(&proc.lock);
 
-        if (flow->info.id < 0) {
+        if (flow->info.id < 0 || flow->dealloc) {
                 pthread_rwlock_unlock(&proc.lock);
                 return -ENOTALLOC;
         }
@@ -2131,7 +3291,7 @@ int np1_flow_write(int                  fd,
                         ssm_flow_set_notify(flow->set, flow->info.id, FLOW_PKT);
         } else {
                 /* Cross-pool copy: GSPP -> PUP */
-                if (pool_copy_spb(proc.pool, idx, pool, &dst) < 0)
+                if (pool_copy_spb(proc.pool, idx, pool, flow->qc, &dst) < 0)
                         return -ENOMEM;
                 idx = ssm_pk_buff_get_idx(dst);
                 ret = ssm_rbuff_write_b(flow->tx_rb, idx, NULL);
@@ -2144,10 +3304,15 @@ int np1_flow_write(int                  fd,
         return ret;
 }
 
+/* IPCPs carry all cubes and can't classify before reading. */
 int ipcp_spb_reserve(struct ssm_pk_buff ** spb,
                      size_t                len)
 {
-        return ssm_pool_alloc_b(proc.pool, len, NULL, spb, NULL) < 0 ? -1 : 0;
+        ssize_t idx;
+
+        idx = ssm_pool_alloc_b(proc.pool, len, SSM_QC_IPCP, NULL, spb, NULL);
+
+        return idx < 0 ? -1 : 0;
 }
 
 void ipcp_spb_release(struct ssm_pk_buff * spb)
@@ -2157,25 +3322,27 @@ void ipcp_spb_release(struct ssm_pk_buff * spb)
 
 int ipcp_flow_fini(int fd)
 {
+        struct flow *      flow;
         struct ssm_rbuff * rx_rb;
 
         assert(fd >= 0 && fd < SYS_MAX_FLOWS);
 
         pthread_rwlock_rdlock(&proc.lock);
 
-        if (proc.flows[fd].info.id < 0) {
+        flow = flow_get(fd);
+        if (flow == NULL || flow->info.id < 0) {
                 pthread_rwlock_unlock(&proc.lock);
                 return -1;
         }
 
-        ssm_rbuff_set_acl(proc.flows[fd].rx_rb, ACL_FLOWDOWN);
-        ssm_rbuff_set_acl(proc.flows[fd].tx_rb, ACL_FLOWDOWN);
+        ssm_rbuff_set_acl(flow->rx_rb, ACL_FLOWDOWN);
+        ssm_rbuff_set_acl(flow->tx_rb, ACL_FLOWDOWN);
 
-        ssm_flow_set_notify(proc.flows[fd].set,
-                            proc.flows[fd].info.id,
+        ssm_flow_set_notify(flow->set,
+                            flow->info.id,
                             FLOW_DEALLOC);
 
-        rx_rb = proc.flows[fd].rx_rb;
+        rx_rb = flow->rx_rb;
 
         pthread_rwlock_unlock(&proc.lock);
 
@@ -2193,9 +3360,9 @@ int ipcp_flow_get_qoscube(int         fd,
 
         pthread_rwlock_rdlock(&proc.lock);
 
-        assert(proc.flows[fd].info.id >= 0);
+        assert(flow_get(fd)->info.id >= 0);
 
-        *cube = qos_spec_to_cube(proc.flows[fd].info.qs);
+        *cube = qos_spec_to_cube(flow_get(fd)->info.qs);
 
         pthread_rwlock_unlock(&proc.lock);
 
@@ -2208,9 +3375,9 @@ size_t ipcp_flow_queued(int fd)
 
         pthread_rwlock_rdlock(&proc.lock);
 
-        assert(proc.flows[fd].info.id >= 0);
+        assert(flow_get(fd)->info.id >= 0);
 
-        q = ssm_rbuff_queued(proc.flows[fd].tx_rb);
+        q = ssm_rbuff_queued(flow_get(fd)->tx_rb);
 
         pthread_rwlock_unlock(&proc.lock);
 
@@ -2233,8 +3400,8 @@ int local_flow_transfer(int               src_fd,
         assert(src_fd >= 0);
         assert(dst_fd >= 0);
 
-        src_flow = &proc.flows[src_fd];
-        dst_flow = &proc.flows[dst_fd];
+        src_flow = flow_get(src_fd);
+        dst_flow = flow_get(dst_fd);
 
         sp = src_pool == NULL ? proc.pool : src_pool;
         dp = dst_pool == NULL ? proc.pool : dst_pool;
@@ -2247,7 +3414,7 @@ int local_flow_transfer(int               src_fd,
                 return idx;
         }
 
-        if (dst_flow->info.id < 0) {
+        if (dst_flow->info.id < 0 || dst_flow->dealloc) {
                 pthread_rwlock_unlock(&proc.lock);
                 ssm_pool_remove(sp, idx);
                 return -ENOTALLOC;
@@ -2265,7 +3432,7 @@ int local_flow_transfer(int               src_fd,
                                             dst_flow->info.id, FLOW_PKT);
         } else {
                 /* Different pools: single copy */
-                if (pool_copy_spb(sp, idx, dp, &dst_spb) < 0)
+                if (pool_copy_spb(sp, idx, dp, dst_flow->qc, &dst_spb) < 0)
                         return -ENOMEM;
 
                 idx = ssm_pk_buff_get_idx(dst_spb);
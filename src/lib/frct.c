@@ -22,12 +22,30 @@
 
 #include <ouroboros/endian.h>
 
+#include "cc/pol.h"
+
 #define DELT_RDV         (100 * MILLION) /* ns */
 #define MAX_RDV            (1 * BILLION) /* ns */
+#define DUP_ACKS         3               /* Loss without SACK   */
+
+/* Pace a bit faster than the window, the ACK clock stays in charge. */
+#define PACE_INTV(srtt, wnd) ((srtt) / (wnd) * 3 / 4)
 
 #define FRCT             "frct"
 #define FRCT_PCILEN      (sizeof(struct frct_pci))
 #define FRCT_NAME_STRLEN 32
+#define FRCT_SACK_BLKS   4
+#define FRCT_RUNS        (FRCT_SACK_BLKS << 1)
+#define FRCT_SACKLEN(n)  (offsetof(struct frct_sack, blk) \
+                          + (n) * sizeof(struct frct_sack_blk))
+#define FEC_MAX_K        64
+
+/* Relaxed, counters may be bumped outside of the frcti lock. */
+#define STAT_INC(x)      (__atomic_fetch_add(&(x), 1, __ATOMIC_RELAXED))
+#define STAT_GET(x)      (__atomic_load_n(&(x), __ATOMIC_RELAXED))
+
+/* A SACK goes with an ACK, alone it marks an FEC repair packet. */
+#define FRCT_IS_FEC(flags) (((flags) & (FRCT_SACK | FRCT_ACK)) == FRCT_SACK)
 
 struct frct_cr {
         uint32_t        lwe;     /* Left window edge               */
@@ -40,6 +58,38 @@ struct frct_cr {
         time_t          inact;   /* Inactivity (s)                 */
 };
 
+struct frct_sack_blk {
+        uint32_t start;
+        uint32_t end;    /* First seqno not received */
+};
+
+/* XOR of a block of k packets, aligned on the seqno. */
+struct fec_tx {
+        size_t            k;
+        uint32_t          base;        /* First seqno of block   */
+        size_t            n;           /* Packets in the parity  */
+        size_t            max;         /* Longest payload        */
+        uint16_t          len;         /* XOR of the lengths     */
+        uint8_t           fgm;         /* XOR of fragment flags  */
+        ssize_t           idx;         /* Repair to send         */
+        uint8_t           buf[FRAG_SIZE];
+};
+
+struct fec_rx {
+        size_t            k;
+        uint32_t          base;        /* First seqno of block   */
+        size_t            n;           /* Packets in the parity  */
+        uint64_t          seen;        /* Packets in the block   */
+        bool              done;        /* Repair was handled     */
+        uint16_t          len;         /* XOR of the lengths     */
+        uint8_t           fgm;         /* XOR of fragment flags  */
+        size_t            n_hold;      /* Held behind a loss     */
+        ssize_t           hidx[FEC_MAX_K]; /* By offset in block */
+        uint8_t           hfgm[FEC_MAX_K];
+        struct timespec   t_hold;      /* First packet held      */
+        uint8_t           buf[FRAG_SIZE];
+};
+
 struct frcti {
         int               fd;
 
@@ -54,7 +104,20 @@ struct frcti {
         uint32_t          rttseq;
         struct timespec   t_probe;     /* Probe time             */
         bool              probe;       /* Probe active           */
-#ifdef PROC_FLOW_STATS
+
+        struct cc_ops *   cc;          /* Congestion control     */
+        void *            cc_ctx;
+        int               cc_pol;      /* FRCTCC* policy         */
+        uint32_t          cc_rcvr;     /* Loss handled up to     */
+        bool              cc_wait;     /* Writer waits for wnd   */
+
+        uint64_t          bw;          /* qosspec bandwidth, b/s */
+        struct timespec   t_pace;      /* Next paced packet      */
+
+        struct fec_tx *   fec_tx;      /* Sender parity          */
+        struct fec_rx *   fec_rx;      /* Receiver recovery      */
+
+        /* Always counted, see STAT_INC. */
         size_t            n_rtx;       /* Number of rxm packets  */
         size_t            n_prb;       /* Number of rtt probes   */
         size_t            n_rtt;       /* Number of estimates    */
@@ -63,12 +126,32 @@ struct frcti {
         size_t            n_rdv;       /* Number of rdv packets  */
         size_t            n_out;       /* Packets out of window  */
         size_t            n_rqo;       /* Packets out of rqueue  */
-#endif
+        size_t            n_sak;       /* Rxm skipped, SACK'd    */
+        size_t            n_pce;       /* Writer held by pacer   */
+        size_t            n_fec;       /* Recovered by FEC       */
+
         struct frct_cr    snd_cr;
         struct frct_cr    rcv_cr;
 
-
-        ssize_t           rq[RQ_SIZE];
+        bool              snd_more;    /* Datagram partly sent   */
+
+        uint32_t          rq_hi;       /* Past highest seqno     */
+        size_t            n_run;       /* Received runs in rq    */
+        struct frct_sack_blk run[FRCT_RUNS];
+        bool              sack_new;    /* rq changed, ACK now    */
+        bool              ack_pend;    /* Delayed ACK scheduled  */
+        size_t            n_unack;     /* Received since ACK     */
+        size_t            n_sack;      /* Blocks from the peer   */
+        size_t            n_dupack;    /* ACKs that kept the lwe */
+        struct frct_sack_blk sack[FRCT_SACK_BLKS];
+
+        ssize_t *         rq;          /* Reorder queue          */
+        uint8_t *         rqf;         /* Fragment flags         */
+        size_t            rq_size;     /* Grows up to RQ_MAX     */
+        uint32_t          frag_lwe;    /* Run being reassembled  */
+        size_t            frag_n;      /* Fragments in that run  */
+        bool              frag_more;   /* Last seen needs more   */
+        struct timespec   frag_t0;     /* First fragment arrived */
         pthread_rwlock_t  lock;
 
         bool              open;        /* Window open/closed     */
@@ -76,6 +159,9 @@ struct frcti {
         struct timespec   t_rdvs;      /* Last rendez-vous sent  */
         pthread_cond_t    cond;
         pthread_mutex_t   mtx;
+
+        pthread_mutex_t   snd_mtx;     /* Keeps fragments together */
+        pthread_mutex_t   rcv_mtx;     /* Held by a reader on the rbuff */
 };
 
 enum frct_flags {
@@ -86,8 +172,16 @@ enum frct_flags {
         FRCT_RDVS = 0x10, /* Rendez-vous      */
         FRCT_FFGM = 0x20, /* First Fragment   */
         FRCT_MFGM = 0x40, /* More fragments   */
+        FRCT_SACK = 0x80, /* SACK follows PCI */
 };
 
+/*
+ * FEC repair packets have no flag of their own. They set FRCT_SACK
+ * without FRCT_ACK, see FRCT_IS_FEC, which a bare ACK never does.
+ * The seqno is the first of the k packets in the block, the window
+ * and ackno are 0. A struct frct_fec and the XOR of the payloads of
+ * the block follow the PCI.
+ */
 struct frct_pci {
         uint8_t  flags;
 
@@ -98,17 +192,71 @@ struct frct_pci {
         uint32_t ackno;
 } __attribute__((packed));
 
+/* Received ranges above the ackno, only sent on bare ACKs. */
+struct frct_sack {
+        uint8_t              n;
+        uint8_t              pad[3];
+        struct frct_sack_blk blk[FRCT_SACK_BLKS];
+} __attribute__((packed));
+
+/* XOR of a block of packets, the parity follows. */
+struct frct_fec {
+        uint8_t              k;
+        uint8_t              fgm;
+        uint16_t             len;
+} __attribute__((packed));
+
+static void frcti_getstat(struct frcti *     frcti,
+                          struct frct_stat * st)
+{
+        assert(frcti);
+        assert(st);
+
+        memset(st, 0, sizeof(*st));
+
+        pthread_rwlock_rdlock(&frcti->lock);
+
+        st->srtt      = frcti->srtt;
+        st->mdev      = frcti->mdev;
+        st->rto       = frcti->rto;
+        st->cwnd      = frcti->cc == NULL ? 0 : frcti->cc->wnd(frcti->cc_ctx);
+        st->rq_size   = frcti->rq_size;
+        st->snd_lwe   = frcti->snd_cr.lwe;
+        st->snd_rwe   = frcti->snd_cr.rwe;
+        st->snd_seqno = frcti->snd_cr.seqno;
+        st->rcv_lwe   = frcti->rcv_cr.lwe;
+        st->rcv_rwe   = frcti->rcv_cr.rwe;
+        st->rcv_ackno = frcti->rcv_cr.seqno;
+
+        pthread_rwlock_unlock(&frcti->lock);
+
+        st->n_rtx = STAT_GET(frcti->n_rtx);
+        st->n_prb = STAT_GET(frcti->n_prb);
+        st->n_rtt = STAT_GET(frcti->n_rtt);
+        st->n_dup = STAT_GET(frcti->n_dup);
+        st->n_dak = STAT_GET(frcti->n_dak);
+        st->n_rdv = STAT_GET(frcti->n_rdv);
+        st->n_out = STAT_GET(frcti->n_out);
+        st->n_rqo = STAT_GET(frcti->n_rqo);
+        st->n_sak = STAT_GET(frcti->n_sak);
+        st->n_pce = STAT_GET(frcti->n_pce);
+        st->n_fec = STAT_GET(frcti->n_fec);
+}
+
 #ifdef PROC_FLOW_STATS
 
 static int frct_rib_read(const char * path,
                          char *       buf,
                          size_t       len)
 {
-        struct timespec now;
-        char *          entry;
-        struct flow *   flow;
-        struct frcti *  frcti;
-        int             fd;
+        struct timespec  now;
+        struct frct_stat st;
+        char *           entry;
+        struct flow *    flow;
+        struct frcti *   frcti;
+        int              fd;
+        time_t           snd_inact;
+        time_t           rcv_inact;
 
         (void) len;
 
@@ -118,63 +266,78 @@ static int frct_rib_read(const char * path,
 
         fd = atoi(path);
 
-        flow = &proc.flows[fd];
+        flow = flow_get(fd);
 
-        clock_gettime(PTHREAD_COND_CLOCK, &now);
+        clock_gettime(COARSE_CLOCK, &now);
 
         pthread_rwlock_rdlock(&proc.lock);
 
         frcti = flow->frcti;
 
+        frcti_getstat(frcti, &st);
+
         pthread_rwlock_rdlock(&frcti->lock);
 
+        snd_inact = ts_diff_ns(&now, &frcti->snd_cr.act);
+        rcv_inact = ts_diff_ns(&now, &frcti->rcv_cr.act);
+
         sprintf(buf,
                 "Maximum packet lifetime (ns):    %20ld\n"
                 "Max time to Ack (ns):            %20ld\n"
                 "Max time to Retransmit (ns):     %20ld\n"
-                "Smoothed rtt (ns):               %20ld\n"
-                "RTT standard deviation (ns):     %20ld\n"
-                "Retransmit timeout RTO (ns):     %20ld\n"
+                "Smoothed rtt (ns):               %20" PRIu64 "\n"
+                "RTT standard deviation (ns):     %20" PRIu64 "\n"
+                "Retransmit timeout RTO (ns):     %20" PRIu64 "\n"
                 "Sender left window edge:         %20u\n"
                 "Sender right window edge:        %20u\n"
                 "Sender inactive (ns):            %20lld\n"
                 "Sender current sequence number:  %20u\n"
+                "Congestion window (packets):     %20" PRIu64 "\n"
+                "Reorder queue size (packets):    %20" PRIu64 "\n"
                 "Receiver left window edge:       %20u\n"
                 "Receiver right window edge:      %20u\n"
                 "Receiver inactive (ns):          %20lld\n"
                 "Receiver last ack:               %20u\n"
-                "Number of pkt retransmissions:   %20zu\n"
-                "Number of rtt probes:            %20zu\n"
-                "Number of rtt estimates:         %20zu\n"
-                "Number of duplicates received:   %20zu\n"
-                "Number of delayed acks received: %20zu\n"
-                "Number of rendez-vous sent:      %20zu\n"
-                "Number of packets out of window: %20zu\n"
-                "Number of packets out of rqueue: %20zu\n",
+                "Number of pkt retransmissions:   %20" PRIu64 "\n"
+                "Number of rtt probes:            %20" PRIu64 "\n"
+                "Number of rtt estimates:         %20" PRIu64 "\n"
+                "Number of duplicates received:   %20" PRIu64 "\n"
+                "Number of delayed acks received: %20" PRIu64 "\n"
+                "Number of rendez-vous sent:      %20" PRIu64 "\n"
+                "Number of packets out of window: %20" PRIu64 "\n"
+                "Number of packets out of rqueue: %20" PRIu64 "\n"
+                "Number of SACK'd rxm skipped:    %20" PRIu64 "\n"
+                "Number of paced waits:           %20" PRIu64 "\n"
+                "Number of FEC recoveries:        %20" PRIu64 "\n",
                 frcti->mpl,
                 frcti->a,
                 frcti->r,
-                frcti->srtt,
-                frcti->mdev,
-                frcti->rto,
-                frcti->snd_cr.lwe,
-                frcti->snd_cr.rwe,
-                ts_diff_ns(&now, &frcti->snd_cr.act),
-                frcti->snd_cr.seqno,
-                frcti->rcv_cr.lwe,
-                frcti->rcv_cr.rwe,
-                ts_diff_ns(&now, &frcti->rcv_cr.act),
-                frcti->rcv_cr.seqno,
-                frcti->n_rtx,
-                frcti->n_prb,
-                frcti->n_rtt,
-                frcti->n_dup,
-                frcti->n_dak,
-                frcti->n_rdv,
-                frcti->n_out,
-                frcti->n_rqo);
-
-        pthread_rwlock_unlock(&flow->frcti->lock);
+                st.srtt,
+                st.mdev,
+                st.rto,
+                st.snd_lwe,
+                st.snd_rwe,
+                (long long) snd_inact,
+                st.snd_seqno,
+                st.cwnd,
+                st.rq_size,
+                st.rcv_lwe,
+                st.rcv_rwe,
+                (long long) rcv_inact,
+                st.rcv_ackno,
+                st.n_rtx,
+                st.n_prb,
+                st.n_rtt,
+                st.n_dup,
+                st.n_dak,
+                st.n_rdv,
+                st.n_out,
+                st.n_rqo,
+                st.n_sak,
+                st.n_pce,
+                st.n_fec);
+
+        pthread_rwlock_unlock(&frcti->lock);
 
         pthread_rwlock_unlock(&proc.lock);
 
@@ -205,7 +368,7 @@ static int frct_rib_getattr(const char *      path,
         (void) path;
         (void) attr;
 
-        attr->size  = 1189;
+        attr->size  = 1459;
         attr->mtime = 0;
 
         return 0;
@@ -232,34 +395,55 @@ static bool after(uint32_t seq1,
         return (int32_t)(seq2 - seq1) < 0;
 }
 
-static void __send_frct_pkt(int      fd,
-                            uint8_t  flags,
-                            uint32_t ackno,
-                            uint32_t rwe)
+static void __send_frct_pkt(int                      fd,
+                            uint8_t                  flags,
+                            uint32_t                 ackno,
+                            uint32_t                 rwe,
+                            const struct frct_sack * sack)
 {
         struct ssm_pk_buff * spb;
         struct frct_pci *    pci;
+        struct frct_sack *   s;
         ssize_t              idx;
+        size_t               len;
+        size_t               i;
         struct flow *        f;
 
+        assert(!(flags & FRCT_SACK) || sack != NULL);
+
+        len = sizeof(*pci);
+        if (flags & FRCT_SACK)
+                len += FRCT_SACKLEN(sack->n);
+
         /* Raw calls needed to bypass frcti. */
 #ifdef RXM_BLOCKING
-        idx = ssm_pool_alloc_b(proc.pool, sizeof(*pci), NULL, &spb, NULL);
+        idx = ssm_pool_alloc_b(proc.pool, len, flow_get(fd)->qc,
+                               NULL, &spb, NULL);
 #else
-        idx = ssm_pool_alloc(proc.pool, sizeof(*pci), NULL, &spb);
+        idx = ssm_pool_alloc(proc.pool, len, flow_get(fd)->qc,
+                             NULL, &spb);
 #endif
         if (idx < 0)
                 return;
 
         pci = (struct frct_pci *) ssm_pk_buff_head(spb);
-        memset(pci, 0, sizeof(*pci));
+        memset(pci, 0, len);
 
         *((uint32_t *) pci) = hton32(rwe);
 
         pci->flags = flags;
         pci->ackno = hton32(ackno);
 
-        f = &proc.flows[fd];
+        if (flags & FRCT_SACK) {
+                s = (struct frct_sack *) (pci + 1);
+                s->n = sack->n;
+                for (i = 0; i < sack->n; ++i) {
+                        s->blk[i].start = hton32(sack->blk[i].start);
+                        s->blk[i].end   = hton32(sack->blk[i].end);
+                }
+        }
+
+        f = flow_get(fd);
 
         if (spb_encrypt(f, spb) < 0)
                 goto fail;
@@ -280,21 +464,126 @@ static void __send_frct_pkt(int      fd,
         return;
 }
 
+/* Needs the wrlock, drops the runs the reader took. */
+static void frcti_run_prune(struct frcti * frcti)
+{
+        uint32_t lwe = frcti->rcv_cr.lwe;
+        size_t   n   = 0;
+        size_t   i;
+
+        for (i = 0; i < frcti->n_run; ++i) {
+                if (!after(frcti->run[i].end, lwe))
+                        continue;
+
+                frcti->run[n] = frcti->run[i];
+                if (before(frcti->run[n].start, lwe))
+                        frcti->run[n].start = lwe;
+                ++n;
+        }
+
+        frcti->n_run = n;
+}
+
+/*
+ * Needs the wrlock, adds seqno to the ascending runs received in the
+ * rq. When they run out, the highest run is forgotten, it gets
+ * retransmitted at worst.
+ */
+static void frcti_run_add(struct frcti * frcti,
+                          uint32_t       seqno)
+{
+        struct frct_sack_blk * run = frcti->run;
+        size_t                 i;
+
+        if (frcti->n_run == FRCT_RUNS)
+                frcti_run_prune(frcti);
+
+        for (i = 0; i < frcti->n_run; ++i)
+                if (!before(run[i].end, seqno))
+                        break;
+
+        if (i < frcti->n_run && run[i].end == seqno) {
+                run[i].end = seqno + 1;
+                if (i + 1 < frcti->n_run && run[i + 1].start == run[i].end) {
+                        run[i].end = run[i + 1].end;
+                        memmove(&run[i + 1], &run[i + 2], (frcti->n_run
+                                - i - 2) * sizeof(*run));
+                        --frcti->n_run;
+                }
+                return;
+        }
+
+        if (i < frcti->n_run && !before(seqno, run[i].start))
+                return;
+
+        if (i < frcti->n_run && run[i].start == seqno + 1) {
+                run[i].start = seqno;
+                return;
+        }
+
+        if (i == FRCT_RUNS)
+                return;
+
+        if (frcti->n_run == FRCT_RUNS)
+                --frcti->n_run;
+
+        memmove(&run[i + 1], &run[i], (frcti->n_run - i) * sizeof(*run));
+
+        run[i].start = seqno;
+        run[i].end   = seqno + 1;
+
+        ++frcti->n_run;
+}
+
+/* Collect the received ranges in the rq, called under the wrlock. */
+static size_t frcti_sack_fill(struct frcti *     frcti,
+                              struct frct_sack * sack)
+{
+        size_t i;
+
+        frcti_run_prune(frcti);
+
+        sack->n = MIN(frcti->n_run, FRCT_SACK_BLKS);
+
+        for (i = 0; i < sack->n; ++i)
+                sack->blk[i] = frcti->run[i];
+
+        return sack->n;
+}
+
+static bool frcti_is_sacked(struct frcti * frcti,
+                            uint32_t       seqno)
+{
+        size_t i;
+
+        for (i = 0; i < frcti->n_sack; ++i)
+                if (!before(seqno, frcti->sack[i].start)
+                    && before(seqno, frcti->sack[i].end))
+                        return true;
+
+        return false;
+}
+
 static void send_frct_pkt(struct frcti * frcti)
 {
         struct timespec      now;
+        struct frct_sack     sack;
         time_t               diff;
         uint32_t             ackno;
         uint32_t             rwe;
+        uint8_t              flags = FRCT_ACK | FRCT_FC;
+        bool                 sack_new;
         int                  fd;
 
         assert(frcti);
 
-        clock_gettime(PTHREAD_COND_CLOCK, &now);
+        clock_gettime(COARSE_CLOCK, &now);
 
         pthread_rwlock_wrlock(&frcti->lock);
 
-        if (!after(frcti->rcv_cr.lwe, frcti->rcv_cr.seqno)) {
+        sack_new = frcti->sack_new;
+
+        if (!after(frcti->rcv_cr.lwe, frcti->rcv_cr.seqno) && !sack_new) {
                 pthread_rwlock_unlock(&frcti->lock);
                 return;
         }
@@ -309,22 +598,110 @@ static void send_frct_pkt(struct frcti * frcti)
                 return;
         }
 
+        /* Data carries the ACK, but not the SACK. */
         diff = ts_diff_ns(&now, &frcti->snd_cr.act);
-        if (diff < TICTIME) {
+        if (diff < TICTIME && !sack_new) {
                 pthread_rwlock_unlock(&frcti->lock);
                 return;
         }
 
         frcti->rcv_cr.seqno = frcti->rcv_cr.lwe;
+        frcti->sack_new     = false;
+        frcti->n_unack      = 0;
+
+        if ((frcti->rcv_cr.cflags & FRCTFSACK)
+            && frcti_sack_fill(frcti, &sack) > 0)
+                flags |= FRCT_SACK;
 
         pthread_rwlock_unlock(&frcti->lock);
 
-        __send_frct_pkt(fd, FRCT_ACK | FRCT_FC, ackno, rwe);
+        __send_frct_pkt(fd, flags, ackno, rwe, &sack);
 }
 
 static void __send_rdv(int fd)
 {
-        __send_frct_pkt(fd, FRCT_RDVS, 0, 0);
+        __send_frct_pkt(fd, FRCT_RDVS, 0, 0, NULL);
+}
+
+/* Needs the wrlock if the frcti is in use. */
+static int __frcti_set_cc(struct frcti * frcti,
+                          int            pol)
+{
+        struct cc_ops * ops;
+        void *          ctx = NULL;
+
+        switch (pol) {
+        case FRCTCCNONE:
+                ops = NULL;
+                break;
+        case FRCTCCRENO:
+                ops = &reno_cc_ops;
+                break;
+        default:
+                return -EINVAL;
+        }
+
+        if (ops != NULL) {
+                ctx = ops->ctx_create();
+                if (ctx == NULL)
+                        return -ENOMEM;
+        }
+
+        if (frcti->cc != NULL)
+                frcti->cc->ctx_destroy(frcti->cc_ctx);
+
+        frcti->cc      = ops;
+        frcti->cc_ctx  = ctx;
+        frcti->cc_pol  = pol;
+        frcti->cc_rcvr = frcti->snd_cr.seqno;
+
+        return 0;
+}
+
+/* Needs the wrlock if the frcti is in use, k = 0 turns FEC off. */
+static int __frcti_set_fec(struct frcti * frcti,
+                           int            k)
+{
+        struct fec_tx * tx = NULL;
+
+        if (k < 0 || k > FEC_MAX_K || (k & (k - 1)) != 0)
+                return -EINVAL;
+
+        if (k > 0) {
+                tx = malloc(sizeof(*tx));
+                if (tx == NULL)
+                        return -ENOMEM;
+
+                memset(tx, 0, sizeof(*tx));
+
+                tx->k   = k;
+                tx->idx = -1;
+        }
+
+        if (frcti->fec_tx != NULL) {
+                if (frcti->fec_tx->idx != -1)
+                        ssm_pool_remove(proc.pool, frcti->fec_tx->idx);
+                free(frcti->fec_tx);
+        }
+
+        frcti->fec_tx = tx;
+
+        return 0;
+}
+
+static void frcti_fec_rx_destroy(struct frcti * frcti)
+{
+        size_t i;
+
+        if (frcti->fec_rx == NULL)
+                return;
+
+        for (i = 0; i < FEC_MAX_K; ++i)
+                if (frcti->fec_rx->hidx[i] != -1)
+                        ssm_pool_remove(proc.pool, frcti->fec_rx->hidx[i]);
+
+        free(frcti->fec_rx);
+        frcti->fec_rx = NULL;
 }
 
 static struct frcti * frcti_create(int    fd,
@@ -349,12 +726,26 @@ static struct frcti * frcti_create(int    fd,
 
         memset(frcti, 0, sizeof(*frcti));
 
+        frcti->rq = malloc(RQ_SIZE * sizeof(*frcti->rq));
+        if (frcti->rq == NULL)
+                goto fail_rq;
+
+        frcti->rqf = malloc(RQ_SIZE * sizeof(*frcti->rqf));
+        if (frcti->rqf == NULL)
+                goto fail_rqf;
+
         if (pthread_rwlock_init(&frcti->lock, NULL))
                 goto fail_lock;
 
         if (pthread_mutex_init(&frcti->mtx, NULL))
                 goto fail_mutex;
 
+        if (pthread_mutex_init(&frcti->snd_mtx, NULL))
+                goto fail_snd_mutex;
+
+        if (pthread_mutex_init(&frcti->rcv_mtx, NULL))
+                goto fail_rcv_mutex;
+
         if (pthread_condattr_init(&cattr))
                 goto fail_cattr;
 #ifndef __APPLE__
@@ -363,6 +754,12 @@ static struct frcti * frcti_create(int    fd,
         if (pthread_cond_init(&frcti->cond, &cattr))
                 goto fail_cond;
 
+        if (flow_get(fd)->info.qs.loss == 0 && __frcti_set_cc(frcti, FRCT_CC))
+                goto fail_cc;
+
+        if (flow_get(fd)->info.qs.loss != 0 && __frcti_set_fec(frcti, FEC_K))
+                goto fail_fec;
+
 #ifdef PROC_FLOW_STATS
         sprintf(frctstr, "%d", fd);
         if (rib_reg(frctstr, &r_ops))
@@ -373,7 +770,9 @@ static struct frcti * frcti_create(int    fd,
         for (idx = 0; idx < RQ_SIZE; ++idx)
                 frcti->rq[idx] = -1;
 
-        clock_gettime(PTHREAD_COND_CLOCK, &now);
+        frcti->rq_size = RQ_SIZE;
+
+        clock_gettime(COARSE_CLOCK, &now);
 
         frcti->mpl = mpl;
         frcti->a   = a;
@@ -388,24 +787,20 @@ static struct frcti * frcti_create(int    fd,
         frcti->srtt = 0;            /* Updated on first ACK */
         frcti->mdev = 10 * MILLION; /* Updated on first ACK */
         frcti->rto  = BILLION;      /* Initial rxm will be after 1 s   */
-#ifdef PROC_FLOW_STATS
-        frcti->n_rtx = 0;
-        frcti->n_prb = 0;
-        frcti->n_rtt = 0;
-        frcti->n_dup = 0;
-        frcti->n_dak = 0;
-        frcti->n_rdv = 0;
-        frcti->n_out = 0;
-        frcti->n_rqo = 0;
-#endif
-        if (proc.flows[fd].info.qs.loss == 0) {
-                frcti->snd_cr.cflags |= FRCTFRTX | FRCTFLINGER;
-                frcti->rcv_cr.cflags |= FRCTFRTX;
+        frcti->bw = flow_get(fd)->info.qs.bandwidth;
+
+        if (flow_get(fd)->info.qs.loss == 0) {
+                frcti->snd_cr.cflags |= FRCTFRTX | FRCTFLINGER | FRCTFSACK;
+                frcti->rcv_cr.cflags |= FRCTFRTX | FRCTFSACK;
         }
 
         frcti->snd_cr.cflags |= FRCTFRESCNTL;
+#ifdef FRCT_PACING
+        frcti->snd_cr.cflags |= FRCTFPACE;
+#endif
 
         frcti->snd_cr.rwe = START_WINDOW;
+        frcti->open       = true;
 
         frcti->snd_cr.inact  = (3 * mpl + a + r) / BILLION + 1; /* s */
         frcti->snd_cr.act.tv_sec = now.tv_sec - (frcti->snd_cr.inact + 1);
@@ -417,15 +812,28 @@ static struct frcti * frcti_create(int    fd,
 
 #ifdef PROC_FLOW_STATS
  fail_rib_reg:
-        pthread_cond_destroy(&frcti->cond);
+        __frcti_set_fec(frcti, 0);
 #endif
+ fail_fec:
+        if (frcti->cc != NULL)
+                frcti->cc->ctx_destroy(frcti->cc_ctx);
+ fail_cc:
+        pthread_cond_destroy(&frcti->cond);
  fail_cond:
         pthread_condattr_destroy(&cattr);
  fail_cattr:
+        pthread_mutex_destroy(&frcti->rcv_mtx);
+ fail_rcv_mutex:
+        pthread_mutex_destroy(&frcti->snd_mtx);
+ fail_snd_mutex:
         pthread_mutex_destroy(&frcti->mtx);
  fail_mutex:
         pthread_rwlock_destroy(&frcti->lock);
  fail_lock:
+        free(frcti->rqf);
+ fail_rqf:
+        free(frcti->rq);
+ fail_rq:
         free(frcti);
  fail_malloc:
         return NULL;
@@ -433,15 +841,30 @@ static struct frcti * frcti_create(int    fd,
 
 static void frcti_destroy(struct frcti * frcti)
 {
+        size_t i;
 #ifdef PROC_FLOW_STATS
         char frctstr[FRCT_NAME_STRLEN + 1];
         sprintf(frctstr, "%d", frcti->fd);
         rib_unreg(frctstr);
 #endif
+        for (i = 0; i < frcti->rq_size; ++i)
+                if (frcti->rq[i] != -1)
+                        ssm_pool_remove(proc.pool, frcti->rq[i]);
+
+        if (frcti->cc != NULL)
+                frcti->cc->ctx_destroy(frcti->cc_ctx);
+
+        __frcti_set_fec(frcti, 0);
+        frcti_fec_rx_destroy(frcti);
+
         pthread_cond_destroy(&frcti->cond);
+        pthread_mutex_destroy(&frcti->rcv_mtx);
+        pthread_mutex_destroy(&frcti->snd_mtx);
         pthread_mutex_destroy(&frcti->mtx);
         pthread_rwlock_destroy(&frcti->lock);
 
+        free(frcti->rqf);
+        free(frcti->rq);
         free(frcti);
 }
 
@@ -463,24 +886,100 @@ static uint16_t frcti_getflags(struct frcti * frcti)
 static void frcti_setflags(struct frcti * frcti,
                            uint16_t       flags)
 {
-        flags |= FRCTFRTX; /* Should not be set by command */
+        assert(frcti);
+
+        pthread_rwlock_wrlock(&frcti->lock);
+
+        /* FRCTFRTX should not be set by command. */
+        frcti->snd_cr.cflags &= FRCTFRTX;
+        frcti->snd_cr.cflags |= flags & ~FRCTFRTX;
+
+        /* SACK needs retransmission, the receiver side follows. */
+        if (!(frcti->snd_cr.cflags & FRCTFRTX))
+                frcti->snd_cr.cflags &= ~FRCTFSACK;
+
+        frcti->rcv_cr.cflags &= ~FRCTFSACK;
+        frcti->rcv_cr.cflags |= frcti->snd_cr.cflags & FRCTFSACK;
+
+        pthread_rwlock_unlock(&frcti->lock);
+}
+
+static int frcti_getcc(struct frcti * frcti)
+{
+        int ret;
+
+        assert(frcti);
+
+        pthread_rwlock_rdlock(&frcti->lock);
+
+        ret = frcti->cc_pol;
+
+        pthread_rwlock_unlock(&frcti->lock);
+
+        return ret;
+}
+
+static int frcti_setcc(struct frcti * frcti,
+                       int            pol)
+{
+        int ret;
 
         assert(frcti);
 
         pthread_rwlock_wrlock(&frcti->lock);
 
-        frcti->snd_cr.cflags &= FRCTFRTX; /* Zero other flags */
+        ret = __frcti_set_cc(frcti, pol);
+
+        /* The new window may be larger. */
+        pthread_mutex_lock(&frcti->mtx);
+        pthread_cond_broadcast(&frcti->cond);
+        pthread_mutex_unlock(&frcti->mtx);
+
+        pthread_rwlock_unlock(&frcti->lock);
+
+        return ret;
+}
+
+static int frcti_getfec(struct frcti * frcti)
+{
+        int ret;
+
+        assert(frcti);
+
+        pthread_rwlock_rdlock(&frcti->lock);
+
+        ret = frcti->fec_tx == NULL ? 0 : (int) frcti->fec_tx->k;
+
+        pthread_rwlock_unlock(&frcti->lock);
+
+        return ret;
+}
+
+static int frcti_setfec(struct frcti * frcti,
+                        int            k)
+{
+        int ret;
+
+        assert(frcti);
+
+        pthread_rwlock_wrlock(&frcti->lock);
 
-        frcti->snd_cr.cflags &= flags;
+        /* Retransmission recovers losses by itself. */
+        if (k > 0 && (frcti->snd_cr.cflags & FRCTFRTX))
+                ret = -EPERM;
+        else
+                ret = __frcti_set_fec(frcti, k);
 
         pthread_rwlock_unlock(&frcti->lock);
+
+        return ret;
 }
 
 #define frcti_queued_pdu(frcti)                         \
         (frcti == NULL ? idx : __frcti_queued_pdu(frcti))
 
-#define frcti_snd(frcti, spb)                           \
-        (frcti == NULL ? 0 : __frcti_snd(frcti, spb))
+#define frcti_snd(frcti, spb, fgm)                      \
+        (frcti == NULL ? 0 : __frcti_snd(frcti, spb, fgm))
 
 #define frcti_rcv(frcti, spb)                           \
         (frcti == NULL ? 0 : __frcti_rcv(frcti, spb))
@@ -494,6 +993,144 @@ static void frcti_setflags(struct frcti * frcti,
 #define frcti_window_wait(frcti, abstime)               \
         (frcti == NULL ? 0 : __frcti_window_wait(frcti, abstime))
 
+#define frcti_fec_pop(frcti)                            \
+        (frcti == NULL ? -1 : __frcti_fec_pop(frcti))
+
+/* Needs the lock, packets sent but not ACK'd or SACK'd. */
+static size_t frcti_pipe(struct frcti * frcti)
+{
+        struct frct_cr * snd_cr = &frcti->snd_cr;
+        size_t           n;
+        size_t           i;
+
+        n = snd_cr->seqno - snd_cr->lwe;
+
+        for (i = 0; i < frcti->n_sack; ++i) {
+                uint32_t start = frcti->sack[i].start;
+                uint32_t end   = frcti->sack[i].end;
+
+                if (before(start, snd_cr->lwe))
+                        start = snd_cr->lwe;
+                if (after(end, snd_cr->seqno))
+                        end = snd_cr->seqno;
+                if (after(end, start))
+                        n -= end - start;
+        }
+
+        return n;
+}
+
+/* Needs the lock. */
+static bool frcti_cc_is_open(struct frcti * frcti)
+{
+        size_t wnd;
+
+        if (frcti->cc == NULL)
+                return true;
+
+        wnd = frcti->cc->wnd(frcti->cc_ctx);
+
+        /* Without SACK, fragments are only ACK'd as a whole. */
+        if (!(frcti->snd_cr.cflags & FRCTFSACK) && frcti->snd_more)
+                return true;
+
+        return frcti_pipe(frcti) < wnd;
+}
+
+/* Needs the wrlock, the ACK clock reopens the window. */
+static void frcti_cc_ack(struct frcti * frcti,
+                         size_t         n)
+{
+        frcti->cc->ack(frcti->cc_ctx, n);
+
+        pthread_mutex_lock(&frcti->mtx);
+        if (frcti->cc_wait) {
+                frcti->cc_wait = false;
+                pthread_cond_broadcast(&frcti->cond);
+        }
+        pthread_mutex_unlock(&frcti->mtx);
+}
+
+/* Needs the wrlock, reacts once per window of data. */
+static void frcti_cc_loss(struct frcti * frcti,
+                          uint32_t       seqno,
+                          bool           rto)
+{
+        struct frct_cr * snd_cr = &frcti->snd_cr;
+
+        if (frcti->cc == NULL || before(seqno, frcti->cc_rcvr))
+                return;
+
+        frcti->cc->loss(frcti->cc_ctx, frcti_pipe(frcti), rto);
+
+        frcti->cc_rcvr = snd_cr->seqno;
+}
+
+/* Needs the lock, the first packet missing below a SACK'd one. */
+static bool frcti_sack_hole(struct frcti * frcti,
+                            uint32_t *     seqno)
+{
+        uint32_t s = frcti->snd_cr.lwe;
+        size_t   i;
+
+        /* The blocks are pruned to the lwe and in ascending order. */
+        for (i = 0; i < frcti->n_sack; ++i) {
+                if (after(frcti->sack[i].start, s)) {
+                        *seqno = s;
+                        return true;
+                }
+                if (after(frcti->sack[i].end, s))
+                        s = frcti->sack[i].end;
+        }
+
+        return false;
+}
+
+/* Needs the wrlock, spaces packets over the RTT or the bandwidth. */
+static void frcti_pace(struct frcti * frcti,
+                       size_t         len)
+{
+        struct timespec now;
+        struct timespec intv;
+        time_t          ns = 0;
+
+        if (frcti->cc != NULL && frcti->srtt > 0)
+                ns = PACE_INTV(frcti->srtt, frcti->cc->wnd(frcti->cc_ctx));
+
+        if (frcti->bw != 0 && frcti->bw != UINT64_MAX)
+                ns = MAX(ns, (time_t) (len * 8 * BILLION / frcti->bw));
+
+        if (ns == 0)
+                return;
+
+        clock_gettime(PTHREAD_COND_CLOCK, &now);
+
+        /* No credit for idle time beyond the quantum. */
+        if (ts_diff_ns(&now, &frcti->t_pace) > 0)
+                frcti->t_pace = now;
+
+        intv.tv_sec  = ns / BILLION;
+        intv.tv_nsec = ns % BILLION;
+
+        ts_add(&frcti->t_pace, &intv, &frcti->t_pace);
+}
+
+/* Needs the lock, true if the pacer holds the writer until t. */
+static bool frcti_is_paced(struct frcti *    frcti,
+                           struct timespec * t)
+{
+        struct timespec now;
+        struct timespec quantum = TIMESPEC_INIT_NS(PACE_QUANTUM);
+
+        if (!(frcti->snd_cr.cflags & FRCTFPACE))
+                return false;
+
+        clock_gettime(PTHREAD_COND_CLOCK, &now);
+
+        ts_diff(&frcti->t_pace, &quantum, t);
+
+        return ts_diff_ns(t, &now) > 0;
+}
 
 static bool __frcti_is_window_open(struct frcti * frcti)
 {
@@ -508,7 +1145,7 @@ static bool __frcti_is_window_open(struct frcti * frcti)
         if (!ret) {
                 struct timespec now;
 
-                clock_gettime(PTHREAD_COND_CLOCK, &now);
+                clock_gettime(COARSE_CLOCK, &now);
 
                 pthread_mutex_lock(&frcti->mtx);
                 if (frcti->open) {
@@ -528,14 +1165,16 @@ static bool __frcti_is_window_open(struct frcti * frcti)
                         if  (diff > frcti->rdv) {
                                 frcti->t_rdvs = now;
                                 __send_rdv(frcti->fd);
-#ifdef PROC_FLOW_STATS
-                                frcti->n_rdv++;
-#endif
+                                STAT_INC(frcti->n_rdv);
 
                         }
                 }
 
                 pthread_mutex_unlock(&frcti->mtx);
+        } else {
+                struct timespec t;
+
+                ret = frcti_cc_is_open(frcti) && !frcti_is_paced(frcti, &t);
         }
 
         pthread_rwlock_unlock(&frcti->lock);
@@ -551,18 +1190,25 @@ static int __frcti_window_wait(struct frcti *    frcti,
 
         pthread_rwlock_rdlock(&frcti->lock);
 
-        if (!(snd_cr->cflags & FRCTFRESCNTL)) {
-                pthread_rwlock_unlock(&frcti->lock);
-                return 0;
-        }
+        while ((snd_cr->cflags & FRCTFRESCNTL)
+               && snd_cr->seqno == snd_cr->rwe && ret != -ETIMEDOUT) {
+                struct timespec   now;
+                struct timespec   t_rdv;
+                struct timespec   intv = TIMESPEC_INIT_NS(frcti->rdv);
+                struct timespec * t    = abstime;
 
-        while (snd_cr->seqno == snd_cr->rwe && ret != -ETIMEDOUT) {
-                struct timespec now;
-                pthread_rwlock_unlock(&frcti->lock);
+                /* Wake up to send rendez-vous, also without a deadline. */
+                clock_gettime(PTHREAD_COND_CLOCK, &t_rdv);
+                ts_add(&t_rdv, &intv, &t_rdv);
+                if (t == NULL || ts_diff_ns(t, &t_rdv) > 0)
+                        t = &t_rdv;
+
+                /* Take mtx first, an update must wait until we sleep. */
                 pthread_mutex_lock(&frcti->mtx);
+                pthread_rwlock_unlock(&frcti->lock);
 
                 if (frcti->open) {
-                        clock_gettime(PTHREAD_COND_CLOCK, &now);
+                        clock_gettime(COARSE_CLOCK, &now);
 
                         frcti->t_wnd  = now;
                         frcti->t_rdvs = now;
@@ -571,14 +1217,14 @@ static int __frcti_window_wait(struct frcti *    frcti,
 
                 pthread_cleanup_push(__cleanup_mutex_unlock, &frcti->mtx);
 
-                ret = -__timedwait(&frcti->cond, &frcti->mtx, abstime);
+                ret = -__timedwait(&frcti->cond, &frcti->mtx, t);
 
                 pthread_cleanup_pop(false);
 
                 if (ret == -ETIMEDOUT) {
                         time_t diff;
 
-                        clock_gettime(PTHREAD_COND_CLOCK, &now);
+                        clock_gettime(COARSE_CLOCK, &now);
 
                         diff = ts_diff_ns(&now, &frcti->t_wnd);
                         if (diff > MAX_RDV) {
@@ -591,44 +1237,569 @@ static int __frcti_window_wait(struct frcti *    frcti,
                                 frcti->t_rdvs = now;
                                 __send_rdv(frcti->fd);
                         }
+
+                        if (t == &t_rdv)
+                                ret = 0;
                 }
 
                 pthread_mutex_unlock(&frcti->mtx);
                 pthread_rwlock_rdlock(&frcti->lock);
         }
 
-        pthread_rwlock_unlock(&frcti->lock);
+        /* Congestion window, reopened by ACKs, no rendez-vous. */
+        while (!frcti_cc_is_open(frcti) && ret != -ETIMEDOUT) {
+                struct timespec   t_chk;
+                struct timespec   intv = TIMESPEC_INIT_NS(frcti->rdv);
+                struct timespec * t    = abstime;
+                struct flow *     f    = flow_get(frcti->fd);
 
-        return ret;
-}
+                if (ssm_rbuff_get_acl(f->tx_rb) & ACL_FLOWDOWN) {
+                        ret = -EFLOWDOWN;
+                        break;
+                }
+
+                /* Check the flow every so often, also without a deadline. */
+                clock_gettime(PTHREAD_COND_CLOCK, &t_chk);
+                ts_add(&t_chk, &intv, &t_chk);
+                if (t == NULL || ts_diff_ns(t, &t_chk) > 0)
+                        t = &t_chk;
+
+                pthread_mutex_lock(&frcti->mtx);
+                pthread_rwlock_unlock(&frcti->lock);
+
+                frcti->cc_wait = true;
+
+                pthread_cleanup_push(__cleanup_mutex_unlock, &frcti->mtx);
+
+                ret = -__timedwait(&frcti->cond, &frcti->mtx, t);
+
+                pthread_cleanup_pop(false);
+
+                if (ret == -ETIMEDOUT && t == &t_chk)
+                        ret = 0;
+
+                pthread_mutex_unlock(&frcti->mtx);
+                pthread_rwlock_rdlock(&frcti->lock);
+        }
+
+        /* Pacer, the window drains over the RTT instead of at once. */
+        while (ret == 0) {
+                struct timespec   t_pace;
+                struct timespec * t = &t_pace;
+
+                if (!frcti_is_paced(frcti, &t_pace))
+                        break;
+
+                if (abstime != NULL && ts_diff_ns(abstime, &t_pace) < 0)
+                        t = abstime;
+
+                pthread_mutex_lock(&frcti->mtx);
+                pthread_rwlock_unlock(&frcti->lock);
+                STAT_INC(frcti->n_pce);
+                pthread_cleanup_push(__cleanup_mutex_unlock, &frcti->mtx);
+
+                ret = -__timedwait(&frcti->cond, &frcti->mtx, t);
+
+                pthread_cleanup_pop(false);
+
+                if (ret == -ETIMEDOUT && t == &t_pace)
+                        ret = 0;
+
+                pthread_mutex_unlock(&frcti->mtx);
+                pthread_rwlock_rdlock(&frcti->lock);
+        }
+
+        pthread_rwlock_unlock(&frcti->lock);
+
+        return ret;
+}
+
+/* Release the rq entries in [start, end), called under the lock. */
+static void frcti_rq_flush(struct frcti * frcti,
+                           uint32_t       start,
+                           uint32_t       end)
+{
+        size_t pos;
+
+        if (!before(start, end))
+                return;
+
+        if (end - start > frcti->rq_size)
+                start = end - frcti->rq_size;
+
+        for (; before(start, end); ++start) {
+                pos = start & (frcti->rq_size - 1);
+                if (frcti->rq[pos] == -1)
+                        continue;
+                ssm_pool_remove(proc.pool, frcti->rq[pos]);
+                frcti->rq[pos] = -1;
+        }
+}
+
+/* Double the rq and the window with it, called under the wrlock. */
+static int frcti_rq_grow(struct frcti * frcti)
+{
+        size_t    size = frcti->rq_size << 1;
+        ssize_t * rq;
+        uint8_t * rqf;
+        size_t    pos;
+        size_t    i;
+
+        rq = malloc(size * sizeof(*rq));
+        if (rq == NULL)
+                goto fail_rq;
+
+        rqf = malloc(size * sizeof(*rqf));
+        if (rqf == NULL)
+                goto fail_rqf;
+
+        for (i = 0; i < size; ++i)
+                rq[i] = -1;
+
+        memset(rqf, 0, size * sizeof(*rqf));
+
+        /* Everything queued lies within the window above the lwe. */
+        for (i = 0; i < frcti->rq_size; ++i) {
+                pos = (frcti->rcv_cr.lwe + i) & (frcti->rq_size - 1);
+                rq[(frcti->rcv_cr.lwe + i) & (size - 1)]  = frcti->rq[pos];
+                rqf[(frcti->rcv_cr.lwe + i) & (size - 1)] = frcti->rqf[pos];
+        }
+
+        free(frcti->rq);
+        free(frcti->rqf);
+
+        frcti->rcv_cr.rwe += size - frcti->rq_size;
+
+        frcti->rq      = rq;
+        frcti->rqf     = rqf;
+        frcti->rq_size = size;
+
+        return 0;
+
+ fail_rqf:
+        free(rq);
+ fail_rq:
+        return -ENOMEM;
+}
+
+/*
+ * Packets in the datagram at the lwe. Returns 0 if it is not
+ * complete yet, or minus the number of packets to discard.
+ */
+static int frcti_frags(struct frcti * frcti)
+{
+        uint32_t lwe = frcti->rcv_cr.lwe;
+        size_t   pos;
+        uint8_t  fgm;
+        int      max;
+        int      n;
+
+        pos = lwe & (frcti->rq_size - 1);
+        if (frcti->rq[pos] == -1)
+                return 0;
+
+        fgm = frcti->rqf[pos];
+        if (fgm == 0)
+                return 1;
+
+        if (fgm != (FRCT_FFGM | FRCT_MFGM))
+                return -1;
+
+        /* A reliable flow grows the rq to fit the datagram. */
+        max = frcti->rcv_cr.cflags & FRCTFRTX ? RQ_MAX : FRAG_MAX;
+
+        for (n = 1; n < (int) MIN((size_t) max, frcti->rq_size); ++n) {
+                pos = (lwe + n) & (frcti->rq_size - 1);
+                if (frcti->rq[pos] == -1)
+                        return 0;
+                if (frcti->rqf[pos] & FRCT_FFGM)
+                        return -n;
+                if (!(frcti->rqf[pos] & FRCT_MFGM))
+                        return n + 1;
+        }
+
+        return n < max ? 0 : -max;
+}
+
+/* Copy n fragments into a new packet, called under the lock. */
+static ssize_t frcti_reassemble(struct frcti * frcti,
+                                int            n)
+{
+        struct ssm_pk_buff * spb;
+        ssize_t              idx;
+        size_t               len = 0;
+        uint8_t *            ptr;
+        uint32_t             seqno;
+        int                  i;
+
+        seqno = frcti->rcv_cr.lwe;
+
+        for (i = 0; i < n; ++i) {
+                idx = frcti->rq[(seqno + i) & (frcti->rq_size - 1)];
+                len += ssm_pk_buff_len(ssm_pool_get(proc.pool, idx));
+        }
+
+        /* Don't block, the reader will try again. */
+        idx = ssm_pool_alloc(proc.pool, len, flow_get(frcti->fd)->qc,
+                             &ptr, &spb);
+        if (idx < 0)
+                return -1;
+
+        for (i = 0; i < n; ++i) {
+                size_t pos = (seqno + i) & (frcti->rq_size - 1);
+                spb = ssm_pool_get(proc.pool, frcti->rq[pos]);
+                len = ssm_pk_buff_len(spb);
+                memcpy(ptr, ssm_pk_buff_head(spb), len);
+                ptr += len;
+        }
+
+        frcti_rq_flush(frcti, seqno, seqno + n);
+
+        return idx;
+}
+
+static void frcti_frag_drop(struct frcti * frcti)
+{
+        frcti_rq_flush(frcti, frcti->frag_lwe,
+                       frcti->frag_lwe + frcti->frag_n);
+        frcti->frag_n = 0;
+}
+
+/*
+ * Without retransmission, the latest packet wins. A datagram is
+ * only put on the lwe once all its fragments are in, a run with a
+ * gap is dropped, as are the fragments that remain of it.
+ */
+static int frcti_rcv_unreliable(struct frcti *          frcti,
+                                uint32_t                seqno,
+                                uint8_t                 fgm,
+                                const struct timespec * now)
+{
+        struct frct_cr * rcv_cr = &frcti->rcv_cr;
+        bool             more   = frcti->frag_more;
+        uint32_t         start;
+
+        /* Dropped datagrams must not close the window. */
+        if (after(seqno + frcti->rq_size, rcv_cr->rwe))
+                rcv_cr->rwe = seqno + frcti->rq_size;
+
+        frcti->frag_more = fgm & FRCT_MFGM;
+
+        if (frcti->frag_n > 0 && (seqno != frcti->frag_lwe + frcti->frag_n
+            || (fgm & FRCT_FFGM) || frcti->frag_n == FRAG_MAX
+            || ts_diff_ns(now, &frcti->frag_t0) > FRAG_TIMEO)) {
+                frcti_frag_drop(frcti);
+        }
+
+        if (fgm == (FRCT_FFGM | FRCT_MFGM)) {
+                frcti->frag_lwe = seqno;
+                frcti->frag_n   = 1;
+                frcti->frag_t0  = *now;
+                return 0;
+        }
+
+        if (frcti->frag_n == 0) {
+                if (fgm != 0 || more) /* Rest of a lost datagram. */
+                        return -1;
+                frcti_rq_flush(frcti, rcv_cr->lwe, seqno);
+                rcv_cr->lwe = seqno;
+                return 0;
+        }
+
+        ++frcti->frag_n;
+
+        if (fgm == 0) { /* Last fragment. */
+                /* Don't wrap around onto the run itself. */
+                start = frcti->frag_lwe + frcti->frag_n - frcti->rq_size;
+                if (before(start, rcv_cr->lwe))
+                        start = rcv_cr->lwe;
+                frcti_rq_flush(frcti, start, frcti->frag_lwe);
+                rcv_cr->lwe   = frcti->frag_lwe;
+                frcti->frag_n = 0;
+        }
+
+        return 0;
+}
+
+/* Needs the wrlock, returns -1 if the packet is dropped. */
+static int frcti_rq_put(struct frcti *          frcti,
+                        uint32_t                seqno,
+                        uint8_t                 fgm,
+                        ssize_t                 idx,
+                        const struct timespec * now,
+                        bool                    run)
+{
+        struct frct_cr * rcv_cr = &frcti->rcv_cr;
+        size_t           pos;
+
+        if (before(seqno, rcv_cr->lwe))
+                return -1;
+
+        /* Right behind the previous one, the reader gets both. */
+        if (run && fgm == 0 && frcti->frag_n == 0 && !frcti->frag_more
+            && before(seqno, rcv_cr->lwe + frcti->rq_size)) {
+                if (after(seqno + frcti->rq_size, rcv_cr->rwe))
+                        rcv_cr->rwe = seqno + frcti->rq_size;
+        } else if (frcti_rcv_unreliable(frcti, seqno, fgm, now) < 0) {
+                return -1;
+        }
+
+        /* A stale packet that was never read. */
+        pos = seqno & (frcti->rq_size - 1);
+        if (frcti->rq[pos] != -1)
+                ssm_pool_remove(proc.pool, frcti->rq[pos]);
+
+        frcti->rq[pos]  = idx;
+        frcti->rqf[pos] = fgm;
+
+        return 0;
+}
+
+/* Needs the wrlock, hands the held packets to the rq in order. */
+static void frcti_fec_release(struct frcti *          frcti,
+                              const struct timespec * now)
+{
+        struct fec_rx * rx   = frcti->fec_rx;
+        bool            run  = false;
+        size_t          off;
+
+        for (off = 0; off < rx->k && rx->n_hold > 0; ++off) {
+                if (rx->hidx[off] == -1) {
+                        run = false;
+                        continue;
+                }
+
+                if (frcti_rq_put(frcti, rx->base + off, rx->hfgm[off],
+                                 rx->hidx[off], now, run) < 0)
+                        ssm_pool_remove(proc.pool, rx->hidx[off]);
+
+                rx->hidx[off] = -1;
+                --rx->n_hold;
+                run = true;
+        }
+}
+
+/* Needs the wrlock, gives up on the current block. */
+static void frcti_fec_next(struct frcti *          frcti,
+                           uint32_t                base,
+                           const struct timespec * now)
+{
+        struct fec_rx * rx = frcti->fec_rx;
+
+        frcti_fec_release(frcti, now);
+
+        memset(rx->buf, 0, sizeof(rx->buf));
+
+        rx->base = base;
+        rx->n    = 0;
+        rx->seen = 0;
+        rx->done = false;
+        rx->len  = 0;
+        rx->fgm  = 0;
+}
+
+/* Needs the wrlock, holds packets behind a loss until the repair. */
+static int frcti_fec_data(struct frcti *          frcti,
+                          uint32_t                seqno,
+                          uint8_t                 fgm,
+                          ssize_t                 idx,
+                          const struct timespec * now)
+{
+        struct fec_rx *      rx = frcti->fec_rx;
+        struct ssm_pk_buff * spb;
+        const uint8_t *      data;
+        size_t               len;
+        size_t               off;
+        uint64_t             below;
+        size_t               i;
+
+        if ((seqno & ~(rx->k - 1)) != rx->base) {
+                if (before(seqno, rx->base)) /* Block is gone. */
+                        return frcti_rq_put(frcti, seqno, fgm, idx, now,
+                                            false);
+                frcti_fec_next(frcti, seqno & ~(rx->k - 1), now);
+        }
+
+        spb  = ssm_pool_get(proc.pool, idx);
+        data = ssm_pk_buff_head(spb);
+        len  = ssm_pk_buff_len(spb);
+        off  = seqno - rx->base;
+
+        if (rx->seen & ((uint64_t) 1 << off))
+                return -1;
+
+        if (rx->done || len > FRAG_SIZE) {
+                rx->done = true;
+                frcti_fec_release(frcti, now);
+                return frcti_rq_put(frcti, seqno, fgm, idx, now, false);
+        }
+
+        for (i = 0; i < len; ++i)
+                rx->buf[i] ^= data[i];
+
+        rx->len  ^= (uint16_t) len;
+        rx->fgm  ^= fgm;
+        rx->seen |= (uint64_t) 1 << off;
+        rx->n++;
+
+        below = ((uint64_t) 1 << off) - 1;
+        if (rx->n_hold == 0 && (rx->seen & below) == below)
+                return frcti_rq_put(frcti, seqno, fgm, idx, now, false);
+
+        if (rx->n_hold++ == 0)
+                rx->t_hold = *now;
+
+        rx->hidx[off] = idx;
+        rx->hfgm[off] = fgm;
+
+        return 0;
+}
+
+/* Needs the wrlock, rebuilds a single lost packet from the parity. */
+static void frcti_fec_rcv(struct frcti *          frcti,
+                          uint32_t                base,
+                          struct ssm_pk_buff *    spb,
+                          const struct timespec * now)
+{
+        struct fec_rx *      rx;
+        struct frct_fec *    fec;
+        struct ssm_pk_buff * rspb;
+        const uint8_t *      parity;
+        uint8_t *            ptr;
+        ssize_t              idx;
+        size_t               plen;
+        size_t               len;
+        size_t               off;
+        size_t               i;
+        uint8_t              fgm;
+
+        if (ssm_pk_buff_len(spb) < sizeof(*fec))
+                return;
+
+        fec    = (struct frct_fec *) ssm_pk_buff_head(spb);
+        parity = (const uint8_t *) (fec + 1);
+        plen   = ssm_pk_buff_len(spb) - sizeof(*fec);
+
+        if (fec->k == 0 || fec->k > FEC_MAX_K || (fec->k & (fec->k - 1))
+            || plen > FRAG_SIZE)
+                return;
+
+        if (frcti->fec_rx == NULL) {
+                frcti->fec_rx = malloc(sizeof(*frcti->fec_rx));
+                if (frcti->fec_rx == NULL)
+                        return;
+                memset(frcti->fec_rx, 0, sizeof(*frcti->fec_rx));
+                for (i = 0; i < FEC_MAX_K; ++i)
+                        frcti->fec_rx->hidx[i] = -1;
+        }
+
+        rx = frcti->fec_rx;
+
+        /* Protection starts with the next block. */
+        if (rx->k != fec->k) {
+                frcti_fec_release(frcti, now);
+                rx->k = fec->k;
+                frcti_fec_next(frcti, base, now);
+                rx->done = true;
+                return;
+        }
+
+        if (base != rx->base || rx->done)
+                return;
+
+        rx->done = true;
+
+        if (rx->n + 1 == rx->k) {
+                for (off = 0; rx->seen & ((uint64_t) 1 << off); ++off)
+                        ;
+
+                len = rx->len ^ ntoh16(fec->len);
+                fgm = rx->fgm ^ fec->fgm;
+
+                if (len == 0 || len > plen || (fgm & ~(FRCT_FFGM | FRCT_MFGM)))
+                        goto release;
+
+                idx = ssm_pool_alloc(proc.pool, len, flow_get(frcti->fd)->qc,
+                                     &ptr, &rspb);
+                if (idx < 0)
+                        goto release;
+
+                for (i = 0; i < len; ++i)
+                        ptr[i] = rx->buf[i] ^ parity[i];
+
+                rx->hidx[off] = idx;
+                rx->hfgm[off] = fgm;
+                rx->n_hold++;
+                STAT_INC(frcti->n_fec);
+        }
+ release:
+        frcti_fec_release(frcti, now);
+}
+
+/* Needs the wrlock, the repair won't come anymore. */
+static void frcti_fec_expire(struct frcti * frcti)
+{
+        struct timespec now;
+
+        clock_gettime(COARSE_CLOCK, &now);
+
+        if (ts_diff_ns(&now, &frcti->fec_rx->t_hold) < FEC_TIMEO)
+                return;
+
+        frcti->fec_rx->done = true;
+        frcti_fec_release(frcti, &now);
+}
 
 static ssize_t __frcti_queued_pdu(struct frcti * frcti)
 {
-        ssize_t idx;
+        ssize_t idx = -1;
         size_t  pos;
+        int     n;
+        bool    ack = false;
 
         assert(frcti);
 
         /* See if we already have the next PDU. */
         pthread_rwlock_wrlock(&frcti->lock);
 
-        pos = frcti->rcv_cr.lwe & (RQ_SIZE - 1);
+        if (frcti->fec_rx != NULL && frcti->fec_rx->n_hold > 0)
+                frcti_fec_expire(frcti);
 
-        idx = frcti->rq[pos];
-        if (idx != -1) {
-                ++frcti->rcv_cr.lwe;
-                ++frcti->rcv_cr.rwe;
+        while ((n = frcti_frags(frcti)) < 0) {
+                frcti_rq_flush(frcti, frcti->rcv_cr.lwe,
+                               frcti->rcv_cr.lwe - n);
+                frcti->rcv_cr.lwe -= n;
+                frcti->rcv_cr.rwe -= n;
+        }
+
+        pos = frcti->rcv_cr.lwe & (frcti->rq_size - 1);
+
+        if (n == 1) {
+                idx = frcti->rq[pos];
                 frcti->rq[pos] = -1;
+        } else if (n > 1) {
+                idx = frcti_reassemble(frcti, n);
+        }
+
+        if (idx != -1) {
+                frcti->rcv_cr.lwe += n;
+                frcti->rcv_cr.rwe += n;
+                /* Delivered enough, don't wait for the delayed ACK. */
+                ack = (frcti->rcv_cr.cflags & FRCTFRTX) && frcti->rcv_cr.lwe
+                        - frcti->rcv_cr.seqno >= (uint32_t) ACK_EVERY;
         }
 
         pthread_rwlock_unlock(&frcti->lock);
 
+        if (ack)
+                send_frct_pkt(frcti);
+
         return idx;
 }
 
 static ssize_t __frcti_pdu_ready(struct frcti * frcti)
 {
-        ssize_t idx;
+        ssize_t idx = -1;
         size_t  pos;
 
         assert(frcti);
@@ -636,8 +1807,9 @@ static ssize_t __frcti_pdu_ready(struct frcti * frcti)
         /* See if we already have the next PDU. */
         pthread_rwlock_rdlock(&frcti->lock);
 
-        pos = frcti->rcv_cr.lwe & (RQ_SIZE - 1);
-        idx = frcti->rq[pos];
+        pos = frcti->rcv_cr.lwe & (frcti->rq_size - 1);
+        if (frcti_frags(frcti) != 0)
+                idx = frcti->rq[pos];
 
         pthread_rwlock_unlock(&frcti->lock);
 
@@ -658,7 +1830,7 @@ static time_t __frcti_dealloc(struct frcti * frcti)
         int             ackno;
         int             fd = -1;
 
-        clock_gettime(PTHREAD_COND_CLOCK, &now);
+        clock_gettime(COARSE_CLOCK, &now);
 
         pthread_rwlock_rdlock(&frcti->lock);
 
@@ -677,13 +1849,96 @@ static time_t __frcti_dealloc(struct frcti * frcti)
         pthread_rwlock_unlock(&frcti->lock);
 
         if (fd != -1)
-                __send_frct_pkt(fd, FRCT_ACK, ackno, 0);
+                __send_frct_pkt(fd, FRCT_ACK, ackno, 0, NULL);
 
         return wait;
 }
 
+/* Needs the wrlock, builds the repair once the block is complete. */
+static void frcti_fec_add(struct frcti *  frcti,
+                          uint32_t        seqno,
+                          const uint8_t * data,
+                          size_t          len,
+                          uint8_t         fgm)
+{
+        struct fec_tx *      tx = frcti->fec_tx;
+        struct frct_pci *    pci;
+        struct frct_fec *    fec;
+        struct ssm_pk_buff * spb;
+        uint8_t *            ptr;
+        ssize_t              idx;
+        size_t               i;
+
+        if ((seqno & ~(tx->k - 1)) != tx->base) {
+                memset(tx->buf, 0, tx->max);
+                tx->base = seqno & ~(tx->k - 1);
+                tx->n    = 0;
+                tx->max  = 0;
+                tx->len  = 0;
+                tx->fgm  = 0;
+        }
+
+        /* Unfragmented and too large, the block is not protected. */
+        if (len > FRAG_SIZE) {
+                tx->n = 0;
+                return;
+        }
+
+        for (i = 0; i < len; ++i)
+                tx->buf[i] ^= data[i];
+
+        tx->len ^= (uint16_t) len;
+        tx->fgm ^= fgm;
+        tx->max  = MAX(tx->max, len);
+
+        /* A block the flow started halfway is not protected. */
+        if (++tx->n < tx->k)
+                return;
+
+        idx = ssm_pool_alloc(proc.pool, FRCT_PCILEN + sizeof(*fec) + tx->max,
+                             flow_get(frcti->fd)->qc, &ptr, &spb);
+        if (idx < 0)
+                return;
+
+        pci = (struct frct_pci *) ptr;
+        memset(pci, 0, FRCT_PCILEN);
+
+        pci->flags = FRCT_SACK;
+        pci->seqno = hton32(tx->base);
+
+        fec = (struct frct_fec *) (pci + 1);
+        fec->k   = (uint8_t) tx->k;
+        fec->fgm = tx->fgm;
+        fec->len = hton16(tx->len);
+
+        memcpy(fec + 1, tx->buf, tx->max);
+
+        if (tx->idx != -1) /* Never made it out. */
+                ssm_pool_remove(proc.pool, tx->idx);
+
+        tx->idx = idx;
+}
+
+/* A repair packet to send after the data that completed its block. */
+static ssize_t __frcti_fec_pop(struct frcti * frcti)
+{
+        ssize_t idx = -1;
+
+        pthread_rwlock_wrlock(&frcti->lock);
+
+        if (frcti->fec_tx != NULL) {
+                idx = frcti->fec_tx->idx;
+                frcti->fec_tx->idx = -1;
+        }
+
+        pthread_rwlock_unlock(&frcti->lock);
+
+        return idx;
+}
+
 static int __frcti_snd(struct frcti *       frcti,
-                       struct ssm_pk_buff * spb)
+                       struct ssm_pk_buff * spb,
+                       uint8_t              fgm)
 {
         struct frct_pci * pci;
         struct timespec   now;
@@ -691,6 +1946,8 @@ static int __frcti_snd(struct frcti *       frcti,
         struct frct_cr *  rcv_cr;
         uint32_t          seqno;
         bool              rtx;
+        const uint8_t *   data;
+        size_t            len;
 
         assert(frcti);
         assert(ssm_pk_buff_len(spb) != 0);
@@ -698,6 +1955,9 @@ static int __frcti_snd(struct frcti *       frcti,
         snd_cr = &frcti->snd_cr;
         rcv_cr = &frcti->rcv_cr;
 
+        data = ssm_pk_buff_head(spb);
+        len  = ssm_pk_buff_len(spb);
+
         timerwheel_move();
 
         pci = (struct frct_pci *) ssm_pk_buff_head_alloc(spb, FRCT_PCILEN);
@@ -706,13 +1966,15 @@ static int __frcti_snd(struct frcti *       frcti,
 
         memset(pci, 0, sizeof(*pci));
 
-        clock_gettime(PTHREAD_COND_CLOCK, &now);
+        clock_gettime(COARSE_CLOCK, &now);
 
         pthread_rwlock_wrlock(&frcti->lock);
 
         rtx = snd_cr->cflags & FRCTFRTX;
 
-        pci->flags |= FRCT_DATA;
+        pci->flags |= FRCT_DATA | fgm;
+
+        frcti->snd_more = fgm & FRCT_MFGM;
 
         /* Set DRF if there are no unacknowledged packets. */
         if (snd_cr->seqno == snd_cr->lwe)
@@ -725,6 +1987,9 @@ static int __frcti_snd(struct frcti *       frcti,
                 random_buffer(&snd_cr->seqno, sizeof(snd_cr->seqno));
                 snd_cr->lwe = snd_cr->seqno;
                 snd_cr->rwe = snd_cr->lwe + START_WINDOW;
+                frcti->n_sack   = 0;
+                frcti->n_dupack = 0;
+                frcti->cc_rcvr  = snd_cr->seqno;
         }
 
         seqno = snd_cr->seqno;
@@ -737,14 +2002,15 @@ static int __frcti_snd(struct frcti *       frcti,
 
         if (!rtx) {
                 snd_cr->lwe++;
+                if (frcti->fec_tx != NULL)
+                        frcti_fec_add(frcti, seqno, data, len, fgm);
         } else {
                 if (!frcti->probe) {
+                        /* RTT samples need the high-resolution clock. */
+                        clock_gettime(PTHREAD_COND_CLOCK, &frcti->t_probe);
                         frcti->rttseq  = snd_cr->seqno;
-                        frcti->t_probe = now;
                         frcti->probe   = true;
-#ifdef PROC_FLOW_STATS
-                        frcti->n_prb++;
-#endif
+                        STAT_INC(frcti->n_prb);
                 }
                 if ((now.tv_sec - rcv_cr->act.tv_sec) * BILLION <= frcti->a) {
                         pci->flags |= FRCT_ACK;
@@ -753,6 +2019,9 @@ static int __frcti_snd(struct frcti *       frcti,
                 }
         }
 
+        if (snd_cr->cflags & FRCTFPACE)
+                frcti_pace(frcti, ssm_pk_buff_len(spb));
+
         snd_cr->seqno++;
         snd_cr->act = now;
 
@@ -783,14 +2052,55 @@ static void rtt_estimator(struct frcti * frcti,
 #endif
                 rttvar += delta;
         }
-#ifdef PROC_FLOW_STATS
-        frcti->n_rtt++;
-#endif
+        STAT_INC(frcti->n_rtt);
         frcti->srtt     = MAX(1000L, srtt);
         frcti->mdev     = MAX(100L, rttvar);
         frcti->rto      = MAX(RTO_MIN, frcti->srtt + (frcti->mdev << MDEV_MUL));
 }
 
+/* Needs the wrlock, drops what the ackno passed. */
+static void frcti_sack_prune(struct frcti * frcti)
+{
+        uint32_t lwe = frcti->snd_cr.lwe;
+        size_t   n   = 0;
+        size_t   i;
+
+        for (i = 0; i < frcti->n_sack; ++i) {
+                if (!after(frcti->sack[i].end, lwe))
+                        continue;
+
+                frcti->sack[n] = frcti->sack[i];
+                if (before(frcti->sack[n].start, lwe))
+                        frcti->sack[n].start = lwe;
+                ++n;
+        }
+
+        frcti->n_sack = n;
+}
+
+/* Keep the latest blocks, the receiver does not renege. */
+static void frcti_sack_rcv(struct frcti *       frcti,
+                           struct ssm_pk_buff * spb)
+{
+        struct frct_sack * sack;
+        size_t             len;
+        size_t             i;
+
+        sack = (struct frct_sack *) ssm_pk_buff_head(spb);
+        len  = ssm_pk_buff_len(spb);
+
+        if (len < FRCT_SACKLEN(0) || sack->n > FRCT_SACK_BLKS
+            || len < FRCT_SACKLEN(sack->n))
+                return;
+
+        for (i = 0; i < sack->n; ++i) {
+                frcti->sack[i].start = ntoh32(sack->blk[i].start);
+                frcti->sack[i].end   = ntoh32(sack->blk[i].end);
+        }
+
+        frcti->n_sack = sack->n;
+}
+
 /* Always queues the next application packet on the RQ. */
 static void __frcti_rcv(struct frcti *       frcti,
                         struct ssm_pk_buff * spb)
@@ -805,27 +2115,32 @@ static void __frcti_rcv(struct frcti *       frcti,
         uint32_t          ackno;
         uint32_t          rwe;
         int               fd = -1;
+        bool              ack = false;
 
         assert(frcti);
 
         rcv_cr = &frcti->rcv_cr;
         snd_cr = &frcti->snd_cr;
 
-        clock_gettime(PTHREAD_COND_CLOCK, &now);
+        clock_gettime(COARSE_CLOCK, &now);
 
         pci = (struct frct_pci *) ssm_pk_buff_head_release(spb, FRCT_PCILEN);
 
         idx = ssm_pk_buff_get_idx(spb);
         seqno = ntoh32(pci->seqno);
-        pos = seqno & (RQ_SIZE - 1);
 
         pthread_rwlock_wrlock(&frcti->lock);
 
         if (now.tv_sec - rcv_cr->act.tv_sec > rcv_cr->inact) {
                 if (pci->flags & FRCT_DRF)  { /* New run. */
                         rcv_cr->lwe = seqno;
-                        rcv_cr->rwe = seqno + RQ_SIZE;
+                        rcv_cr->rwe = seqno + frcti->rq_size;
                         rcv_cr->seqno = seqno;
+                        frcti->rq_hi  = seqno;
+                        frcti->n_run  = 0;
+                        frcti_frag_drop(frcti);
+                        frcti->frag_more = false;
+                        frcti_fec_rx_destroy(frcti);
                 } else if (pci->flags & FRCT_DATA) {
                         goto drop_packet;
                 }
@@ -839,23 +2154,52 @@ static void __frcti_rcv(struct frcti *       frcti,
                 rwe = rcv_cr->rwe;
                 pthread_rwlock_unlock(&frcti->lock);
 
-                __send_frct_pkt(fd, FRCT_FC, 0, rwe);
+                __send_frct_pkt(fd, FRCT_FC, 0, rwe, NULL);
 
                 ssm_pool_remove(proc.pool, idx);
                 return;
         }
 
         if (pci->flags & FRCT_ACK) {
+                size_t   pipe = frcti_pipe(frcti);
+                uint32_t hole;
+
                 ackno = ntoh32(pci->ackno);
-                if (after(ackno, frcti->snd_cr.lwe))
+                if (after(ackno, frcti->snd_cr.lwe)) {
                         frcti->snd_cr.lwe = ackno;
+                        frcti->n_dupack   = 0;
+                } else if (!(snd_cr->cflags & FRCTFSACK)
+                           && !(pci->flags & FRCT_DATA) && pipe > 0) {
+                        ++frcti->n_dupack;
+                }
 
-                if (frcti->probe && after(ackno, frcti->rttseq)) {
-#ifdef PROC_FLOW_STATS
+                /* Data only piggybacks the ACK, never the blocks. */
+                if ((pci->flags & FRCT_SACK)
+                    && (snd_cr->cflags & FRCTFSACK))
+                        frcti_sack_rcv(frcti, spb);
+                else if (!(pci->flags & FRCT_DATA))
+                        frcti->n_sack = 0;
+
+                frcti_sack_prune(frcti);
+
+                if (frcti->cc != NULL && frcti_pipe(frcti) < pipe)
+                        frcti_cc_ack(frcti, pipe - frcti_pipe(frcti));
+
+                /* Later packets got through, no need to wait for rto. */
+                if (frcti_sack_hole(frcti, &hole))
+                        frcti_cc_loss(frcti, hole, false);
+                else if (frcti->n_dupack == DUP_ACKS)
+                        frcti_cc_loss(frcti, snd_cr->lwe, false);
+
+                /* A SACK'd probe isn't held back by an earlier hole. */
+                if (frcti->probe && (after(ackno, frcti->rttseq)
+                    || frcti_is_sacked(frcti, frcti->rttseq))) {
+                        struct timespec t_ack;
                         if (!(pci->flags & FRCT_DATA))
-                                frcti->n_dak++;
-#endif
-                        rtt_estimator(frcti, ts_diff_ns(&now, &frcti->t_probe));
+                                STAT_INC(frcti->n_dak);
+                        clock_gettime(PTHREAD_COND_CLOCK, &t_ack);
+                        rtt_estimator(frcti,
+                                      ts_diff_ns(&t_ack, &frcti->t_probe));
                         frcti->probe = false;
                 }
         }
@@ -880,47 +2224,88 @@ static void __frcti_rcv(struct frcti *       frcti,
                 pthread_mutex_unlock(&frcti->mtx);
         }
 
+        if (FRCT_IS_FEC(pci->flags) && !(rcv_cr->cflags & FRCTFRTX)) {
+                frcti_fec_rcv(frcti, seqno, spb, &now);
+                goto drop_packet;
+        }
+
         if (!(pci->flags & FRCT_DATA))
                 goto drop_packet;
 
         if (before(seqno, rcv_cr->lwe)) {
                 rcv_cr->seqno = seqno; /* Ensures we send a new ACK. */
-#ifdef PROC_FLOW_STATS
-                frcti->n_dup++;
-#endif
+                STAT_INC(frcti->n_dup);
                 goto drop_packet;
         }
 
         if (rcv_cr->cflags & FRCTFRTX) {
+                /* The reader keeps up, but the window fills. */
+                if (before(seqno, rcv_cr->rwe)
+                    && seqno - rcv_cr->lwe >= frcti->rq_size >> 1
+                    && frcti->rq_size < RQ_MAX
+                    && frcti_frags(frcti) == 0)
+                        frcti_rq_grow(frcti);
 
                 if (!before(seqno, rcv_cr->rwe)) {  /* Out of window. */
-#ifdef PROC_FLOW_STATS
-                        frcti->n_out++;
-#endif
+                        STAT_INC(frcti->n_out);
                         goto drop_packet;
                 }
 
-                if (!before(seqno, rcv_cr->lwe + RQ_SIZE))  {
-#ifdef PROC_FLOW_STATS
-                        frcti->n_rqo++;
-#endif
+                if (!before(seqno, rcv_cr->lwe + frcti->rq_size))  {
+                        STAT_INC(frcti->n_rqo);
                         goto drop_packet; /* Out of rq. */
                 }
+
+                pos = seqno & (frcti->rq_size - 1);
                 if (frcti->rq[pos] != -1) {
-#ifdef PROC_FLOW_STATS
-                        frcti->n_dup++;
-#endif
+                        STAT_INC(frcti->n_dup);
                         goto drop_packet; /* Duplicate in rq. */
                 }
                 fd = frcti->fd;
+
+                /* Out of order, the sender hears about it right away. */
+                ack = seqno != frcti->rq_hi
+                        || ++frcti->n_unack >= (size_t) ACK_EVERY;
+
+                if (after(seqno + 1, frcti->rq_hi))
+                        frcti->rq_hi = seqno + 1;
+
+                frcti_run_add(frcti, seqno);
+
+                /* The cumulative ACK won't cover this one yet. */
+                if ((rcv_cr->cflags & FRCTFSACK)
+                    && (seqno != rcv_cr->lwe || (pci->flags & FRCT_MFGM)))
+                        frcti->sack_new = true;
+                /* Without SACK, a hole at the lwe gets duplicate ACKs. */
+                else if (!(rcv_cr->cflags & FRCTFSACK) && seqno != rcv_cr->lwe
+                         && frcti->rq[rcv_cr->lwe & (frcti->rq_size - 1)] == -1)
+                        frcti->sack_new = true;
         } else {
-                rcv_cr->lwe = seqno;
+                uint8_t fgm = pci->flags & (FRCT_FFGM | FRCT_MFGM);
+                int     ret;
+
+                if (frcti->fec_rx != NULL)
+                        ret = frcti_fec_data(frcti, seqno, fgm, idx, &now);
+                else
+                        ret = frcti_rq_put(frcti, seqno, fgm, idx, &now,
+                                           false);
+                if (ret < 0)
+                        goto drop_packet;
+
+                pthread_rwlock_unlock(&frcti->lock);
+
+                return;
         }
 
-        frcti->rq[pos] = idx;
+        frcti->rq[pos]  = idx;
+        frcti->rqf[pos] = pci->flags & (FRCT_FFGM | FRCT_MFGM);
 
         pthread_rwlock_unlock(&frcti->lock);
 
+        if (ack)
+                send_frct_pkt(frcti);
+
+        /* The timer ACKs what the decimated ACKs left out. */
         if (fd != -1)
                 timerwheel_delayed_ack(fd, frcti);
 
@@ -79,6 +79,7 @@ flow_info_msg_t * flow_info_s_to_msg(const struct flow_info * s)
         msg->n_pid    = s->n_pid;
         msg->n_1_pid  = s->n_1_pid;
         msg->mpl      = s->mpl;
+        msg->mtu      = s->mtu;
         msg->state    = s->state;
         msg->uid      = s->uid;
         msg->qos      = qos_spec_s_to_msg(&s->qs);
@@ -105,6 +106,7 @@ struct flow_info flow_info_msg_to_s(const flow_info_msg_t * msg)
         s.n_pid   = msg->n_pid;
         s.n_1_pid = msg->n_1_pid;
         s.mpl     = msg->mpl;
+        s.mtu     = msg->mtu;
         s.state   = msg->state;
         s.uid     = msg->uid;
         s.qs      = qos_spec_msg_to_s(msg->qos);
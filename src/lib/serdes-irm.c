@@ -222,6 +222,54 @@ int flow_dealloc__irm_req_ser(buffer_t *               buf,
         return -ENOMEM;
 }
 
+int flow_dealloc_batch__irm_req_ser(buffer_t *               buf,
+                                    const struct flow_info * flows,
+                                    size_t                   n,
+                                    const struct timespec *  timeo)
+{
+        irm_msg_t * msg;
+        size_t      len;
+
+        msg = malloc(sizeof(*msg));
+        if (msg == NULL)
+                goto fail_malloc;
+
+        irm_msg__init(msg);
+
+        msg->code = IRM_MSG_CODE__IRM_FLOW_DEALLOC;
+
+        msg->flows = malloc(n * sizeof(*msg->flows));
+        if (msg->flows == NULL)
+                goto fail_msg;
+
+        for (; msg->n_flows < n; ++msg->n_flows) {
+                msg->flows[msg->n_flows] =
+                        flow_info_s_to_msg(&flows[msg->n_flows]);
+                if (msg->flows[msg->n_flows] == NULL)
+                        goto fail_msg;
+        }
+
+        msg->timeo = timespec_s_to_msg(timeo);
+        if (msg->timeo == NULL)
+                goto fail_msg;
+
+        len = irm_msg__get_packed_size(msg);
+        if (len == 0 || len > buf->len)
+                goto fail_msg;
+
+        buf->len = len;
+
+        irm_msg__pack(msg, buf->data);
+        irm_msg__free_unpacked(msg, NULL);
+
+        return 0;
+
+ fail_msg:
+        irm_msg__free_unpacked(msg, NULL);
+ fail_malloc:
+        return -ENOMEM;
+}
+
 int ipcp_flow_dealloc__irm_req_ser(buffer_t *               buf,
                                    const struct flow_info * flow)
 {
@@ -58,6 +58,8 @@
 #define QUEUESIZE ((SSM_RBUFF_SIZE) * sizeof(struct flowevent))
 
 #define SSM_FSET_FILE_SIZE (SYS_MAX_FLOWS * sizeof(ssize_t)             \
+                            + SYS_MAX_FLOWS * sizeof(struct fs_link)    \
+                            + PROG_MAX_FQUEUES * sizeof(ssize_t)        \
                             + PROG_MAX_FQUEUES * sizeof(size_t)         \
                             + PROG_MAX_FQUEUES * sizeof(pthread_cond_t) \
                             + PROG_MAX_FQUEUES * QUEUESIZE              \
@@ -65,8 +67,16 @@
 
 #define fqueue_ptr(fs, idx) (fs->fqueues + (SSM_RBUFF_SIZE) * idx)
 
+/* Links the members of an fqueue, only valid while in the mtable. */
+struct fs_link {
+        ssize_t prev;
+        ssize_t next;
+};
+
 struct ssm_flow_set {
-        ssize_t *          mtable;
+        ssize_t *          mtable;  /* fqueue + 1, 0 if not in a set */
+        struct fs_link *   links;
+        ssize_t *          members; /* first flow_id per fqueue */
         size_t *           heads;
         pthread_cond_t *   conds;
         struct flowevent * fqueues;
@@ -93,7 +103,9 @@ static struct ssm_flow_set * flow_set_create(pid_t pid,
         if (fd == -1)
                 goto fail_shm_open;
 
-        if ((oflags & O_CREAT) && ftruncate(fd, SSM_FSET_FILE_SIZE) < 0)
+        /* Truncate first, a stale file would not read as zeroes. */
+        if ((oflags & O_CREAT) && (ftruncate(fd, 0) < 0
+            || ftruncate(fd, SSM_FSET_FILE_SIZE) < 0))
                 goto fail_truncate;
 
         shm_base = mmap(NULL, SSM_FSET_FILE_SIZE, FS_PROT, MAP_SHARED, fd, 0);
@@ -103,7 +115,9 @@ static struct ssm_flow_set * flow_set_create(pid_t pid,
         close(fd);
 
         set->mtable  = shm_base;
-        set->heads   = (size_t *) (set->mtable + SYS_MAX_FLOWS);
+        set->links   = (struct fs_link *) (set->mtable + SYS_MAX_FLOWS);
+        set->members = (ssize_t *) (set->links + SYS_MAX_FLOWS);
+        set->heads   = (size_t *) (set->members + PROG_MAX_FQUEUES);
         set->conds   = (pthread_cond_t *)(set->heads + PROG_MAX_FQUEUES);
         set->fqueues = (struct flowevent *) (set->conds + PROG_MAX_FQUEUES);
         set->lock    = (pthread_mutex_t *)
@@ -164,15 +178,14 @@ struct ssm_flow_set * ssm_flow_set_create(pid_t pid)
         if (pthread_condattr_setclock(&cattr, PTHREAD_COND_CLOCK))
                 goto fail_condattr_set;
 #endif
+        /* The mtable starts zeroed, untouched pages stay unbacked. */
         for (i = 0; i < PROG_MAX_FQUEUES; ++i) {
-                set->heads[i] = 0;
+                set->members[i] = -1;
+                set->heads[i]   = 0;
                 if (pthread_cond_init(&set->conds[i], &cattr))
                         goto fail_init;
         }
 
-        for (i = 0; i < SYS_MAX_FLOWS; ++i)
-                set->mtable[i] = -1;
-
         return set;
 
  fail_init:
@@ -216,21 +229,37 @@ void ssm_flow_set_close(struct ssm_flow_set * set)
         free(set);
 }
 
+static void flow_set_unlink(struct ssm_flow_set * set,
+                            int                   flow_id)
+{
+        struct fs_link * l = &set->links[flow_id];
+
+        if (l->prev != -1)
+                set->links[l->prev].next = l->next;
+        else
+                set->members[set->mtable[flow_id] - 1] = l->next;
+
+        if (l->next != -1)
+                set->links[l->next].prev = l->prev;
+
+        set->mtable[flow_id] = 0;
+}
+
 void ssm_flow_set_zero(struct ssm_flow_set * set,
                        size_t                idx)
 {
-        ssize_t i = 0;
+        ssize_t i;
 
         assert(set);
         assert(idx < PROG_MAX_FQUEUES);
 
         pthread_mutex_lock(set->lock);
 
-        for (i = 0; i < SYS_MAX_FLOWS; ++i)
-                if (set->mtable[i] == (ssize_t) idx)
-                        set->mtable[i] = -1;
+        for (i = set->members[idx]; i != -1; i = set->links[i].next)
+                set->mtable[i] = 0;
 
-        set->heads[idx] = 0;
+        set->members[idx] = -1;
+        set->heads[idx]   = 0;
 
         pthread_mutex_unlock(set->lock);
 }
@@ -246,12 +275,19 @@ int ssm_flow_set_add(struct ssm_flow_set * set,
 
         pthread_mutex_lock(set->lock);
 
-        if (set->mtable[flow_id] != -1) {
+        if (set->mtable[flow_id] != 0) {
                 pthread_mutex_unlock(set->lock);
                 return -EPERM;
         }
 
-        set->mtable[flow_id] = idx;
+        set->mtable[flow_id]     = idx + 1;
+        set->links[flow_id].prev = -1;
+        set->links[flow_id].next = set->members[idx];
+
+        if (set->members[idx] != -1)
+                set->links[set->members[idx]].prev = flow_id;
+
+        set->members[idx] = flow_id;
 
         pthread_mutex_unlock(set->lock);
 
@@ -268,8 +304,8 @@ void ssm_flow_set_del(struct ssm_flow_set * set,
 
         pthread_mutex_lock(set->lock);
 
-        if (set->mtable[flow_id] == (ssize_t) idx)
-                set->mtable[flow_id] = -1;
+        if (set->mtable[flow_id] == (ssize_t) idx + 1)
+                flow_set_unlink(set, flow_id);
 
         pthread_mutex_unlock(set->lock);
 }
@@ -286,7 +322,7 @@ int ssm_flow_set_has(struct ssm_flow_set * set,
 
         pthread_mutex_lock(set->lock);
 
-        if (set->mtable[flow_id] == (ssize_t) idx)
+        if (set->mtable[flow_id] == (ssize_t) idx + 1)
                 ret = 1;
 
         pthread_mutex_unlock(set->lock);
@@ -299,26 +335,28 @@ void ssm_flow_set_notify(struct ssm_flow_set * set,
                          int                   event)
 {
         struct flowevent * e;
+        ssize_t            idx;
 
         assert(set);
         assert(!(flow_id < 0) && flow_id < SYS_MAX_FLOWS);
 
         pthread_mutex_lock(set->lock);
 
-        if (set->mtable[flow_id] == -1) {
+        if (set->mtable[flow_id] == 0) {
                 pthread_mutex_unlock(set->lock);
                 return;
         }
 
-        e = fqueue_ptr(set, set->mtable[flow_id]) +
-                set->heads[set->mtable[flow_id]];
+        idx = set->mtable[flow_id] - 1;
+
+        e = fqueue_ptr(set, idx) + set->heads[idx];
 
         e->flow_id = flow_id;
         e->event   = event;
 
-        ++set->heads[set->mtable[flow_id]];
+        ++set->heads[idx];
 
-        pthread_cond_signal(&set->conds[set->mtable[flow_id]]);
+        pthread_cond_signal(&set->conds[idx]);
 
         pthread_mutex_unlock(set->lock);
 }
@@ -96,6 +96,10 @@ static const struct ssm_size_class_cfg ssm_pup_cfg[SSM_POOL_MAX_CLASSES] = {
 #define FETCH_SUB(ptr, val)                                                    \
         (__atomic_fetch_sub(ptr, val, __ATOMIC_SEQ_CST))
 
+#define CAS(ptr, exp, val)                                                     \
+        (__atomic_compare_exchange_n(ptr, exp, val, false,                     \
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+
 #define SSM_FILE_SIZE (SSM_POOL_TOTAL_SIZE + sizeof(struct _ssm_pool_hdr))
 #define SSM_GSPP_FILE_SIZE (SSM_GSPP_TOTAL_SIZE + sizeof(struct _ssm_pool_hdr))
 #define SSM_PUP_FILE_SIZE (SSM_PUP_TOTAL_SIZE + sizeof(struct _ssm_pool_hdr))
@@ -253,6 +257,17 @@ static void init_size_classes(struct ssm_pool * pool)
                 sc->pool_size    = cfg[c].size * cfg[c].blocks;
                 sc->object_count = cfg[c].blocks;
 
+                sc->reserved[QOS_CUBE_BE]    = 0;
+                sc->reserved[QOS_CUBE_VIDEO] =
+                        cfg[c].blocks * SSM_POOL_RSV_VIDEO / 100;
+                sc->reserved[QOS_CUBE_VOICE] =
+                        cfg[c].blocks * SSM_POOL_RSV_VOICE / 100;
+
+                for (i = 0; i < QOS_CUBE_MAX; ++i)
+                        STORE(&sc->denied[i], 0);
+
+                STORE(&sc->free_blocks, sc->object_count);
+
                 /* Initialize all shards */
                 for (s = 0; s < SSM_POOL_SHARDS; s++) {
                         shard = &sc->shards[s];
@@ -262,9 +277,12 @@ static void init_size_classes(struct ssm_pool * pool)
                         STORE(&shard->free_count, 0);
 
                         pthread_mutex_init(&shard->mtx, &mattr);
-                        pthread_cond_init(&shard->cond, &cattr);
                 }
 
+                pthread_mutex_init(&sc->mtx, &mattr);
+                pthread_cond_init(&sc->cond, &cattr);
+                STORE(&sc->waiters, 0);
+
                 /* Lazy distribution: put all blocks in shard 0 initially */
                 region = pool->shm_base + offset;
 
@@ -293,6 +311,20 @@ static void init_size_classes(struct ssm_pool * pool)
         pthread_condattr_destroy(&cattr);
 }
 
+/* Return n blocks to the class, wakes blocked allocs on any shard. */
+static __inline__ void release_blocks(struct _ssm_size_class * sc,
+                                      size_t                   n)
+{
+        FETCH_ADD(&sc->free_blocks, n);
+
+        if (LOAD(&sc->waiters) == 0)
+                return;
+
+        robust_mutex_lock(&sc->mtx);
+        pthread_cond_broadcast(&sc->cond);
+        pthread_mutex_unlock(&sc->mtx);
+}
+
 /*
  * Reclaim all blocks allocated by a specific pid in a size class.
  * Called with shard mutex held.
@@ -328,6 +360,7 @@ void ssm_pool_reclaim_orphans(struct ssm_pool * pool,
                               pid_t             pid)
 {
         size_t sc_idx;
+        size_t n;
 
         if (pool == NULL || pid <= 0)
                 return;
@@ -343,11 +376,54 @@ void ssm_pool_reclaim_orphans(struct ssm_pool * pool,
                 /* Reclaim to shard 0 for simplicity */
                 shard = &sc->shards[0];
                 robust_mutex_lock(&shard->mtx);
-                reclaim_pid_from_sc(sc, shard, pool->pool_base, pid);
+                n = reclaim_pid_from_sc(sc, shard, pool->pool_base, pid);
                 pthread_mutex_unlock(&shard->mtx);
+                release_blocks(sc, n);
         }
 }
 
+/* Blocks held back from cube qc for higher-priority cubes. */
+static __inline__ size_t cube_rsv(struct _ssm_size_class * sc,
+                                  qoscube_t                qc)
+{
+        size_t rsv = 0;
+        int    i;
+
+        for (i = qc + 1; i < QOS_CUBE_MAX; ++i)
+                rsv += sc->reserved[i];
+
+        return rsv;
+}
+
+/*
+ * Claim one block of the class for cube qc. The class-wide free count
+ * never exceeds the blocks on the shard lists, so a successful claim
+ * leaves the blocks reserved for higher-priority cubes untouched.
+ */
+static __inline__ bool claim_block(struct _ssm_size_class * sc,
+                                   qoscube_t                qc)
+{
+        size_t rsv;
+        size_t avail;
+
+        rsv = cube_rsv(sc, qc);
+
+        avail = LOAD(&sc->free_blocks);
+        do {
+                if (avail <= rsv)
+                        return false;
+        } while (!CAS(&sc->free_blocks, &avail, avail - 1));
+
+        return true;
+}
+
+static __inline__ void count_denied(struct _ssm_size_class * sc,
+                                    qoscube_t                qc)
+{
+        if (qc < QOS_CUBE_MAX) /* SSM_QC_IPCP is not accounted */
+                FETCH_ADD(&sc->denied[qc], 1);
+}
+
 static __inline__
 struct ssm_pk_buff * try_alloc_from_shard(struct _ssm_shard * shard,
                                           void *              base)
@@ -398,6 +474,7 @@ static __inline__ ssize_t init_block(struct ssm_pool *        pool,
 static ssize_t alloc_from_sc(struct ssm_pool *     pool,
                              int                   idx,
                              size_t                len,
+                             qoscube_t             qc,
                              uint8_t **            ptr,
                              struct ssm_pk_buff ** spb)
 {
@@ -413,6 +490,11 @@ static ssize_t alloc_from_sc(struct ssm_pool *     pool,
         sc = &pool->hdr->size_classes[idx];
         local = GET_SHARD_FOR_PID(getpid());
 
+        if (!claim_block(sc, qc)) {
+                count_denied(sc, qc);
+                return -EAGAIN;
+        }
+
         for (s = 0; s < SSM_POOL_SHARDS; s++) {
                 struct _ssm_shard * shard;
                 int                 idx;
@@ -425,6 +507,9 @@ static ssize_t alloc_from_sc(struct ssm_pool *     pool,
                         return init_block(pool, sc, shard, blk, len, ptr, spb);
         }
 
+        /* Lost a race with a concurrent free, release the claim */
+        release_blocks(sc, 1);
+
         return -EAGAIN;
 }
 
@@ -432,6 +517,7 @@ static ssize_t alloc_from_sc(struct ssm_pool *     pool,
 static ssize_t alloc_from_sc_b(struct ssm_pool *       pool,
                                int                     idx,
                                size_t                  len,
+                               qoscube_t               qc,
                                uint8_t **              ptr,
                                struct ssm_pk_buff **   spb,
                                const struct timespec * abstime)
@@ -452,23 +538,33 @@ static ssize_t alloc_from_sc_b(struct ssm_pool *       pool,
 
         while (blk == NULL && ret != ETIMEDOUT) {
                 /* Try non-blocking allocation from any shard */
-                for (s = 0; s < SSM_POOL_SHARDS && blk == NULL; s++) {
-                        shard = &sc->shards[(local + s) % SSM_POOL_SHARDS];
-                        blk = try_alloc_from_shard(shard, pool->pool_base);
+                if (claim_block(sc, qc)) {
+                        for (s = 0; s < SSM_POOL_SHARDS && blk == NULL; s++) {
+                                shard = &sc->shards[(local + s)
+                                                    % SSM_POOL_SHARDS];
+                                blk = try_alloc_from_shard(shard,
+                                                           pool->pool_base);
+                        }
+
+                        if (blk != NULL)
+                                break;
+
+                        release_blocks(sc, 1);
                 }
 
-                if (blk != NULL)
-                        break;
-
-                /* Nothing available, wait for signal */
-                shard = &sc->shards[local];
-                robust_mutex_lock(&shard->mtx);
-                ret = robust_wait(&shard->cond, &shard->mtx, abstime);
-                pthread_mutex_unlock(&shard->mtx);
+                /* Nothing available, wait for a free on any shard */
+                robust_mutex_lock(&sc->mtx);
+                FETCH_ADD(&sc->waiters, 1);
+                if (LOAD(&sc->free_blocks) <= cube_rsv(sc, qc))
+                        ret = robust_wait(&sc->cond, &sc->mtx, abstime);
+                FETCH_SUB(&sc->waiters, 1);
+                pthread_mutex_unlock(&sc->mtx);
         }
 
-        if (ret == ETIMEDOUT)
+        if (ret == ETIMEDOUT) {
+                count_denied(sc, qc);
                 return -ETIMEDOUT;
+        }
 
         return init_block(pool, sc, shard, blk, len, ptr, spb);
 }
@@ -692,23 +788,26 @@ int ssm_pool_mlock(struct ssm_pool * pool)
 
 ssize_t ssm_pool_alloc(struct ssm_pool *     pool,
                        size_t                count,
+                       qoscube_t             qc,
                        uint8_t **            ptr,
                        struct ssm_pk_buff ** spb)
 {
         int idx;
 
         assert(pool != NULL);
+        assert(qc >= 0 && qc <= SSM_QC_IPCP);
         assert(spb != NULL);
 
         idx = select_size_class(pool, count);
         if (idx >= 0)
-                return alloc_from_sc(pool, idx, count, ptr, spb);
+                return alloc_from_sc(pool, idx, count, qc, ptr, spb);
 
         return -EMSGSIZE;
 }
 
 ssize_t ssm_pool_alloc_b(struct ssm_pool *       pool,
                          size_t                  count,
+                         qoscube_t               qc,
                          uint8_t **              ptr,
                          struct ssm_pk_buff **   spb,
                          const struct timespec * abstime)
@@ -716,11 +815,13 @@ ssize_t ssm_pool_alloc_b(struct ssm_pool *       pool,
         int idx;
 
         assert(pool != NULL);
+        assert(qc >= 0 && qc <= SSM_QC_IPCP);
         assert(spb != NULL);
 
         idx = select_size_class(pool, count);
         if (idx >= 0)
-                return alloc_from_sc_b(pool, idx, count, ptr, spb, abstime);
+                return alloc_from_sc_b(pool, idx, count, qc, ptr, spb,
+                                       abstime);
 
         return -EMSGSIZE;
 }
@@ -816,13 +917,47 @@ int ssm_pool_remove(struct ssm_pool * pool,
         list_add_head(&shard->free_list, blk, pool->pool_base);
         FETCH_ADD(&shard->free_count, 1);
 
-        pthread_cond_signal(&shard->cond);
-
         pthread_mutex_unlock(&shard->mtx);
 
+        release_blocks(sc, 1);
+
         return 0;
 }
 
+int ssm_pool_stats(struct ssm_pool *       pool,
+                   size_t                  n,
+                   struct ssm_pool_stats * stats)
+{
+        struct _ssm_size_class * sc;
+        int                      c;
+        int                      i;
+
+        assert(pool != NULL);
+        assert(stats != NULL);
+
+        for (c = 0; c < SSM_POOL_MAX_CLASSES; c++) {
+                sc = &pool->hdr->size_classes[c];
+                if (sc->object_count == 0)
+                        continue;
+
+                if (n-- > 0)
+                        continue;
+
+                stats->size   = sc->object_size;
+                stats->blocks = sc->object_count;
+                stats->free   = LOAD_RELAXED(&sc->free_blocks);
+
+                for (i = 0; i < QOS_CUBE_MAX; ++i) {
+                        stats->reserved[i] = sc->reserved[i];
+                        stats->denied[i]   = LOAD_RELAXED(&sc->denied[i]);
+                }
+
+                return 0;
+        }
+
+        return -ENOENT;
+}
+
 size_t ssm_pk_buff_get_idx(struct ssm_pk_buff * spb)
 {
         assert(spb != NULL);
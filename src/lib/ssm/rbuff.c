@@ -356,6 +356,12 @@ ssize_t ssm_rbuff_read(struct ssm_rbuff * rb)
 
         robust_mutex_lock(rb->mtx);
 
+        /* Another reader may have emptied it in the meantime. */
+        if (IS_EMPTY(rb)) {
+                pthread_mutex_unlock(rb->mtx);
+                return check_rb_acl(rb);
+        }
+
         ret = TAIL(rb);
         ADVANCE_TAIL(rb);
 
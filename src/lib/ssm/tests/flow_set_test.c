@@ -169,6 +169,71 @@ fail:
         return TEST_RC_FAIL;
 }
 
+static int test_ssm_flow_set_zero_idx(void)
+{
+        struct ssm_flow_set * set;
+        pid_t                 pid;
+        int                   i;
+
+        TEST_START();
+
+        pid = getpid();
+
+        set = ssm_flow_set_create(pid);
+        if (set == NULL) {
+                printf("Failed to create flow set.\n");
+                goto fail;
+        }
+
+        for (i = 0; i < 8; ++i) {
+                if (ssm_flow_set_add(set, i & 1, i) < 0) {
+                        printf("Failed to add flow %d to set.\n", i);
+                        goto fail_destroy;
+                }
+        }
+
+        /* Unlink from the head, the middle and the tail. */
+        ssm_flow_set_del(set, 0, 6);
+        ssm_flow_set_del(set, 0, 2);
+        ssm_flow_set_del(set, 0, 0);
+
+        ssm_flow_set_zero(set, 0);
+
+        for (i = 0; i < 8; ++i) {
+                if (ssm_flow_set_has(set, 0, i)) {
+                        printf("Flow %d should not be in set 0.\n", i);
+                        goto fail_destroy;
+                }
+
+                if (ssm_flow_set_has(set, 1, i) != (i & 1)) {
+                        printf("Flow %d membership of set 1 wrong.\n", i);
+                        goto fail_destroy;
+                }
+        }
+
+        if (ssm_flow_set_add(set, 0, 4) < 0) {
+                printf("Failed to re-add flow after zero.\n");
+                goto fail_destroy;
+        }
+
+        ssm_flow_set_zero(set, 1);
+
+        if (!ssm_flow_set_has(set, 0, 4) || ssm_flow_set_has(set, 1, 5)) {
+                printf("Zeroing set 1 should only clear set 1.\n");
+                goto fail_destroy;
+        }
+
+        ssm_flow_set_destroy(set);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+fail_destroy:
+        ssm_flow_set_destroy(set);
+fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
 static int test_ssm_flow_set_notify_wait(void)
 {
         struct ssm_flow_set * set;
@@ -249,6 +314,7 @@ int flow_set_test(int     argc,
         ret |= test_ssm_flow_set_create_destroy();
         ret |= test_ssm_flow_set_add_del_has();
         ret |= test_ssm_flow_set_zero();
+        ret |= test_ssm_flow_set_zero_idx();
         ret |= test_ssm_flow_set_notify_wait();
 
         return ret;
@@ -31,6 +31,8 @@
 
 #include <test/test.h>
 #include <ouroboros/ssm_pool.h>
+#include <ouroboros/pthread.h>
+#include <ouroboros/time.h>
 
 #include <errno.h>
 #include <stdio.h>
@@ -43,6 +45,7 @@
 #include <signal.h>
 
 #define TEST_SIZE 256
+#define MAX_BLOCKS (1 << 16)
 
 /* Helper to get pool header for inspection */
 static struct _ssm_pool_hdr * get_pool_hdr(struct ssm_pool * pool)
@@ -166,7 +169,8 @@ static int test_shard_migration(void)
         sc = &hdr->size_classes[sc_idx];
 
         /* Allocate from this process */
-        off = ssm_pool_alloc(pool, TEST_SIZE, &ptr, &spb);
+        off = ssm_pool_alloc(pool, TEST_SIZE, QOS_CUBE_VOICE,
+                             &ptr, &spb);
         if (off < 0) {
                 printf("Allocation failed: %zd.\n", off);
                 goto fail_pool;
@@ -250,6 +254,7 @@ static int test_fallback_stealing(void)
         /* Allocate half the blocks from single process */
         for (i = 0; i < total_blocks / 2; i++) {
                 ssize_t off = ssm_pool_alloc(pool, TEST_SIZE,
+                                             QOS_CUBE_VOICE,
                                              &ptrs[i], &spbs[i]);
                 if (off < 0) {
                         printf("Allocation %zu failed: %zd.\n", i, off);
@@ -287,6 +292,7 @@ static int test_fallback_stealing(void)
         /* Allocate again - should succeed by taking from shards */
         for (i = 0; i < total_blocks / 2; i++) {
                 ssize_t off = ssm_pool_alloc(pool, TEST_SIZE,
+                                             QOS_CUBE_VOICE,
                                              &ptrs[i], &spbs[i]);
                 if (off < 0) {
                         printf("Fallback alloc %zu failed: %zd.\n", i, off);
@@ -362,7 +368,7 @@ static int test_multiprocess_sharding(void)
 
                         /* Each child allocates and frees a block */
                         off = ssm_pool_alloc(child_pool, TEST_SIZE,
-                                            &ptr, &spb);
+                                             QOS_CUBE_VOICE, &ptr, &spb);
                         if (off < 0) {
                                 ssm_pool_close(child_pool);
                                 exit(EXIT_FAILURE);
@@ -455,7 +461,8 @@ static int test_exhaustion_with_fallback(void)
 
         /* Allocate until exhausted across all shards */
         while (true) {
-                off = ssm_pool_alloc(pool, TEST_SIZE, &ptr, &spb);
+                off = ssm_pool_alloc(pool, TEST_SIZE, QOS_CUBE_VOICE,
+                                     &ptr, &spb);
                 if (off < 0) {
                         if (off == -EAGAIN)
                                 break;
@@ -465,7 +472,8 @@ static int test_exhaustion_with_fallback(void)
         }
 
         /* Should fail with -EAGAIN when truly exhausted */
-        off = ssm_pool_alloc(pool, TEST_SIZE, &ptr, &spb);
+        off = ssm_pool_alloc(pool, TEST_SIZE, QOS_CUBE_VOICE,
+                             &ptr, &spb);
         if (off != -EAGAIN) {
                 printf("Expected -EAGAIN, got %zd.\n", off);
                 goto fail_pool;
@@ -483,6 +491,111 @@ static int test_exhaustion_with_fallback(void)
         return TEST_RC_FAIL;
 }
 
+/* A free on the allocator's shard must wake a waiter on another shard */
+static int test_blocking_cross_shard(void)
+{
+        struct ssm_pool *    pool;
+        struct ssm_pk_buff * spb;
+        uint8_t *            ptr;
+        ssize_t *            offs;
+        ssize_t              off;
+        size_t               n = 0;
+        pid_t                child;
+        int                  status;
+
+        TEST_START();
+
+        pool = ssm_pool_create(getuid(), getgid());
+        if (pool == NULL) {
+                printf("Failed to create pool.\n");
+                goto fail;
+        }
+
+        offs = malloc(MAX_BLOCKS * sizeof(*offs));
+        if (offs == NULL) {
+                printf("Failed to malloc.\n");
+                goto fail_pool;
+        }
+
+        while (n < MAX_BLOCKS) {
+                off = ssm_pool_alloc(pool, TEST_SIZE, QOS_CUBE_VOICE,
+                                     &ptr, &spb);
+                if (off < 0)
+                        break;
+                offs[n++] = off;
+        }
+
+        if (n == 0 || n == MAX_BLOCKS) {
+                printf("Failed to exhaust the class: %zu.\n", n);
+                goto fail_offs;
+        }
+
+        child = fork();
+        if (child == -1) {
+                printf("Fork failed.\n");
+                goto fail_offs;
+        }
+
+        if (child == 0) {
+                struct ssm_pool * child_pool;
+                struct timespec   abs;
+                struct timespec   intv = TIMESPEC_INIT_S(2);
+
+                child_pool = ssm_pool_open(getuid());
+                if (child_pool == NULL)
+                        exit(EXIT_FAILURE);
+
+                clock_gettime(PTHREAD_COND_CLOCK, &abs);
+                ts_add(&abs, &intv, &abs);
+
+                off = ssm_pool_alloc_b(child_pool, TEST_SIZE, QOS_CUBE_VOICE,
+                                       &ptr, &spb, &abs);
+                if (off < 0) {
+                        ssm_pool_close(child_pool);
+                        exit(EXIT_FAILURE);
+                }
+
+                ssm_pool_remove(child_pool, off);
+                ssm_pool_close(child_pool);
+                exit(EXIT_SUCCESS);
+        }
+
+        /* Let the child block, then free on this process' shard. */
+        usleep(100000);
+
+        ssm_pool_remove(pool, offs[--n]);
+
+        if (waitpid(child, &status, 0) == -1) {
+                printf("Waitpid failed.\n");
+                goto fail_offs;
+        }
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                printf("Waiter on shard %d missed free on shard %d.\n",
+                       child % SSM_POOL_SHARDS, getpid() % SSM_POOL_SHARDS);
+                goto fail_offs;
+        }
+
+        while (n > 0)
+                ssm_pool_remove(pool, offs[--n]);
+
+        free(offs);
+        ssm_pool_destroy(pool);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+
+ fail_offs:
+        while (n > 0)
+                ssm_pool_remove(pool, offs[--n]);
+        free(offs);
+ fail_pool:
+        ssm_pool_destroy(pool);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
 int pool_sharding_test(int     argc,
                        char ** argv)
 {
@@ -496,6 +609,7 @@ int pool_sharding_test(int     argc,
         ret |= test_fallback_stealing();
         ret |= test_multiprocess_sharding();
         ret |= test_exhaustion_with_fallback();
+        ret |= test_blocking_cross_shard();
 
         return ret;
 }
@@ -66,7 +66,7 @@ static int test_ssm_pool_basic_allocation(void)
                 printf("Failed to create pool.\n");
                 goto fail_create;
         }
-        ret = ssm_pool_alloc(pool, POOL_256, &ptr, &spb);
+        ret = ssm_pool_alloc(pool, POOL_256, QOS_CUBE_BE, &ptr, &spb);
         if (ret < 0) {
                 printf("Alloc failed: %zd.\n", ret);
                 goto fail_alloc;
@@ -126,9 +126,9 @@ static int test_ssm_pool_multiple_allocations(void)
                 goto fail_create;
         }
 
-        ret1 = ssm_pool_alloc(pool, POOL_256, &ptr1, &spb1);
-        ret2 = ssm_pool_alloc(pool, POOL_256, &ptr2, &spb2);
-        ret3 = ssm_pool_alloc(pool, POOL_256, &ptr3, &spb3);
+        ret1 = ssm_pool_alloc(pool, POOL_256, QOS_CUBE_BE, &ptr1, &spb1);
+        ret2 = ssm_pool_alloc(pool, POOL_256, QOS_CUBE_BE, &ptr2, &spb2);
+        ret3 = ssm_pool_alloc(pool, POOL_256, QOS_CUBE_BE, &ptr3, &spb3);
         if (ret1 < 0 || ret2 < 0 || ret3 < 0) {
                 printf("Allocs failed: %zd, %zd, %zd.\n", ret1, ret2, ret3);
                 goto fail_alloc;
@@ -221,7 +221,7 @@ static int test_ssm_pool_no_fallback_for_large(void)
                 goto fail_create;
         }
 
-        ret = ssm_pool_alloc(pool, POOL_2M, &ptr, &spb);
+        ret = ssm_pool_alloc(pool, POOL_2M, QOS_CUBE_BE, &ptr, &spb);
         if (ret >= 0) {
                 printf("Oversized alloc succeeded: %zd.\n", ret);
                 goto fail_alloc;
@@ -259,19 +259,19 @@ static int test_ssm_pool_blocking_vs_nonblocking(void)
                 goto fail_create;
         }
 
-        ret = ssm_pool_alloc(pool, POOL_2M, &ptr, &spb);
+        ret = ssm_pool_alloc(pool, POOL_2M, QOS_CUBE_BE, &ptr, &spb);
         if (ret != -EMSGSIZE) {
                 printf("Nonblocking oversized: %zd.\n", ret);
                 goto fail_alloc;
         }
 
-        ret = ssm_pool_alloc_b(pool, POOL_2M, &ptr, &spb, NULL);
+        ret = ssm_pool_alloc_b(pool, POOL_2M, QOS_CUBE_BE, &ptr, &spb, NULL);
         if (ret != -EMSGSIZE) {
                 printf("Blocking oversized: %zd.\n", ret);
                 goto fail_alloc;
         }
 
-        ret = ssm_pool_alloc(pool, POOL_256, &ptr, &spb);
+        ret = ssm_pool_alloc(pool, POOL_256, QOS_CUBE_BE, &ptr, &spb);
         if (ret < 0) {
                 printf("Valid alloc failed: %zd.\n", ret);
                 goto fail_alloc;
@@ -338,7 +338,8 @@ static int test_ssm_pool_stress_test(void)
                                 break;
                         }
 
-                        ret = ssm_pool_alloc(pool, size, &ptr, &spb);
+                        ret = ssm_pool_alloc(pool, size, QOS_CUBE_BE,
+                                             &ptr, &spb);
                         if (ret < 0) {
                                 printf("Alloc at iter %zu: %zd.\n", i, ret);
                                 goto fail_test;
@@ -362,7 +363,8 @@ static int test_ssm_pool_stress_test(void)
                 }
 
                 if (i % 10 == 0) {
-                        ret = ssm_pool_alloc(pool, POOL_256, &ptr, &spb);
+                        ret = ssm_pool_alloc(pool, POOL_256, QOS_CUBE_BE,
+                                             &ptr, &spb);
                         if (ret < 0) {
                                 printf("Periodic alloc at %zu: %zd.\n", i, ret);
                                 goto fail_test;
@@ -407,7 +409,7 @@ static int test_ssm_pool_open_initializes_ssm(void)
                 goto fail_create;
         }
 
-        ret = ssm_pool_alloc(creator, POOL_256, &ptr, &spb);
+        ret = ssm_pool_alloc(creator, POOL_256, QOS_CUBE_BE, &ptr, &spb);
         if (ret < 0) {
                 printf("Creator alloc failed: %zd.\n", ret);
                 goto fail_creator;
@@ -420,7 +422,7 @@ static int test_ssm_pool_open_initializes_ssm(void)
                 goto fail_creator;
         }
 
-        ret = ssm_pool_alloc(opener, POOL_256, &ptr, &spb);
+        ret = ssm_pool_alloc(opener, POOL_256, QOS_CUBE_BE, &ptr, &spb);
         if (ret < 0) {
                 printf("Opener alloc failed: %zd.\n", ret);
                 goto fail_opener;
@@ -456,7 +458,7 @@ static int test_ssm_pool_bounds_checking(void)
                 goto fail_create;
         }
 
-        ret = ssm_pool_alloc(pool, POOL_256, NULL, &spb);
+        ret = ssm_pool_alloc(pool, POOL_256, QOS_CUBE_BE, NULL, &spb);
         if (ret < 0) {
                 printf("alloc failed: %zd.\n", ret);
                 goto fail_alloc;
@@ -563,7 +565,7 @@ static int test_ssm_pool_inter_process_communication(void)
                 exit(0);
         }
 
-        idx = ssm_pool_alloc(pool, len, &ptr, &spb);
+        idx = ssm_pool_alloc(pool, len, QOS_CUBE_BE, &ptr, &spb);
         if (idx < 0) {
                 printf("Parent: pool alloc: %zd.\n", idx);
                 goto fail_child;
@@ -627,7 +629,7 @@ static int test_ssm_pool_read_operation(void)
                 goto fail_create;
         }
 
-        idx = ssm_pool_alloc(pool, len, &wptr, &spb);
+        idx = ssm_pool_alloc(pool, len, QOS_CUBE_BE, &wptr, &spb);
         if (idx < 0) {
                 printf("alloc failed: %zd.\n", idx);
                 goto fail_alloc;
@@ -715,7 +717,7 @@ static int test_ssm_pk_buff_operations(void)
                 goto fail_create;
         }
 
-        idx = ssm_pool_alloc(pool, POOL_256, &ptr, &spb);
+        idx = ssm_pool_alloc(pool, POOL_256, QOS_CUBE_BE, &ptr, &spb);
         if (idx < 0) {
                 printf("alloc failed: %zd.\n", idx);
                 goto fail_alloc;
@@ -826,7 +828,8 @@ static int test_ssm_pool_size_class_boundaries(void)
                 struct ssm_pk_buff * hdr;
                 size_t               actual_class;
 
-                idx = ssm_pool_alloc(pool, sizes[i], &ptr, &spb);
+                idx = ssm_pool_alloc(pool, sizes[i], QOS_CUBE_BE,
+                                     &ptr, &spb);
                 if (idx < 0) {
                         printf("Alloc at %zu failed: %zd.\n", sizes[i], idx);
                         goto fail_alloc;
@@ -892,7 +895,7 @@ static int test_ssm_pool_exhaustion(void)
         }
 
         for (i = 0; i < 2048; i++) {
-                ret = ssm_pool_alloc(pool, POOL_256, &ptr, &spb);
+                ret = ssm_pool_alloc(pool, POOL_256, QOS_CUBE_BE, &ptr, &spb);
                 if (ret < 0) {
                         if (ret == -EAGAIN)
                                 break;
@@ -907,7 +910,7 @@ static int test_ssm_pool_exhaustion(void)
                 goto fail_test;
         }
 
-        ret = ssm_pool_alloc(pool, POOL_256, &ptr, &spb);
+        ret = ssm_pool_alloc(pool, POOL_256, QOS_CUBE_BE, &ptr, &spb);
         if (ret >= 0) {
                 ssm_pool_remove(pool, ret);
         } else if (ret != -EAGAIN) {
@@ -918,7 +921,7 @@ static int test_ssm_pool_exhaustion(void)
         for (i = 0; i < count; i++)
                 ssm_pool_remove(pool, indices[i]);
 
-        ret = ssm_pool_alloc(pool, POOL_256, &ptr, &spb);
+        ret = ssm_pool_alloc(pool, POOL_256, QOS_CUBE_BE, &ptr, &spb);
         if (ret < 0) {
                 printf("Alloc after free failed: %zd.\n", ret);
                 goto fail_test;
@@ -968,9 +971,9 @@ static int test_ssm_pool_reclaim_orphans(void)
         my_pid = getpid();
 
         /* Allocate some blocks */
-        ret1 = ssm_pool_alloc(pool, POOL_256, &ptr1, &spb1);
-        ret2 = ssm_pool_alloc(pool, POOL_512, &ptr2, &spb2);
-        ret3 = ssm_pool_alloc(pool, POOL_1K, &ptr3, &spb3);
+        ret1 = ssm_pool_alloc(pool, POOL_256, QOS_CUBE_BE, &ptr1, &spb1);
+        ret2 = ssm_pool_alloc(pool, POOL_512, QOS_CUBE_BE, &ptr2, &spb2);
+        ret3 = ssm_pool_alloc(pool, POOL_1K, QOS_CUBE_BE, &ptr3, &spb3);
         if (ret1 < 0 || ret2 < 0 || ret3 < 0) {
                 printf("Allocs failed: %zd, %zd, %zd.\n", ret1, ret2, ret3);
                 goto fail_alloc;
@@ -1005,7 +1008,7 @@ static int test_ssm_pool_reclaim_orphans(void)
         ssm_pool_remove(pool, ret3);
 
         /* Try allocating again - should get blocks from reclaimed pool */
-        ret1 = ssm_pool_alloc(pool, POOL_256, &ptr1, &spb1);
+        ret1 = ssm_pool_alloc(pool, POOL_256, QOS_CUBE_BE, &ptr1, &spb1);
         if (ret1 < 0) {
                 printf("Alloc after reclaim failed: %zd.\n", ret1);
                 goto fail_test;
@@ -1033,6 +1036,129 @@ static int test_ssm_pool_reclaim_orphans(void)
         return TEST_RC_FAIL;
 }
 
+static int test_ssm_pool_qos_reservation(void)
+{
+        struct ssm_pool *     pool;
+        struct ssm_pk_buff *  spb;
+        struct ssm_pool_stats st;
+        uint8_t *             ptr;
+        ssize_t *             indices;
+        size_t                count = 0;
+        size_t                n;
+        size_t                i;
+        ssize_t               ret;
+
+        TEST_START();
+
+        pool = ssm_pool_create(getuid(), getgid());
+        if (pool == NULL) {
+                printf("Failed to create pool.\n");
+                goto fail_create;
+        }
+
+        /* Find the class serving empty packets. */
+        n = 0;
+        do {
+                if (ssm_pool_stats(pool, n++, &st) < 0) {
+                        printf("Failed to get stats.\n");
+                        goto fail_alloc;
+                }
+        } while (st.size < sizeof(struct ssm_pk_buff) + SSM_PK_BUFF_HEADSPACE
+                 + SSM_PK_BUFF_TAILSPACE);
+
+        if (st.free != st.blocks) {
+                printf("Bad initial stats: %zu/%zu.\n", st.free, st.blocks);
+                goto fail_alloc;
+        }
+
+        indices = malloc(st.blocks * sizeof(*indices));
+        if (indices == NULL) {
+                printf("Malloc failed.\n");
+                goto fail_alloc;
+        }
+
+        /* Best effort stops at the video and voice reservations. */
+        while ((ret = ssm_pool_alloc(pool, 0, QOS_CUBE_BE, &ptr, &spb)) >= 0)
+                indices[count++] = ret;
+
+        if (ret != -EAGAIN) {
+                printf("Unexpected error: %zd.\n", ret);
+                goto fail_test;
+        }
+
+        ssm_pool_stats(pool, n - 1, &st);
+        if (st.free != st.reserved[QOS_CUBE_VIDEO]
+            + st.reserved[QOS_CUBE_VOICE]) {
+                printf("BE took reserved blocks: %zu free.\n", st.free);
+                goto fail_test;
+        }
+
+        if (st.denied[QOS_CUBE_BE] != 1) {
+                printf("BE denial not counted: %zu.\n",
+                       st.denied[QOS_CUBE_BE]);
+                goto fail_test;
+        }
+
+        /* IPCP allocations are not held to the reservations. */
+        ret = ssm_pool_alloc(pool, 0, SSM_QC_IPCP, &ptr, &spb);
+        if (ret < 0) {
+                printf("IPCP alloc restricted: %zd.\n", ret);
+                goto fail_test;
+        }
+
+        indices[count++] = ret;
+
+        /* Video may use its own reservation, but not voice's. */
+        while ((ret = ssm_pool_alloc(pool, 0, QOS_CUBE_VIDEO,
+                                     &ptr, &spb)) >= 0)
+                indices[count++] = ret;
+
+        ssm_pool_stats(pool, n - 1, &st);
+        if (st.free != st.reserved[QOS_CUBE_VOICE]) {
+                printf("Video took voice blocks: %zu free.\n", st.free);
+                goto fail_test;
+        }
+
+        /* Voice may take everything that is left. */
+        while ((ret = ssm_pool_alloc(pool, 0, QOS_CUBE_VOICE,
+                                     &ptr, &spb)) >= 0)
+                indices[count++] = ret;
+
+        ssm_pool_stats(pool, n - 1, &st);
+        if (st.free != 0 || count != st.blocks) {
+                printf("Voice could not drain the class: %zu/%zu.\n",
+                       count, st.blocks);
+                goto fail_test;
+        }
+
+        for (i = 0; i < count; i++)
+                ssm_pool_remove(pool, indices[i]);
+
+        ssm_pool_stats(pool, n - 1, &st);
+        if (st.free != st.blocks) {
+                printf("Blocks not returned: %zu/%zu.\n",
+                       st.free, st.blocks);
+                goto fail_freed;
+        }
+
+        free(indices);
+        ssm_pool_destroy(pool);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+
+ fail_test:
+        for (i = 0; i < count; i++)
+                ssm_pool_remove(pool, indices[i]);
+ fail_freed:
+        free(indices);
+ fail_alloc:
+        ssm_pool_destroy(pool);
+ fail_create:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
 int pool_test(int     argc,
               char ** argv)
 {
@@ -1055,6 +1181,7 @@ int pool_test(int     argc,
         ret |= test_ssm_pool_size_class_boundaries();
         ret |= test_ssm_pool_exhaustion();
         ret |= test_ssm_pool_reclaim_orphans();
+        ret |= test_ssm_pool_qos_reservation();
 
         return ret;
 }
@@ -35,7 +35,9 @@
 #include <ouroboros/time.h>
 
 #include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
 
@@ -652,6 +654,115 @@ static int test_ssm_rbuff_threaded(void)
         return TEST_RC_FAIL;
 }
 
+#define RACE_N 100000
+
+struct race_args {
+        struct ssm_rbuff * rb;
+        uint8_t *          seen;
+        volatile bool *    done;
+};
+
+/* Pops whatever it finds, every value must come out once. */
+static void * racing_reader(void * arg)
+{
+        struct race_args * args = (struct race_args *) arg;
+        ssize_t            val;
+
+        while (true) {
+                val = ssm_rbuff_read(args->rb);
+                if (val >= 0) {
+                        if (val >= RACE_N)
+                                return (void *) -1;
+                        __atomic_fetch_add(&args->seen[val], 1,
+                                           __ATOMIC_RELAXED);
+                        continue;
+                }
+
+                if (*args->done && ssm_rbuff_queued(args->rb) == 0)
+                        break;
+        }
+
+        return NULL;
+}
+
+static int test_ssm_rbuff_concurrent_read(void)
+{
+        struct ssm_rbuff * rb;
+        struct race_args   args;
+        pthread_t          rthread[2];
+        volatile bool      done = false;
+        void *             ret[2];
+        uint8_t *          seen;
+        size_t             i;
+
+        TEST_START();
+
+        seen = calloc(RACE_N, sizeof(*seen));
+        if (seen == NULL) {
+                printf("Failed to malloc.\n");
+                goto fail;
+        }
+
+        rb = ssm_rbuff_create(getpid(), 8);
+        if (rb == NULL) {
+                printf("Failed to create rbuff.\n");
+                goto fail_rb;
+        }
+
+        args.rb   = rb;
+        args.seen = seen;
+        args.done = &done;
+
+        for (i = 0; i < 2; ++i) {
+                if (pthread_create(&rthread[i], NULL, racing_reader, &args)) {
+                        printf("Failed to create reader thread.\n");
+                        goto fail_thr;
+                }
+        }
+
+        /* Keep the ring near empty, readers race for the last slot. */
+        for (i = 0; i < RACE_N; ++i)
+                while (ssm_rbuff_write(rb, i) < 0)
+                        ;
+
+        done = true;
+
+        pthread_join(rthread[0], &ret[0]);
+        pthread_join(rthread[1], &ret[1]);
+
+        if (ret[0] != NULL || ret[1] != NULL) {
+                printf("Read a value that was never written.\n");
+                goto fail_read;
+        }
+
+        for (i = 0; i < RACE_N; ++i) {
+                if (seen[i] != 1) {
+                        printf("Value %zu read %d times.\n", i, seen[i]);
+                        goto fail_read;
+                }
+        }
+
+        ssm_rbuff_destroy(rb);
+        free(seen);
+
+        TEST_SUCCESS();
+        return TEST_RC_SUCCESS;
+
+ fail_thr:
+        done = true;
+        while (i-- > 0)
+                pthread_join(rthread[i], NULL);
+ fail_read:
+        while (ssm_rbuff_read(rb) >= 0)
+                ;
+        ssm_rbuff_destroy(rb);
+ fail_rb:
+        free(seen);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
 int rbuff_test(int     argc,
                char ** argv)
 {
@@ -667,6 +778,7 @@ int rbuff_test(int     argc,
         ret |= test_ssm_rbuff_acl();
         ret |= test_ssm_rbuff_open_close();
         ret |= test_ssm_rbuff_threaded();
+        ret |= test_ssm_rbuff_concurrent_read();
         ret |= test_ssm_rbuff_blocking();
         ret |= test_ssm_rbuff_blocking_timeout();
         ret |= test_ssm_rbuff_blocking_flowdown();
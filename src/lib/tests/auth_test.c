@@ -347,6 +347,81 @@ static int test_verify_crt(void)
         return TEST_RC_FAIL;
 }
 
+/* Only the crts in the chain bound its expiry, not the whole store */
+static int test_verify_crt_chain(void)
+{
+        struct auth_ctx * auth;
+        const char *      strs[] = { root_ca_crt_ec, im_ca_crt_ec,
+                                     other_ca_crt_ec, signed_server_crt_ec };
+        void *            crts[4];
+        time_t            end[4];
+        time_t            expiry;
+        time_t            min;
+        int               i;
+
+        TEST_START();
+
+        memset(crts, 0, sizeof(crts));
+
+        auth = auth_create_ctx();
+        if (auth == NULL) {
+                printf("Failed to create auth context.\n");
+                goto fail_create_ctx;
+        }
+
+        for (i = 0; i < 4; ++i) {
+                if (crypt_load_crt_str(strs[i], &crts[i]) < 0) {
+                        printf("Failed to load crt %d.\n", i);
+                        goto fail_crt;
+                }
+
+                if (crypt_get_crt_expiry(crts[i], &end[i]) < 0) {
+                        printf("Failed to get expiry of crt %d.\n", i);
+                        goto fail_crt;
+                }
+
+                if (i < 3 && auth_add_crt_to_store(auth, crts[i]) < 0) {
+                        printf("Failed to add crt %d to store.\n", i);
+                        goto fail_crt;
+                }
+        }
+
+        min = MIN(MIN(end[0], end[1]), end[3]);
+
+        if (end[2] >= min) {
+                printf("Unrelated CA does not expire first.\n");
+                goto fail_crt;
+        }
+
+        if (auth_verify_crt_chain(auth, crts[3], &expiry) < 0) {
+                printf("Failed to verify signed crt.\n");
+                goto fail_crt;
+        }
+
+        if (expiry != min) {
+                printf("Chain expiry %ld, expected %ld.\n",
+                       (long) expiry, (long) min);
+                goto fail_crt;
+        }
+
+        for (i = 0; i < 4; ++i)
+                crypt_free_crt(crts[i]);
+
+        auth_destroy_ctx(auth);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_crt:
+        for (i = 0; i < 4; ++i)
+                if (crts[i] != NULL)
+                        crypt_free_crt(crts[i]);
+        auth_destroy_ctx(auth);
+ fail_create_ctx:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
 int test_auth_sign(void)
 {
         uint8_t  buf[TEST_MSG_SIZE];
@@ -526,6 +601,7 @@ int auth_test(int     argc,
         ret |= test_crypt_check_pubkey_crt();
         ret |= test_store_add();
         ret |= test_verify_crt();
+        ret |= test_verify_crt_chain();
         ret |= test_auth_sign();
         ret |= test_auth_bad_signature();
         ret |= test_crt_str();
@@ -538,6 +614,7 @@ int auth_test(int     argc,
         (void) test_crypt_check_pubkey_crt;
         (void) test_store_add;
         (void) test_verify_crt;
+        (void) test_verify_crt_chain;
         (void) test_auth_sign;
         (void) test_auth_bad_signature;
         (void) test_crt_str;
@@ -20,16 +20,23 @@
  * Foundation, Inc., http://www.fsf.org/about/contact/.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "config.h"
 
 #include <test/test.h>
 #include <ouroboros/random.h>
 #include <ouroboros/crypt.h>
+#include <ouroboros/time.h>
 #include <ouroboros/utils.h>
 
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define TEST_PACKET_SIZE 1500
+#define TEST_ROOM        64 /* Room for the IV and tag */
 
 extern const uint16_t crypt_supported_nids[];
 extern const uint16_t md_supported_nids[];
@@ -67,6 +74,7 @@ static int test_crypt_create_destroy(void)
 static int test_crypt_encrypt_decrypt(int nid)
 {
         uint8_t            pkt[TEST_PACKET_SIZE];
+        uint8_t            tmp[TEST_PACKET_SIZE + 2 * TEST_ROOM];
         struct crypt_ctx * ctx;
         uint8_t            key[SYMMKEYSZ];
         struct crypt_sk    sk = {
@@ -74,14 +82,16 @@ static int test_crypt_encrypt_decrypt(int nid)
                 .key     = key,
                 .rot_bit = KEY_ROTATION_BIT
         };
-        buffer_t           in;
-        buffer_t           out;
-        buffer_t           out2;
+        buffer_t           buf;
+        int                ivsz;
+        int                tagsz;
         const char *       cipher;
 
         cipher = crypt_nid_to_str(nid);
         TEST_START("(%s)", cipher);
 
+        sk.nid = nid;
+
         if (random_buffer(key, sizeof(key)) < 0) {
                 printf("Failed to generate random key.\n");
                 goto fail_init;
@@ -98,52 +108,114 @@ static int test_crypt_encrypt_decrypt(int nid)
                 goto fail_init;
         }
 
-        in.len  = sizeof(pkt);
-        in.data = pkt;
+        ivsz  = crypt_get_ivsz(ctx);
+        tagsz = crypt_get_tagsz(ctx);
+        if (ivsz < 0 || ivsz > TEST_ROOM || tagsz < 0 || tagsz > TEST_ROOM) {
+                printf("Invalid IV or tag size.\n");
+                goto fail_crypt;
+        }
+
+        memcpy(tmp + ivsz, pkt, sizeof(pkt));
+
+        buf.data = tmp;
+        buf.len  = ivsz + sizeof(pkt) + tagsz;
 
-        if (crypt_encrypt(ctx, in, &out) < 0) {
+        if (crypt_encrypt(ctx, buf) < 0) {
                 printf("Encryption failed.\n");
-                goto fail_encrypt;
+                goto fail_crypt;
         }
 
-        if (out.len < in.len) {
-                printf("Encryption returned too little data.\n");
-                goto fail_encrypt;
+        if (memcmp(tmp + ivsz, pkt, sizeof(pkt)) == 0) {
+                printf("Encryption did not change the data.\n");
+                goto fail_crypt;
         }
 
-        if (crypt_decrypt(ctx, out, &out2) < 0) {
+        if (crypt_decrypt(ctx, buf) < 0) {
                 printf("Decryption failed.\n");
-                goto fail_decrypt;
-        }
-
-        if (out2.len != in.len) {
-                printf("Decrypted data length does not match original.\n");
-                goto fail_chk;
+                goto fail_crypt;
         }
 
-        if (memcmp(in.data, out2.data, in.len) != 0) {
+        if (memcmp(tmp + ivsz, pkt, sizeof(pkt)) != 0) {
                 printf("Decrypted data does not match original.\n");
-                goto fail_chk;
+                goto fail_crypt;
         }
 
         crypt_destroy_ctx(ctx);
-        freebuf(out2);
-        freebuf(out);
 
         TEST_SUCCESS("(%s)", cipher);
 
         return TEST_RC_SUCCESS;
- fail_chk:
-        freebuf(out2);
- fail_decrypt:
-        freebuf(out);
- fail_encrypt:
+ fail_crypt:
         crypt_destroy_ctx(ctx);
  fail_init:
         TEST_FAIL("(%s)", cipher);
         return TEST_RC_FAIL;
 }
 
+static int test_crypt_tamper(void)
+{
+        uint8_t            tmp[TEST_PACKET_SIZE + 2 * TEST_ROOM];
+        struct crypt_ctx * ctx;
+        uint8_t            key[SYMMKEYSZ];
+        struct crypt_sk    sk = {
+                .nid     = NID_aes_256_gcm,
+                .key     = key,
+                .rot_bit = KEY_ROTATION_BIT
+        };
+        buffer_t           buf;
+
+        TEST_START();
+
+        if (random_buffer(key, sizeof(key)) < 0) {
+                printf("Failed to generate random key.\n");
+                goto fail;
+        }
+
+        if (random_buffer(tmp, sizeof(tmp)) < 0) {
+                printf("Failed to generate random data.\n");
+                goto fail;
+        }
+
+        ctx = crypt_create_ctx(&sk);
+        if (ctx == NULL) {
+                printf("Failed to initialize cryptography.\n");
+                goto fail;
+        }
+
+        buf.data = tmp;
+        buf.len  = sizeof(tmp);
+
+        if (crypt_encrypt(ctx, buf) < 0) {
+                printf("Encryption failed.\n");
+                goto fail_ctx;
+        }
+
+        tmp[TEST_ROOM] ^= 0x01;
+
+        if (crypt_decrypt(ctx, buf) == 0) {
+                printf("Tampered packet was accepted.\n");
+                goto fail_ctx;
+        }
+
+        buf.len = crypt_get_ivsz(ctx) + crypt_get_tagsz(ctx) - 1;
+
+        if (crypt_decrypt(ctx, buf) == 0) {
+                printf("Truncated packet was accepted.\n");
+                goto fail_ctx;
+        }
+
+        crypt_destroy_ctx(ctx);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_ctx:
+        crypt_destroy_ctx(ctx);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
 static int test_encrypt_decrypt_all(void)
 {
         int ret = 0;
@@ -256,9 +328,511 @@ static int test_md_nid_values(void)
 }
 #endif
 
+static int test_crypt_nonce(void)
+{
+        uint8_t            tmp[4][TEST_PACKET_SIZE + 2 * TEST_ROOM];
+        struct crypt_ctx * cli;
+        struct crypt_ctx * srv;
+        uint8_t            key[SYMMKEYSZ];
+        struct crypt_sk    sk = {
+                .nid     = NID_aes_256_gcm,
+                .key     = key,
+                .rot_bit = KEY_ROTATION_BIT,
+                .dir     = CRYPT_DIR_CLI
+        };
+        buffer_t           buf;
+        int                ivsz;
+        int                i;
+        int                j;
+
+        TEST_START();
+
+        if (random_buffer(key, sizeof(key)) < 0) {
+                printf("Failed to generate random key.\n");
+                goto fail;
+        }
+
+        memset(tmp, 0, sizeof(tmp));
+
+        cli = crypt_create_ctx(&sk);
+        if (cli == NULL) {
+                printf("Failed to create client context.\n");
+                goto fail;
+        }
+
+        sk.dir = CRYPT_DIR_SRV;
+
+        srv = crypt_create_ctx(&sk);
+        if (srv == NULL) {
+                printf("Failed to create server context.\n");
+                goto fail_cli;
+        }
+
+        ivsz = crypt_get_ivsz(cli);
+
+        buf.len = ivsz + TEST_PACKET_SIZE + crypt_get_tagsz(cli);
+
+        /* Two packets from each end, same key, all nonces differ. */
+        for (i = 0; i < 4; ++i) {
+                buf.data = tmp[i];
+                if (crypt_encrypt(i < 2 ? cli : srv, buf) < 0) {
+                        printf("Encryption failed at packet %d.\n", i);
+                        goto fail_srv;
+                }
+        }
+
+        for (i = 0; i < 4; ++i) {
+                for (j = i + 1; j < 4; ++j) {
+                        if (memcmp(tmp[i], tmp[j], ivsz) == 0) {
+                                printf("Nonce reused: %d and %d.\n", i, j);
+                                goto fail_srv;
+                        }
+                }
+        }
+
+        /* Each end decrypts what the other sent. */
+        buf.data = tmp[0];
+        if (crypt_decrypt(srv, buf) < 0) {
+                printf("Server failed to decrypt.\n");
+                goto fail_srv;
+        }
+
+        buf.data = tmp[2];
+        if (crypt_decrypt(cli, buf) < 0) {
+                printf("Client failed to decrypt.\n");
+                goto fail_srv;
+        }
+
+        crypt_destroy_ctx(srv);
+        crypt_destroy_ctx(cli);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_srv:
+        crypt_destroy_ctx(srv);
+ fail_cli:
+        crypt_destroy_ctx(cli);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+static int test_crypt_batch(void)
+{
+        uint8_t            pkt[4][TEST_PACKET_SIZE + 2 * TEST_ROOM];
+        uint8_t            tmp[4][TEST_PACKET_SIZE + 2 * TEST_ROOM];
+        struct crypt_ctx * cli;
+        struct crypt_ctx * srv;
+        uint8_t            key[SYMMKEYSZ];
+        struct crypt_sk    sk = {
+                .nid     = NID_aes_256_gcm,
+                .key     = key,
+                .rot_bit = KEY_ROTATION_BIT,
+                .dir     = CRYPT_DIR_CLI
+        };
+        buffer_t           bufs[4];
+        size_t             len;
+        int                ivsz;
+        int                i;
+
+        TEST_START();
+
+        if (random_buffer(key, sizeof(key)) < 0) {
+                printf("Failed to generate random key.\n");
+                goto fail;
+        }
+
+        if (random_buffer(pkt, sizeof(pkt)) < 0) {
+                printf("Failed to generate random data.\n");
+                goto fail;
+        }
+
+        memcpy(tmp, pkt, sizeof(tmp));
+
+        cli = crypt_create_ctx(&sk);
+        if (cli == NULL) {
+                printf("Failed to create client context.\n");
+                goto fail;
+        }
+
+        sk.dir = CRYPT_DIR_SRV;
+
+        srv = crypt_create_ctx(&sk);
+        if (srv == NULL) {
+                printf("Failed to create server context.\n");
+                goto fail_cli;
+        }
+
+        ivsz = crypt_get_ivsz(cli);
+        len  = ivsz + TEST_PACKET_SIZE + crypt_get_tagsz(cli);
+
+        for (i = 0; i < 4; ++i) {
+                bufs[i].data = tmp[i];
+                bufs[i].len  = len;
+        }
+
+        if (crypt_encrypt_batch(cli, bufs, 4) != 4) {
+                printf("Batch encryption failed.\n");
+                goto fail_srv;
+        }
+
+        /* A bad packet fails alone, the rest of the batch goes through. */
+        tmp[2][ivsz] ^= 0x01;
+
+        if (crypt_decrypt_batch(srv, bufs, 4) != 3) {
+                printf("Batch decryption count wrong.\n");
+                goto fail_srv;
+        }
+
+        for (i = 0; i < 4; ++i) {
+                if (i == 2) {
+                        if (bufs[i].len != 0) {
+                                printf("Tampered packet was accepted.\n");
+                                goto fail_srv;
+                        }
+                        continue;
+                }
+                if (memcmp(tmp[i] + ivsz, pkt[i] + ivsz,
+                           TEST_PACKET_SIZE) != 0) {
+                        printf("Packet %d corrupted.\n", i);
+                        goto fail_srv;
+                }
+        }
+
+        crypt_destroy_ctx(srv);
+        crypt_destroy_ctx(cli);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_srv:
+        crypt_destroy_ctx(srv);
+ fail_cli:
+        crypt_destroy_ctx(cli);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+#define BENCH_BATCH      16
+#define BENCH_MS         100 /* per cipher, size and mode */
+#define BENCH_SIZES      4
+
+static const size_t bench_sizes[BENCH_SIZES] = { 64, 256, 1500, 9000 };
+
+/* Encrypts, then decrypts BENCH_BATCH packets a round, rates in Gbit/s. */
+static int bench_crypt(int      nid,
+                       size_t   size,
+                       bool     batch,
+                       double * enc,
+                       double * dec)
+{
+        struct crypt_ctx * cli;
+        struct crypt_ctx * srv;
+        uint8_t            key[SYMMKEYSZ];
+        struct crypt_sk    sk = {
+                .nid     = nid,
+                .key     = key,
+                .rot_bit = KEY_ROTATION_BIT,
+                .dir     = CRYPT_DIR_CLI
+        };
+        buffer_t           bufs[BENCH_BATCH];
+        uint8_t *          mem;
+        struct timespec    start;
+        struct timespec    t0;
+        struct timespec    t1;
+        long long          t_enc = 0;
+        long long          t_dec = 0;
+        size_t             len;
+        size_t             n = 0;
+        int                i;
+
+        if (random_buffer(key, sizeof(key)) < 0)
+                goto fail;
+
+        mem = malloc(BENCH_BATCH * (size + 2 * TEST_ROOM));
+        if (mem == NULL)
+                goto fail;
+
+        if (random_buffer(mem, BENCH_BATCH * (size + 2 * TEST_ROOM)) < 0)
+                goto fail_mem;
+
+        cli = crypt_create_ctx(&sk);
+        if (cli == NULL)
+                goto fail_mem;
+
+        sk.dir = CRYPT_DIR_SRV;
+
+        srv = crypt_create_ctx(&sk);
+        if (srv == NULL)
+                goto fail_cli;
+
+        len = crypt_get_ivsz(cli) + size + crypt_get_tagsz(cli);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        do {
+                for (i = 0; i < BENCH_BATCH; ++i) {
+                        bufs[i].data = mem + i * (size + 2 * TEST_ROOM);
+                        bufs[i].len  = len;
+                }
+
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+
+                if (batch) {
+                        if (crypt_encrypt_batch(cli, bufs, BENCH_BATCH)
+                            != BENCH_BATCH)
+                                goto fail_srv;
+                } else {
+                        for (i = 0; i < BENCH_BATCH; ++i)
+                                if (crypt_encrypt(cli, bufs[i]) < 0)
+                                        goto fail_srv;
+                }
+
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                t_enc += ts_diff_ns(&t1, &t0);
+
+                if (batch) {
+                        if (crypt_decrypt_batch(srv, bufs, BENCH_BATCH)
+                            != BENCH_BATCH)
+                                goto fail_srv;
+                } else {
+                        for (i = 0; i < BENCH_BATCH; ++i)
+                                if (crypt_decrypt(srv, bufs[i]) < 0)
+                                        goto fail_srv;
+                }
+
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+                t_dec += ts_diff_ns(&t0, &t1);
+
+                n += BENCH_BATCH;
+        } while (ts_diff_ms(&t0, &start) < BENCH_MS);
+
+        *enc = (double) n * size * 8 / t_enc;
+        *dec = (double) n * size * 8 / t_dec;
+
+        crypt_destroy_ctx(srv);
+        crypt_destroy_ctx(cli);
+        free(mem);
+
+        return 0;
+ fail_srv:
+        crypt_destroy_ctx(srv);
+ fail_cli:
+        crypt_destroy_ctx(cli);
+ fail_mem:
+        free(mem);
+ fail:
+        return -1;
+}
+
+/* Not run by ctest, start with "crypt_test bench". */
+static int test_crypt_bench(void)
+{
+        double enc[2][BENCH_SIZES];
+        double dec[2][BENCH_SIZES];
+        int    nid;
+        int    b;
+        int    i;
+        int    j;
+
+        TEST_START();
+
+        printf("%-28s", "Gbit/s");
+        for (j = 0; j < BENCH_SIZES; ++j)
+                printf("%6zu B", bench_sizes[j]);
+        printf("\n");
+
+        for (i = 0; crypt_supported_nids[i] != NID_undef; ++i) {
+                nid = crypt_supported_nids[i];
+                for (b = 0; b < 2; ++b) {
+                        for (j = 0; j < BENCH_SIZES; ++j) {
+                                if (bench_crypt(nid, bench_sizes[j], b,
+                                                &enc[b][j], &dec[b][j])) {
+                                        printf("Failed to run %s.\n",
+                                               crypt_nid_to_str(nid));
+                                        goto fail;
+                                }
+                        }
+                }
+
+                for (b = 0; b < 2; ++b) {
+                        printf("%-18s %-3s", b == 0 ? crypt_nid_to_str(nid)
+                               : "", b == 0 ? "enc" : "");
+                        printf(" %-5s", b == 0 ? "one" : "batch");
+                        for (j = 0; j < BENCH_SIZES; ++j)
+                                printf("%8.2f", enc[b][j]);
+                        printf("\n");
+                }
+
+                for (b = 0; b < 2; ++b) {
+                        printf("%-18s %-3s", "", b == 0 ? "dec" : "");
+                        printf(" %-5s", b == 0 ? "one" : "batch");
+                        for (j = 0; j < BENCH_SIZES; ++j)
+                                printf("%8.2f", dec[b][j]);
+                        printf("\n");
+                }
+        }
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+#define LANE_THREADS     4
+#define LANE_PKTS        96  /* Three epochs at rot_bit 7 */
+#define LANE_PKT_SIZE    64
+
+struct lane_arg {
+        struct crypt_ctx * ctx;
+        size_t             lane;
+        uint8_t            (* pkt)[LANE_PKT_SIZE + 2 * TEST_ROOM];
+        size_t             len;
+        int                ret;
+};
+
+static void * lane_encrypt(void * o)
+{
+        struct lane_arg * arg = o;
+        buffer_t          buf;
+        size_t            i;
+
+        buf.len = arg->len;
+
+        for (i = 0; i < LANE_PKTS; ++i) {
+                buf.data = arg->pkt[i];
+                if (crypt_encrypt_lane(arg->ctx, buf, arg->lane) < 0) {
+                        arg->ret = -1;
+                        break;
+                }
+        }
+
+        return (void *) 0;
+}
+
+/* Nonce counter, big endian after the 4 byte salt. */
+static uint64_t lane_cntr(const uint8_t * iv)
+{
+        uint64_t cntr = 0;
+        int      i;
+
+        for (i = 4; i < 12; ++i)
+                cntr = (cntr << 8) | iv[i];
+
+        return cntr;
+}
+
+static int test_crypt_lanes(void)
+{
+        static uint8_t     pkt[LANE_THREADS * LANE_PKTS]
+                              [LANE_PKT_SIZE + 2 * TEST_ROOM];
+        static uint8_t *   ord[LANE_THREADS * LANE_PKTS];
+        struct crypt_ctx * cli;
+        struct crypt_ctx * srv;
+        uint8_t            key[SYMMKEYSZ];
+        struct crypt_sk    sk = {
+                .nid     = NID_aes_256_gcm,
+                .key     = key,
+                .rot_bit = 7,
+                .dir     = CRYPT_DIR_CLI,
+                .lanes   = LANE_THREADS
+        };
+        struct lane_arg    arg[LANE_THREADS];
+        pthread_t          tid[LANE_THREADS];
+        buffer_t           buf;
+        size_t             len;
+        size_t             n = LANE_THREADS * LANE_PKTS;
+        size_t             i;
+        int                ivsz;
+
+        TEST_START();
+
+        if (random_buffer(key, sizeof(key)) < 0) {
+                printf("Failed to generate random key.\n");
+                goto fail;
+        }
+
+        memset(pkt, 0, sizeof(pkt));
+
+        cli = crypt_create_ctx(&sk);
+        if (cli == NULL) {
+                printf("Failed to create client context.\n");
+                goto fail;
+        }
+
+        sk.dir   = CRYPT_DIR_SRV;
+        sk.lanes = 0;
+
+        srv = crypt_create_ctx(&sk);
+        if (srv == NULL) {
+                printf("Failed to create server context.\n");
+                goto fail_cli;
+        }
+
+        ivsz = crypt_get_ivsz(cli);
+        len  = ivsz + LANE_PKT_SIZE + crypt_get_tagsz(cli);
+
+        for (i = 0; i < LANE_THREADS; ++i) {
+                arg[i].ctx  = cli;
+                arg[i].lane = i;
+                arg[i].pkt  = pkt + i * LANE_PKTS;
+                arg[i].len  = len;
+                arg[i].ret  = 0;
+                pthread_create(&tid[i], NULL, lane_encrypt, &arg[i]);
+        }
+
+        for (i = 0; i < LANE_THREADS; ++i) {
+                pthread_join(tid[i], NULL);
+                if (arg[i].ret < 0) {
+                        printf("Encryption failed on lane %zu.\n", i);
+                        goto fail_srv;
+                }
+        }
+
+        /* Each nonce taken once, put the packets in nonce order. */
+        memset(ord, 0, sizeof(ord));
+        for (i = 0; i < n; ++i) {
+                uint64_t c = lane_cntr(pkt[i]);
+                if (c >= n || ord[c] != NULL) {
+                        printf("Bad or reused nonce %zu.\n", (size_t) c);
+                        goto fail_srv;
+                }
+                ord[c] = pkt[i];
+        }
+
+        buf.len = len;
+
+        for (i = 0; i < n; ++i) {
+                buf.data = ord[i];
+                if (crypt_decrypt(srv, buf) < 0) {
+                        printf("Decryption failed at packet %zu.\n", i);
+                        goto fail_srv;
+                }
+        }
+
+        crypt_destroy_ctx(srv);
+        crypt_destroy_ctx(cli);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_srv:
+        crypt_destroy_ctx(srv);
+ fail_cli:
+        crypt_destroy_ctx(cli);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
 static int test_key_rotation(void)
 {
         uint8_t             pkt[TEST_PACKET_SIZE];
+        uint8_t             tmp[TEST_PACKET_SIZE + 2 * TEST_ROOM];
         struct crypt_ctx *  tx_ctx;
         struct crypt_ctx *  rx_ctx;
         uint8_t             key[SYMMKEYSZ];
@@ -267,9 +841,8 @@ static int test_key_rotation(void)
                 .key     = key,
                 .rot_bit = 7
         };
-        buffer_t            in;
-        buffer_t            enc;
-        buffer_t            dec;
+        buffer_t            buf;
+        int                 ivsz;
         uint32_t            i;
         uint32_t            threshold;
 
@@ -297,34 +870,351 @@ static int test_key_rotation(void)
                 goto fail_tx;
         }
 
-        in.len  = sizeof(pkt);
-        in.data = pkt;
+        ivsz = crypt_get_ivsz(tx_ctx);
+
+        buf.data = tmp;
+        buf.len  = ivsz + sizeof(pkt) + crypt_get_tagsz(tx_ctx);
 
         threshold = (1U << sk.rot_bit);
 
         /* Encrypt and decrypt across multiple rotations */
         for (i = 0; i < threshold * 3; i++) {
-                if (crypt_encrypt(tx_ctx, in, &enc) < 0) {
+                memcpy(tmp + ivsz, pkt, sizeof(pkt));
+
+                if (crypt_encrypt(tx_ctx, buf) < 0) {
                         printf("Encryption failed at packet %u.\n", i);
                         goto fail_rx;
                 }
 
-                if (crypt_decrypt(rx_ctx, enc, &dec) < 0) {
+                if (crypt_decrypt(rx_ctx, buf) < 0) {
                         printf("Decryption failed at packet %u.\n", i);
-                        freebuf(enc);
                         goto fail_rx;
                 }
 
-                if (dec.len != in.len ||
-                    memcmp(in.data, dec.data, in.len) != 0) {
+                if (memcmp(tmp + ivsz, pkt, sizeof(pkt)) != 0) {
                         printf("Data mismatch at packet %u.\n", i);
-                        freebuf(dec);
-                        freebuf(enc);
                         goto fail_rx;
                 }
+        }
+
+        crypt_destroy_ctx(rx_ctx);
+        crypt_destroy_ctx(tx_ctx);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_rx:
+        crypt_destroy_ctx(rx_ctx);
+ fail_tx:
+        crypt_destroy_ctx(tx_ctx);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+static int test_key_rotation_reorder(void)
+{
+        uint8_t             pkt[TEST_PACKET_SIZE];
+        uint8_t             old[TEST_PACKET_SIZE + 2 * TEST_ROOM];
+        uint8_t             new[TEST_PACKET_SIZE + 2 * TEST_ROOM];
+        struct crypt_ctx *  tx_ctx;
+        struct crypt_ctx *  rx_ctx;
+        uint8_t             key[SYMMKEYSZ];
+        struct crypt_sk     sk = {
+                .nid     = NID_aes_256_gcm,
+                .key     = key,
+                .rot_bit = 7
+        };
+        buffer_t            o;
+        buffer_t            n;
+        int                 ivsz;
+        uint32_t            i;
+
+        TEST_START();
+
+        if (random_buffer(key, sizeof(key)) < 0) {
+                printf("Failed to generate random key.\n");
+                goto fail;
+        }
+
+        if (random_buffer(pkt, sizeof(pkt)) < 0) {
+                printf("Failed to generate random data.\n");
+                goto fail;
+        }
+
+        tx_ctx = crypt_create_ctx(&sk);
+        if (tx_ctx == NULL) {
+                printf("Failed to create TX context.\n");
+                goto fail;
+        }
+
+        rx_ctx = crypt_create_ctx(&sk);
+        if (rx_ctx == NULL) {
+                printf("Failed to create RX context.\n");
+                goto fail_tx;
+        }
+
+        ivsz = crypt_get_ivsz(tx_ctx);
+
+        memset(old, 0, sizeof(old));
+        memset(new, 0, sizeof(new));
+
+        o.data = old;
+        o.len  = ivsz + sizeof(pkt) + crypt_get_tagsz(tx_ctx);
+        n.data = new;
+        n.len  = o.len;
+
+        /* Run up to the last packet before the rotation. */
+        for (i = 0; i < (1U << sk.rot_bit) - 1; i++) {
+                if (crypt_encrypt(tx_ctx, o) < 0 ||
+                    crypt_decrypt(rx_ctx, o) < 0) {
+                        printf("Failed at packet %u.\n", i);
+                        goto fail_rx;
+                }
+        }
+
+        memcpy(old + ivsz, pkt, sizeof(pkt));
+        memcpy(new + ivsz, pkt, sizeof(pkt));
+
+        if (crypt_encrypt(tx_ctx, o) < 0 || crypt_encrypt(tx_ctx, n) < 0) {
+                printf("Encryption failed.\n");
+                goto fail_rx;
+        }
+
+        /* The new key arrives first, the old one must still decrypt. */
+        if (crypt_decrypt(rx_ctx, n) < 0) {
+                printf("Decryption with the new key failed.\n");
+                goto fail_rx;
+        }
+
+        if (crypt_decrypt(rx_ctx, o) < 0) {
+                printf("Decryption with the old key failed.\n");
+                goto fail_rx;
+        }
+
+        if (memcmp(old + ivsz, pkt, sizeof(pkt)) != 0 ||
+            memcmp(new + ivsz, pkt, sizeof(pkt)) != 0) {
+                printf("Data mismatch.\n");
+                goto fail_rx;
+        }
+
+        crypt_destroy_ctx(rx_ctx);
+        crypt_destroy_ctx(tx_ctx);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_rx:
+        crypt_destroy_ctx(rx_ctx);
+ fail_tx:
+        crypt_destroy_ctx(tx_ctx);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+static int test_key_epoch(void)
+{
+        uint8_t             tmp[TEST_PACKET_SIZE + 2 * TEST_ROOM];
+        struct crypt_ctx *  tx_ctx;
+        struct crypt_ctx *  rx_ctx;
+        uint8_t             key[SYMMKEYSZ];
+        struct crypt_sk     sk = {
+                .nid     = NID_aes_256_gcm,
+                .key     = key,
+                .rot_bit = 7
+        };
+        struct crypt_stat   st;
+        buffer_t            buf;
+        int                 ivsz;
+        uint32_t            i;
+
+        TEST_START();
+
+        if (random_buffer(key, sizeof(key)) < 0) {
+                printf("Failed to generate random key.\n");
+                goto fail;
+        }
+
+        memset(tmp, 0, sizeof(tmp));
+
+        tx_ctx = crypt_create_ctx(&sk);
+        if (tx_ctx == NULL) {
+                printf("Failed to create TX context.\n");
+                goto fail;
+        }
+
+        rx_ctx = crypt_create_ctx(&sk);
+        if (rx_ctx == NULL) {
+                printf("Failed to create RX context.\n");
+                goto fail_tx;
+        }
+
+        ivsz = crypt_get_ivsz(tx_ctx);
+
+        buf.data = tmp;
+        buf.len  = ivsz + TEST_PACKET_SIZE + crypt_get_tagsz(tx_ctx);
+
+        /* A forged epoch bump fails and must not rotate the keys. */
+        for (i = 0; i < (1U << sk.rot_bit) - 1; i++) {
+                if (crypt_encrypt(tx_ctx, buf) < 0 ||
+                    crypt_decrypt(rx_ctx, buf) < 0) {
+                        printf("Failed at packet %u.\n", i);
+                        goto fail_rx;
+                }
+        }
+
+        if (crypt_encrypt(tx_ctx, buf) < 0) {
+                printf("Encryption failed.\n");
+                goto fail_rx;
+        }
+
+        tmp[1]++;
 
-                freebuf(dec);
-                freebuf(enc);
+        if (crypt_decrypt(rx_ctx, buf) == 0) {
+                printf("Forged epoch was accepted.\n");
+                goto fail_rx;
+        }
+
+        tmp[1]--;
+
+        if (crypt_decrypt(rx_ctx, buf) < 0) {
+                printf("Packet rejected after a forged epoch.\n");
+                goto fail_rx;
+        }
+
+        /* Two epochs ahead has no key, dropped unauthenticated. */
+        tmp[1] += 2;
+
+        if (crypt_decrypt(rx_ctx, buf) == 0) {
+                printf("Unknown epoch was accepted.\n");
+                goto fail_rx;
+        }
+
+        crypt_get_stat(rx_ctx, &st);
+        if (st.epoch != 0 || st.n_auth != 1 || st.n_epoch != 1) {
+                printf("Stats epoch %u, auth %zu, epoch %zu.\n",
+                       st.epoch, st.n_auth, st.n_epoch);
+                goto fail_rx;
+        }
+
+        /* The real rotation moves the receiver along. */
+        if (crypt_encrypt(tx_ctx, buf) < 0 ||
+            crypt_decrypt(rx_ctx, buf) < 0) {
+                printf("Failed after rotation.\n");
+                goto fail_rx;
+        }
+
+        crypt_get_stat(rx_ctx, &st);
+        if (st.epoch != 1) {
+                printf("Receiver did not rotate, epoch %u.\n", st.epoch);
+                goto fail_rx;
+        }
+
+        crypt_destroy_ctx(rx_ctx);
+        crypt_destroy_ctx(tx_ctx);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_rx:
+        crypt_destroy_ctx(rx_ctx);
+ fail_tx:
+        crypt_destroy_ctx(tx_ctx);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+/* A receiver that lost most of an epoch follows the next one. */
+static int test_key_resync(void)
+{
+        uint8_t             tmp[TEST_PACKET_SIZE + 2 * TEST_ROOM];
+        struct crypt_ctx *  tx_ctx;
+        struct crypt_ctx *  rx_ctx;
+        uint8_t             key[SYMMKEYSZ];
+        struct crypt_sk     sk = {
+                .nid     = NID_aes_256_gcm,
+                .key     = key,
+                .rot_bit = 7
+        };
+        struct crypt_stat   st;
+        buffer_t            buf;
+        int                 ivsz;
+        uint32_t            i;
+
+        TEST_START();
+
+        if (random_buffer(key, sizeof(key)) < 0) {
+                printf("Failed to generate random key.\n");
+                goto fail;
+        }
+
+        memset(tmp, 0, sizeof(tmp));
+
+        tx_ctx = crypt_create_ctx(&sk);
+        if (tx_ctx == NULL) {
+                printf("Failed to create TX context.\n");
+                goto fail;
+        }
+
+        rx_ctx = crypt_create_ctx(&sk);
+        if (rx_ctx == NULL) {
+                printf("Failed to create RX context.\n");
+                goto fail_tx;
+        }
+
+        ivsz = crypt_get_ivsz(tx_ctx);
+
+        buf.data = tmp;
+        buf.len  = ivsz + TEST_PACKET_SIZE + crypt_get_tagsz(tx_ctx);
+
+        /* Only the first quarter of the epoch gets through. */
+        for (i = 0; i < (1U << sk.rot_bit); i++) {
+                if (crypt_encrypt(tx_ctx, buf) < 0) {
+                        printf("Encryption failed at packet %u.\n", i);
+                        goto fail_rx;
+                }
+
+                if (i >= (1U << sk.rot_bit) >> 2)
+                        continue;
+
+                if (crypt_decrypt(rx_ctx, buf) < 0) {
+                        printf("Decryption failed at packet %u.\n", i);
+                        goto fail_rx;
+                }
+        }
+
+        if (crypt_encrypt(tx_ctx, buf) < 0) {
+                printf("Encryption failed.\n");
+                goto fail_rx;
+        }
+
+        /* Forgeries for the next epoch don't rotate, early or not. */
+        for (i = 0; i < 4; i++) {
+                tmp[ivsz] ^= 0x01;
+                if (crypt_decrypt(rx_ctx, buf) == 0) {
+                        printf("Forged packet was accepted.\n");
+                        goto fail_rx;
+                }
+                tmp[ivsz] ^= 0x01;
+        }
+
+        crypt_get_stat(rx_ctx, &st);
+        if (st.epoch != 0 || st.n_auth != 4) {
+                printf("Stats epoch %u, auth %zu.\n", st.epoch, st.n_auth);
+                goto fail_rx;
+        }
+
+        if (crypt_decrypt(rx_ctx, buf) < 0) {
+                printf("Next epoch rejected after losses.\n");
+                goto fail_rx;
+        }
+
+        crypt_get_stat(rx_ctx, &st);
+        if (st.epoch != 1) {
+                printf("Receiver did not rotate, epoch %u.\n", st.epoch);
+                goto fail_rx;
         }
 
         crypt_destroy_ctx(rx_ctx);
@@ -344,7 +1234,7 @@ static int test_key_rotation(void)
 
 static int test_key_phase_bit(void)
 {
-        uint8_t            pkt[TEST_PACKET_SIZE];
+        uint8_t            tmp[TEST_PACKET_SIZE + 2 * TEST_ROOM];
         struct crypt_ctx * ctx;
         uint8_t            key[SYMMKEYSZ];
         struct crypt_sk    sk = {
@@ -352,8 +1242,7 @@ static int test_key_phase_bit(void)
                 .key     = key,
                 .rot_bit = 7
         };
-        buffer_t           in;
-        buffer_t           out;
+        buffer_t           buf;
         uint32_t           count;
         uint32_t           threshold;
         uint8_t            phase_before;
@@ -367,7 +1256,7 @@ static int test_key_phase_bit(void)
                 goto fail;
         }
 
-        if (random_buffer(pkt, sizeof(pkt)) < 0) {
+        if (random_buffer(tmp, sizeof(tmp)) < 0) {
                 printf("Failed to generate random data.\n");
                 goto fail;
         }
@@ -384,36 +1273,33 @@ static int test_key_phase_bit(void)
                 goto fail_ctx;
         }
 
-        in.len  = sizeof(pkt);
-        in.data = pkt;
+        buf.data = tmp;
+        buf.len  = ivsz + TEST_PACKET_SIZE + crypt_get_tagsz(ctx);
 
         /* Encrypt packets up to just before rotation threshold */
         threshold = (1U << sk.rot_bit);
 
         /* Encrypt threshold - 1 packets (indices 0 to threshold-2) */
         for (count = 0; count < threshold - 1; count++) {
-                if (crypt_encrypt(ctx, in, &out) < 0) {
+                if (crypt_encrypt(ctx, buf) < 0) {
                         printf("Encryption failed at count %u.\n", count);
                         goto fail_ctx;
                 }
-                freebuf(out);
         }
 
         /* Packet at index threshold-1: phase should still be initial */
-        if (crypt_encrypt(ctx, in, &out) < 0) {
+        if (crypt_encrypt(ctx, buf) < 0) {
                 printf("Encryption failed before rotation.\n");
                 goto fail_ctx;
         }
-        phase_before = (out.data[0] & 0x80) ? 1 : 0;
-        freebuf(out);
+        phase_before = (buf.data[0] & 0x80) ? 1 : 0;
 
         /* Packet at index threshold: phase should have toggled */
-        if (crypt_encrypt(ctx, in, &out) < 0) {
+        if (crypt_encrypt(ctx, buf) < 0) {
                 printf("Encryption failed at rotation threshold.\n");
                 goto fail_ctx;
         }
-        phase_after = (out.data[0] & 0x80) ? 1 : 0;
-        freebuf(out);
+        phase_after = (buf.data[0] & 0x80) ? 1 : 0;
 
         /* Phase bit should have toggled */
         if (phase_before == phase_after) {
@@ -439,18 +1325,35 @@ int crypt_test(int     argc,
 {
         int ret = 0;
 
-        (void) argc;
-        (void) argv;
-
+#ifdef HAVE_OPENSSL
+        if (argc > 1 && strcmp(argv[1], "bench") == 0)
+                return test_crypt_bench();
+#else
+        (void) test_crypt_bench;
+#endif
         ret |= test_crypt_create_destroy();
         ret |= test_encrypt_decrypt_all();
 #ifdef HAVE_OPENSSL
         ret |= test_cipher_nid_values();
         ret |= test_md_nid_values();
+        ret |= test_crypt_tamper();
+        ret |= test_crypt_nonce();
+        ret |= test_crypt_batch();
+        ret |= test_crypt_lanes();
         ret |= test_key_rotation();
+        ret |= test_key_rotation_reorder();
+        ret |= test_key_epoch();
+        ret |= test_key_resync();
         ret |= test_key_phase_bit();
 #else
+        (void) test_crypt_tamper;
+        (void) test_crypt_nonce;
+        (void) test_crypt_batch;
+        (void) test_crypt_lanes;
         (void) test_key_rotation;
+        (void) test_key_rotation_reorder;
+        (void) test_key_epoch;
+        (void) test_key_resync;
         (void) test_key_phase_bit;
 
         return TEST_RC_SKIP;
@@ -0,0 +1,290 @@
+/*
+ * Ouroboros - Copyright (C) 2016 - 2026
+ *
+ * Test of the asynchronous flow deallocation
+ *
+ *    Dimitri Staessens <dimitri@ouroboros.rocks>
+ *    Sander Vrijders   <sander@ouroboros.rocks>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., http://www.fsf.org/about/contact/.
+ */
+
+#include "irmd_stub.c"
+
+#include <test/test.h>
+
+#define N_FLOWS   256
+#define N_SYNC    16
+#define MAX_WAIT  2000 /* ms */
+#define PEER_TO   200  /* ms */
+#define COARSE_MS 10   /* activity is stamped with a coarse clock */
+
+/* Wait until the IRMd saw n flows released, returns ms taken. */
+static long wait_deallocs(size_t                  n,
+                          const struct timespec * t0)
+{
+        struct timespec now;
+        struct timespec intv = TIMESPEC_INIT_MS(1);
+
+        while (true) {
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                if (stub_deallocs() >= n)
+                        return ts_diff_ms(&now, t0);
+                if (ts_diff_ms(&now, t0) > MAX_WAIT)
+                        return -1;
+                nanosleep(&intv, NULL);
+        }
+}
+
+static int test_dealloc_async_teardown(void)
+{
+        struct timespec t0;
+        struct timespec t1;
+        qosspec_t       qs = qos_raw;
+        int             fds[N_FLOWS];
+        size_t          base;
+        size_t          msgs;
+        long            t_sync;
+        long            t_async;
+        long            t_call;
+        int             i;
+
+        TEST_START();
+
+        for (i = 0; i < N_FLOWS; ++i) {
+                fds[i] = flow_alloc("stub", &qs, NULL);
+                if (fds[i] < 0) {
+                        printf("Failed to allocate flow %d.\n", i);
+                        goto fail;
+                }
+        }
+
+        /* Reference: the synchronous call lingers on every flow. */
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
+        for (i = 0; i < N_SYNC; ++i)
+                flow_dealloc(fds[i]);
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        t_sync = ts_diff_us(&t1, &t0) / N_SYNC;
+
+        base = stub_deallocs();
+        msgs = stub_dealloc_msgs();
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
+        for (i = N_SYNC; i < N_FLOWS; ++i) {
+                if (flow_dealloc_async(fds[i]) < 0) {
+                        printf("Failed to dealloc flow %d.\n", i);
+                        goto fail;
+                }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        t_call = ts_diff_us(&t1, &t0);
+
+        t_async = wait_deallocs(base + N_FLOWS - N_SYNC, &t0);
+        if (t_async < 0) {
+                printf("Only %zu of %d flows released.\n",
+                       stub_deallocs() - base, N_FLOWS - N_SYNC);
+                goto fail;
+        }
+
+        msgs = stub_dealloc_msgs() - msgs;
+
+        printf("Sync: %ld us per flow, async: %ld us to queue %d flows, "
+               "%ld ms until released in %zu requests.\n",
+               t_sync, t_call, N_FLOWS - N_SYNC, t_async, msgs);
+
+        if (msgs >= (size_t) (N_FLOWS - N_SYNC)) {
+                printf("Flows were not released in batches.\n");
+                goto fail;
+        }
+
+        if (t_async * 1000 > t_sync * (N_FLOWS - N_SYNC)) {
+                printf("Async teardown slower than synchronous.\n");
+                goto fail;
+        }
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+/* A lingering flow keeps the peer alive, until the peer times out. */
+static int test_dealloc_async_keepalive(void)
+{
+        struct timespec t0;
+        struct timespec intv = TIMESPEC_INIT_MS(PEER_TO / 2);
+        qosspec_t       qs   = qos_raw;
+        uint8_t         buf[64];
+        size_t          base;
+        long            t;
+        int             fd;
+
+        TEST_START();
+
+        qs.timeout = PEER_TO;
+
+        /* The peer timeout runs from the last packet, the alloc. */
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
+        fd = flow_alloc("stub", &qs, NULL);
+        if (fd < 0) {
+                printf("Failed to allocate flow.\n");
+                goto fail;
+        }
+
+        /* Unread by the peer, the flow lingers. */
+        memset(buf, 0, sizeof(buf));
+        if (flow_write(fd, buf, sizeof(buf)) < 0) {
+                printf("Failed to write.\n");
+                goto fail;
+        }
+
+        base = stub_deallocs();
+
+        if (flow_dealloc_async(fd) < 0) {
+                printf("Failed to dealloc flow.\n");
+                goto fail;
+        }
+
+        nanosleep(&intv, NULL);
+
+        if (stub_deallocs() != base) {
+                printf("Flow released while lingering.\n");
+                goto fail;
+        }
+
+        if (stub_queued(fd) < 2) {
+                printf("No keepalives sent while lingering.\n");
+                goto fail;
+        }
+
+        t = wait_deallocs(base + 1, &t0);
+        if (t < 0) {
+                printf("Flow still lingering after peer timeout.\n");
+                goto fail;
+        }
+
+        if (t < PEER_TO - COARSE_MS) {
+                printf("Flow released before peer timeout: %ld ms.\n", t);
+                goto fail;
+        }
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+/* The fd is gone for the caller, while the flow still lingers. */
+static int test_dealloc_async_closed(void)
+{
+        struct flow_set * set;
+        qosspec_t         qs = qos_raw;
+        uint8_t           buf[64];
+        size_t            base;
+        int               fd;
+
+        TEST_START();
+
+        qs.timeout = PEER_TO;
+
+        set = fset_create();
+        if (set == NULL) {
+                printf("Failed to create flow set.\n");
+                goto fail;
+        }
+
+        fd = flow_alloc("stub", &qs, NULL);
+        if (fd < 0) {
+                printf("Failed to allocate flow.\n");
+                goto fail_set;
+        }
+
+        memset(buf, 0, sizeof(buf));
+        if (flow_write(fd, buf, sizeof(buf)) < 0) {
+                printf("Failed to write.\n");
+                goto fail_set;
+        }
+
+        base = stub_deallocs();
+
+        if (flow_dealloc_async(fd) < 0) {
+                printf("Failed to dealloc flow.\n");
+                goto fail_set;
+        }
+
+        if (flow_write(fd, buf, sizeof(buf)) != -ENOTALLOC) {
+                printf("Write accepted after dealloc.\n");
+                goto fail_set;
+        }
+
+        if (flow_read(fd, buf, sizeof(buf)) != -ENOTALLOC) {
+                printf("Read accepted after dealloc.\n");
+                goto fail_set;
+        }
+
+        if (fccntl(fd, FLOWSFLAGS, FLOWFRNOBLOCK) != -ENOTALLOC) {
+                printf("fccntl accepted after dealloc.\n");
+                goto fail_set;
+        }
+
+        if (fset_add(set, fd) != -ENOTALLOC) {
+                printf("fset_add accepted after dealloc.\n");
+                goto fail_set;
+        }
+
+        if (flow_dealloc_async(fd) != -ENOTALLOC) {
+                printf("Flow deallocated twice.\n");
+                goto fail_set;
+        }
+
+        if (stub_deallocs() != base) {
+                printf("Flow released while lingering.\n");
+                goto fail_set;
+        }
+
+        fset_destroy(set);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_set:
+        fset_destroy(set);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+int dealloc_test(int     argc,
+                 char ** argv)
+{
+        int ret = 0;
+
+        (void) argc;
+        (void) argv;
+
+        ret |= test_dealloc_async_teardown();
+        ret |= test_dealloc_async_keepalive();
+        ret |= test_dealloc_async_closed();
+
+        return ret;
+}
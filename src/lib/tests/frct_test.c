@@ -0,0 +1,1673 @@
+/*
+ * Ouroboros - Copyright (C) 2016 - 2026
+ *
+ * Test of the Flow and Retransmission Control Protocol
+ *
+ *    Dimitri Staessens <dimitri@ouroboros.rocks>
+ *    Sander Vrijders   <sander@ouroboros.rocks>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., http://www.fsf.org/about/contact/.
+ */
+
+#include "irmd_stub.c"
+
+#include <test/test.h>
+
+#define PING_ROUNDS 500
+#define PING_LEN    32   /* less than a read, no partial reads */
+#define READ_TO     1    /* s */
+#define LOSSY_PKTS  10000
+#define LOSSY_LEN   1000
+#define LOSSY_PCT   2
+#define LOSSY_TO    20   /* s */
+#define BIG_LEN     ((1 << 20) - 1024) /* a 1 MB block, less its room */
+#define BIG_TO      10   /* s */
+#define FRAG_MTU    600
+#define FRAG_N      300  /* more than the initial rq, fit in 1K blocks */
+#define FRAG_LEN    (FRAG_N * (FRAG_MTU - FRCT_PCILEN - CRCLEN))
+#define RQ_PKTS     8
+#define PART_LEN    16   /* fragments put in the rq by hand */
+#define MAX_WAIT    1000 /* ms */
+#define RTO_PKTS    4
+#define RTO_WAIT    3    /* s, the first rto is 1 s */
+#define RTT_PROBE   2    /* ms */
+#define RTT_PKTS    64
+#define FEC_BLOCKS  30
+#define FEC_LEN     256
+#define FEC_PKT_LEN(i) (FEC_LEN - (i) % 32 * 4)
+#define FEC_WAIT    200  /* ms */
+
+struct lossy {
+        int      fd;      /* the sender's */
+        uint32_t rnd;
+        size_t   n_data;
+        size_t   n_drop;
+};
+
+/* Drops LOSSY_PCT of the sender's data, retransmissions too. */
+static bool lossy_drop(void *               arg,
+                       int                  fd,
+                       struct ssm_pk_buff * spb)
+{
+        struct lossy *    l   = (struct lossy *) arg;
+        struct frct_pci * pci = (struct frct_pci *) ssm_pk_buff_head(spb);
+
+        if (fd != l->fd || !(pci->flags & FRCT_DATA))
+                return false;
+
+        ++l->n_data;
+
+        l->rnd = l->rnd * 1103515245 + 12345;
+        if ((l->rnd >> 16) % 100 >= LOSSY_PCT)
+                return false;
+
+        ++l->n_drop;
+
+        return true;
+}
+
+struct sink {
+        int    fd;
+        size_t n;
+        int    ret;
+};
+
+static void * sink_loop(void * o)
+{
+        struct sink * s = (struct sink *) o;
+        uint8_t       buf[LOSSY_LEN + 1];
+        uint32_t      seq;
+        ssize_t       n;
+
+        s->ret = 0;
+
+        for (s->n = 0; s->n < LOSSY_PKTS; ++s->n) {
+                n = flow_read(s->fd, buf, sizeof(buf));
+                if (n != LOSSY_LEN) {
+                        s->ret = n < 0 ? (int) n : -EMSGSIZE;
+                        break;
+                }
+
+                memcpy(&seq, buf, sizeof(seq));
+                if (seq != s->n) {
+                        s->ret = -EILSEQ;
+                        break;
+                }
+        }
+
+        return (void *) 0;
+}
+
+struct pong {
+        int     fd;
+        ssize_t ret;
+};
+
+static void * pong_loop(void * o)
+{
+        struct pong * p = (struct pong *) o;
+        uint8_t       buf[64];
+        int           i;
+
+        for (i = 0; i < PING_ROUNDS; ++i) {
+                p->ret = flow_read(p->fd, buf, sizeof(buf));
+                if (p->ret < 0)
+                        break;
+
+                p->ret = flow_write(p->fd, buf, p->ret);
+                if (p->ret < 0)
+                        break;
+        }
+
+        return (void *) 0;
+}
+
+/* Every reply is the last packet, a missed wakeup stalls the flow. */
+static int test_frct_read_wakeup(void)
+{
+        struct timespec to = TIMESPEC_INIT_S(READ_TO);
+        struct pong     p;
+        pthread_t       thr;
+        uint8_t         buf[64];
+        ssize_t         ret;
+        int             fd;
+        int             i;
+
+        TEST_START();
+
+        if (stub_flow_pair(qos_data, &fd, &p.fd) < 0) {
+                printf("Failed to allocate flows.\n");
+                goto fail;
+        }
+
+        fccntl(fd, FLOWSRCVTIMEO, &to);
+        fccntl(p.fd, FLOWSRCVTIMEO, &to);
+
+        if (stub_link(fd, p.fd, NULL, NULL) < 0) {
+                printf("Failed to link flows.\n");
+                goto fail_link;
+        }
+
+        if (pthread_create(&thr, NULL, pong_loop, &p)) {
+                printf("Failed to start pong thread.\n");
+                goto fail_thr;
+        }
+
+        memset(buf, 0, sizeof(buf));
+
+        for (i = 0; i < PING_ROUNDS; ++i) {
+                buf[0] = (uint8_t) i;
+
+                ret = flow_write(fd, buf, PING_LEN);
+                if (ret < 0) {
+                        printf("Failed to write ping %d: %zd.\n", i, ret);
+                        break;
+                }
+
+                ret = flow_read(fd, buf, sizeof(buf));
+                if (ret < 0) {
+                        printf("No pong %d: %zd.\n", i, ret);
+                        break;
+                }
+
+                if (buf[0] != (uint8_t) i) {
+                        printf("Pong %d out of order.\n", i);
+                        break;
+                }
+        }
+
+        pthread_join(thr, NULL);
+
+        if (i < PING_ROUNDS)
+                goto fail_thr;
+
+        flow_dealloc(p.fd);
+        flow_dealloc(fd);
+
+        stub_unlink();
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_thr:
+        stub_unlink();
+ fail_link:
+        flow_dealloc_async(p.fd);
+        flow_dealloc_async(fd);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+static int test_frct_lossy(bool sack)
+{
+        struct timespec to = TIMESPEC_INIT_S(LOSSY_TO);
+        struct timespec t0;
+        struct timespec t1;
+        struct lossy    l;
+        struct sink     s;
+        struct frcti *  frcti;
+        pthread_t       thr;
+        uint8_t         buf[LOSSY_LEN];
+        uint16_t        flags;
+        uint32_t        i;
+        int             fd;
+
+        TEST_START("(%s)", sack ? "SACK" : "no SACK");
+
+        if (stub_flow_pair(qos_data, &fd, &s.fd) < 0) {
+                printf("Failed to allocate flows.\n");
+                goto fail;
+        }
+
+        if (!sack) {
+                fccntl(fd, FRCTGFLAGS, &flags);
+                fccntl(fd, FRCTSFLAGS, flags & ~FRCTFSACK);
+                fccntl(s.fd, FRCTGFLAGS, &flags);
+                fccntl(s.fd, FRCTSFLAGS, flags & ~FRCTFSACK);
+        }
+
+        fccntl(s.fd, FLOWSRCVTIMEO, &to);
+
+        memset(&l, 0, sizeof(l));
+        l.fd  = fd;
+        l.rnd = 1;
+
+        if (stub_link(fd, s.fd, lossy_drop, &l) < 0) {
+                printf("Failed to link flows.\n");
+                goto fail_link;
+        }
+
+        if (pthread_create(&thr, NULL, sink_loop, &s)) {
+                printf("Failed to start sink thread.\n");
+                goto fail_thr;
+        }
+
+        memset(buf, 0, sizeof(buf));
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
+        for (i = 0; i < LOSSY_PKTS; ++i) {
+                memcpy(buf, &i, sizeof(i));
+                if (flow_write(fd, buf, sizeof(buf)) < 0) {
+                        printf("Failed to write packet %u.\n", i);
+                        break;
+                }
+        }
+
+        pthread_join(thr, NULL);
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        printf("%zu of %d packets in %lld ms, %zu of %zu data "
+               "packets dropped.\n", s.n, LOSSY_PKTS,
+               ts_diff_ms(&t1, &t0), l.n_drop, l.n_data);
+
+        frcti = flow_get(fd)->frcti;
+
+        printf("%zu retransmitted, %zu skipped as SACK'd.\n",
+               frcti->n_rtx, frcti->n_sak);
+
+        if (s.ret < 0) {
+                printf("Sink failed at %zu: %d.\n", s.n, s.ret);
+                goto fail_thr;
+        }
+
+        if (sack && frcti->n_sak == 0) {
+                printf("No retransmission skipped by SACK.\n");
+                goto fail_thr;
+        }
+
+        flow_dealloc(s.fd);
+        flow_dealloc(fd);
+
+        stub_unlink();
+
+        TEST_SUCCESS("(%s)", sack ? "SACK" : "no SACK");
+
+        return TEST_RC_SUCCESS;
+ fail_thr:
+        stub_unlink();
+ fail_link:
+        flow_dealloc_async(s.fd);
+        flow_dealloc_async(fd);
+ fail:
+        TEST_FAIL("(%s)", sack ? "SACK" : "no SACK");
+        return TEST_RC_FAIL;
+}
+
+/* Counts the sender's data packets, drops none. */
+static bool count_data(void *               arg,
+                       int                  fd,
+                       struct ssm_pk_buff * spb)
+{
+        struct lossy *    l   = (struct lossy *) arg;
+        struct frct_pci * pci = (struct frct_pci *) ssm_pk_buff_head(spb);
+
+        if (fd == l->fd && (pci->flags & FRCT_DATA))
+                ++l->n_data;
+
+        return false;
+}
+
+struct big {
+        int       fd;
+        uint8_t * buf;
+        size_t    len;
+        ssize_t   ret;
+};
+
+static void * big_read(void * o)
+{
+        struct big * b = (struct big *) o;
+
+        b->ret = flow_read(b->fd, b->buf, b->len + 1);
+
+        return (void *) 0;
+}
+
+/* Without an MTU a large write goes out whole, else in fragments. */
+static int test_frct_large_write(size_t mtu,
+                                 size_t len)
+{
+        struct timespec to = TIMESPEC_INIT_S(BIG_TO);
+        struct lossy    l;
+        struct big      b;
+        pthread_t       thr;
+        uint8_t *       buf;
+        size_t          frag;
+        size_t          i;
+        int             fd;
+
+        TEST_START("(MTU %zu, %zu B)", mtu, len);
+
+        buf = malloc(len);
+        if (buf == NULL) {
+                printf("Failed to malloc.\n");
+                goto fail;
+        }
+
+        b.len = len;
+        b.buf = malloc(len + 1);
+        if (b.buf == NULL) {
+                printf("Failed to malloc.\n");
+                goto fail_buf;
+        }
+
+        for (i = 0; i < len; ++i)
+                buf[i] = (uint8_t) (i * 7 + (i >> 8));
+
+        stub_set_mtu(mtu);
+
+        if (stub_flow_pair(qos_data, &fd, &b.fd) < 0) {
+                printf("Failed to allocate flows.\n");
+                goto fail_flow;
+        }
+
+        stub_set_mtu(0);
+
+        fccntl(b.fd, FLOWSRCVTIMEO, &to);
+        fccntl(fd, FLOWSSNDTIMEO, &to);
+
+        memset(&l, 0, sizeof(l));
+        l.fd = fd;
+
+        if (stub_link(fd, b.fd, count_data, &l) < 0) {
+                printf("Failed to link flows.\n");
+                goto fail_link;
+        }
+
+        if (pthread_create(&thr, NULL, big_read, &b)) {
+                printf("Failed to start reader.\n");
+                goto fail_thr;
+        }
+
+        if (flow_write(fd, buf, len) != (ssize_t) len) {
+                printf("Failed to write.\n");
+                pthread_join(thr, NULL);
+                goto fail_thr;
+        }
+
+        pthread_join(thr, NULL);
+
+        frag = flow_get(fd)->frag;
+
+        printf("Sent in %zu packets, %zu B fragments.\n", l.n_data, frag);
+
+        if (b.ret != (ssize_t) len || memcmp(buf, b.buf, len) != 0) {
+                printf("Read %zd B, not the datagram.\n", b.ret);
+                goto fail_thr;
+        }
+
+        if (mtu == 0 ? frag != 0 : frag == 0 || frag > mtu) {
+                printf("Fragments of %zu B for MTU %zu.\n", frag, mtu);
+                goto fail_thr;
+        }
+
+        if (frag > 0 && l.n_data < len / frag) {
+                printf("Not fragmented to the MTU.\n");
+                goto fail_thr;
+        }
+
+        flow_dealloc(b.fd);
+        flow_dealloc(fd);
+
+        stub_unlink();
+
+        free(b.buf);
+        free(buf);
+
+        TEST_SUCCESS("(MTU %zu, %zu B)", mtu, len);
+
+        return TEST_RC_SUCCESS;
+ fail_thr:
+        stub_unlink();
+ fail_link:
+        flow_dealloc_async(b.fd);
+        flow_dealloc_async(fd);
+ fail_flow:
+        stub_set_mtu(0);
+        free(b.buf);
+ fail_buf:
+        free(buf);
+ fail:
+        TEST_FAIL("(MTU %zu, %zu B)", mtu, len);
+        return TEST_RC_FAIL;
+}
+
+/* Send a bare ACK to frcti, as the peer would. */
+static int frct_bare_ack(struct frcti * frcti,
+                         uint32_t       ackno)
+{
+        struct ssm_pk_buff * spb;
+        struct frct_pci *    pci;
+
+        if (ssm_pool_alloc(proc.pool, FRCT_PCILEN, QOS_CUBE_BE,
+                           NULL, &spb) < 0)
+                return -ENOMEM;
+
+        pci = (struct frct_pci *) ssm_pk_buff_head(spb);
+        memset(pci, 0, FRCT_PCILEN);
+
+        pci->flags = FRCT_ACK;
+        pci->ackno = hton32(ackno);
+
+        __frcti_rcv(frcti, spb);
+
+        return 0;
+}
+
+static int test_frct_sack_expire(void)
+{
+        struct frcti * frcti;
+        int            fd;
+        int            fd2;
+
+        TEST_START();
+
+        if (stub_flow_pair(qos_data, &fd, &fd2) < 0) {
+                printf("Failed to allocate flows.\n");
+                goto fail;
+        }
+
+        frcti = flow_get(fd)->frcti;
+
+        pthread_rwlock_wrlock(&frcti->lock);
+
+        frcti->snd_cr.lwe    = 100;
+        frcti->snd_cr.seqno  = 120;
+        frcti->sack[0].start = 90;
+        frcti->sack[0].end   = 95;
+        frcti->sack[1].start = 98;
+        frcti->sack[1].end   = 110;
+        frcti->n_sack        = 2;
+
+        frcti_sack_prune(frcti);
+
+        if (frcti->n_sack != 1 || frcti->sack[0].start != 100
+            || frcti->sack[0].end != 110) {
+                printf("Blocks below the ackno were kept.\n");
+                goto fail_lock;
+        }
+
+        pthread_rwlock_unlock(&frcti->lock);
+
+        if (frct_bare_ack(frcti, 105) < 0) {
+                printf("Failed to send ACK.\n");
+                goto fail_flow;
+        }
+
+        if (frcti->n_sack != 0) {
+                printf("Blocks kept after an ACK without SACK.\n");
+                goto fail_flow;
+        }
+
+        if (frcti_is_sacked(frcti, 108)) {
+                printf("Packet still taken as SACK'd.\n");
+                goto fail_flow;
+        }
+
+        flow_dealloc_async(fd2);
+        flow_dealloc_async(fd);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_lock:
+        pthread_rwlock_unlock(&frcti->lock);
+ fail_flow:
+        flow_dealloc_async(fd2);
+        flow_dealloc_async(fd);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+/* Send a bare ACK with one SACK block to frcti, as the peer would. */
+static int frct_sack_ack(struct frcti * frcti,
+                         uint32_t       ackno,
+                         uint32_t       start,
+                         uint32_t       end)
+{
+        struct ssm_pk_buff * spb;
+        struct frct_pci *    pci;
+        struct frct_sack *   sack;
+
+        if (ssm_pool_alloc(proc.pool, FRCT_PCILEN + FRCT_SACKLEN(1),
+                           QOS_CUBE_BE, NULL, &spb) < 0)
+                return -ENOMEM;
+
+        pci = (struct frct_pci *) ssm_pk_buff_head(spb);
+        memset(pci, 0, FRCT_PCILEN + FRCT_SACKLEN(1));
+
+        pci->flags = FRCT_ACK | FRCT_SACK;
+        pci->ackno = hton32(ackno);
+
+        sack = (struct frct_sack *) (pci + 1);
+        sack->n            = 1;
+        sack->blk[0].start = hton32(start);
+        sack->blk[0].end   = hton32(end);
+
+        __frcti_rcv(frcti, spb);
+
+        return 0;
+}
+
+/* A SACK'd hole or duplicate ACKs halve the window, no restart. */
+static int test_frct_cc_fast(bool sack)
+{
+        struct frcti * frcti;
+        uint16_t       flags;
+        size_t         wnd;
+        int            fd;
+        int            fd2;
+        int            i;
+
+        TEST_START("(%s)", sack ? "SACK" : "dup ACK");
+
+        if (stub_flow_pair(qos_data, &fd, &fd2) < 0) {
+                printf("Failed to allocate flows.\n");
+                goto fail;
+        }
+
+        fccntl(fd, FRCTSCC, FRCTCCRENO);
+
+        if (!sack) {
+                fccntl(fd, FRCTGFLAGS, &flags);
+                fccntl(fd, FRCTSFLAGS, flags & ~FRCTFSACK);
+        }
+
+        frcti = flow_get(fd)->frcti;
+
+        pthread_rwlock_wrlock(&frcti->lock);
+
+        frcti->snd_cr.lwe   = 100;
+        frcti->snd_cr.seqno = 110;
+        frcti->cc_rcvr      = 100;
+
+        pthread_rwlock_unlock(&frcti->lock);
+
+        if (sack) {
+                /* 3 SACK'd open the window to 13, 7 in flight. */
+                if (frct_sack_ack(frcti, 100, 105, 108) < 0) {
+                        printf("Failed to send SACK.\n");
+                        goto fail_flow;
+                }
+                wnd = 3;
+        } else {
+                for (i = 0; i < DUP_ACKS - 1; ++i)
+                        frct_bare_ack(frcti, 100);
+
+                if (frcti->cc->wnd(frcti->cc_ctx) != 10) {
+                        printf("Window cut before %d dup ACKs.\n",
+                               DUP_ACKS);
+                        goto fail_flow;
+                }
+
+                if (frct_bare_ack(frcti, 100) < 0) {
+                        printf("Failed to send ACK.\n");
+                        goto fail_flow;
+                }
+                wnd = 5;
+        }
+
+        if (frcti->cc->wnd(frcti->cc_ctx) != wnd) {
+                printf("Window %zu after loss, expected %zu.\n",
+                       frcti->cc->wnd(frcti->cc_ctx), wnd);
+                goto fail_flow;
+        }
+
+        /* The timer for the same window does not cut again. */
+        pthread_rwlock_wrlock(&frcti->lock);
+        frcti_cc_loss(frcti, 100, true);
+        pthread_rwlock_unlock(&frcti->lock);
+
+        if (frcti->cc->wnd(frcti->cc_ctx) != wnd) {
+                printf("Reacted twice to one window.\n");
+                goto fail_flow;
+        }
+
+        flow_dealloc_async(fd2);
+        flow_dealloc_async(fd);
+
+        TEST_SUCCESS("(%s)", sack ? "SACK" : "dup ACK");
+
+        return TEST_RC_SUCCESS;
+ fail_flow:
+        flow_dealloc_async(fd2);
+        flow_dealloc_async(fd);
+ fail:
+        TEST_FAIL("(%s)", sack ? "SACK" : "dup ACK");
+        return TEST_RC_FAIL;
+}
+
+struct blackout {
+        int    fd;
+        bool   on;
+        size_t n_drop;
+};
+
+/* Drops all of the sender's data while on, set under the stub lock. */
+static bool blackout_drop(void *               arg,
+                          int                  fd,
+                          struct ssm_pk_buff * spb)
+{
+        struct blackout * b   = (struct blackout *) arg;
+        struct frct_pci * pci = (struct frct_pci *) ssm_pk_buff_head(spb);
+
+        if (!b->on || fd != b->fd || !(pci->flags & FRCT_DATA))
+                return false;
+
+        ++b->n_drop;
+
+        return true;
+}
+
+/* Nothing gets through, the retransmission timer restarts from 1. */
+static int test_frct_cc_rto(void)
+{
+        struct timespec intv = TIMESPEC_INIT_MS(1);
+        struct timespec to   = TIMESPEC_INIT_S(RTO_WAIT);
+        struct timespec t0;
+        struct timespec now;
+        struct blackout b;
+        struct frcti *  frcti;
+        uint8_t         buf[64];
+        size_t          wnd;
+        int             fd;
+        int             fd2;
+        int             i;
+
+        TEST_START();
+
+        if (stub_flow_pair(qos_data, &fd, &fd2) < 0) {
+                printf("Failed to allocate flows.\n");
+                goto fail;
+        }
+
+        fccntl(fd, FRCTSCC, FRCTCCRENO);
+        fccntl(fd2, FLOWSRCVTIMEO, &to);
+
+        frcti = flow_get(fd)->frcti;
+
+        memset(&b, 0, sizeof(b));
+        b.fd = fd;
+        b.on = true;
+
+        if (stub_link(fd, fd2, blackout_drop, &b) < 0) {
+                printf("Failed to link flows.\n");
+                goto fail_link;
+        }
+
+        memset(buf, 0, sizeof(buf));
+
+        for (i = 0; i < RTO_PKTS; ++i) {
+                if (flow_write(fd, buf, PING_LEN) < 0) {
+                        printf("Failed to write packet %d.\n", i);
+                        goto fail_thr;
+                }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
+        while (STAT_GET(frcti->n_rtx) == 0) {
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                if (ts_diff_ms(&now, &t0) > RTO_WAIT * 1000) {
+                        printf("No retransmission.\n");
+                        goto fail_thr;
+                }
+                nanosleep(&intv, NULL);
+        }
+
+        pthread_rwlock_rdlock(&frcti->lock);
+        wnd = frcti->cc->wnd(frcti->cc_ctx);
+        pthread_rwlock_unlock(&frcti->lock);
+
+        pthread_mutex_lock(&stub.mtx);
+        b.on = false;
+        pthread_mutex_unlock(&stub.mtx);
+
+        if (wnd != 1) {
+                printf("Window %zu after a timeout.\n", wnd);
+                goto fail_thr;
+        }
+
+        for (i = 0; i < RTO_PKTS; ++i) {
+                if (flow_read(fd2, buf, sizeof(buf)) != PING_LEN) {
+                        printf("Failed to read packet %d.\n", i);
+                        goto fail_thr;
+                }
+        }
+
+        flow_dealloc(fd2);
+        flow_dealloc(fd);
+
+        stub_unlink();
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_thr:
+        stub_unlink();
+ fail_link:
+        flow_dealloc_async(fd2);
+        flow_dealloc_async(fd);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+/* Start an RTT probe on seqno, sent ms ago. */
+static void frct_probe(struct frcti * frcti,
+                       uint32_t       seqno,
+                       time_t         ms)
+{
+        struct timespec intv = TIMESPEC_INIT_MS(ms);
+        struct timespec now;
+
+        clock_gettime(PTHREAD_COND_CLOCK, &now);
+
+        pthread_rwlock_wrlock(&frcti->lock);
+
+        ts_diff(&now, &intv, &frcti->t_probe);
+        frcti->rttseq = seqno;
+        frcti->probe  = true;
+
+        pthread_rwlock_unlock(&frcti->lock);
+}
+
+/* The rto follows srtt and mdev, with a floor. */
+static bool frct_rto_ok(struct frcti * frcti)
+{
+        return frcti->rto == MAX(RTO_MIN, frcti->srtt
+                                 + (frcti->mdev << MDEV_MUL));
+}
+
+/* A probe behind a hole is timed by the SACK, not the later ACK. */
+static int test_frct_rtt_sack(void)
+{
+        struct frcti * frcti;
+        time_t         srtt;
+        int            fd;
+        int            fd2;
+
+        TEST_START();
+
+        if (stub_flow_pair(qos_data, &fd, &fd2) < 0) {
+                printf("Failed to allocate flows.\n");
+                goto fail;
+        }
+
+        frcti = flow_get(fd)->frcti;
+
+        pthread_rwlock_wrlock(&frcti->lock);
+
+        frcti->snd_cr.lwe   = 100;
+        frcti->snd_cr.seqno = 110;
+
+        pthread_rwlock_unlock(&frcti->lock);
+
+        frct_probe(frcti, 105, RTT_PROBE);
+
+        frct_bare_ack(frcti, 102);
+
+        if (!frcti->probe || frcti->n_rtt != 0) {
+                printf("Sampled on an ACK below the probe.\n");
+                goto fail_flow;
+        }
+
+        /* The receiver ACKs out of order arrivals right away. */
+        if (frct_sack_ack(frcti, 102, 105, 106) < 0) {
+                printf("Failed to send SACK.\n");
+                goto fail_flow;
+        }
+
+        if (frcti->probe || frcti->n_rtt != 1) {
+                printf("No sample from the SACK'd probe.\n");
+                goto fail_flow;
+        }
+
+        srtt = frcti->srtt;
+
+        if (srtt < RTT_PROBE * MILLION || srtt > 2 * RTT_PROBE * MILLION) {
+                printf("First sample %ld ns for a %d ms probe.\n",
+                       (long) srtt, RTT_PROBE);
+                goto fail_flow;
+        }
+
+        if (frcti->mdev != srtt >> 1 || !frct_rto_ok(frcti)) {
+                printf("Bad rto %ld ns after the first sample.\n",
+                       (long) frcti->rto);
+                goto fail_flow;
+        }
+
+        /* Later samples move srtt an eighth of the way. */
+        frct_probe(frcti, 108, 4 * RTT_PROBE);
+
+        frct_bare_ack(frcti, 109);
+
+        if (frcti->n_rtt != 2) {
+                printf("No sample from the cumulative ACK.\n");
+                goto fail_flow;
+        }
+
+        if (frcti->srtt <= srtt
+            || frcti->srtt > srtt + (4 * RTT_PROBE * MILLION >> 3)
+            || !frct_rto_ok(frcti)) {
+                printf("srtt %ld ns, rto %ld ns from %ld ns.\n",
+                       (long) frcti->srtt, (long) frcti->rto, (long) srtt);
+                goto fail_flow;
+        }
+
+        flow_dealloc_async(fd2);
+        flow_dealloc_async(fd);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_flow:
+        flow_dealloc_async(fd2);
+        flow_dealloc_async(fd);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+static void * rtt_read(void * o)
+{
+        struct pong * p = (struct pong *) o;
+        uint8_t       buf[64];
+        int           i;
+
+        for (i = 0; i < RTT_PKTS; ++i) {
+                p->ret = flow_read(p->fd, buf, sizeof(buf));
+                if (p->ret < 0)
+                        break;
+        }
+
+        return (void *) 0;
+}
+
+/* Every ACK_EVERY packets is ACK'd at once, RTT stays below the timer. */
+static int test_frct_rtt_ack_every(void)
+{
+        struct timespec to = TIMESPEC_INIT_S(READ_TO);
+        struct frcti *  frcti;
+        struct pong     p;
+        pthread_t       thr;
+        uint8_t         buf[64];
+        int             fd;
+        int             i;
+
+        TEST_START();
+
+        if (stub_flow_pair(qos_data, &fd, &p.fd) < 0) {
+                printf("Failed to allocate flows.\n");
+                goto fail;
+        }
+
+        fccntl(p.fd, FLOWSRCVTIMEO, &to);
+
+        if (stub_link(fd, p.fd, NULL, NULL) < 0) {
+                printf("Failed to link flows.\n");
+                goto fail_link;
+        }
+
+        if (pthread_create(&thr, NULL, rtt_read, &p)) {
+                printf("Failed to start reader.\n");
+                goto fail_thr;
+        }
+
+        memset(buf, 0, sizeof(buf));
+
+        for (i = 0; i < RTT_PKTS; ++i) {
+                if (flow_write(fd, buf, PING_LEN) < 0) {
+                        printf("Failed to write packet %d.\n", i);
+                        break;
+                }
+        }
+
+        pthread_join(thr, NULL);
+
+        frcti = flow_get(fd)->frcti;
+
+        pthread_rwlock_rdlock(&frcti->lock);
+
+        printf("%zu samples, srtt %ld ns, rto %ld ns, %zu bare ACKs.\n",
+               frcti->n_rtt, (long) frcti->srtt, (long) frcti->rto,
+               frcti->n_dak);
+
+        if (p.ret < 0) {
+                printf("Reader failed: %zd.\n", p.ret);
+                goto fail_lock;
+        }
+
+        if (frcti->n_rtt == 0 || frcti->srtt >= TICTIME) {
+                printf("RTT not below the delayed ACK timer.\n");
+                goto fail_lock;
+        }
+
+        /* A retransmission on a busy host may have backed rto off. */
+        if (frcti->rto < MAX(RTO_MIN, frcti->srtt + (frcti->mdev << MDEV_MUL))
+            || frcti->rto >= 100 * MILLION) {
+                printf("rto does not follow srtt.\n");
+                goto fail_lock;
+        }
+
+        pthread_rwlock_unlock(&frcti->lock);
+
+        flow_dealloc(p.fd);
+        flow_dealloc(fd);
+
+        stub_unlink();
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_lock:
+        pthread_rwlock_unlock(&frcti->lock);
+ fail_thr:
+        stub_unlink();
+ fail_link:
+        flow_dealloc_async(p.fd);
+        flow_dealloc_async(fd);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+struct fec_loss {
+        int      fd;      /* the sender's */
+        uint32_t k;
+        uint32_t base;    /* block of the last data packet */
+        size_t   blk;     /* blocks seen                   */
+        size_t   n_data;
+        size_t   n_one;   /* blocks that lost one packet   */
+        size_t   n_two;   /* blocks that lost two          */
+};
+
+/*
+ * Drops by block, from the third on: the first one the flow may
+ * have started halfway, the repair for the second sets up the
+ * receiver. Of every three blocks, one loses a packet, the next
+ * two, the last none. The repairs always get through.
+ */
+static bool fec_drop(void *               arg,
+                     int                  fd,
+                     struct ssm_pk_buff * spb)
+{
+        struct fec_loss * l   = (struct fec_loss *) arg;
+        struct frct_pci * pci = (struct frct_pci *) ssm_pk_buff_head(spb);
+        uint32_t          seqno;
+        uint32_t          off;
+
+        if (fd != l->fd || !(pci->flags & FRCT_DATA))
+                return false;
+
+        seqno = ntoh32(pci->seqno);
+        off   = seqno & (l->k - 1);
+
+        if (l->n_data++ == 0 || (seqno & ~(l->k - 1)) != l->base) {
+                l->base = seqno & ~(l->k - 1);
+                ++l->blk;
+        }
+
+        /* Whole blocks only, the tail is one more than FEC_BLOCKS. */
+        if (l->blk < 3 || l->blk > FEC_BLOCKS)
+                return false;
+
+        switch (l->blk % 3) {
+        case 0:
+                l->n_one += off == 1;
+                return off == 1;
+        case 1:
+                l->n_two += off == 1;
+                return off == 1 || off == 2;
+        default:
+                return false;
+        }
+}
+
+struct fec_sink {
+        int     fd;
+        size_t  n;
+        size_t  expect;
+        ssize_t ret;
+};
+
+static void * fec_read(void * o)
+{
+        struct fec_sink * s = (struct fec_sink *) o;
+        uint8_t           buf[FEC_LEN + 1];
+        uint32_t          seq;
+        uint32_t          last = 0;
+
+        for (s->n = 0; s->n < s->expect; ++s->n) {
+                s->ret = flow_read(s->fd, buf, sizeof(buf));
+                if (s->ret < 0)
+                        break;
+
+                memcpy(&seq, buf, sizeof(seq));
+                if (s->ret != (ssize_t) FEC_PKT_LEN(seq)
+                    || (s->n > 0 && seq <= last)) {
+                        s->ret = -EILSEQ;
+                        break;
+                }
+
+                last = seq;
+        }
+
+        return (void *) 0;
+}
+
+/* Single losses per block are repaired, double ones stay lost. */
+static int test_frct_fec_lossy(int k)
+{
+        struct timespec to = TIMESPEC_INIT_MS(FEC_WAIT);
+        struct fec_loss l;
+        struct fec_sink s;
+        struct frcti *  frcti;
+        pthread_t       thr;
+        uint8_t         buf[FEC_LEN];
+        size_t          n;
+        uint32_t        i;
+        int             fd;
+
+        TEST_START("(k = %d)", k);
+
+        if (stub_flow_pair(qos_best_effort, &fd, &s.fd) < 0) {
+                printf("Failed to allocate flows.\n");
+                goto fail;
+        }
+
+        if (fccntl(fd, FRCTSFEC, k) < 0) {
+                printf("Failed to set FEC.\n");
+                goto fail_link;
+        }
+
+        fccntl(s.fd, FLOWSRCVTIMEO, &to);
+
+        memset(&l, 0, sizeof(l));
+        l.fd = fd;
+        l.k  = k;
+
+        /* The reader stops when nothing more comes in. */
+        n        = (FEC_BLOCKS + 1) * k;
+        s.expect = n;
+
+        if (stub_link(fd, s.fd, fec_drop, &l) < 0) {
+                printf("Failed to link flows.\n");
+                goto fail_link;
+        }
+
+        if (pthread_create(&thr, NULL, fec_read, &s)) {
+                printf("Failed to start reader.\n");
+                goto fail_thr;
+        }
+
+        memset(buf, 0, sizeof(buf));
+
+        for (i = 0; i < n; ++i) {
+                memcpy(buf, &i, sizeof(i));
+                if (flow_write(fd, buf, FEC_PKT_LEN(i)) < 0) {
+                        printf("Failed to write packet %u.\n", i);
+                        break;
+                }
+        }
+
+        pthread_join(thr, NULL);
+
+        frcti = flow_get(s.fd)->frcti;
+
+        printf("%zu of %zu packets read, %zu repaired, "
+               "%zu + %zu blocks with losses.\n", s.n, n,
+               STAT_GET(frcti->n_fec), l.n_one, l.n_two);
+
+        if (s.ret < 0 && s.ret != -ETIMEDOUT) {
+                printf("Reader failed: %zd.\n", s.ret);
+                goto fail_thr;
+        }
+
+        if (l.n_one == 0 || STAT_GET(frcti->n_fec) != l.n_one) {
+                printf("Not every single loss repaired.\n");
+                goto fail_thr;
+        }
+
+        if (s.n != n - 2 * l.n_two) {
+                printf("Residual loss of %zu, expected %zu.\n",
+                       n - s.n, 2 * l.n_two);
+                goto fail_thr;
+        }
+
+        flow_dealloc(s.fd);
+        flow_dealloc(fd);
+
+        stub_unlink();
+
+        TEST_SUCCESS("(k = %d)", k);
+
+        return TEST_RC_SUCCESS;
+ fail_thr:
+        stub_unlink();
+ fail_link:
+        flow_dealloc_async(s.fd);
+        flow_dealloc_async(fd);
+ fail:
+        TEST_FAIL("(k = %d)", k);
+        return TEST_RC_FAIL;
+}
+
+/* Free blocks over all size classes of the pool. */
+static size_t pool_free(void)
+{
+        struct ssm_pool_stats st;
+        size_t                n    = 0;
+        size_t                free = 0;
+
+        while (ssm_pool_stats(proc.pool, n++, &st) == 0)
+                free += st.free;
+
+        return free;
+}
+
+/* Packets still in the rq go back to the pool with the flow. */
+static int test_frct_rq_release(void)
+{
+        struct timespec      now;
+        struct timespec      intv = TIMESPEC_INIT_MS(1);
+        struct timespec      t0;
+        struct frcti *       frcti;
+        struct ssm_pk_buff * spb;
+        size_t               base;
+        ssize_t              idx;
+        uint8_t              fgm;
+        int                  fd;
+        int                  fd2;
+        int                  i;
+
+        TEST_START();
+
+        if (stub_flow_pair(qos_best_effort, &fd, &fd2) < 0) {
+                printf("Failed to allocate flows.\n");
+                goto fail;
+        }
+
+        frcti = flow_get(fd2)->frcti;
+
+        base = pool_free();
+
+        clock_gettime(COARSE_CLOCK, &now);
+
+        pthread_rwlock_wrlock(&frcti->lock);
+
+        /* A datagram that never completes. */
+        for (i = 0; i < RQ_PKTS; ++i) {
+                idx = ssm_pool_alloc(proc.pool, 64, QOS_CUBE_BE, NULL, &spb);
+                if (idx < 0)
+                        break;
+
+                fgm = i == 0 ? FRCT_FFGM | FRCT_MFGM : FRCT_MFGM;
+                if (frcti_rq_put(frcti, frcti->rcv_cr.lwe + i, fgm, idx,
+                                 &now, false) < 0) {
+                        ssm_pool_remove(proc.pool, idx);
+                        break;
+                }
+        }
+
+        pthread_rwlock_unlock(&frcti->lock);
+
+        if (i < RQ_PKTS) {
+                printf("Failed to queue packet %d.\n", i);
+                goto fail_flow;
+        }
+
+        flow_dealloc(fd2);
+        flow_dealloc(fd);
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
+        while (pool_free() < base) {
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                if (ts_diff_ms(&now, &t0) > MAX_WAIT) {
+                        printf("%zu blocks not released.\n",
+                               base - pool_free());
+                        goto fail;
+                }
+                nanosleep(&intv, NULL);
+        }
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_flow:
+        flow_dealloc_async(fd2);
+        flow_dealloc_async(fd);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+/* Put a fragment filled with c in the rq, as the receiver would. */
+static int frag_put(struct frcti *          frcti,
+                    uint32_t                seqno,
+                    uint8_t                 fgm,
+                    uint8_t                 c,
+                    const struct timespec * now)
+{
+        struct ssm_pk_buff * spb;
+        uint8_t *            ptr;
+        ssize_t              idx;
+        int                  ret;
+
+        idx = ssm_pool_alloc(proc.pool, PART_LEN, QOS_CUBE_BE, &ptr, &spb);
+        if (idx < 0)
+                return -ENOMEM;
+
+        memset(ptr, c, PART_LEN);
+
+        pthread_rwlock_wrlock(&frcti->lock);
+        ret = frcti_rq_put(frcti, seqno, fgm, idx, now, false);
+        pthread_rwlock_unlock(&frcti->lock);
+
+        if (ret < 0)
+                ssm_pool_remove(proc.pool, idx);
+
+        return ret;
+}
+
+/* The next datagram, n fragments filled with c, c + 1, ... */
+static int frag_check(struct frcti * frcti,
+                      int            n,
+                      uint8_t        c)
+{
+        struct ssm_pk_buff * spb;
+        uint8_t *            data;
+        ssize_t              idx;
+        int                  i;
+        int                  j;
+
+        idx = __frcti_queued_pdu(frcti);
+        if (idx < 0) {
+                printf("No datagram delivered.\n");
+                return -1;
+        }
+
+        spb  = ssm_pool_get(proc.pool, idx);
+        data = ssm_pk_buff_head(spb);
+
+        if (ssm_pk_buff_len(spb) != (size_t) n * PART_LEN) {
+                printf("Datagram of %zu B, expected %d.\n",
+                       ssm_pk_buff_len(spb), n * PART_LEN);
+                goto fail;
+        }
+
+        for (i = 0; i < n; ++i) {
+                for (j = 0; j < PART_LEN; ++j) {
+                        if (data[i * PART_LEN + j] != (uint8_t) (c + i)) {
+                                printf("Fragment %d out of place.\n", i);
+                                goto fail;
+                        }
+                }
+        }
+
+        ssm_pool_remove(proc.pool, idx);
+
+        return 0;
+ fail:
+        ssm_pool_remove(proc.pool, idx);
+        return -1;
+}
+
+/* Drops everything fd sends, the receiver's ACKs in these tests. */
+static bool drop_from(void *               arg,
+                      int                  fd,
+                      struct ssm_pk_buff * spb)
+{
+        (void) spb;
+
+        return fd == *((int *) arg);
+}
+
+/* Send frcti a data packet that carries its own seqno. */
+static int frct_data(struct frcti * frcti,
+                     uint32_t       seqno)
+{
+        struct ssm_pk_buff * spb;
+        struct frct_pci *    pci;
+
+        if (ssm_pool_alloc(proc.pool, FRCT_PCILEN + sizeof(seqno),
+                           QOS_CUBE_BE, NULL, &spb) < 0)
+                return -ENOMEM;
+
+        pci = (struct frct_pci *) ssm_pk_buff_head(spb);
+        memset(pci, 0, FRCT_PCILEN);
+
+        pci->flags = FRCT_DATA;
+        pci->seqno = hton32(seqno);
+        memcpy(pci + 1, &seqno, sizeof(seqno));
+
+        __frcti_rcv(frcti, spb);
+
+        return 0;
+}
+
+/* The blocks the receiver would SACK, n of them, the first as given. */
+static int rq_sack_check(struct frcti * frcti,
+                         size_t         n,
+                         uint32_t       start,
+                         uint32_t       end)
+{
+        struct frct_sack sack;
+
+        pthread_rwlock_wrlock(&frcti->lock);
+        frcti_sack_fill(frcti, &sack);
+        pthread_rwlock_unlock(&frcti->lock);
+
+        if (sack.n != n) {
+                printf("%u SACK blocks, expected %zu.\n", sack.n, n);
+                return -1;
+        }
+
+        if (n > 0 && (sack.blk[0].start != start || sack.blk[0].end != end)) {
+                printf("SACK [%u, %u), expected [%u, %u).\n",
+                       sack.blk[0].start, sack.blk[0].end, start, end);
+                return -1;
+        }
+
+        return 0;
+}
+
+/* Runs merge in the SACK, the rq doubles across the seqno wrap. */
+static int test_frct_rq_grow(void)
+{
+        struct ssm_pk_buff * spb;
+        struct frcti *       frcti;
+        uint32_t             lwe = (uint32_t) -(RQ_SIZE / 2);
+        uint32_t             seqno;
+        uint32_t             n;
+        ssize_t              idx;
+        int                  fd;
+        int                  fd2;
+
+        TEST_START();
+
+        if (stub_flow_pair(qos_data, &fd, &fd2) < 0) {
+                printf("Failed to allocate flows.\n");
+                goto fail;
+        }
+
+        if (stub_link(fd, fd2, drop_from, &fd2) < 0) {
+                printf("Failed to link flows.\n");
+                goto fail_link;
+        }
+
+        frcti = flow_get(fd2)->frcti;
+
+        pthread_rwlock_wrlock(&frcti->lock);
+
+        clock_gettime(COARSE_CLOCK, &frcti->rcv_cr.act);
+        frcti->rcv_cr.lwe   = lwe;
+        frcti->rcv_cr.rwe   = lwe + frcti->rq_size;
+        frcti->rcv_cr.seqno = lwe;
+        frcti->rq_hi        = lwe;
+
+        pthread_rwlock_unlock(&frcti->lock);
+
+        /* Every other packet, then the ones in between. */
+        for (n = 2; n <= 6; n += 2)
+                frct_data(frcti, lwe + n);
+
+        if (rq_sack_check(frcti, 3, lwe + 2, lwe + 3) < 0)
+                goto fail_thr;
+
+        for (n = 1; n <= 5; n += 2)
+                frct_data(frcti, lwe + n);
+
+        if (rq_sack_check(frcti, 1, lwe + 1, lwe + 7) < 0)
+                goto fail_thr;
+
+        /* Into the upper half of the rq, with a hole at the lwe. */
+        for (n = 7; n < RQ_SIZE / 2 + RQ_PKTS; ++n)
+                frct_data(frcti, lwe + n);
+
+        if (frcti->rq_size != RQ_SIZE << 1
+            || frcti->rcv_cr.rwe != lwe + (RQ_SIZE << 1)) {
+                printf("rq of %zu, window to %u after growing.\n",
+                       frcti->rq_size, frcti->rcv_cr.rwe - lwe);
+                goto fail_thr;
+        }
+
+        if (rq_sack_check(frcti, 1, lwe + 1, lwe + n) < 0)
+                goto fail_thr;
+
+        if (__frcti_queued_pdu(frcti) != -1) {
+                printf("Delivered past the hole.\n");
+                goto fail_thr;
+        }
+
+        frct_data(frcti, lwe);
+
+        for (n = 0; n < RQ_SIZE / 2 + RQ_PKTS; ++n) {
+                idx = __frcti_queued_pdu(frcti);
+                if (idx < 0) {
+                        printf("Packet %u lost in the rq.\n", n);
+                        goto fail_thr;
+                }
+
+                spb = ssm_pool_get(proc.pool, idx);
+                memcpy(&seqno, ssm_pk_buff_head(spb), sizeof(seqno));
+                ssm_pool_remove(proc.pool, idx);
+
+                if (seqno != lwe + n) {
+                        printf("Got %u, expected %u.\n", seqno, lwe + n);
+                        goto fail_thr;
+                }
+        }
+
+        if (rq_sack_check(frcti, 0, 0, 0) < 0)
+                goto fail_thr;
+
+        flow_dealloc(fd2);
+        flow_dealloc(fd);
+
+        stub_unlink();
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_thr:
+        stub_unlink();
+ fail_link:
+        flow_dealloc_async(fd2);
+        flow_dealloc_async(fd);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+enum frag_case {
+        FRAG_WHOLE = 0,
+        FRAG_GAP,
+        FRAG_TIMEOUT,
+        FRAG_OVERRUN
+};
+
+static const char * frag_str[] = {"whole", "gap", "timeout", "overrun"};
+
+/*
+ * A datagram broken in the given way is not delivered, nor are its
+ * remaining fragments. The datagram after it is reassembled intact.
+ */
+static int test_frct_frag_rcv(enum frag_case c)
+{
+        struct timespec now;
+        struct timespec late;
+        struct timespec intv = TIMESPEC_INIT_NS(FRAG_TIMEO);
+        struct frcti *  frcti;
+        uint32_t        seqno;
+        int             n    = 3;
+        int             i;
+        int             fd;
+        int             fd2;
+
+        TEST_START("(%s)", frag_str[c]);
+
+        if (stub_flow_pair(qos_best_effort, &fd, &fd2) < 0) {
+                printf("Failed to allocate flows.\n");
+                goto fail;
+        }
+
+        /* Takes the ACK that dealloc sends for the moved lwe. */
+        if (stub_link(fd, fd2, NULL, NULL) < 0) {
+                printf("Failed to link flows.\n");
+                goto fail_flow;
+        }
+
+        frcti = flow_get(fd2)->frcti;
+        seqno = frcti->rcv_cr.lwe;
+
+        clock_gettime(COARSE_CLOCK, &now);
+        ts_add(&now, &intv, &late);
+        ++late.tv_nsec; /* past the timeout */
+
+        if (c == FRAG_OVERRUN)
+                n = FRAG_MAX + 1;
+
+        frag_put(frcti, seqno++, FRCT_FFGM | FRCT_MFGM, 'a', &now);
+
+        if (c == FRAG_GAP)
+                ++seqno;
+
+        for (i = 1; i < n - 1; ++i)
+                frag_put(frcti, seqno++, FRCT_MFGM, 'a' + i,
+                         c == FRAG_TIMEOUT ? &late : &now);
+
+        frag_put(frcti, seqno++, 0, 'a' + i, c == FRAG_TIMEOUT ? &late : &now);
+
+        if (c == FRAG_WHOLE && frag_check(frcti, n, 'a') < 0)
+                goto fail_link;
+
+        if (c != FRAG_WHOLE && __frcti_queued_pdu(frcti) >= 0) {
+                printf("Broken datagram delivered.\n");
+                goto fail_link;
+        }
+
+        frag_put(frcti, seqno++, FRCT_FFGM | FRCT_MFGM, 'x', &late);
+        frag_put(frcti, seqno++, 0, 'y', &late);
+
+        if (frag_check(frcti, 2, 'x') < 0)
+                goto fail_link;
+
+        flow_dealloc(fd2);
+        flow_dealloc(fd);
+
+        stub_unlink();
+
+        TEST_SUCCESS("(%s)", frag_str[c]);
+
+        return TEST_RC_SUCCESS;
+ fail_link:
+        stub_unlink();
+ fail_flow:
+        flow_dealloc_async(fd2);
+        flow_dealloc_async(fd);
+ fail:
+        TEST_FAIL("(%s)", frag_str[c]);
+        return TEST_RC_FAIL;
+}
+
+/* Without retransmission, a datagram takes at most FRAG_MAX fragments. */
+static int test_frct_frag_max(void)
+{
+        uint8_t * buf;
+        size_t    len;
+        int       fd;
+        int       fd2;
+
+        TEST_START();
+
+        stub_set_mtu(FRAG_MTU);
+
+        if (stub_flow_pair(qos_best_effort, &fd, &fd2) < 0) {
+                printf("Failed to allocate flows.\n");
+                stub_set_mtu(0);
+                goto fail;
+        }
+
+        stub_set_mtu(0);
+
+        len = flow_get(fd)->frag * FRAG_MAX + 1;
+
+        buf = malloc(len);
+        if (buf == NULL) {
+                printf("Failed to malloc.\n");
+                goto fail_flow;
+        }
+
+        memset(buf, 0, len);
+
+        if (flow_write(fd, buf, len) != -EMSGSIZE) {
+                printf("Wrote more than %d fragments.\n", FRAG_MAX);
+                goto fail_buf;
+        }
+
+        free(buf);
+
+        flow_dealloc_async(fd2);
+        flow_dealloc_async(fd);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_buf:
+        free(buf);
+ fail_flow:
+        flow_dealloc_async(fd2);
+        flow_dealloc_async(fd);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+int frct_test(int     argc,
+              char ** argv)
+{
+        int ret = 0;
+
+        (void) argc;
+        (void) argv;
+
+        ret |= test_frct_read_wakeup();
+        ret |= test_frct_sack_expire();
+        ret |= test_frct_cc_fast(true);
+        ret |= test_frct_cc_fast(false);
+        ret |= test_frct_cc_rto();
+        ret |= test_frct_rtt_sack();
+        ret |= test_frct_rtt_ack_every();
+        ret |= test_frct_rq_release();
+        ret |= test_frct_rq_grow();
+        ret |= test_frct_frag_rcv(FRAG_WHOLE);
+        ret |= test_frct_frag_rcv(FRAG_GAP);
+        ret |= test_frct_frag_rcv(FRAG_TIMEOUT);
+        ret |= test_frct_frag_rcv(FRAG_OVERRUN);
+        ret |= test_frct_frag_max();
+        ret |= test_frct_fec_lossy(4);
+        ret |= test_frct_fec_lossy(8);
+        ret |= test_frct_lossy(true);
+        ret |= test_frct_lossy(false);
+        ret |= test_frct_large_write(0, BIG_LEN);
+        ret |= test_frct_large_write(FRAG_MTU, FRAG_LEN);
+
+        return ret;
+}
@@ -0,0 +1,486 @@
+/*
+ * Ouroboros - Copyright (C) 2016 - 2026
+ *
+ * IRMd stand-in to test dev.c within a single process
+ *
+ *    Dimitri Staessens <dimitri@ouroboros.rocks>
+ *    Sander Vrijders   <sander@ouroboros.rocks>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., http://www.fsf.org/about/contact/.
+ */
+
+/*
+ * Include this instead of dev.c. The IRMd requests of dev.c are
+ * answered locally, the pool and flow sets are created when dev.c
+ * announces itself. The other end of each flow is a process that
+ * only exists as rbuffs. stub_link() relays packets between the far
+ * ends of two flows and drops the ones its filter picks.
+ */
+
+#define send_recv_msg stub_send_recv_msg
+
+#include "dev.c"
+
+#include <ouroboros/protobuf.h>
+
+#include <time.h>
+
+#define STUB_PEER_PID  (1 << 22) /* above the default pid_max */
+#define STUB_MAX_FLOWS 1024
+#define STUB_MPL       100       /* ms */
+
+/* Return true to drop a packet that fd sent. */
+typedef bool (* stub_drop_t)(void *               arg,
+                             int                  fd,
+                             struct ssm_pk_buff * spb);
+
+static struct {
+        pthread_mutex_t       mtx;
+        struct ssm_pool *     pool;
+        struct ssm_flow_set * set;      /* ours            */
+        struct ssm_flow_set * peer_set; /* the fake peer's */
+        struct ssm_rbuff *    rx[STUB_MAX_FLOWS];
+        struct ssm_rbuff *    tx[STUB_MAX_FLOWS];
+        int                   next_id;
+        size_t                n_dealloc; /* flows released   */
+        size_t                n_msgs;    /* dealloc requests */
+
+        int                   nid;       /* cipher, new flows */
+        uint8_t               key[SYMMKEYSZ];
+        size_t                mtu;       /* new flows         */
+
+        ssize_t               clog;      /* placeholder block */
+        size_t                n_clog;    /* slots it takes    */
+
+        pthread_t             relay;
+        bool                  linked;
+        bool                  stop;
+        int                   fd[2];
+        stub_drop_t           drop;
+        void *                arg;
+} stub = {
+        .mtx  = PTHREAD_MUTEX_INITIALIZER,
+        .nid  = NID_undef,
+        .clog = -1
+};
+
+static void stub_flow_free(int id)
+{
+        ssize_t idx;
+
+        if (stub.rx[id] == NULL)
+                return;
+
+        while ((idx = ssm_rbuff_read(stub.rx[id])) >= 0)
+                ssm_pool_remove(stub.pool, idx);
+
+        while ((idx = ssm_rbuff_read(stub.tx[id])) >= 0)
+                ssm_pool_remove(stub.pool, idx);
+
+        ssm_rbuff_destroy(stub.rx[id]);
+        ssm_rbuff_destroy(stub.tx[id]);
+
+        stub.rx[id] = NULL;
+        stub.tx[id] = NULL;
+}
+
+static int stub_proc_announce(void)
+{
+        uid_t uid;
+
+        uid = is_ouroboros_member_uid(getuid()) ? 0 : getuid();
+
+        stub.pool = ssm_pool_create(uid, getgid());
+        if (stub.pool == NULL)
+                goto fail_pool;
+
+        stub.set = ssm_flow_set_create(getpid());
+        if (stub.set == NULL)
+                goto fail_set;
+
+        stub.peer_set = ssm_flow_set_create(STUB_PEER_PID);
+        if (stub.peer_set == NULL)
+                goto fail_peer_set;
+
+        stub.next_id = 1;
+
+        return 0;
+
+ fail_peer_set:
+        ssm_flow_set_destroy(stub.set);
+ fail_set:
+        ssm_pool_destroy(stub.pool);
+ fail_pool:
+        return -ENOMEM;
+}
+
+static void stub_proc_exit(void)
+{
+        int id;
+
+        for (id = 0; id < STUB_MAX_FLOWS; ++id)
+                stub_flow_free(id);
+
+        ssm_flow_set_destroy(stub.peer_set);
+        ssm_flow_set_destroy(stub.set);
+        ssm_pool_destroy(stub.pool);
+}
+
+static int stub_flow_alloc(irm_msg_t * req,
+                           irm_msg_t * rsp)
+{
+        struct flow_info info;
+        int              id;
+
+        if (req->flow_info == NULL || stub.next_id == STUB_MAX_FLOWS)
+                return -EBADF;
+
+        info = flow_info_msg_to_s(req->flow_info);
+
+        id = stub.next_id++;
+
+        stub.rx[id] = ssm_rbuff_create(info.n_pid, id);
+        if (stub.rx[id] == NULL)
+                goto fail_rx;
+
+        stub.tx[id] = ssm_rbuff_create(STUB_PEER_PID, id);
+        if (stub.tx[id] == NULL)
+                goto fail_tx;
+
+        info.id      = id;
+        info.n_1_pid = STUB_PEER_PID;
+        info.mpl     = STUB_MPL;
+        info.mtu     = stub.mtu;
+        info.state   = FLOW_ALLOCATED;
+
+        rsp->flow_info = flow_info_s_to_msg(&info);
+        if (rsp->flow_info == NULL)
+                goto fail_info;
+
+        if (stub.nid != NID_undef) {
+                rsp->has_cipher_nid = true;
+                rsp->cipher_nid     = stub.nid;
+                rsp->has_sym_key    = true;
+                rsp->sym_key.data   = stub.key;
+                rsp->sym_key.len    = SYMMKEYSZ;
+        }
+
+        return 0;
+
+ fail_info:
+        ssm_rbuff_destroy(stub.tx[id]);
+        stub.tx[id] = NULL;
+ fail_tx:
+        ssm_rbuff_destroy(stub.rx[id]);
+        stub.rx[id] = NULL;
+ fail_rx:
+        return -ENOMEM;
+}
+
+static void stub_flow_dealloc(irm_msg_t * req)
+{
+        size_t i;
+
+        ++stub.n_msgs;
+
+        if (req->flow_info != NULL) {
+                stub_flow_free(req->flow_info->id);
+                ++stub.n_dealloc;
+        }
+
+        for (i = 0; i < req->n_flows; ++i) {
+                stub_flow_free(req->flows[i]->id);
+                ++stub.n_dealloc;
+        }
+}
+
+int stub_send_recv_msg(buffer_t * msg)
+{
+        irm_msg_t * req;
+        irm_msg_t   rsp = IRM_MSG__INIT;
+        int         ret = 0;
+
+        req = irm_msg__unpack(NULL, msg->len, msg->data);
+        if (req == NULL)
+                return -EIRMD;
+
+        pthread_mutex_lock(&stub.mtx);
+
+        switch (req->code) {
+        case IRM_MSG_CODE__IRM_PROC_ANNOUNCE:
+                ret = stub_proc_announce();
+                break;
+        case IRM_MSG_CODE__IRM_PROC_EXIT:
+                stub_proc_exit();
+                break;
+        case IRM_MSG_CODE__IRM_FLOW_ALLOC:
+        case IRM_MSG_CODE__IRM_FLOW_ACCEPT:
+                ret = stub_flow_alloc(req, &rsp);
+                break;
+        case IRM_MSG_CODE__IRM_FLOW_DEALLOC:
+                stub_flow_dealloc(req);
+                break;
+        default:
+                ret = -EIRMD;
+                break;
+        }
+
+        pthread_mutex_unlock(&stub.mtx);
+
+        irm_msg__free_unpacked(req, NULL);
+
+        rsp.code       = IRM_MSG_CODE__IRM_REPLY;
+        rsp.has_result = true;
+        rsp.result     = ret;
+
+        msg->len = irm_msg__get_packed_size(&rsp);
+        irm_msg__pack(&rsp, msg->data);
+
+        if (rsp.flow_info != NULL)
+                flow_info_msg__free_unpacked(rsp.flow_info, NULL);
+
+        return 0;
+}
+
+static size_t __attribute__((unused)) stub_deallocs(void)
+{
+        size_t n;
+
+        pthread_mutex_lock(&stub.mtx);
+        n = stub.n_dealloc;
+        pthread_mutex_unlock(&stub.mtx);
+
+        return n;
+}
+
+static size_t __attribute__((unused)) stub_dealloc_msgs(void)
+{
+        size_t n;
+
+        pthread_mutex_lock(&stub.mtx);
+        n = stub.n_msgs;
+        pthread_mutex_unlock(&stub.mtx);
+
+        return n;
+}
+
+/* Packets fd sent that did not reach the other side yet. */
+static size_t __attribute__((unused)) stub_queued(int fd)
+{
+        size_t n = 0;
+        int    id;
+
+        pthread_mutex_lock(&stub.mtx);
+
+        id = flow_get(fd)->info.id;
+        if (id > 0 && stub.tx[id] != NULL)
+                n = ssm_rbuff_queued(stub.tx[id]);
+
+        pthread_mutex_unlock(&stub.mtx);
+
+        return n;
+}
+
+/* Call before allocating flows, NID_undef turns encryption off. */
+static void __attribute__((unused)) stub_set_cipher(int nid)
+{
+        pthread_mutex_lock(&stub.mtx);
+
+        stub.nid = nid;
+        random_buffer(stub.key, SYMMKEYSZ);
+
+        pthread_mutex_unlock(&stub.mtx);
+}
+
+/* Call before allocating flows, 0 leaves packets unbounded. */
+static void __attribute__((unused)) stub_set_mtu(size_t mtu)
+{
+        pthread_mutex_lock(&stub.mtx);
+
+        stub.mtu = mtu;
+
+        pthread_mutex_unlock(&stub.mtx);
+}
+
+/* Fill n slots of what fd sends, as a peer that does not read. */
+static int __attribute__((unused)) stub_clog(int    fd,
+                                             size_t n)
+{
+        struct ssm_pk_buff * spb;
+        uint8_t *            ptr;
+        int                  id;
+        int                  ret = 0;
+
+        pthread_mutex_lock(&stub.mtx);
+
+        assert(stub.clog < 0);
+
+        id = flow_get(fd)->info.id;
+
+        stub.clog   = ssm_pool_alloc(stub.pool, 0, QOS_CUBE_BE, &ptr, &spb);
+        stub.n_clog = 0;
+
+        if (stub.clog < 0)
+                ret = -ENOMEM;
+
+        while (ret == 0 && stub.n_clog < n) {
+                ret = ssm_rbuff_write(stub.tx[id], stub.clog);
+                if (ret == 0)
+                        ++stub.n_clog;
+        }
+
+        pthread_mutex_unlock(&stub.mtx);
+
+        return ret;
+}
+
+/* Free the slots again, they come out before what fd sent later. */
+static void __attribute__((unused)) stub_unclog(int fd)
+{
+        int id;
+
+        pthread_mutex_lock(&stub.mtx);
+
+        id = flow_get(fd)->info.id;
+
+        for (; stub.n_clog > 0; --stub.n_clog)
+                ssm_rbuff_read(stub.tx[id]);
+
+        if (stub.clog >= 0)
+                ssm_pool_remove(stub.pool, stub.clog);
+
+        stub.clog = -1;
+
+        pthread_mutex_unlock(&stub.mtx);
+}
+
+/* Move one packet sent on src over to dst, needs the stub lock. */
+static bool stub_relay_one(int src,
+                           int dst)
+{
+        struct ssm_pk_buff * spb;
+        ssize_t              idx;
+        int                  s_id;
+        int                  d_id;
+
+        s_id = flow_get(src)->info.id;
+        d_id = flow_get(dst)->info.id;
+
+        if (s_id < 0 || d_id < 0)
+                return false;
+
+        if (stub.tx[s_id] == NULL || stub.rx[d_id] == NULL)
+                return false;
+
+        idx = ssm_rbuff_read(stub.tx[s_id]);
+        if (idx < 0)
+                return false;
+
+        spb = ssm_pool_get(stub.pool, idx);
+
+        if (stub.drop != NULL && stub.drop(stub.arg, src, spb)) {
+                ssm_pool_remove(stub.pool, idx);
+                return true;
+        }
+
+        if (ssm_rbuff_write(stub.rx[d_id], idx) < 0) {
+                ssm_pool_remove(stub.pool, idx);
+                return true;
+        }
+
+        ssm_flow_set_notify(stub.set, d_id, FLOW_PKT);
+
+        return true;
+}
+
+static void * stub_relay(void * o)
+{
+        struct timespec intv = TIMESPEC_INIT_US(50);
+        bool            moved;
+
+        (void) o;
+
+        while (true) {
+                pthread_mutex_lock(&stub.mtx);
+
+                if (stub.stop) {
+                        pthread_mutex_unlock(&stub.mtx);
+                        break;
+                }
+
+                moved  = stub_relay_one(stub.fd[0], stub.fd[1]);
+                moved |= stub_relay_one(stub.fd[1], stub.fd[0]);
+
+                pthread_mutex_unlock(&stub.mtx);
+
+                if (!moved)
+                        nanosleep(&intv, NULL);
+        }
+
+        return (void *) 0;
+}
+
+/* Connect two local flows, drop may be NULL for a lossless link. */
+static int __attribute__((unused)) stub_link(int         fd_a,
+                                             int         fd_b,
+                                             stub_drop_t drop,
+                                             void *      arg)
+{
+        assert(!stub.linked);
+
+        stub.fd[0] = fd_a;
+        stub.fd[1] = fd_b;
+        stub.drop  = drop;
+        stub.arg   = arg;
+        stub.stop  = false;
+
+        if (pthread_create(&stub.relay, NULL, stub_relay, NULL))
+                return -1;
+
+        stub.linked = true;
+
+        return 0;
+}
+
+static void __attribute__((unused)) stub_unlink(void)
+{
+        if (!stub.linked)
+                return;
+
+        pthread_mutex_lock(&stub.mtx);
+        stub.stop = true;
+        pthread_mutex_unlock(&stub.mtx);
+
+        pthread_join(stub.relay, NULL);
+
+        stub.linked = false;
+}
+
+/* Allocate both ends of a flow with the given QoS. */
+static int __attribute__((unused)) stub_flow_pair(qosspec_t qs,
+                                                  int *     fd_a,
+                                                  int *     fd_b)
+{
+        *fd_a = flow_alloc("stub", &qs, NULL);
+        if (*fd_a < 0)
+                return *fd_a;
+
+        *fd_b = flow_accept(&qs, NULL);
+        if (*fd_b < 0) {
+                flow_dealloc(*fd_a);
+                return *fd_b;
+        }
+
+        return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Ouroboros - Copyright (C) 2016 - 2026
+ *
+ * Test of the Reno congestion control policy
+ *
+ *    Dimitri Staessens <dimitri@ouroboros.rocks>
+ *    Sander Vrijders   <sander@ouroboros.rocks>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., http://www.fsf.org/about/contact/.
+ */
+
+#include "cc/reno.c"
+
+#include <test/test.h>
+
+#include <stdio.h>
+
+static int test_reno_slow_start(void)
+{
+        void * ctx;
+        size_t i;
+
+        TEST_START();
+
+        ctx = reno_ctx_create();
+        if (ctx == NULL) {
+                printf("Failed to create context.\n");
+                goto fail_create;
+        }
+
+        if (reno_wnd(ctx) != RENO_IW) {
+                printf("Initial window %zu.\n", reno_wnd(ctx));
+                goto fail;
+        }
+
+        /* Every ACK'd packet grows the window by one. */
+        for (i = 0; i < RENO_IW; ++i)
+                reno_ack(ctx, 1);
+
+        if (reno_wnd(ctx) != 2 * RENO_IW) {
+                printf("Window %zu after one round.\n", reno_wnd(ctx));
+                goto fail;
+        }
+
+        reno_ack(ctx, 2 * RENO_IW);
+
+        if (reno_wnd(ctx) != 4 * RENO_IW) {
+                printf("Window %zu after two rounds.\n", reno_wnd(ctx));
+                goto fail;
+        }
+
+        reno_ctx_destroy(ctx);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail:
+        reno_ctx_destroy(ctx);
+ fail_create:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+static int test_reno_loss(void)
+{
+        void * ctx;
+        size_t i;
+
+        TEST_START();
+
+        ctx = reno_ctx_create();
+        if (ctx == NULL) {
+                printf("Failed to create context.\n");
+                goto fail_create;
+        }
+
+        reno_loss(ctx, 40, false);
+
+        if (reno_wnd(ctx) != 20) {
+                printf("Window %zu after loss, expected 20.\n",
+                       reno_wnd(ctx));
+                goto fail;
+        }
+
+        /* Congestion avoidance, one packet per window. */
+        for (i = 0; i < 19; ++i)
+                reno_ack(ctx, 1);
+
+        if (reno_wnd(ctx) != 20) {
+                printf("Window grew early to %zu.\n", reno_wnd(ctx));
+                goto fail;
+        }
+
+        reno_ack(ctx, 1);
+
+        if (reno_wnd(ctx) != 21) {
+                printf("Window %zu after a round, expected 21.\n",
+                       reno_wnd(ctx));
+                goto fail;
+        }
+
+        reno_loss(ctx, 21, true);
+
+        if (reno_wnd(ctx) != 1) {
+                printf("Window %zu after timeout.\n", reno_wnd(ctx));
+                goto fail;
+        }
+
+        /* Slow start up to the threshold, then additive increase. */
+        reno_ack(ctx, 1);
+        reno_ack(ctx, 2);
+        reno_ack(ctx, 4);
+        reno_ack(ctx, 8);
+
+        if (reno_wnd(ctx) != 10) {
+                printf("Window %zu after slow start, expected 10.\n",
+                       reno_wnd(ctx));
+                goto fail;
+        }
+
+        reno_loss(ctx, 1, true);
+        reno_loss(ctx, 1, false);
+
+        if (reno_wnd(ctx) != RENO_MIN_SST) {
+                printf("Window %zu below minimum.\n", reno_wnd(ctx));
+                goto fail;
+        }
+
+        reno_ctx_destroy(ctx);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail:
+        reno_ctx_destroy(ctx);
+ fail_create:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+int reno_test(int     argc,
+              char ** argv)
+{
+        int ret = 0;
+
+        (void) argc;
+        (void) argv;
+
+        ret |= test_reno_slow_start();
+        ret |= test_reno_loss();
+
+        return ret;
+}
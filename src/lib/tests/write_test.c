@@ -0,0 +1,174 @@
+/*
+ * Ouroboros - Copyright (C) 2016 - 2026
+ *
+ * Test of writes on encrypted flows
+ *
+ *    Dimitri Staessens <dimitri@ouroboros.rocks>
+ *    Sander Vrijders   <sander@ouroboros.rocks>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., http://www.fsf.org/about/contact/.
+ */
+
+#include "irmd_stub.c"
+
+#include <test/test.h>
+
+#define SND_TIMEO  20   /* ms */
+#define N_LATE     4    /* writes that find everything full */
+#define RCV_TIMEO  200  /* ms */
+#define COARSE_MS  10
+#define PKT_LEN    64
+#define N_ROOM     64   /* rbuff slots the peer leaves free */
+
+/* What fits before the writer feels the backpressure. */
+#define N_FIT      (N_ROOM + (CRYPT_WORKERS > 0 ? CRYPT_QUEUE : 0))
+
+/*
+ * Nobody reads until the rbuff, and with crypto workers their queue,
+ * is full. Later writes wait out their own timeout and are dropped,
+ * the ones queued before all arrive, in order.
+ */
+static int test_write_backpressure(void)
+{
+        struct timespec snd  = TIMESPEC_INIT_MS(SND_TIMEO);
+        struct timespec rcv  = TIMESPEC_INIT_MS(RCV_TIMEO);
+        struct timespec t0;
+        struct timespec t1;
+        qosspec_t       qs   = qos_raw;
+        uint8_t         buf[PKT_LEN + 1];
+        uint32_t        seq;
+        uint32_t        i;
+        ssize_t         ret;
+        long            t;
+        int             fd;
+        int             fd2;
+
+        TEST_START();
+
+        qs.timeout = 0; /* no keepalives in the rbuff */
+
+        stub_set_cipher(NID_aes_256_gcm);
+
+        if (stub_flow_pair(qs, &fd, &fd2) < 0) {
+                printf("Failed to allocate flows.\n");
+                goto fail;
+        }
+
+        fccntl(fd, FLOWSSNDTIMEO, &snd);
+        fccntl(fd2, FLOWSRCVTIMEO, &rcv);
+
+        /* A full rbuff still has one empty slot. */
+        if (stub_clog(fd, SSM_RBUFF_SIZE - 1 - N_ROOM) < 0) {
+                printf("Failed to fill the rbuff.\n");
+                goto fail_flow;
+        }
+
+        memset(buf, 0, sizeof(buf));
+
+        for (i = 0; i < N_FIT; ++i) {
+                memcpy(buf, &i, sizeof(i));
+                if (flow_write(fd, buf, PKT_LEN) < 0) {
+                        printf("Failed to write packet %u.\n", i);
+                        goto fail_flow;
+                }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
+        for (; i < N_FIT + N_LATE; ++i) {
+                memcpy(buf, &i, sizeof(i));
+                if (flow_write(fd, buf, PKT_LEN) < 0) {
+                        printf("Failed to write packet %u.\n", i);
+                        goto fail_flow;
+                }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        t = ts_diff_ms(&t1, &t0);
+
+        printf("%d late writes took %ld ms, timeout %d ms.\n",
+               N_LATE, t, SND_TIMEO);
+
+        if (t < N_LATE * (SND_TIMEO - COARSE_MS)) {
+                printf("Late writes did not wait.\n");
+                goto fail_flow;
+        }
+
+        if (t > N_LATE * (SND_TIMEO + 2 * COARSE_MS)) {
+                printf("Late writes waited past their timeout.\n");
+                goto fail_flow;
+        }
+
+        stub_unclog(fd);
+
+        if (stub_link(fd, fd2, NULL, NULL) < 0) {
+                printf("Failed to link flows.\n");
+                goto fail_flow;
+        }
+
+        for (i = 0; (ret = flow_read(fd2, buf, sizeof(buf))) >= 0; ++i) {
+                memcpy(&seq, buf, sizeof(seq));
+                if (ret != PKT_LEN || seq != i) {
+                        printf("Got packet %u of %zd B, expected %u.\n",
+                               seq, ret, i);
+                        goto fail_link;
+                }
+        }
+
+        if (i != N_FIT) {
+                printf("Read %u of %d queued packets.\n", i, N_FIT);
+                goto fail_link;
+        }
+
+        stub_unlink();
+
+        flow_dealloc(fd2);
+        flow_dealloc(fd);
+
+        stub_set_cipher(NID_undef);
+
+        TEST_SUCCESS();
+
+        return TEST_RC_SUCCESS;
+ fail_link:
+        stub_unlink();
+ fail_flow:
+        stub_unclog(fd);
+        flow_dealloc_async(fd2);
+        flow_dealloc_async(fd);
+        stub_set_cipher(NID_undef);
+ fail:
+        TEST_FAIL();
+        return TEST_RC_FAIL;
+}
+
+int write_test(int     argc,
+               char ** argv)
+{
+        int ret = 0;
+
+        (void) argc;
+        (void) argv;
+
+#ifdef HAVE_OPENSSL
+        ret |= test_write_backpressure();
+#else
+        (void) test_write_backpressure;
+
+        ret = TEST_RC_SKIP;
+#endif
+
+        return ret;
+}
@@ -27,6 +27,9 @@
 #define ts_to_rxm_slot(ts) (ts_to_ns(ts) >> RXMQ_RES)
 #define ts_to_ack_slot(ts) (ts_to_ns(ts) >> ACKQ_RES)
 
+#define SLAB_OBJS          256 /* Objects added when a slab runs out. */
+#define RXM_BUF_SIZE       (FRAG_SIZE + FRCT_PCILEN)
+
 struct rxm {
         struct list_head     next;
         uint32_t             seqno;
@@ -39,6 +42,9 @@ struct rxm {
         struct frcti *       frcti;
         int                  fd;
         int                  flow_id; /* Prevent rtx when fd reused.       */
+#ifdef RXM_BUFFER_ON_HEAP
+        uint8_t              buf[RXM_BUF_SIZE]; /* Fits a fragment.       */
+#endif
 };
 
 struct ack {
@@ -48,68 +54,193 @@ struct ack {
         int              flow_id;
 };
 
+/* Fixed-size objects, each starts with a list_head. */
+struct slab {
+        struct list_head free;
+        struct list_head chunks;
+        size_t           size;
+        pthread_mutex_t  mtx;
+};
+
 struct {
         /*
          * At a 1 ms min resolution, every level bumps the
          * resolution by a factor of 16.
          */
         struct list_head rxms[RXMQ_LVLS][RXMQ_SLOTS];
+        size_t           prv_rxm[RXMQ_LVLS]; /* Last processed rxm slots. */
+        pthread_mutex_t  rxm_lock[RXMQ_LVLS];
 
         struct list_head acks[ACKQ_SLOTS];
-        bool             map[ACKQ_SLOTS][PROG_MAX_FLOWS];
-
-        size_t           prv_rxm[RXMQ_LVLS]; /* Last processed rxm slots. */
         size_t           prv_ack;            /* Last processed ack slot.  */
-        pthread_mutex_t  lock;
+        pthread_mutex_t  ack_lock;
+
+        struct slab      rxm_slab;
+        struct slab      ack_slab;
+
+        time_t           next;               /* Wakeup of tx thread (ns). */
+        pthread_cond_t   cond;
+        pthread_mutex_t  lock;               /* Protects next.            */
 } rw;
 
-static void timerwheel_fini(void)
+static int slab_init(struct slab * s,
+                     size_t        size)
+{
+        if (pthread_mutex_init(&s->mtx, NULL))
+                return -1;
+
+        list_head_init(&s->free);
+        list_head_init(&s->chunks);
+        s->size = size;
+
+        return 0;
+}
+
+static void slab_fini(struct slab * s)
 {
-        size_t             i;
-        size_t             j;
         struct list_head * p;
         struct list_head * h;
 
-        pthread_mutex_lock(&rw.lock);
+        list_for_each_safe(p, h, &s->chunks) {
+                list_del(p);
+                free(p);
+        }
 
-        for (i = 0; i < RXMQ_LVLS; ++i) {
-                for (j = 0; j < RXMQ_SLOTS; j++) {
-                        list_for_each_safe(p, h, &rw.rxms[i][j]) {
-                                struct rxm * rxm;
-                                rxm = list_entry(p, struct rxm, next);
-                                list_del(&rxm->next);
+        pthread_mutex_destroy(&s->mtx);
+}
+
+static void * slab_alloc(struct slab * s)
+{
+        struct list_head * p;
+        uint8_t *          c;
+        size_t             i;
+
+        pthread_mutex_lock(&s->mtx);
+
+        if (list_is_empty(&s->free)) {
+                c = malloc(sizeof(*p) + SLAB_OBJS * s->size);
+                if (c == NULL) {
+                        pthread_mutex_unlock(&s->mtx);
+                        return NULL;
+                }
+
+                list_add((struct list_head *) c, &s->chunks);
+
+                for (i = 0; i < SLAB_OBJS; ++i) {
+                        p = (struct list_head *) (c + sizeof(*p)
+                                                  + i * s->size);
+                        list_add(p, &s->free);
+                }
+        }
+
+        p = s->free.nxt;
+        list_del(p);
+
+        pthread_mutex_unlock(&s->mtx);
+
+        return p;
+}
+
+static void slab_free(struct slab *      s,
+                      struct list_head * o)
+{
+        pthread_mutex_lock(&s->mtx);
+
+        list_add(o, &s->free);
+
+        pthread_mutex_unlock(&s->mtx);
+}
+
+static void rxm_free(struct rxm * r)
+{
 #ifdef RXM_BUFFER_ON_HEAP
-                                free(rxm->pkt);
+        if (r->pkt != (struct frct_pci *) r->buf)
+                free(r->pkt);
 #else
-                                ssm_pk_buff_ack(rxm->spb);
-                                ipcp_spb_release(rxm->spb);
+        ipcp_spb_release(r->spb);
 #endif
-                                free(rxm);
-                        }
-                }
+        slab_free(&rw.rxm_slab, &r->next);
+}
+
+static void __cleanup_rxms(void * o)
+{
+        struct list_head * p;
+        struct list_head * h;
+
+        list_for_each_safe(p, h, (struct list_head *) o) {
+                list_del(p);
+                rxm_free(list_entry(p, struct rxm, next));
+        }
+}
+
+static void timerwheel_fini(void)
+{
+        size_t             i;
+        size_t             j;
+        struct list_head * p;
+        struct list_head * h;
+
+        for (i = 0; i < RXMQ_LVLS; ++i) {
+                pthread_mutex_lock(&rw.rxm_lock[i]);
+                for (j = 0; j < RXMQ_SLOTS; j++)
+                        __cleanup_rxms(&rw.rxms[i][j]);
+                pthread_mutex_unlock(&rw.rxm_lock[i]);
+                pthread_mutex_destroy(&rw.rxm_lock[i]);
         }
 
+        pthread_mutex_lock(&rw.ack_lock);
+
         for (i = 0; i < ACKQ_SLOTS; ++i) {
                 list_for_each_safe(p, h, &rw.acks[i]) {
-                        struct ack * a = list_entry(p, struct ack, next);
-                        list_del(&a->next);
-                        free(a);
+                        list_del(p);
+                        slab_free(&rw.ack_slab, p);
                 }
         }
 
-        pthread_mutex_unlock(&rw.lock);
+        pthread_mutex_unlock(&rw.ack_lock);
+        pthread_mutex_destroy(&rw.ack_lock);
+
+        slab_fini(&rw.rxm_slab);
+        slab_fini(&rw.ack_slab);
 
+        pthread_cond_destroy(&rw.cond);
         pthread_mutex_destroy(&rw.lock);
 }
 
 static int timerwheel_init(void)
 {
-        struct timespec   now;
-        size_t            i;
-        size_t            j;
+        struct timespec    now;
+        pthread_condattr_t cattr;
+        size_t             i;
+        size_t             j;
 
         if (pthread_mutex_init(&rw.lock, NULL))
-                return -1;
+                goto fail_lock;
+
+        if (pthread_mutex_init(&rw.ack_lock, NULL))
+                goto fail_ack_lock;
+
+        for (i = 0; i < RXMQ_LVLS; ++i)
+                if (pthread_mutex_init(&rw.rxm_lock[i], NULL))
+                        goto fail_rxm_lock;
+
+        if (slab_init(&rw.rxm_slab, sizeof(struct rxm)))
+                goto fail_rxm_slab;
+
+        if (slab_init(&rw.ack_slab, sizeof(struct ack)))
+                goto fail_ack_slab;
+
+        if (pthread_condattr_init(&cattr))
+                goto fail_cattr;
+#ifndef __APPLE__
+        pthread_condattr_setclock(&cattr, PTHREAD_COND_CLOCK);
+#endif
+        if (pthread_cond_init(&rw.cond, &cattr))
+                goto fail_cond;
+
+        pthread_condattr_destroy(&cattr);
+
+        rw.next = -1;
 
         clock_gettime(PTHREAD_COND_CLOCK, &now);
 
@@ -126,154 +257,293 @@ static int timerwheel_init(void)
                 list_head_init(&rw.acks[i]);
 
         return 0;
+
+ fail_cond:
+        pthread_condattr_destroy(&cattr);
+ fail_cattr:
+        slab_fini(&rw.ack_slab);
+ fail_ack_slab:
+        slab_fini(&rw.rxm_slab);
+ fail_rxm_slab:
+ fail_rxm_lock:
+        while (i-- > 0)
+                pthread_mutex_destroy(&rw.rxm_lock[i]);
+        pthread_mutex_destroy(&rw.ack_lock);
+ fail_ack_lock:
+        pthread_mutex_destroy(&rw.lock);
+ fail_lock:
+        return -1;
+}
+
+/* Needs rw.lock, wakes the tx thread if t is before its deadline. */
+static void timerwheel_schedule(time_t t)
+{
+        if (rw.next >= 0 && t >= rw.next)
+                return;
+
+        rw.next = t;
+        pthread_cond_signal(&rw.cond);
+}
+
+/* Needs rw.lock, returns the first deadline (ns) or -1 if idle. */
+static time_t timerwheel_next(const struct timespec * now)
+{
+        size_t slot;
+        size_t prv;
+        size_t i;
+        size_t j;
+        time_t t;
+        time_t next = -1;
+
+        slot = ts_to_rxm_slot((*now));
+
+        for (i = 0; i < RXMQ_LVLS; ++i) {
+                pthread_mutex_lock(&rw.rxm_lock[i]);
+                prv = slot - ((slot - rw.prv_rxm[i]) & (RXMQ_SLOTS - 1));
+                for (j = 1; j <= RXMQ_SLOTS; ++j) {
+                        if (list_is_empty(&rw.rxms[i][(prv + j)
+                                                      & (RXMQ_SLOTS - 1)]))
+                                continue;
+                        t = ((prv + j) << (RXMQ_BUMP * i)) << RXMQ_RES;
+                        if (next < 0 || t < next)
+                                next = t;
+                        break;
+                }
+                pthread_mutex_unlock(&rw.rxm_lock[i]);
+                slot >>= RXMQ_BUMP;
+        }
+
+        slot = ts_to_ack_slot((*now));
+
+        pthread_mutex_lock(&rw.ack_lock);
+
+        prv = slot - ((slot - rw.prv_ack) & (ACKQ_SLOTS - 1));
+
+        for (j = 1; j <= ACKQ_SLOTS; ++j) {
+                if (list_is_empty(&rw.acks[(prv + j) & (ACKQ_SLOTS - 1)]))
+                        continue;
+                t = (prv + j) << ACKQ_RES;
+                if (next < 0 || t < next)
+                        next = t;
+                break;
+        }
+
+        pthread_mutex_unlock(&rw.ack_lock);
+
+        return next;
+}
+
+/* Sleep until the first timer expires or an earlier one is added. */
+static void timerwheel_wait(void)
+{
+        struct timespec   now;
+        struct timespec   abs;
+        struct timespec * t = NULL;
+
+        clock_gettime(PTHREAD_COND_CLOCK, &now);
+
+        pthread_mutex_lock(&rw.lock);
+
+        pthread_cleanup_push(__cleanup_mutex_unlock, &rw.lock);
+
+        rw.next = timerwheel_next(&now);
+        if (rw.next >= 0) {
+                abs.tv_sec  = rw.next / BILLION;
+                abs.tv_nsec = rw.next % BILLION;
+                t = &abs;
+        }
+
+        if (rw.next < 0 || rw.next > ts_to_ns(now))
+                __timedwait(&rw.cond, &rw.lock, t);
+
+        pthread_cleanup_pop(true);
 }
 
 static void timerwheel_move(void)
 {
         struct timespec    now;
+        struct list_head   rxms;
+        struct list_head   acks;
         struct list_head * p;
         struct list_head * h;
         size_t             rxm_slot;
         size_t             ack_slot;
         size_t             i;
         size_t             j;
-
-        pthread_mutex_lock(&rw.lock);
-
-        pthread_cleanup_push(__cleanup_mutex_unlock, &rw.lock);
+        time_t             t;
+        time_t             next = -1;
+#ifdef RXM_BLOCKING
+        struct timespec    abs;
+        struct timespec    intv = TIMESPEC_INIT_NS(1 << RXMQ_RES);
+#endif
 
         clock_gettime(PTHREAD_COND_CLOCK, &now);
 
+        list_head_init(&rxms);
+        list_head_init(&acks);
+
         rxm_slot = ts_to_rxm_slot(now);
 
         for (i = 0; i < RXMQ_LVLS; ++i) {
                 size_t j_max_slot = rxm_slot & (RXMQ_SLOTS - 1);
+
+                pthread_mutex_lock(&rw.rxm_lock[i]);
+
                 j = rw.prv_rxm[i];
                 if (j_max_slot < j)
                         j_max_slot += RXMQ_SLOTS;
                 while (j++ < j_max_slot) {
                         list_for_each_safe(p, h,
                                            &rw.rxms[i][j & (RXMQ_SLOTS - 1)]) {
-                                struct rxm *         r;
-                                struct frct_cr *     snd_cr;
-                                struct frct_cr *     rcv_cr;
-                                size_t               slot;
-                                size_t               rslot;
-                                ssize_t              idx;
-                                struct ssm_pk_buff * spb;
-                                struct frct_pci *    pci;
-                                struct flow *        f;
-                                uint32_t             snd_lwe;
-                                uint32_t             rcv_lwe;
-                                size_t               lvl = 0;
-
-                                r = list_entry(p, struct rxm, next);
-
-                                list_del(&r->next);
-
-                                snd_cr = &r->frcti->snd_cr;
-                                rcv_cr = &r->frcti->rcv_cr;
-                                f      = &proc.flows[r->fd];
-#ifndef RXM_BUFFER_ON_HEAP
-                                ssm_pk_buff_ack(r->spb);
-#endif
-                                if (f->frcti == NULL
-                                    || f->info.id != r->flow_id)
-                                        goto cleanup;
-
-                                pthread_rwlock_rdlock(&r->frcti->lock);
-
-                                snd_lwe = snd_cr->lwe;
-                                rcv_lwe = rcv_cr->lwe;
-
-                                pthread_rwlock_unlock(&r->frcti->lock);
-
-                                /* Has been ack'd, remove. */
-                                if (before(r->seqno, snd_lwe))
-                                        goto cleanup;
-
-                                /* Check for r-timer expiry. */
-                                if (ts_to_ns(now) - r->t0 > r->frcti->r)
-                                        goto flow_down;
+                                list_del(p);
+                                list_add_tail(p, &rxms);
+                        }
+                }
+                rw.prv_rxm[i] = rxm_slot & (RXMQ_SLOTS - 1);
 
-                                pthread_rwlock_wrlock(&r->frcti->lock);
+                pthread_mutex_unlock(&rw.rxm_lock[i]);
 
-                                if (r->seqno == r->frcti->rttseq) {
-                                        r->frcti->rto +=
-                                                r->frcti->rto >> RTO_DIV;
-                                        r->frcti->probe = false;
-                                }
-#ifdef PROC_FLOW_STATS
-                                r->frcti->n_rtx++;
-#endif
-                                rslot = r->frcti->rto >> RXMQ_RES;
-
-                                pthread_rwlock_unlock(&r->frcti->lock);
+                /* Move up a level in the wheel. */
+                rxm_slot >>= RXMQ_BUMP;
+        }
 
-                                /* Schedule at least in the next time slot. */
-                                slot = ts_to_ns(now) >> RXMQ_RES;
+        pthread_cleanup_push(__cleanup_rxms, &rxms);
+
+        /* Expired entries are handled outside of the wheel locks. */
+        list_for_each_safe(p, h, &rxms) {
+                        struct rxm *         r;
+                        struct frct_cr *     snd_cr;
+                        struct frct_cr *     rcv_cr;
+                        size_t               slot;
+                        size_t               rslot;
+                        ssize_t              idx;
+                        struct ssm_pk_buff * spb;
+                        struct frct_pci *    pci;
+                        struct flow *        f;
+                        uint32_t             snd_lwe;
+                        uint32_t             rcv_lwe;
+                        bool                 sacked;
+                        int                  ret;
+                        size_t               lvl = 0;
+
+                        r = list_entry(p, struct rxm, next);
+
+                        snd_cr = &r->frcti->snd_cr;
+                        rcv_cr = &r->frcti->rcv_cr;
+                        f      = flow_get(r->fd);
+                        if (f->frcti == NULL
+                            || f->info.id != r->flow_id)
+                                goto cleanup;
+
+                        pthread_rwlock_rdlock(&r->frcti->lock);
+
+                        snd_lwe = snd_cr->lwe;
+                        rcv_lwe = rcv_cr->lwe;
+                        sacked  = frcti_is_sacked(r->frcti, r->seqno);
+
+                        pthread_rwlock_unlock(&r->frcti->lock);
+
+                        /* Has been ack'd, remove. */
+                        if (before(r->seqno, snd_lwe))
+                                goto cleanup;
+
+                        /* Check for r-timer expiry. */
+                        if (ts_to_ns(now) - r->t0 > r->frcti->r)
+                                goto flow_down;
+
+                        pthread_rwlock_wrlock(&r->frcti->lock);
+
+                        if (!sacked && r->seqno == r->frcti->rttseq) {
+                                r->frcti->rto +=
+                                        r->frcti->rto >> RTO_DIV;
+                                r->frcti->probe = false;
+                        }
+                        if (!sacked)
+                                frcti_cc_loss(r->frcti, r->seqno, true);
+                        if (sacked)
+                                STAT_INC(r->frcti->n_sak);
+                        else
+                                STAT_INC(r->frcti->n_rtx);
+                        rslot = r->frcti->rto >> RXMQ_RES;
+
+                        pthread_rwlock_unlock(&r->frcti->lock);
+
+                        /* Schedule at least in the next time slot. */
+                        slot = ts_to_ns(now) >> RXMQ_RES;
+
+                        while (rslot >= RXMQ_SLOTS) {
+                                ++lvl;
+                                rslot >>= RXMQ_BUMP;
+                                slot >>= RXMQ_BUMP;
+                        }
 
-                                while (rslot >= RXMQ_SLOTS) {
-                                        ++lvl;
-                                        rslot >>= RXMQ_BUMP;
-                                        slot >>= RXMQ_BUMP;
-                                }
+                        if (lvl >= RXMQ_LVLS) /* Can't reschedule */
+                                goto flow_down;
 
-                                if (lvl >= RXMQ_LVLS) /* Can't reschedule */
-                                        goto flow_down;
+                        rslot += slot + 1;
 
-                                rslot = (rslot + slot + 1) & (RXMQ_SLOTS - 1);
+                        /* Receiver has it, check again later. */
+                        if (sacked)
+                                goto reschedule;
 #ifdef RXM_BLOCKING
-                                if (ipcp_spb_reserve(&spb, r->len) < 0)
+                        /* A slot per pass, we free the ack'd copies. */
+                        ts_add(&now, &intv, &abs);
+                        if (ssm_pool_alloc_b(proc.pool, r->len, f->qc,
+                                             NULL, &spb, &abs) < 0)
 #else
-                                if (ssm_pool_alloc(proc.pool, r->len, NULL,
-                                                      &spb) < 0)
+                        if (ssm_pool_alloc(proc.pool, r->len, f->qc,
+                                           NULL, &spb) < 0)
 #endif
-                                        goto reschedule; /* rdrbuff full */
+                                goto reschedule; /* rdrbuff full */
 
-                                pci = (struct frct_pci *) ssm_pk_buff_head(spb);
-                                memcpy(pci, r->pkt, r->len);
+                        pci = (struct frct_pci *) ssm_pk_buff_head(spb);
+                        memcpy(pci, r->pkt, r->len);
 #ifndef RXM_BUFFER_ON_HEAP
-                                ipcp_spb_release(r->spb);
-                                r->spb = spb;
-                                r->pkt = pci;
-                                ssm_pk_buff_wait_ack(spb);
+                        ipcp_spb_release(r->spb);
+                        r->spb = spb;
+                        r->pkt = pci;
+                        ssm_pk_buff_wait_ack(spb);
 #endif
-                                idx = ssm_pk_buff_get_idx(spb);
+                        idx = ssm_pk_buff_get_idx(spb);
 
-                                /* Retransmit the copy. */
-                                pci->ackno = hton32(rcv_lwe);
+                        /* Retransmit the copy. */
+                        pci->ackno = hton32(rcv_lwe);
 #ifdef RXM_BLOCKING
-                                if (ssm_rbuff_write_b(f->tx_rb, idx, NULL) < 0)
+                        ret = ssm_rbuff_write_b(f->tx_rb, idx, NULL);
 #else
-                                if (ssm_rbuff_write(f->tx_rb, idx) < 0)
+                        ret = ssm_rbuff_write(f->tx_rb, idx);
 #endif
-                                        goto flow_down;
-                                ssm_flow_set_notify(f->set, f->info.id,
-                                                    FLOW_PKT);
-                         reschedule:
-                                list_add(&r->next, &rw.rxms[lvl][rslot]);
-                                continue;
-
-                         flow_down:
-                                ssm_rbuff_set_acl(f->tx_rb, ACL_FLOWDOWN);
-                                ssm_rbuff_set_acl(f->rx_rb, ACL_FLOWDOWN);
-                         cleanup:
-#ifdef RXM_BUFFER_ON_HEAP
-                                free(r->pkt);
-#else
-                                ipcp_spb_release(r->spb);
-#endif
-                                free(r);
+                        if (ret < 0) {
+                                ipcp_spb_release(spb); /* Not sent. */
+                                goto flow_down;
                         }
-                }
-                rw.prv_rxm[i] = rxm_slot & (RXMQ_SLOTS - 1);
-                /* Move up a level in the wheel. */
-                rxm_slot >>= RXMQ_BUMP;
+                        ssm_flow_set_notify(f->set, f->info.id,
+                                            FLOW_PKT);
+                 reschedule:
+                        list_del(&r->next);
+                        pthread_mutex_lock(&rw.rxm_lock[lvl]);
+                        list_add(&r->next,
+                                 &rw.rxms[lvl][rslot & (RXMQ_SLOTS - 1)]);
+                        pthread_mutex_unlock(&rw.rxm_lock[lvl]);
+                        t = (rslot << (RXMQ_BUMP * lvl)) << RXMQ_RES;
+                        if (next < 0 || t < next)
+                                next = t;
+                        continue;
+
+                 flow_down:
+                        ssm_rbuff_set_acl(f->tx_rb, ACL_FLOWDOWN);
+                        ssm_rbuff_set_acl(f->rx_rb, ACL_FLOWDOWN);
+                 cleanup:
+                        list_del(&r->next);
+                        rxm_free(r);
         }
 
+        pthread_cleanup_pop(false);
+
         ack_slot = ts_to_ack_slot(now) & (ACKQ_SLOTS - 1) ;
 
+        pthread_mutex_lock(&rw.ack_lock);
+
         j = rw.prv_ack;
 
         if (ack_slot < j)
@@ -281,27 +551,43 @@ static void timerwheel_move(void)
 
         while (j++ < ack_slot) {
                 list_for_each_safe(p, h, &rw.acks[j & (ACKQ_SLOTS - 1)]) {
-                        struct ack *  a;
-                        struct flow * f;
+                        list_del(p);
+                        list_add_tail(p, &acks);
+                }
+        }
+
+        rw.prv_ack = ack_slot & (ACKQ_SLOTS - 1);
 
-                        a = list_entry(p, struct ack, next);
+        pthread_mutex_unlock(&rw.ack_lock);
 
-                        list_del(&a->next);
+        list_for_each_safe(p, h, &acks) {
+                struct ack *  a;
+                struct flow * f;
 
-                        f = &proc.flows[a->fd];
+                a = list_entry(p, struct ack, next);
 
-                        rw.map[j & (ACKQ_SLOTS - 1)][a->fd] = false;
+                list_del(&a->next);
 
-                        if (f->info.id == a->flow_id && f->frcti != NULL)
-                                send_frct_pkt(a->frcti);
+                f = flow_get(a->fd);
 
-                        free(a);
+                if (f->info.id == a->flow_id && f->frcti != NULL) {
+                        pthread_rwlock_wrlock(&a->frcti->lock);
+                        a->frcti->ack_pend = false;
+                        pthread_rwlock_unlock(&a->frcti->lock);
+                        send_frct_pkt(a->frcti);
                 }
+
+                slab_free(&rw.ack_slab, &a->next);
         }
 
-        rw.prv_ack = ack_slot & (ACKQ_SLOTS - 1);
+        if (next < 0)
+                return;
 
-        pthread_cleanup_pop(true);
+        pthread_mutex_lock(&rw.lock);
+
+        timerwheel_schedule(next);
+
+        pthread_mutex_unlock(&rw.lock);
 }
 
 static int timerwheel_rxm(struct frcti *       frcti,
@@ -313,37 +599,18 @@ static int timerwheel_rxm(struct frcti *       frcti,
         size_t          slot;
         size_t          lvl = 0;
         time_t          rto_slot;
-
-        r = malloc(sizeof(*r));
-        if (r == NULL)
-                return -ENOMEM;
+        int             fd;
 
         clock_gettime(PTHREAD_COND_CLOCK, &now);
 
-        r->t0    = ts_to_ns(now);
-        r->seqno = seqno;
-        r->frcti = frcti;
-        r->len  = ssm_pk_buff_len(spb);
-#ifdef RXM_BUFFER_ON_HEAP
-        r->pkt = malloc(r->len);
-        if (r->pkt == NULL) {
-                free(r);
-                return -ENOMEM;
-        }
-        memcpy(r->pkt, ssm_pk_buff_head(spb), r->len);
-#else
-        r->spb = spb;
-        r->pkt = (struct frct_pci *) ssm_pk_buff_head(spb);
-#endif
-        pthread_rwlock_rdlock(&r->frcti->lock);
+        pthread_rwlock_rdlock(&frcti->lock);
 
         rto_slot = frcti->rto >> RXMQ_RES;
-        slot     = r->t0 >> RXMQ_RES;
+        fd       = frcti->fd;
 
-        r->fd      = frcti->fd;
-        r->flow_id = proc.flows[r->fd].info.id;
+        pthread_rwlock_unlock(&frcti->lock);
 
-        pthread_rwlock_unlock(&r->frcti->lock);
+        slot = ts_to_rxm_slot(now);
 
         while (rto_slot >= RXMQ_SLOTS) {
                 ++lvl;
@@ -351,22 +618,46 @@ static int timerwheel_rxm(struct frcti *       frcti,
                 slot >>= RXMQ_BUMP;
         }
 
-        if (lvl >= RXMQ_LVLS) { /* Out of timerwheel range. */
-#ifdef RXM_BUFFER_ON_HEAP
-                free(r->pkt);
-#endif
-                free(r);
+        if (lvl >= RXMQ_LVLS) /* Out of timerwheel range. */
                 return -EPERM;
-        }
 
-        slot = (slot + rto_slot + 1) & (RXMQ_SLOTS - 1);
+        slot += rto_slot + 1;
 
-        pthread_mutex_lock(&rw.lock);
+        r = slab_alloc(&rw.rxm_slab);
+        if (r == NULL)
+                return -ENOMEM;
 
-        list_add_tail(&r->next, &rw.rxms[lvl][slot]);
-#ifndef RXM_BUFFER_ON_HEAP
+        r->t0      = ts_to_ns(now);
+        r->seqno   = seqno;
+        r->frcti   = frcti;
+        r->len     = ssm_pk_buff_len(spb);
+        r->fd      = fd;
+        r->flow_id = flow_get(fd)->info.id;
+#ifdef RXM_BUFFER_ON_HEAP
+        r->pkt = (struct frct_pci *) r->buf;
+        if (r->len > RXM_BUF_SIZE) {
+                r->pkt = malloc(r->len);
+                if (r->pkt == NULL) {
+                        slab_free(&rw.rxm_slab, &r->next);
+                        return -ENOMEM;
+                }
+        }
+        memcpy(r->pkt, ssm_pk_buff_head(spb), r->len);
+#else
+        r->spb = spb;
+        r->pkt = (struct frct_pci *) ssm_pk_buff_head(spb);
         ssm_pk_buff_wait_ack(spb);
 #endif
+        pthread_mutex_lock(&rw.rxm_lock[lvl]);
+
+        list_add_tail(&r->next, &rw.rxms[lvl][slot & (RXMQ_SLOTS - 1)]);
+
+        pthread_mutex_unlock(&rw.rxm_lock[lvl]);
+
+        pthread_mutex_lock(&rw.lock);
+
+        timerwheel_schedule((slot << (RXMQ_BUMP * lvl)) << RXMQ_RES);
+
         pthread_mutex_unlock(&rw.lock);
 
         return 0;
@@ -379,34 +670,42 @@ static int timerwheel_delayed_ack(int            fd,
         struct ack *    a;
         size_t          slot;
 
-        a = malloc(sizeof(*a));
-        if (a == NULL)
-                return -ENOMEM;
-
         clock_gettime(PTHREAD_COND_CLOCK, &now);
 
-        pthread_rwlock_rdlock(&frcti->lock);
+        slot = ((ts_to_ns(now) + (TICTIME << 1)) >> ACKQ_RES) + 1;
 
-        slot = (((ts_to_ns(now) + (TICTIME << 1)) >> ACKQ_RES) + 1)
-                & (ACKQ_SLOTS - 1);
+        pthread_rwlock_wrlock(&frcti->lock);
 
-        pthread_rwlock_unlock(&frcti->lock);
+        if (frcti->ack_pend) { /* The pending ACK covers this one. */
+                pthread_rwlock_unlock(&frcti->lock);
+                return 0;
+        }
 
-        a->fd    = fd;
-        a->frcti = frcti;
-        a->flow_id = proc.flows[fd].info.id;
+        frcti->ack_pend = true;
 
-        pthread_mutex_lock(&rw.lock);
+        pthread_rwlock_unlock(&frcti->lock);
 
-        if (rw.map[slot][fd]) {
-                pthread_mutex_unlock(&rw.lock);
-                free(a);
-                return 0;
+        a = slab_alloc(&rw.ack_slab);
+        if (a == NULL) {
+                pthread_rwlock_wrlock(&frcti->lock);
+                frcti->ack_pend = false;
+                pthread_rwlock_unlock(&frcti->lock);
+                return -ENOMEM;
         }
 
-        rw.map[slot][fd] = true;
+        a->fd      = fd;
+        a->frcti   = frcti;
+        a->flow_id = flow_get(fd)->info.id;
+
+        pthread_mutex_lock(&rw.ack_lock);
+
+        list_add_tail(&a->next, &rw.acks[slot & (ACKQ_SLOTS - 1)]);
+
+        pthread_mutex_unlock(&rw.ack_lock);
+
+        pthread_mutex_lock(&rw.lock);
 
-        list_add_tail(&a->next, &rw.acks[slot]);
+        timerwheel_schedule(slot << ACKQ_RES);
 
         pthread_mutex_unlock(&rw.lock);
 